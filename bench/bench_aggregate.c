@@ -0,0 +1,338 @@
+#include "usb_internal.h"
+#include "usb_decode.h"
+#include "usb_aggregate.h"
+
+// 窗口统计的交叉校验和吞吐量
+//   1. 交叉校验: 随机样本 (含极值)、随机通道数/窗口/级别、随机分块送入，最后flush，
+//      每个CPU支持的级别 (scalar/sse4.2/avx2) 的输出与逐个样本计算的参考结果比较，有不一致时退出码为1
+//   2. 吞吐量 (M样本/s，GB/s按int32输入): 通道数 1/4 (SIMD) 和 3 (标量)，一级窗口 vs 四级窗口，
+//      以及 feed_bytes 从s16原始字节解包再统计
+//   3. 端到端: 帧流经解码器 (拆分+CRC+解包) 后统计，与只解码比较，报告输入的 MB/s
+//
+// 吞吐量的输入是在缓存中的一块样本 (默认64K个，256KB) 反复送入，相当于刚解包的传输缓冲区；
+// 用 --samples 加大到超出缓存时测到的是内存带宽。
+//
+// 用法: bench_aggregate [--samples=K] [--frame=负载字节] [--duration=ms]
+
+#define MAX_RECORDS (1 << 16)
+#define CHECK_MAX_CHANNELS 8
+
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+// ---- 交叉校验 ----
+
+typedef struct {
+    int level;
+    uint64_t index;
+    uint64_t first_sample;
+    uint32_t count;
+    usb_aggregate_value_t values[CHECK_MAX_CHANNELS];
+} check_record_t;
+
+typedef struct {
+    check_record_t* records;
+    int count;
+    int channels;
+} check_ctx_t;
+
+static void on_check_window(const usb_aggregate_window_t* w, const usb_aggregate_value_t* values, void* user_data) {
+    check_ctx_t* c = (check_ctx_t*)user_data;
+    if (c->count < MAX_RECORDS) {
+        check_record_t* r = &c->records[c->count++];
+        r->level = w->level;
+        r->index = w->index;
+        r->first_sample = w->first_sample;
+        r->count = w->count;
+        memcpy(r->values, values, sizeof(usb_aggregate_value_t) * (size_t)c->channels);
+    }
+}
+
+static int same_double(double a, double b) {
+    double d = a > b ? a - b : b - a;
+    double m = a > 0 ? a : -a;
+    return d <= 1e-9 * (m > 1 ? m : 1);
+}
+
+// 第level级第index个窗口的参考值 (每通道样本 [index*W, (index+1)*W) 与 n 的交集)
+static int check_window(const int32_t* s, int n, int channels, uint32_t window, const check_record_t* r) {
+    uint64_t from = r->index * window;
+    for (int c = 0; c < channels; c++) {
+        int32_t min = INT32_MAX, max = INT32_MIN;
+        int64_t sum = 0;
+        double sumsq = 0;
+        uint64_t count = 0;
+        for (uint64_t k = from; k < from + window && (int64_t)(k * (uint64_t)channels + (uint64_t)c) < n; k++) {
+            int32_t v = s[k * (uint64_t)channels + (uint64_t)c];
+            if (v < min) min = v;
+            if (v > max) max = v;
+            sum += v;
+            sumsq += (double)v * v;
+            count++;
+        }
+        const usb_aggregate_value_t* got = &r->values[c];
+        if (c == 0 && count != r->count) return 0;
+        if (count == 0) {
+            if (got->min != 0 || got->max != 0) return 0;
+            continue;
+        }
+        double mean = (double)sum / (double)count;
+        if (got->min != min || got->max != max || got->mean != mean ||
+            !same_double(got->rms * got->rms, sumsq / (double)count)) {
+            return 0;
+        }
+    }
+    return r->first_sample == from;
+}
+
+static int cross_check(usb_decode_level_t level) {
+    enum { CASES = 300, MAX_SAMPLES = 20000 };
+    static const int channel_choices[] = {1, 2, 3, 4, 5, 8};
+    int32_t* s = (int32_t*)malloc(sizeof(int32_t) * MAX_SAMPLES);
+    check_ctx_t ctx;
+    int errors = 0;
+    uint64_t windows = 0;
+
+    ctx.records = (check_record_t*)malloc(sizeof(check_record_t) * MAX_RECORDS);
+    usb_decode_set_level(level);
+    for (int t = 0; t < CASES && errors < 10; t++) {
+        usb_aggregate_config_t cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.channels = channel_choices[next_rand() % 6];
+        cfg.levels = 1 + (int)(next_rand() % 3);
+        cfg.window[0] = 1 + next_rand() % 300;
+        for (int k = 1; k < cfg.levels; k++) {
+            cfg.window[k] = cfg.window[k - 1] * (1 + next_rand() % 5);
+        }
+        int n = (int)(next_rand() % MAX_SAMPLES);
+        for (int i = 0; i < n; i++) {
+            uint32_t r = next_rand() % 16;
+            s[i] = r == 0 ? INT32_MIN : r == 1 ? INT32_MAX : r < 8 ? (int32_t)(next_rand() % 65536) - 32768
+                                                                   : (int32_t)next_rand();
+        }
+
+        ctx.count = 0;
+        ctx.channels = cfg.channels;
+        usb_aggregate_t* agg = usb_aggregate_create(&cfg, on_check_window, &ctx);
+        for (int pos = 0; pos < n;) {
+            int chunk = 1 + (int)(next_rand() % 700);
+            if (chunk > n - pos) chunk = n - pos;
+            usb_aggregate_feed(agg, s + pos, chunk, 0);
+            pos += chunk;
+        }
+        usb_aggregate_flush(agg);
+        usb_aggregate_destroy(agg);
+
+        // 每一级的窗口数和内容
+        for (int k = 0; k < cfg.levels; k++) {
+            uint64_t per_channel = ((uint64_t)n + (uint64_t)cfg.channels - 1) / (uint64_t)cfg.channels;
+            uint64_t expect = (per_channel + cfg.window[k] - 1) / cfg.window[k];
+            uint64_t seen = 0;
+            for (int i = 0; i < ctx.count; i++) {
+                const check_record_t* r = &ctx.records[i];
+                if (r->level != k) continue;
+                if (r->index != seen++ || !check_window(s, n, cfg.channels, cfg.window[k], r)) {
+                    if (errors++ < 3) {
+                        printf("  %s: mismatch, %d channel(s), level %d window %u, index %llu\n",
+                               usb_decode_level_name(level), cfg.channels, k, cfg.window[k],
+                               (unsigned long long)r->index);
+                    }
+                    break;
+                }
+            }
+            if (seen != expect && errors++ < 3) {
+                printf("  %s: level %d produced %llu windows, expected %llu\n", usb_decode_level_name(level), k,
+                       (unsigned long long)seen, (unsigned long long)expect);
+            }
+            windows += seen;
+        }
+    }
+    printf("  %-7s %s (%llu windows)\n", usb_decode_level_name(level), errors ? "FAILED" : "ok",
+           (unsigned long long)windows);
+    free(ctx.records);
+    free(s);
+    return errors;
+}
+
+// ---- 吞吐量 ----
+
+static void on_window(const usb_aggregate_window_t* w, const usb_aggregate_value_t* values, void* user_data) {
+    (void)w;
+    *(double*)user_data += values[0].mean;
+}
+
+// 重复送入到duration_ms，返回 M样本/s
+static double measure(const usb_aggregate_config_t* cfg, const int32_t* s, int n, int duration_ms) {
+    double sink = 0;
+    usb_aggregate_t* agg = usb_aggregate_create(cfg, on_window, &sink);
+    uint64_t samples = 0;
+    if (!agg) return 0;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now;
+    do {
+        for (int pos = 0; pos < n; pos += 4096) {
+            usb_aggregate_feed(agg, s + pos, n - pos < 4096 ? n - pos : 4096, 0);
+        }
+        samples += (uint64_t)n;
+        now = usb_time_ns();
+    } while (now < end);
+    usb_aggregate_destroy(agg);
+    return (double)samples * 1000.0 / (double)(now - start);
+}
+
+static double measure_bytes(const usb_aggregate_config_t* cfg, const unsigned char* data, int length, int duration_ms) {
+    double sink = 0;
+    usb_aggregate_t* agg = usb_aggregate_create(cfg, on_window, &sink);
+    uint64_t bytes = 0;
+    if (!agg) return 0;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now;
+    do {
+        for (int pos = 0; pos < length; pos += 16384) {
+            usb_aggregate_feed_bytes(agg, data + pos, length - pos < 16384 ? length - pos : 16384, 0);
+        }
+        bytes += (uint64_t)length;
+        now = usb_time_ns();
+    } while (now < end);
+    usb_aggregate_destroy(agg);
+    return (double)bytes / (double)(now - start);
+}
+
+// ---- 端到端 ----
+
+static void on_decoded(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data) {
+    (void)header;
+    if (count > 0) *(int64_t*)user_data += samples[0];
+}
+
+static unsigned char* make_frames(size_t total, int payload) {
+    unsigned char* data = (unsigned char*)malloc(total);
+    size_t pos = 0;
+    uint32_t seq = 0;
+    for (size_t i = 0; i < total; i++) data[i] = (unsigned char)next_rand();
+    while (pos + USB_FRAME_HEADER_SIZE + (size_t)payload <= total) {
+        usb_frame_header_t h = {USB_FRAME_SYNC, 1, 0, seq++, (uint32_t)payload, 0};
+        h.crc = usb_crc32c(0, data + pos + USB_FRAME_HEADER_SIZE, (size_t)payload);
+        usb_frame_encode_header(&h, data + pos);
+        pos += USB_FRAME_HEADER_SIZE + (size_t)payload;
+    }
+    return data;
+}
+
+// agg为NULL时只解码，返回 MB/s (输入字节)
+static double measure_pipeline(const unsigned char* data, size_t total, int payload, usb_aggregate_t* agg,
+                               int duration_ms) {
+    int64_t sink = 0;
+    usb_decoder_t* dec = agg ? usb_decoder_create(USB_SAMPLE_S16, payload, usb_aggregate_decode_cb, agg)
+                             : usb_decoder_create(USB_SAMPLE_S16, payload, on_decoded, &sink);
+    uint64_t bytes = 0;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now;
+    do {
+        for (size_t pos = 0; pos < total; pos += 16384) {
+            usb_decoder_feed(dec, data + pos, total - pos < 16384 ? (int)(total - pos) : 16384);
+        }
+        bytes += total;
+        now = usb_time_ns();
+    } while (now < end);
+    usb_decoder_destroy(dec);
+    return (double)bytes * 1000.0 / (double)(now - start) / 1.048576;
+}
+
+int main(int argc, char* argv[]) {
+    int samples_k = 64;
+    int payload = 4096;
+    int duration_ms = 300;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--samples=", 10) == 0) {
+            samples_k = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--frame=", 8) == 0) {
+            payload = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (samples_k <= 0) samples_k = 64;
+    if (payload < 16) payload = 4096;
+    if (duration_ms <= 0) duration_ms = 300;
+
+    usb_decode_level_t best = usb_decode_detect();
+    printf("CPU supports: %s\n", usb_decode_level_name(best));
+
+    printf("\nCross-check against per-sample reference:\n");
+    int errors = 0;
+    for (int l = 0; l <= (int)best; l++) {
+        errors += cross_check((usb_decode_level_t)l);
+    }
+
+    int n = samples_k * 1024;
+    int32_t* s = (int32_t*)malloc(sizeof(int32_t) * (size_t)n);
+    unsigned char* raw = (unsigned char*)malloc((size_t)n * 2);
+    for (int i = 0; i < n; i++) s[i] = (int32_t)(next_rand() % 16777216) - 8388608;
+    for (int i = 0; i < n * 2; i++) raw[i] = (unsigned char)next_rand();
+
+    usb_aggregate_config_t one, four;
+    memset(&one, 0, sizeof(one));
+    one.levels = 1;
+    one.window[0] = 1000;
+    memset(&four, 0, sizeof(four));
+    usb_aggregate_parse_windows("100,1000,10000,100000", &four);
+
+    printf("\nThroughput on %d K samples (M samples/s; GB/s of int32 input in parentheses):\n", samples_k);
+    printf("%-8s %16s %16s %16s %16s %16s %12s\n", "level", "1ch 1000", "1ch 4 levels", "4ch 4 levels",
+           "8ch 4 levels", "3ch 4 (scalar)", "s16 bytes");
+    for (int l = 0; l <= (int)best; l++) {
+        double r[5];
+        usb_decode_set_level((usb_decode_level_t)l);
+        r[0] = measure(&one, s, n, duration_ms);
+        r[1] = measure(&four, s, n, duration_ms);
+        four.channels = 4;
+        r[2] = measure(&four, s, n, duration_ms);
+        four.channels = 8;
+        r[3] = measure(&four, s, n, duration_ms);
+        four.channels = 3;
+        r[4] = measure(&four, s, n, duration_ms);
+        four.channels = 1;
+        double bytes = measure_bytes(&four, raw, n * 2, duration_ms);
+        printf("%-8s", usb_decode_level_name((usb_decode_level_t)l));
+        for (int k = 0; k < 5; k++) {
+            char cell[32];
+            snprintf(cell, sizeof(cell), "%.0f (%.2f)", r[k], r[k] * 4 / 1000.0);
+            printf(" %16s", cell);
+        }
+        printf(" %7.2f GB/s\n", bytes);
+    }
+
+    size_t total = 16u * 1024 * 1024;
+    unsigned char* frames = make_frames(total, payload);
+    printf("\nDecoder + aggregate, s16, %d-byte payloads, 4 levels (MB/s of input):\n", payload);
+    printf("%-8s %12s %12s %9s\n", "level", "decode only", "+aggregate", "cost");
+    for (int l = 0; l <= (int)best; l++) {
+        usb_decode_set_level((usb_decode_level_t)l);
+        double sink = 0;
+        usb_aggregate_t* agg = usb_aggregate_create(&four, on_window, &sink);
+        double base = measure_pipeline(frames, total, payload, NULL, duration_ms);
+        double with = measure_pipeline(frames, total, payload, agg, duration_ms);
+        usb_aggregate_destroy(agg);
+        printf("%-8s %12.0f %12.0f %8.1f%%\n", usb_decode_level_name((usb_decode_level_t)l), base, with,
+               base > 0 ? 100.0 * (base / with - 1.0) : 0.0);
+    }
+
+    free(frames);
+    free(s);
+    free(raw);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,202 @@
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_capture.h"
+
+// 采集落盘的持续写入吞吐量
+//   direct: 一个线程不经过USB，循环把同一块缓冲区写入采集 (落盘路径本身的上限)
+//   stream: 流式读取的回调直接写入采集 (usb_capture_stream_cb)，设备不限速或按 --rate 限速
+//   矩阵: 记录大小 x 段大小
+//   报告: 写入MB/s、记录/s、每MB的CPU时间、段数、轮换等待次数、丢弃的记录数
+//
+// 用法: bench_capture [--backend=sim|null] [--rate=MB/s] [--duration=ms] [--dir=DIR]
+//                     [--durable] [--keep] [--quick]
+// 段文件写到 DIR (默认当前目录)，每个测试点结束后删除，--keep 不删除。
+// 测量时间足够长时 (默认2秒，段64MB) 会包含多次轮换和后台写回，结果是持续吞吐量。
+
+static const int bench_sizes[] = {1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+static const size_t bench_segments[] = {16u * 1024 * 1024, 64u * 1024 * 1024};
+
+typedef struct {
+    const char* mode;
+    int size;
+    size_t segment_size;
+    double mb_per_sec;
+    double records_per_sec;
+    double cpu_ms_per_mb;
+    usb_capture_stats_t stats;
+} bench_result_t;
+
+static char bench_path[1024];
+static int bench_durable = 0;
+
+static void finish(bench_result_t* res, uint64_t wall_ns, uint64_t cpu_ns) {
+    double mb = (double)res->stats.bytes / (1024.0 * 1024.0);
+    double sec = (double)wall_ns / 1e9;
+    res->mb_per_sec = mb / sec;
+    res->records_per_sec = (double)res->stats.records / sec;
+    res->cpu_ms_per_mb = mb > 0 ? (double)cpu_ns / 1e6 / mb : 0;
+}
+
+// 删除一次运行产生的段文件
+static void remove_segments(uint64_t segments) {
+    char name[1100];
+    for (uint64_t i = 0; i <= segments; i++) {
+        snprintf(name, sizeof(name), "%s.%06u.cap", bench_path, (unsigned int)i);
+        remove(name);
+    }
+}
+
+static int open_capture(usb_capture_t** cap, bench_result_t* res) {
+    usb_capture_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = bench_path;
+    cfg.segment_size = res->segment_size;
+    cfg.durable = bench_durable;
+    return usb_capture_open(cap, &cfg);
+}
+
+// 关闭也计入时间: 最后一个段写回磁盘后才算写完
+static int run_direct(bench_result_t* res, int duration_ms) {
+    usb_capture_t* cap;
+    unsigned char* data = (unsigned char*)malloc((size_t)res->size);
+    if (!data) return LIBUSB_ERROR_NO_MEM;
+    for (int i = 0; i < res->size; i++) data[i] = (unsigned char)i;
+
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    int r = open_capture(&cap, res);
+    if (r < 0) {
+        free(data);
+        return r;
+    }
+    usb_capture_sink_t* sink = usb_capture_add_device(cap, "BENCH0001");
+    while (usb_time_ns() < end) {
+        for (int i = 0; i < 64; i++) {
+            usb_capture_write(sink, data, res->size);
+        }
+    }
+    usb_capture_get_stats(cap, &res->stats);
+    usb_capture_close(cap);
+    finish(res, usb_time_ns() - start, usb_cpu_time_ns() - cpu);
+    free(data);
+    return 0;
+}
+
+static int run_stream(bench_result_t* res, int duration_ms) {
+    usb_capture_t* cap;
+    usb_stream_t* stream;
+    usb_stream_config_t cfg = {8, res->size, 0};
+
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    int r = open_capture(&cap, res);
+    if (r < 0) return r;
+    usb_capture_sink_t* sink = usb_capture_add_device(cap, "BENCH0001");
+    r = usb_stream_start(&stream, NULL, &cfg, usb_capture_stream_cb, sink);
+    if (r < 0) {
+        usb_capture_close(cap);
+        return r;
+    }
+    usb_sleep_ms((unsigned int)duration_ms);
+    usb_stream_stop(stream);
+    usb_capture_get_stats(cap, &res->stats);
+    usb_capture_close(cap);
+    finish(res, usb_time_ns() - start, usb_cpu_time_ns() - cpu);
+    return 0;
+}
+
+static void print_result(const bench_result_t* r) {
+    printf("%-7s %8d %6zu %10.2f %11.0f %9.3f %6llu %6llu %7llu\n",
+           r->mode, r->size, r->segment_size >> 20, r->mb_per_sec, r->records_per_sec, r->cpu_ms_per_mb,
+           (unsigned long long)r->stats.segments, (unsigned long long)r->stats.stalls,
+           (unsigned long long)r->stats.dropped);
+}
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int main(int argc, char* argv[]) {
+    const char* backend = "sim";
+    const char* dir = ".";
+    double rate = 0;
+    int duration_ms = 2000;
+    int keep = 0;
+    int quick = 0;
+    usb_sim_config_t sim_cfg;
+    int r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--backend=", 10) == 0) {
+            backend = argv[i] + 10;
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--dir=", 6) == 0) {
+            dir = argv[i] + 6;
+        } else if (strcmp(argv[i], "--durable") == 0) {
+            bench_durable = 1;
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = 1;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 2000;
+    snprintf(bench_path, sizeof(bench_path), "%s/bench_capture", dir);
+
+    if (strcmp(backend, "null") == 0) {
+        r = usb_control_init_null();
+    } else if (strcmp(backend, "sim") == 0) {
+        memset(&sim_cfg, 0, sizeof(sim_cfg));
+        sim_cfg.num_devices = 1;
+        sim_cfg.bytes_per_sec = rate * 1024 * 1024;
+        r = usb_control_init_sim(&sim_cfg);
+    } else {
+        printf("Unknown backend: %s\n", backend);
+        return 1;
+    }
+    if (r < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        return 1;
+    }
+
+    printf("\nbackend=%s rate=", backend);
+    if (rate > 0) {
+        printf("%.1f MB/s", rate);
+    } else {
+        printf("unlimited");
+    }
+    printf(" duration=%d ms dir=%s%s\n", duration_ms, dir, bench_durable ? " durable" : "");
+    printf("%-7s %8s %6s %10s %11s %9s %6s %6s %7s\n",
+           "mode", "size", "seg MB", "MB/s", "records/s", "cpu ms/MB", "segs", "stalls", "dropped");
+
+    static const char* modes[] = {"direct", "stream"};
+    bench_result_t res;
+    for (int m = 0; m < COUNT(modes); m++) {
+        for (int s = 0; s < COUNT(bench_sizes); s++) {
+            if (quick && (s % 2)) continue;
+            for (int g = 0; g < COUNT(bench_segments); g++) {
+                if (quick && g > 0) continue;
+                memset(&res, 0, sizeof(res));
+                res.mode = modes[m];
+                res.size = bench_sizes[s];
+                res.segment_size = bench_segments[g];
+                r = m == 0 ? run_direct(&res, duration_ms) : run_stream(&res, duration_ms);
+                if (r < 0) {
+                    printf("%s size %d failed: %s\n", res.mode, res.size, libusb_error_name(r));
+                    continue;
+                }
+                print_result(&res);
+                if (!keep) remove_segments(res.stats.segments);
+            }
+        }
+    }
+
+    USB_CloseDevice();
+    usb_control_exit();
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_command.h"
+
+// 命令通道基准 (模拟设备): 后台一个流式读取，同时尽可能快地发送命令
+//   sync:  每条命令一次同步写 (usb_device_write)，等待完成后再发下一条
+//   queue: usb_command_send，最多 --window 条命令未完成 (回调后补发)，
+//          矩阵: 同时挂起的写传输 1/4 x 合并 关闭(batch_size=命令长度)/开启(4096)
+//   模拟设备每次写入固定完成延迟 --latency-us
+//   报告: 命令/s、每次写传输的命令数、命令 提交->完成 的延迟 p50/p99、同时流式读取的 MB/s
+//
+// 用法: bench_command [--duration=ms] [--latency-us=N] [--size=命令字节] [--window=N]
+
+typedef struct {
+    const char* name;
+    int in_flight;
+    int batch;
+} bench_mode_t;
+
+static const bench_mode_t bench_modes[] = {
+    {"queue", 1, 0},
+    {"queue", 1, 1},
+    {"queue", 4, 0},
+    {"queue", 4, 1},
+};
+
+static atomic_int bench_outstanding;
+static atomic_uint_least64_t bench_stream_bytes;
+
+static void on_stream_data(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    (void)user_data;
+    atomic_fetch_add_explicit(&bench_stream_bytes, (uint64_t)length, memory_order_relaxed);
+}
+
+static void on_command_done(int status, void* user_data) {
+    (void)status;
+    (void)user_data;
+    atomic_fetch_sub_explicit(&bench_outstanding, 1, memory_order_release);
+}
+
+static void report(const char* mode, int in_flight, const char* batch, double sec, uint64_t commands,
+                   uint64_t transfers, const usb_stats_snapshot_t* latency, uint64_t stream_bytes, uint64_t failed) {
+    printf("%-6s %9d %6s %12.0f %10.2f %10.1f %10.1f %10.2f", mode, in_flight, batch, (double)commands / sec,
+           transfers ? (double)commands / (double)transfers : 0.0, usb_stats_percentile(latency, 0.5) / 1000.0,
+           usb_stats_percentile(latency, 0.99) / 1000.0, (double)stream_bytes / sec / (1024.0 * 1024.0));
+    if (failed) printf("  (%llu failed)", (unsigned long long)failed);
+    printf("\n");
+}
+
+static void run_sync(usb_device_t* device, int size, int duration_ms) {
+    unsigned char cmd[USB_COMMAND_DEFAULT_BATCH];
+    usb_stats_t* stats = usb_stats_create();
+    uint64_t commands = 0, failed = 0;
+    int transferred;
+
+    memset(cmd, 0x5A, sizeof(cmd));
+    uint64_t bytes = atomic_load(&bench_stream_bytes);
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    while (usb_time_ns() < end) {
+        uint64_t t = usb_stats_clock();
+        int r = usb_device_write(device, cmd, size, &transferred, 0);
+        usb_stats_record(stats, t, size, transferred, r);
+        if (r < 0) failed++;
+        commands++;
+    }
+    double sec = (double)(usb_time_ns() - start) / 1e9;
+    usb_stats_snapshot_t snap;
+    usb_stats_snapshot(stats, &snap);
+    report("sync", 1, "-", sec, commands, commands, &snap, atomic_load(&bench_stream_bytes) - bytes, failed);
+    usb_stats_destroy(stats);
+}
+
+static void run_queue(usb_device_t* device, const bench_mode_t* mode, int size, int window, int duration_ms) {
+    unsigned char cmd[USB_COMMAND_DEFAULT_BATCH];
+    usb_command_config_t cfg;
+    usb_command_queue_t* queue;
+    usb_command_stats_t st;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.max_in_flight = mode->in_flight;
+    cfg.max_command = size;
+    cfg.batch_size = mode->batch ? USB_COMMAND_DEFAULT_BATCH : size;
+    int r = usb_command_open(&queue, device, &cfg);
+    if (r < 0) {
+        printf("%-6s %9d: %s\n", mode->name, mode->in_flight, libusb_error_name(r));
+        return;
+    }
+
+    memset(cmd, 0x5A, sizeof(cmd));
+    atomic_store(&bench_outstanding, 0);
+    uint64_t bytes = atomic_load(&bench_stream_bytes);
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    while (usb_time_ns() < end) {
+        if (atomic_load_explicit(&bench_outstanding, memory_order_acquire) >= window) {
+            usb_sleep_until_ns(usb_time_ns() + 20000);
+            continue;
+        }
+        atomic_fetch_add_explicit(&bench_outstanding, 1, memory_order_relaxed);
+        if (usb_command_send(queue, cmd, size, 0, on_command_done, NULL) < 0) {
+            atomic_fetch_sub_explicit(&bench_outstanding, 1, memory_order_relaxed);
+            usb_sleep_until_ns(usb_time_ns() + 20000);
+        }
+    }
+    usb_command_flush(queue, 1000);
+    double sec = (double)(usb_time_ns() - start) / 1e9;
+    uint64_t stream_bytes = atomic_load(&bench_stream_bytes) - bytes;
+    usb_command_get_stats(queue, &st);
+    report(mode->name, mode->in_flight, mode->batch ? "on" : "off", sec, st.completed, st.transfers, &st.latency,
+           stream_bytes, st.timeouts + st.errors);
+    usb_command_close(queue);
+}
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int main(int argc, char* argv[]) {
+    int duration_ms = 1000;
+    int latency_us = 125;
+    int size = 16;
+    int window = 256;
+    usb_sim_config_t sim_cfg;
+    usb_device_t* device;
+    usb_stream_t* stream;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--latency-us=", 13) == 0) {
+            latency_us = atoi(argv[i] + 13);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            size = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--window=", 9) == 0) {
+            window = atoi(argv[i] + 9);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 1000;
+    if (latency_us < 0) latency_us = 125;
+    if (size <= 1 || size > USB_COMMAND_DEFAULT_MAX) size = 16;  // 单字节命令是开始/停止
+    if (window <= 0) window = 256;
+
+    memset(&sim_cfg, 0, sizeof(sim_cfg));
+    sim_cfg.num_devices = 1;
+    sim_cfg.latency_us = latency_us;
+    sim_cfg.bytes_per_sec = USB_SIM_DEFAULT_RATE;
+    sim_cfg.fifo_bytes = USB_SIM_DEFAULT_FIFO;
+    if (usb_control_init_sim(&sim_cfg) < 0) return 1;
+    if (USB_OpenDeviceEx(NULL, &device) < 0) {
+        usb_control_exit();
+        return 1;
+    }
+    if (usb_stream_start(&stream, device, NULL, on_stream_data, NULL) < 0) {
+        USB_CloseDeviceEx(device);
+        usb_control_exit();
+        return 1;
+    }
+    usb_sleep_ms(50);
+
+    printf("\nsim latency=%d us, %d-byte commands, window=%d, stream at %.0f MB/s, duration=%d ms\n", latency_us,
+           size, window, USB_SIM_DEFAULT_RATE / (1024.0 * 1024.0), duration_ms);
+    printf("%-6s %9s %6s %12s %10s %10s %10s %10s\n", "mode", "in_flight", "batch", "cmds/s", "cmds/xfer",
+           "p50 us", "p99 us", "stream MB/s");
+    run_sync(device, size, duration_ms);
+    for (int m = 0; m < COUNT(bench_modes); m++) {
+        run_queue(device, &bench_modes[m], size, window, duration_ms);
+    }
+
+    usb_stream_stop(stream);
+    USB_CloseDeviceEx(device);
+    usb_control_exit();
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "usb_internal.h"
+#include "usb_decode.h"
+
+// 帧解码内核的交叉校验和吞吐量
+//   1. 交叉校验: 随机数据、随机长度和对齐，每个CPU支持的级别 (scalar/sse4.2/avx2) 的同步搜索、CRC-32C、
+//      样本解包结果与标量实现逐一比较，有不一致时退出码为1
+//   2. 内核吞吐量 (GB/s): 同步搜索 (数据中没有同步字，扫描全部)、CRC-32C、s16/s24/s32 解包
+//   3. 端到端: 帧头+负载的数据按传输大小分块交给解码器 (拆分、CRC校验、解包)，报告输入的 GB/s
+//
+// 用法: bench_decode [--size=KB] [--frame=负载字节] [--chunk=字节] [--duration=ms]
+
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+static void fill_random(unsigned char* p, size_t n) {
+    for (size_t i = 0; i < n; i++) p[i] = (unsigned char)next_rand();
+}
+
+// ---- 交叉校验 ----
+
+static int cross_check(usb_decode_level_t level) {
+    enum { BUF = 4096, CASES = 20000 };
+    unsigned char* buf = (unsigned char*)malloc(BUF + 64);
+    int32_t* expect = (int32_t*)malloc(sizeof(int32_t) * BUF);
+    int32_t* got = (int32_t*)malloc(sizeof(int32_t) * BUF);
+    int errors = 0;
+
+    for (int c = 0; c < CASES; c++) {
+        // 大量同步字节，让匹配出现在各种位置 (包括块边界和末尾)
+        for (int i = 0; i < BUF + 64; i++) {
+            uint32_t r = next_rand() % 8;
+            buf[i] = r == 0 ? 0x5A : r == 1 ? 0xA5 : (unsigned char)next_rand();
+        }
+        const unsigned char* p = buf + next_rand() % 32;
+        int n = (int)(next_rand() % 600);
+        int from = n ? (int)(next_rand() % (unsigned)n) : 0;
+        uint32_t init = next_rand();
+        size_t crc_len = next_rand() % 2048;
+        int count = (int)(next_rand() % 300);
+        usb_sample_format_t format = (usb_sample_format_t)(next_rand() % 3);
+
+        usb_decode_set_level(USB_DECODE_SCALAR);
+        int sync_expect = usb_decode_find_sync(p, from, n);
+        uint32_t crc_expect = usb_crc32c(init, p, crc_len);
+        usb_decode_unpack(format, p, count, expect);
+
+        usb_decode_set_level(level);
+        int sync_got = usb_decode_find_sync(p, from, n);
+        uint32_t crc_got = usb_crc32c(init, p, crc_len);
+        usb_decode_unpack(format, p, count, got);
+
+        if (sync_got != sync_expect) {
+            if (errors++ < 5) printf("  find_sync(from=%d, n=%d): %d != %d\n", from, n, sync_got, sync_expect);
+        }
+        if (crc_got != crc_expect) {
+            if (errors++ < 5) printf("  crc32c(len=%zu): %08x != %08x\n", crc_len, crc_got, crc_expect);
+        }
+        if (memcmp(got, expect, sizeof(int32_t) * (size_t)count) != 0) {
+            if (errors++ < 5) printf("  unpack(format=%d, count=%d) differs\n", (int)format, count);
+        }
+    }
+    // CRC-32C 的标准校验值
+    if (usb_crc32c(0, (const unsigned char*)"123456789", 9) != 0xE3069283u) {
+        printf("  crc32c check value wrong\n");
+        errors++;
+    }
+    printf("  %-7s %d cases, %d mismatch(es)\n", usb_decode_level_name(level), CASES, errors);
+    free(buf);
+    free(expect);
+    free(got);
+    return errors;
+}
+
+// ---- 吞吐量 ----
+
+typedef struct {
+    const unsigned char* data;
+    int length;
+    int32_t* out;
+    usb_sample_format_t format;
+    uint64_t sink;
+} kernel_arg_t;
+
+static void run_find_sync(kernel_arg_t* a) {
+    a->sink += (uint64_t)usb_decode_find_sync(a->data, 0, a->length);
+}
+
+static void run_crc(kernel_arg_t* a) {
+    a->sink += usb_crc32c(0, a->data, (size_t)a->length);
+}
+
+static void run_unpack(kernel_arg_t* a) {
+    usb_decode_unpack(a->format, a->data, a->length / usb_sample_size(a->format), a->out);
+    a->sink += (uint64_t)a->out[0];
+}
+
+// 重复执行到duration_ms，返回 GB/s (按输入字节)
+static double measure(void (*fn)(kernel_arg_t*), kernel_arg_t* a, int duration_ms) {
+    uint64_t bytes = 0;
+    fn(a);  // 预热
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now;
+    do {
+        for (int i = 0; i < 8; i++) {
+            fn(a);
+            bytes += (uint64_t)a->length;
+        }
+        now = usb_time_ns();
+    } while (now < end);
+    return (double)bytes / (double)(now - start);
+}
+
+typedef struct {
+    uint64_t frames;
+    uint64_t samples;
+    int64_t checksum;
+    int64_t first_pass;      // 第一遍的样本校验和，用于与标量结果比较
+} decode_ctx_t;
+
+static void on_decoded(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data) {
+    decode_ctx_t* c = (decode_ctx_t*)user_data;
+    (void)header;
+    c->frames++;
+    c->samples += (uint64_t)count;
+    if (count > 0) c->checksum += samples[0] + samples[count - 1];
+}
+
+// 生成帧流: 帧头 + 随机负载，total字节 (最后一帧可能不完整)
+static unsigned char* make_frames(size_t total, int payload) {
+    unsigned char* data = (unsigned char*)malloc(total);
+    size_t pos = 0;
+    uint32_t seq = 0;
+    fill_random(data, total);
+    while (pos + USB_FRAME_HEADER_SIZE + (size_t)payload <= total) {
+        usb_frame_header_t h = {USB_FRAME_SYNC, 1, 0, seq++, (uint32_t)payload, 0};
+        h.crc = usb_crc32c(0, data + pos + USB_FRAME_HEADER_SIZE, (size_t)payload);
+        usb_frame_encode_header(&h, data + pos);
+        pos += USB_FRAME_HEADER_SIZE + (size_t)payload;
+    }
+    return data;
+}
+
+static double measure_decoder(const unsigned char* data, size_t total, int payload, int chunk, usb_sample_format_t format,
+                              int duration_ms, decode_ctx_t* ctx) {
+    usb_decoder_t* dec = usb_decoder_create(format, payload, on_decoded, ctx);
+    uint64_t bytes = 0;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now;
+    do {
+        for (size_t pos = 0; pos < total; pos += (size_t)chunk) {
+            int n = total - pos < (size_t)chunk ? (int)(total - pos) : chunk;
+            usb_decoder_feed(dec, data + pos, n);
+        }
+        if (bytes == 0) ctx->first_pass = ctx->checksum;
+        bytes += total;
+        now = usb_time_ns();
+    } while (now < end);
+
+    usb_decode_stats_t st;
+    usb_decoder_get_stats(dec, &st);
+    if (st.frames.crc_errors > 0) {
+        printf("  unexpected CRC errors: %llu\n", (unsigned long long)st.frames.crc_errors);
+    }
+    usb_decoder_destroy(dec);
+    return (double)bytes / (double)(now - start);
+}
+
+int main(int argc, char* argv[]) {
+    int size_kb = 256;
+    int payload = 4096;
+    int chunk = 16384;
+    int duration_ms = 200;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0) {
+            size_kb = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--frame=", 8) == 0) {
+            payload = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--chunk=", 8) == 0) {
+            chunk = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (size_kb <= 0) size_kb = 256;
+    if (payload < 12) payload = 4096;
+    if (chunk <= 0) chunk = 16384;
+    if (duration_ms <= 0) duration_ms = 200;
+
+    usb_decode_level_t best = usb_decode_detect();
+    printf("CPU supports: %s\n", usb_decode_level_name(best));
+
+    printf("\nCross-check against scalar:\n");
+    int errors = 0;
+    for (int l = USB_DECODE_SSE42; l <= (int)best; l++) {
+        errors += cross_check((usb_decode_level_t)l);
+    }
+    if (best == USB_DECODE_SCALAR) {
+        printf("  (no vector kernels on this CPU)\n");
+    }
+
+    size_t size = (size_t)size_kb * 1024;
+    unsigned char* data = (unsigned char*)malloc(size);
+    unsigned char* nosync = (unsigned char*)malloc(size);
+    int32_t* out = (int32_t*)malloc(sizeof(int32_t) * (size / 2 + 1));
+    fill_random(data, size);
+    for (size_t i = 0; i < size; i++) nosync[i] = data[i] == 0x5A ? 0 : data[i];
+
+    printf("\nKernels on %d KB (GB/s of input):\n", size_kb);
+    printf("%-8s %10s %10s %10s %10s %10s\n", "level", "find_sync", "crc32c", "s16", "s24", "s32");
+    for (int l = 0; l <= (int)best; l++) {
+        kernel_arg_t a = {nosync, (int)size, out, USB_SAMPLE_S16, 0};
+        double r[5];
+        usb_decode_set_level((usb_decode_level_t)l);
+        r[0] = measure(run_find_sync, &a, duration_ms);
+        a.data = data;
+        r[1] = measure(run_crc, &a, duration_ms);
+        for (int f = 0; f < 3; f++) {
+            a.format = (usb_sample_format_t)f;
+            r[2 + f] = measure(run_unpack, &a, duration_ms);
+        }
+        printf("%-8s %10.2f %10.2f %10.2f %10.2f %10.2f\n", usb_decode_level_name((usb_decode_level_t)l),
+               r[0], r[1], r[2], r[3], r[4]);
+    }
+
+    size_t total = 16u * 1024 * 1024;
+    unsigned char* frames = make_frames(total, payload);
+    printf("\nDecoder (split + CRC + unpack), %d-byte payloads fed in %d-byte chunks (GB/s of input):\n", payload, chunk);
+    printf("%-8s %10s %10s\n", "level", "s16", "s24");
+    int64_t reference[2] = {0, 0};
+    for (int l = 0; l <= (int)best; l++) {
+        double r[2];
+        usb_decode_set_level((usb_decode_level_t)l);
+        for (int f = 0; f < 2; f++) {
+            decode_ctx_t ctx;
+            memset(&ctx, 0, sizeof(ctx));
+            r[f] = measure_decoder(frames, total, payload, chunk, (usb_sample_format_t)f, duration_ms, &ctx);
+            if (l == 0) {
+                reference[f] = ctx.first_pass;
+            } else if (ctx.first_pass != reference[f]) {
+                printf("  decoded samples differ from scalar\n");
+                errors++;
+            }
+        }
+        printf("%-8s %10.2f %10.2f\n", usb_decode_level_name((usb_decode_level_t)l), r[0], r[1]);
+    }
+
+    free(frames);
+    free(data);
+    free(nosync);
+    free(out);
+    return errors ? 1 : 0;
+}
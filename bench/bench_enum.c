@@ -0,0 +1,185 @@
+#include "usb_internal.h"
+#include "usb_registry.h"
+#include "usb_trace.h"
+
+// 启动时 "扫描 + 按序列号打开" 的耗时: 旧的全量遍历 vs 设备注册表
+// 模拟设备的每次控制传输有固定延迟
+// 之后按设备数量扫描 (1 ~ USB_SIM_MAX_DEVICES 台): 旧的逐台串行读取 / 注册表并行读取全部字符串 /
+// 并行只读取序列号 (lazy) + 按需读取一台的字符串
+//
+// 用法: bench_enum [--latency-us=N]   每次控制传输 (打开、字符串描述符) 的延迟，默认1000us
+
+#define BENCH_DEVICES 16
+#define BENCH_CONTROL_LATENCY_US 500
+
+// 旧实现: 遍历总线，打开每台设备读取三个字符串描述符
+static int legacy_scan(device_info_t* devices, int max_devices) {
+    libusb_device** devs;
+    struct libusb_device_descriptor desc;
+    int found = 0;
+    ssize_t cnt = usb_transport->get_device_list(usb_control_context(), &devs);
+    if (cnt < 0) return (int)cnt;
+
+    for (ssize_t i = 0; i < cnt && found < max_devices; i++) {
+        libusb_device_handle* handle;
+        if (usb_transport->get_device_descriptor(devs[i], &desc) < 0) continue;
+        if (desc.idVendor != VENDOR_ID || desc.idProduct != PRODUCT_ID) continue;
+        if (usb_transport->open(devs[i], &handle) < 0) continue;
+        device_info_t* info = &devices[found++];
+        usb_transport->get_string_descriptor_ascii(handle, desc.iManufacturer, (unsigned char*)info->manufacturer, MAX_STR_LENGTH);
+        usb_transport->get_string_descriptor_ascii(handle, desc.iProduct, (unsigned char*)info->product, MAX_STR_LENGTH);
+        usb_transport->get_string_descriptor_ascii(handle, desc.iSerialNumber, (unsigned char*)info->serial, MAX_STR_LENGTH);
+        usb_transport->close(handle);
+    }
+    usb_transport->free_device_list(devs, 1);
+    return found;
+}
+
+// 旧实现: 再遍历一次，逐台打开比较序列号
+static int legacy_open(const char* serial) {
+    libusb_device** devs;
+    struct libusb_device_descriptor desc;
+    unsigned char string[MAX_STR_LENGTH];
+    int r = LIBUSB_ERROR_NOT_FOUND;
+    ssize_t cnt = usb_transport->get_device_list(usb_control_context(), &devs);
+    if (cnt < 0) return (int)cnt;
+
+    for (ssize_t i = 0; i < cnt; i++) {
+        libusb_device_handle* handle;
+        if (usb_transport->get_device_descriptor(devs[i], &desc) < 0) continue;
+        if (desc.idVendor != VENDOR_ID || desc.idProduct != PRODUCT_ID) continue;
+        if (usb_transport->open(devs[i], &handle) < 0) continue;
+        usb_transport->get_string_descriptor_ascii(handle, desc.iSerialNumber, string, sizeof(string));
+        if (strcmp((char*)string, serial) == 0) {
+            usb_transport->set_configuration(handle, 1);
+            usb_transport->claim_interface(handle, 0);
+            usb_transport->release_interface(handle, 0);
+            usb_transport->close(handle);
+            r = 0;
+            break;
+        }
+        usb_transport->close(handle);
+    }
+    usb_transport->free_device_list(devs, 1);
+    return r;
+}
+
+static double elapsed_ms(uint64_t start) {
+    return (double)(usb_time_ns() - start) / 1e6;
+}
+
+static const int sweep_counts[] = {1, 4, 16, 64, 128, USB_SIM_MAX_DEVICES};
+
+// 冷扫描 (注册表为空) 的耗时。mode: 0 旧的串行遍历, 1 并行读取全部, 2 并行只读序列号 + 一台按需读取
+static double sweep_scan(int count, int latency_us, int mode, int* found) {
+    usb_sim_config_t cfg;
+    device_info_t* list = NULL;
+    device_info_t info;
+    double ms;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_devices = count;
+    cfg.control_latency_us = latency_us;
+    if (usb_control_init_sim(&cfg) < 0) {
+        return -1;
+    }
+    uint64_t t = usb_time_ns();
+    if (mode == 0) {
+        list = (device_info_t*)malloc(sizeof(device_info_t) * (size_t)count);
+        *found = list ? legacy_scan(list, count) : 0;
+    } else {
+        *found = USB_ScanDeviceList(&list, mode == 2 ? USB_SCAN_LAZY : 0);
+        if (mode == 2 && *found > 0) {
+            USB_GetDeviceInfo(list[*found - 1].serial, &info);
+        }
+    }
+    ms = elapsed_ms(t);
+    free(list);
+    usb_control_exit();
+    return ms;
+}
+
+static void bench_sweep(int latency_us) {
+    usb_trace_level_t level = usb_trace_get_level();
+
+    usb_trace_set_level(USB_TRACE_WARN);  // 每次初始化的日志
+    printf("\ncold scan vs device count, %d us per control transfer, up to %d fetch threads\n", latency_us,
+           USB_REGISTRY_FETCH_THREADS);
+    printf("%7s %12s %12s %12s %9s\n", "devices", "serial ms", "parallel ms", "lazy+1 ms", "speedup");
+    for (int i = 0; i < (int)(sizeof(sweep_counts) / sizeof(sweep_counts[0])); i++) {
+        int n[3];
+        double ms[3];
+        for (int mode = 0; mode < 3; mode++) {
+            ms[mode] = sweep_scan(sweep_counts[i], latency_us, mode, &n[mode]);
+        }
+        if (n[0] != sweep_counts[i] || n[1] != sweep_counts[i] || n[2] != sweep_counts[i]) {
+            printf("%7d found %d/%d/%d devices\n", sweep_counts[i], n[0], n[1], n[2]);
+            continue;
+        }
+        printf("%7d %12.2f %12.2f %12.2f %8.1fx\n", sweep_counts[i], ms[0], ms[1], ms[2],
+               ms[1] > 0 ? ms[0] / ms[1] : 0.0);
+    }
+    usb_trace_set_level(level);
+}
+
+int main(int argc, char* argv[]) {
+    device_info_t devices[MAX_DEVICES];
+    usb_device_t* device;
+    usb_sim_config_t cfg;
+    uint64_t t;
+    int latency_us = 1000;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--latency-us=", 13) == 0) {
+            latency_us = atoi(argv[i] + 13);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_devices = BENCH_DEVICES;
+    cfg.control_latency_us = BENCH_CONTROL_LATENCY_US;
+    if (usb_control_init_sim(&cfg) < 0) {
+        return 1;
+    }
+
+    // 打开最后一台设备，旧实现需要遍历最多的设备
+    t = usb_time_ns();
+    int n = legacy_scan(devices, MAX_DEVICES);
+    legacy_open(devices[n - 1].serial);
+    double legacy = elapsed_ms(t);
+
+    t = usb_time_ns();
+    n = USB_ScanDevice(devices, MAX_DEVICES);
+    USB_OpenDeviceEx(devices[n - 1].serial, &device);
+    double cold = elapsed_ms(t);
+    USB_CloseDeviceEx(device);
+
+    t = usb_time_ns();
+    n = USB_ScanDevice(devices, MAX_DEVICES);
+    USB_OpenDeviceEx(devices[n - 1].serial, &device);
+    double warm = elapsed_ms(t);
+    USB_CloseDeviceEx(device);
+
+    // 热插拔: 拔出再插入一台设备，只有它需要重新读取描述符
+    usb_sim_unplug(3);
+    usb_sim_plug(3);
+    t = usb_time_ns();
+    n = USB_ScanDevice(devices, MAX_DEVICES);
+    USB_OpenDeviceEx(devices[n - 1].serial, &device);
+    double replug = elapsed_ms(t);
+    USB_CloseDeviceEx(device);
+
+    printf("\nscan+open, %d simulated devices, %d us per control transfer\n", BENCH_DEVICES, BENCH_CONTROL_LATENCY_US);
+    printf("  legacy full walk:     %8.2f ms\n", legacy);
+    printf("  registry (cold):      %8.2f ms\n", cold);
+    printf("  registry (cached):    %8.2f ms\n", warm);
+    printf("  registry (1 replug):  %8.2f ms\n", replug);
+
+    usb_control_exit();
+
+    bench_sweep(latency_us);
+    return 0;
+}
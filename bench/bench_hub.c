@@ -0,0 +1,302 @@
+#include "usb_internal.h"
+#include "usb_hub.h"
+
+// 进程内发布/订阅的分发开销
+//   1. 扇出: 1 ~ 64个订阅者 (BLOCK，深度64)，每个在自己的线程中读取消息 (每64字节读一次)，发布者不限速地发布池缓冲区。
+//      报告 发布的消息/s、投递/s、每次投递的ns (发布者线程)，以及按引用投递相当于的 GB/s；
+//      只算发布者一侧: 同样数量的订阅者 (DROP_OLDEST) 不启动读取线程，每次投递 (过滤、入队、丢弃最旧的) 的ns，不含线程切换；
+//      对照: 每个订阅者复制一份 (memcpy) 的ns
+//   2. 混合订阅者: 落盘 (BLOCK，全部)、显示 (DROP_OLDEST 深度4，每条处理2ms，抽取1/10)、
+//      解码 (只要type 1的帧)、8个报警 (按字节模式过滤)。
+//      和没有显示订阅者时比较发布速率，检查落盘收到全部消息、慢的显示只丢自己的消息
+//
+// 用法: bench_hub [--size=消息字节] [--duration=ms] [--max-subs=N]
+
+#define BENCH_MAX_SUBS 64
+#define BENCH_DEPTH    64
+
+static volatile unsigned char bench_sink;  // 复制的结果不被优化掉
+static const unsigned char alarm_pattern[4] = {0xDE, 0xAD, 0xBE, 0xEF};
+
+typedef struct {
+    usb_hub_sub_t* sub;
+    usb_thread_t thread;
+    unsigned int work_ms;    // 每条消息的处理时间 (模拟慢的订阅者)
+    uint64_t checksum;
+} bench_sub_t;
+
+static void* sub_thread(void* arg) {
+    bench_sub_t* s = (bench_sub_t*)arg;
+    usb_hub_msg_t msg;
+    for (;;) {
+        int r = usb_hub_next(s->sub, &msg, 100);
+        if (r == LIBUSB_ERROR_TIMEOUT) continue;
+        if (r < 0) break;
+        for (int i = 0; i < msg.length; i += 64) {
+            s->checksum += msg.data[i];
+        }
+        if (s->work_ms) usb_sleep_ms(s->work_ms);
+        usb_hub_release(&msg);
+    }
+    return NULL;
+}
+
+// 发布者: 帧头type为 seq%4，每100条在负载中放一次报警模式
+static uint64_t publish_loop(usb_hub_t* hub, usb_pool_t* pool, int size, int duration_ms, uint64_t* busy_ns) {
+    usb_frame_header_t header;
+    uint64_t seq = 0;
+    uint64_t end = usb_time_ns() + (uint64_t)duration_ms * 1000000ull;
+    uint64_t busy = 0;
+
+    memset(&header, 0, sizeof(header));
+    header.sync = USB_FRAME_SYNC;
+    header.length = (uint32_t)(size - USB_FRAME_HEADER_SIZE);
+    while (usb_time_ns() < end) {
+        usb_buffer_t* b = usb_pool_get(pool);
+        if (!b) {
+            usb_thread_yield();
+            continue;
+        }
+        header.type = (uint8_t)(seq & 3);
+        header.seq = (uint32_t)seq;
+        usb_frame_encode_header(&header, b->data);
+        memcpy(b->data + size / 2, seq % 100 == 0 ? alarm_pattern : (const unsigned char*)"\0\0\0\0", 4);
+        b->length = size;
+        b->time_ns = usb_time_ns();
+        uint64_t start = usb_time_ns();
+        usb_hub_publish(hub, b, 0, size);
+        busy += usb_time_ns() - start;
+        usb_buffer_release(b);
+        seq++;
+    }
+    *busy_ns = busy;
+    return seq;
+}
+
+static usb_pool_t* create_pool(int count, int size) {
+    usb_pool_t* pool = usb_pool_create(count, size, 0);
+    if (!pool) return NULL;
+    // 先写一遍所有缓冲区，测量中不计缺页
+    usb_buffer_t** all = (usb_buffer_t**)malloc(sizeof(usb_buffer_t*) * (size_t)count);
+    int n = 0;
+    while (all && n < count && (all[n] = usb_pool_get(pool)) != NULL) {
+        memset(all[n]->data, 0x11, (size_t)all[n]->size);
+        n++;
+    }
+    for (int i = 0; i < n; i++) usb_buffer_release(all[i]);
+    free(all);
+    return pool;
+}
+
+static void start_sub(bench_sub_t* s, usb_hub_t* hub, const usb_hub_sub_config_t* cfg, unsigned int work_ms) {
+    memset(s, 0, sizeof(*s));
+    s->sub = usb_hub_subscribe(hub, cfg);
+    s->work_ms = work_ms;
+    if (s->sub && usb_thread_create(&s->thread, sub_thread, s) != 0) {
+        usb_hub_unsubscribe(s->sub);
+        s->sub = NULL;
+    }
+}
+
+static void stop_subs(usb_hub_t* hub, bench_sub_t* subs, int n) {
+    usb_hub_close(hub);
+    for (int i = 0; i < n; i++) {
+        if (subs[i].sub) usb_thread_join(subs[i].thread);
+    }
+}
+
+static void free_subs(bench_sub_t* subs, int n) {
+    for (int i = 0; i < n; i++) {
+        usb_hub_unsubscribe(subs[i].sub);
+    }
+}
+
+// ---- 扇出 ----
+
+static void bench_fanout(int size, int duration_ms, int max_subs) {
+    static bench_sub_t subs[BENCH_MAX_SUBS];
+    unsigned char* src = (unsigned char*)malloc((size_t)size);
+    unsigned char* dst = (unsigned char*)malloc((size_t)size * 16);
+    double copy_ns = 0;
+
+    // 对照: 复制一份消息 (16个目标轮流，不总在缓存里)
+    if (src && dst) {
+        enum { COPIES = 20000 };
+        memset(src, 0x22, (size_t)size);
+        memset(dst, 0, (size_t)size * 16);
+        uint64_t start = usb_time_ns();
+        for (int i = 0; i < COPIES; i++) {
+            memcpy(dst + (size_t)(i & 15) * (size_t)size, src, (size_t)size);
+        }
+        copy_ns = (double)(usb_time_ns() - start) / COPIES;
+        bench_sink = dst[(size_t)size * 15];
+    }
+    free(src);
+    free(dst);
+
+    printf("Fan-out, %d-byte messages, BLOCK subscribers (depth %d), %d ms each:\n", size, BENCH_DEPTH, duration_ms);
+    printf("%5s %12s %14s %12s %14s %13s %12s\n", "subs", "msgs/s", "deliveries/s", "ns/delivery", "by-ref GB/s",
+           "publish-only", "copy ns/sub");
+    for (int n = 1; n <= max_subs; n *= 2) {
+        usb_hub_sub_config_t cfg;
+        usb_hub_t* hub = usb_hub_create(0, 0);
+        usb_pool_t* pool = create_pool(n * (BENCH_DEPTH + 1) + 4, size);
+        uint64_t busy_ns;
+        usb_hub_stats_t st;
+
+        if (!hub || !pool) {
+            printf("%5d out of memory\n", n);
+            usb_hub_destroy(hub);
+            usb_pool_destroy(pool);
+            return;
+        }
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.depth = BENCH_DEPTH;
+        for (int i = 0; i < n; i++) {
+            start_sub(&subs[i], hub, &cfg, 0);
+        }
+        uint64_t start = usb_time_ns();
+        uint64_t published = publish_loop(hub, pool, size, duration_ms, &busy_ns);
+        double sec = (double)(usb_time_ns() - start) / 1e9;
+        stop_subs(hub, subs, n);
+        usb_hub_get_stats(hub, &st);
+        free_subs(subs, n);
+        usb_hub_destroy(hub);
+
+        // 没有读取线程: 队列满后每次投递丢弃最旧的一条
+        usb_hub_stats_t only;
+        uint64_t only_ns = 0;
+        hub = usb_hub_create(0, 0);
+        cfg.policy = USB_RING_DROP_OLDEST;
+        for (int i = 0; hub && i < n; i++) {
+            subs[i].sub = usb_hub_subscribe(hub, &cfg);
+        }
+        memset(&only, 0, sizeof(only));
+        if (hub) {
+            publish_loop(hub, pool, size, duration_ms / 4 + 1, &only_ns);
+            usb_hub_get_stats(hub, &only);
+            usb_hub_close(hub);
+            free_subs(subs, n);
+            usb_hub_destroy(hub);
+        }
+        usb_pool_destroy(pool);
+
+        printf("%5d %12.0f %14.0f %12.1f %14.2f %13.1f %12.1f\n", n, (double)published / sec, (double)st.deliveries / sec,
+               st.deliveries ? (double)busy_ns / (double)st.deliveries : 0.0, (double)st.deliveries * size / sec / 1e9,
+               only.deliveries ? (double)only_ns / (double)only.deliveries : 0.0, copy_ns);
+    }
+}
+
+// ---- 混合订阅者 ----
+
+enum { MIX_RECORDER, MIX_DECODER, MIX_DISPLAY, MIX_ALARM, MIX_ALARMS = 8, MIX_SUBS = MIX_ALARM + MIX_ALARMS };
+
+static double run_mix(int size, int duration_ms, int with_display, bench_sub_t* subs, usb_hub_sub_stats_t* stats, uint64_t* published) {
+    static const uint8_t decode_types[] = {1};
+    usb_hub_sub_config_t cfg;
+    usb_hub_t* hub = usb_hub_create(0, 0);
+    usb_pool_t* pool = create_pool(MIX_SUBS * (BENCH_DEPTH + 1) + 4, size);
+    uint64_t busy_ns;
+
+    if (!hub || !pool) {
+        usb_hub_destroy(hub);
+        usb_pool_destroy(pool);
+        return 0;
+    }
+    memset(subs, 0, sizeof(bench_sub_t) * MIX_SUBS);
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.name = "recorder";
+    cfg.depth = BENCH_DEPTH;
+    cfg.policy = USB_RING_BLOCK;
+    start_sub(&subs[MIX_RECORDER], hub, &cfg, 0);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.name = "decoder";
+    cfg.depth = BENCH_DEPTH;
+    cfg.policy = USB_RING_DROP_NEWEST;
+    cfg.types = decode_types;
+    cfg.num_types = 1;
+    start_sub(&subs[MIX_DECODER], hub, &cfg, 0);
+
+    if (with_display) {
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.name = "display";
+        cfg.depth = 4;
+        cfg.policy = USB_RING_DROP_OLDEST;
+        cfg.sample_every = 10;
+        start_sub(&subs[MIX_DISPLAY], hub, &cfg, 2);
+    }
+
+    for (int i = 0; i < MIX_ALARMS; i++) {
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.name = "alarm";
+        cfg.depth = BENCH_DEPTH;
+        cfg.policy = USB_RING_DROP_NEWEST;
+        cfg.pattern = alarm_pattern;
+        cfg.pattern_length = sizeof(alarm_pattern);
+        cfg.pattern_offset = USB_HUB_ANYWHERE;
+        start_sub(&subs[MIX_ALARM + i], hub, &cfg, 0);
+    }
+
+    uint64_t start = usb_time_ns();
+    *published = publish_loop(hub, pool, size, duration_ms, &busy_ns);
+    double sec = (double)(usb_time_ns() - start) / 1e9;
+    stop_subs(hub, subs, MIX_SUBS);
+    for (int i = 0; i < MIX_SUBS; i++) {
+        if (subs[i].sub) usb_hub_sub_get_stats(subs[i].sub, &stats[i]);
+        else memset(&stats[i], 0, sizeof(stats[i]));
+    }
+    free_subs(subs, MIX_SUBS);
+    usb_hub_destroy(hub);
+    usb_pool_destroy(pool);
+    return (double)*published / sec;
+}
+
+static void bench_mix(int size, int duration_ms) {
+    static bench_sub_t subs[MIX_SUBS];
+    usb_hub_sub_stats_t stats[MIX_SUBS];
+    uint64_t published;
+
+    printf("\nMixed subscribers, %d-byte messages, %d ms: recorder (BLOCK), decoder (type 1), display (DROP_OLDEST depth 4,\n"
+           "1 in 10, 2 ms per message), %d alarms (pattern anywhere, 1 in 100 messages)\n", size, duration_ms, MIX_ALARMS);
+    double base = run_mix(size, duration_ms, 0, subs, stats, &published);
+    double rate = run_mix(size, duration_ms, 1, subs, stats, &published);
+    printf("%-9s %10s %10s %10s %10s %10s %11s\n", "sub", "matched", "filtered", "received", "dropped", "high-water", "blocked ms");
+    for (int i = 0; i < MIX_ALARM + 1; i++) {
+        const usb_hub_sub_stats_t* st = &stats[i];
+        printf("%-9s %10llu %10llu %10llu %10llu %10d %11.1f\n", st->name, (unsigned long long)st->matched,
+               (unsigned long long)st->filtered, (unsigned long long)st->received, (unsigned long long)st->dropped,
+               st->high_water, (double)st->blocked_ns / 1e6);
+    }
+    printf("Published %llu messages; recorder received %s; display dropped %llu of %llu matched\n",
+           (unsigned long long)published, stats[MIX_RECORDER].received == published ? "all" : "NOT all",
+           (unsigned long long)stats[MIX_DISPLAY].dropped, (unsigned long long)stats[MIX_DISPLAY].matched);
+    printf("Publish rate: %.0f msgs/s without display, %.0f msgs/s with the slow display (%.1f%%)\n", base, rate,
+           base > 0 ? 100.0 * rate / base : 0.0);
+}
+
+int main(int argc, char* argv[]) {
+    int size = 16384;
+    int duration_ms = 1000;
+    int max_subs = BENCH_MAX_SUBS;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--size=", 7) == 0) {
+            size = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--max-subs=", 11) == 0) {
+            max_subs = atoi(argv[i] + 11);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (size < USB_FRAME_HEADER_SIZE + 8) size = 16384;
+    if (duration_ms <= 0) duration_ms = 1000;
+    if (max_subs <= 0 || max_subs > BENCH_MAX_SUBS) max_subs = BENCH_MAX_SUBS;
+
+    bench_fanout(size, duration_ms, max_subs);
+    bench_mix(size, duration_ms);
+    return 0;
+}
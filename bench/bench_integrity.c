@@ -0,0 +1,314 @@
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_reader.h"
+#include "usb_supervisor.h"
+#include "usb_integrity.h"
+
+// 序号检查的开销和丢失归因
+//   1. 热路径: usb_integrity_check 每个序号的 ns，按顺序 / 每1000个有一个缺口 (归因) / 乱序到达
+//   2. 模拟设备上的故障场景，每个场景只注入一种故障，报告各原因的缺失帧数:
+//      clean       无故障，不应有缺失
+//      device      设备FIFO很小、消费者慢，设备端溢出丢弃
+//      transfer    批量传输随机失败，失败传输里的帧丢失
+//      host        读取线程的环形缓冲区很小 (DROP_OLDEST)，消费者慢
+//      disconnect  周期性掉电，受监护的流重新连接 (模拟设备重连后序号从0开始，记为restart)
+//
+// 用法: bench_integrity [--duration=ms] [--frame=负载字节]
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+static int bench_payload = 1000;
+
+static void spin_ns(int ns) {
+    if (ns > 0) {
+        uint64_t end = usb_time_ns() + (uint64_t)ns;
+        while (usb_time_ns() < end) {
+        }
+    }
+}
+
+// ---- 热路径 ----
+
+static double measure_check(const uint32_t* seqs, int n, int rounds) {
+    usb_integrity_t* ig = usb_integrity_create();
+    uint64_t start = usb_time_ns();
+    uint32_t base = 0;
+    int sink = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < n; i++) {
+            sink += usb_integrity_check(ig, base + seqs[i]);
+        }
+        base += seqs[n - 1] + 1;
+    }
+    uint64_t ns = usb_time_ns() - start;
+    usb_integrity_destroy(ig);
+    (void)sink;
+    return (double)ns / ((double)n * rounds);
+}
+
+static void bench_hot_path(void) {
+    enum { N = 100000, ROUNDS = 50 };
+    uint32_t* seqs = (uint32_t*)malloc(sizeof(uint32_t) * N);
+    double r[3];
+
+    for (int i = 0; i < N; i++) seqs[i] = (uint32_t)i;
+    r[0] = measure_check(seqs, N, ROUNDS);
+
+    // 每1000个序号跳过一个
+    uint32_t s = 0;
+    for (int i = 0; i < N; i++) {
+        if (i % 1000 == 999) s++;
+        seqs[i] = s++;
+    }
+    r[1] = measure_check(seqs, N, ROUNDS);
+
+    // 每1000个序号有一对交换
+    for (int i = 0; i < N; i++) seqs[i] = (uint32_t)i;
+    for (int i = 998; i + 1 < N; i += 1000) {
+        seqs[i] = (uint32_t)(i + 1);
+        seqs[i + 1] = (uint32_t)i;
+    }
+    r[2] = measure_check(seqs, N, ROUNDS);
+
+    printf("usb_integrity_check (ns per sequence number):\n");
+    printf("  %-28s %6.2f\n", "in order", r[0]);
+    printf("  %-28s %6.2f\n", "1 gap per 1000", r[1]);
+    printf("  %-28s %6.2f\n", "1 swapped pair per 1000", r[2]);
+    free(seqs);
+}
+
+// ---- 故障场景 ----
+
+typedef struct {
+    const char* name;
+    int expect;                // 应该出现的原因 (usb_loss_cause_t)，clean 为 -1
+    usb_integrity_stats_t stats;
+    uint64_t delivered;        // 交付的帧数
+} scenario_t;
+
+typedef struct {
+    int cost_ns;               // 每帧的处理时间
+    uint64_t frames;
+} frame_ctx_t;
+
+static void on_frame(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data) {
+    frame_ctx_t* c = (frame_ctx_t*)user_data;
+    (void)header;
+    (void)payload;
+    (void)length;
+    c->frames++;
+    spin_ns(c->cost_ns);
+}
+
+static void on_data(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    (void)length;
+    (void)user_data;
+}
+
+static void sim_defaults(usb_sim_config_t* cfg, double mb_per_sec) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->num_devices = 1;
+    cfg->bytes_per_sec = mb_per_sec * 1024 * 1024;
+    cfg->frame_payload = bench_payload;
+    cfg->seed = 1;
+}
+
+// 流式读取 + 拆分器
+static int run_stream(scenario_t* sc, const usb_sim_config_t* sim, int transfers, int cost_ns, int duration_ms) {
+    usb_stream_t* stream;
+    usb_stream_config_t cfg;
+    usb_integrity_t* ig = usb_integrity_create();
+    frame_ctx_t ctx = {cost_ns, 0};
+    int r;
+
+    if ((r = usb_control_init_sim(sim)) < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        usb_integrity_destroy(ig);
+        return r;
+    }
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_transfers = transfers;
+    cfg.transfer_size = 16 * 1024;
+    cfg.splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, bench_payload, on_frame, &ctx);
+    cfg.integrity = ig;
+    r = usb_stream_start(&stream, NULL, &cfg, on_data, &ctx);
+    if (r == 0) {
+        usb_sleep_ms((unsigned int)duration_ms);
+        usb_stream_stop(stream);
+        usb_integrity_get_stats(ig, &sc->stats);
+        sc->delivered = ctx.frames;
+    }
+    usb_frame_splitter_destroy(cfg.splitter);
+    usb_integrity_destroy(ig);
+    USB_CloseDevice();
+    usb_control_exit();
+    return r;
+}
+
+// 读取线程 + 消费者线程中的拆分器
+static int run_reader(scenario_t* sc, const usb_sim_config_t* sim, int slots, int cost_ns, int duration_ms) {
+    usb_reader_t* reader;
+    usb_reader_config_t cfg;
+    usb_integrity_t* ig = usb_integrity_create();
+    usb_frame_splitter_t* sp;
+    frame_ctx_t ctx = {0, 0};
+    unsigned char* data = (unsigned char*)malloc(16 * 1024);
+    int transferred;
+    int r;
+
+    if ((r = usb_control_init_sim(sim)) < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        usb_integrity_destroy(ig);
+        free(data);
+        return r;
+    }
+    sp = usb_frame_splitter_create(USB_SPLIT_HEADER, bench_payload, on_frame, &ctx);
+    usb_frame_set_integrity(sp, ig);
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.stream.num_transfers = 8;
+    cfg.stream.transfer_size = 16 * 1024;
+    cfg.stream.integrity = ig;
+    cfg.ring_slots = slots;
+    cfg.policy = USB_RING_DROP_OLDEST;
+    r = usb_reader_start(&reader, NULL, &cfg);
+    if (r == 0) {
+        uint64_t end = usb_time_ns() + (uint64_t)duration_ms * 1000000ull;
+        while (usb_time_ns() < end) {
+            r = usb_reader_read(reader, data, 16 * 1024, &transferred, 100);
+            if (r == 0) {
+                usb_frame_feed(sp, data, transferred, 1);
+                spin_ns(cost_ns);
+            }
+        }
+        usb_reader_stop(reader);
+        usb_integrity_get_stats(ig, &sc->stats);
+        sc->delivered = ctx.frames;
+        r = 0;
+    }
+    usb_frame_splitter_destroy(sp);
+    usb_integrity_destroy(ig);
+    free(data);
+    USB_CloseDevice();
+    usb_control_exit();
+    return r;
+}
+
+// 受监护的流式读取
+static int run_supervised(scenario_t* sc, const usb_sim_config_t* sim, int duration_ms) {
+    usb_supervisor_t* sup;
+    usb_supervisor_config_t cfg;
+    usb_integrity_t* ig = usb_integrity_create();
+    frame_ctx_t ctx = {0, 0};
+    int r;
+
+    if ((r = usb_control_init_sim(sim)) < 0) {
+        usb_integrity_destroy(ig);
+        return r;
+    }
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.stream.num_transfers = 8;
+    cfg.stream.transfer_size = 16 * 1024;
+    cfg.stream.splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, bench_payload, on_frame, &ctx);
+    cfg.stream.integrity = ig;
+    r = usb_supervisor_start(&sup, NULL, &cfg, on_data, NULL, &ctx);
+    if (r == 0) {
+        usb_sleep_ms((unsigned int)duration_ms);
+        usb_supervisor_stop(sup);
+        usb_integrity_get_stats(ig, &sc->stats);
+        sc->delivered = ctx.frames;
+    }
+    usb_frame_splitter_destroy(cfg.stream.splitter);
+    usb_integrity_destroy(ig);
+    usb_control_exit();
+    return r;
+}
+
+static void print_scenario(const scenario_t* sc) {
+    const usb_integrity_stats_t* st = &sc->stats;
+    uint64_t other = 0;
+    for (int c = 0; c < USB_LOSS_CAUSES; c++) {
+        if (c != sc->expect) other += st->lost_by[c];
+    }
+    const char* verdict = other == 0 && (sc->expect < 0 || st->lost_by[sc->expect] > 0 || st->restarts > 0) ? "ok" : "check";
+    printf("%-11s %9llu %8llu %6llu %8llu %9llu %6llu %10llu %5llu %5llu %8llu  %s\n", sc->name,
+           (unsigned long long)sc->delivered, (unsigned long long)st->lost, (unsigned long long)st->gaps,
+           (unsigned long long)st->lost_by[USB_LOSS_DEVICE], (unsigned long long)st->lost_by[USB_LOSS_TRANSFER],
+           (unsigned long long)st->lost_by[USB_LOSS_HOST], (unsigned long long)st->lost_by[USB_LOSS_DISCONNECT],
+           (unsigned long long)st->duplicates, (unsigned long long)st->reordered, (unsigned long long)st->restarts,
+           verdict);
+}
+
+int main(int argc, char* argv[]) {
+    int duration_ms = 1000;
+    usb_sim_config_t sim;
+    scenario_t sc[5];
+    int r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--frame=", 8) == 0) {
+            bench_payload = atoi(argv[i] + 8);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 1000;
+    if (bench_payload <= 0 || bench_payload > 8192) bench_payload = 1000;
+
+    bench_hot_path();
+
+    memset(sc, 0, sizeof(sc));
+    sc[0].name = "clean";
+    sc[0].expect = -1;
+    sc[1].name = "device";
+    sc[1].expect = USB_LOSS_DEVICE;
+    sc[2].name = "transfer";
+    sc[2].expect = USB_LOSS_TRANSFER;
+    sc[3].name = "host";
+    sc[3].expect = USB_LOSS_HOST;
+    sc[4].name = "disconnect";
+    sc[4].expect = USB_LOSS_DISCONNECT;
+
+    printf("\nFault scenarios, %d-byte payloads, %d ms each (frames):\n", bench_payload, duration_ms);
+    printf("%-11s %9s %8s %6s %8s %9s %6s %10s %5s %5s %8s\n", "scenario", "delivered", "lost", "gaps",
+           "device", "transfer", "host", "disconnect", "dup", "late", "restarts");
+    for (int i = 0; i < COUNT(sc); i++) {
+        switch (i) {
+            case 0:
+                sim_defaults(&sim, 16);
+                r = run_stream(&sc[i], &sim, 8, 0, duration_ms);
+                break;
+            case 1:
+                // 8 MB/s 的设备，消费者每帧200us (约5 MB/s)，FIFO只有16KB
+                sim_defaults(&sim, 8);
+                sim.fifo_bytes = 16 * 1024;
+                r = run_stream(&sc[i], &sim, 1, 200000, duration_ms);
+                break;
+            case 2:
+                // 失败的传输不再提交，挂起足够多的传输让流在测试期间不会结束
+                sim_defaults(&sim, 4);
+                sim.error_rate = 0.002;
+                r = run_stream(&sc[i], &sim, 64, 0, duration_ms);
+                break;
+            case 3:
+                // 消费者每个传输200us，环形缓冲区8槽，满时丢弃最旧的
+                sim_defaults(&sim, 8);
+                r = run_reader(&sc[i], &sim, 8, 200000, duration_ms);
+                break;
+            default:
+                sim_defaults(&sim, 8);
+                sim.dropout_interval_ms = duration_ms / 3 > 0 ? duration_ms / 3 : 1;
+                r = run_supervised(&sc[i], &sim, duration_ms);
+                break;
+        }
+        if (r < 0) {
+            printf("%-11s failed: %s\n", sc[i].name, libusb_error_name(r));
+            continue;
+        }
+        print_scenario(&sc[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include "usb_internal.h"
+#include "usb_frame.h"
+#include "usb_reader.h"
+#include "usb_sim.h"
+
+// 数据到达 -> 交给消费者 的延迟分布
+// 模拟设备按帧发送 (每帧以短包结束，一个传输正好一帧)，负载开头是帧开始产生的设备时间戳，
+// 帧的最后一个字节产生 (传输可以完成) 的主机时间 = usb_sim_device_to_host(时间戳) + 帧长 / 速率，
+// 消费者拿到数据时的 usb_time_ns 减去它就是延迟 (包含主机这一侧的所有等待: 事件线程唤醒、环形缓冲区、消费者唤醒)。
+//   sync           usb_control_read 同步读取 (参考)
+//   reader         独立读取线程，默认模式: 事件线程阻塞等待事件，消费者在条件变量上等待
+//   reader-rt      同上，事件线程使用实时调度
+//   low-latency    事件线程忙轮询、消费者自旋等待 (usb_reader_config_t.low_latency)，
+//                  2个以上CPU时事件线程绑定最后一个CPU，消费者绑定其余CPU
+//   low-latency-rt 同上，事件线程使用实时调度
+// 报告 p50/p99/p99.9/max (us) 和进程CPU占用 (100% = 一个CPU)。
+// 没有实时调度权限时 -rt 两项跳过。单核机器上忙轮询和自旋都改为让出CPU，结果只能说明没有退化。
+//
+// 用法: bench_latency [--rate=MB/s] [--frame=负载字节] [--duration=ms]
+
+#define BENCH_MAX_SAMPLES (1 << 20)
+#define BENCH_TRANSFER    16384
+
+static uint64_t samples[BENCH_MAX_SAMPLES];
+static int num_samples;
+static double bench_rate;       // 字节/秒
+static int bench_frame_bytes;   // 帧头 + 负载
+static int bench_cpus;
+
+typedef struct {
+    const char* name;
+    int reader;        // 0: usb_control_read
+    int low_latency;
+    int realtime;
+} bench_mode_t;
+
+// 一个传输 (一帧) 的延迟，数据不是带时间戳的完整帧时返回0
+static int frame_latency(const unsigned char* data, int length, uint64_t now, uint64_t* latency) {
+    usb_frame_header_t header;
+    uint64_t ts, host;
+
+    if (length != bench_frame_bytes) {
+        return 0;
+    }
+    usb_frame_decode_header(data, &header);
+    if (usb_frame_get_timestamp(&header, data + USB_FRAME_HEADER_SIZE, length - USB_FRAME_HEADER_SIZE, &ts) < 0 ||
+        usb_sim_device_to_host(0, ts, &host) < 0) {
+        return 0;
+    }
+    uint64_t ready = host + (uint64_t)((double)bench_frame_bytes * 1e9 / bench_rate);
+    *latency = now > ready ? now - ready : 0;
+    return 1;
+}
+
+static void add_sample(const unsigned char* data, int length, uint64_t now, uint64_t measure_from) {
+    uint64_t latency;
+    if (now >= measure_from && num_samples < BENCH_MAX_SAMPLES && frame_latency(data, length, now, &latency)) {
+        samples[num_samples++] = latency;
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void* probe_realtime(void* arg) {
+    *(int*)arg = usb_thread_set_realtime(1);
+    return NULL;
+}
+
+// 在临时线程中试一次，不改变主线程的调度
+static int realtime_permitted(void) {
+    usb_thread_t thread;
+    int r = -1;
+    if (usb_thread_create(&thread, probe_realtime, &r) != 0) {
+        return 0;
+    }
+    usb_thread_join(thread);
+    return r == 0;
+}
+
+static uint64_t all_cpus(void) {
+    return bench_cpus >= 64 ? ~0ull : (1ull << bench_cpus) - 1;
+}
+
+static int run_mode(const bench_mode_t* mode, int duration_ms, double* cpu_pct) {
+    usb_sim_config_t sim;
+    usb_reader_t* reader = NULL;
+    unsigned char* data = malloc(BENCH_TRANSFER);
+    int r;
+
+    memset(&sim, 0, sizeof(sim));
+    sim.bytes_per_sec = bench_rate;
+    sim.frame_payload = bench_frame_bytes - USB_FRAME_HEADER_SIZE;
+    sim.timestamps = 1;
+    if (!data) {
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    if ((r = usb_control_init_sim(&sim)) < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        free(data);
+        return r;
+    }
+    if (mode->reader) {
+        usb_reader_config_t cfg;
+        memset(&cfg, 0, sizeof(cfg));
+        cfg.stream.transfer_size = BENCH_TRANSFER;
+        cfg.stream.realtime = mode->realtime;
+        cfg.low_latency = mode->low_latency;
+        if (mode->low_latency && bench_cpus >= 2) {
+            cfg.stream.cpu_mask = 1ull << (bench_cpus - 1);
+            usb_thread_set_affinity(all_cpus() & ~cfg.stream.cpu_mask);
+        }
+        r = usb_reader_start(&reader, NULL, &cfg);
+    }
+    if (r >= 0) {
+        uint64_t start = usb_time_ns();
+        uint64_t measure_from = start + 100000000ull;  // 前100ms是启动时积压的数据，不计入
+        uint64_t end = measure_from + (uint64_t)duration_ms * 1000000ull;
+        uint64_t cpu = 0;
+        int transferred;
+
+        num_samples = 0;
+        for (;;) {
+            uint64_t now = usb_time_ns();
+            if (now >= end) break;
+            if (!cpu && now >= measure_from) {
+                cpu = usb_cpu_time_ns();
+            }
+            if (reader) {
+                r = usb_reader_read(reader, data, BENCH_TRANSFER, &transferred, 100);
+            } else {
+                r = usb_control_read(data, BENCH_TRANSFER, &transferred);
+            }
+            if (r == LIBUSB_ERROR_TIMEOUT) continue;
+            if (r < 0) break;
+            add_sample(data, transferred, usb_time_ns(), measure_from);
+        }
+        *cpu_pct = cpu ? (double)(usb_cpu_time_ns() - cpu) * 100.0 / (double)(usb_time_ns() - measure_from) : 0;
+        if (r == LIBUSB_ERROR_TIMEOUT) r = 0;
+    }
+    if (reader) {
+        usb_reader_stop(reader);
+    }
+    if (mode->low_latency && bench_cpus >= 2) {
+        usb_thread_set_affinity(all_cpus());
+    }
+    USB_CloseDevice();
+    usb_control_exit();
+    free(data);
+    return r < 0 ? r : 0;
+}
+
+int main(int argc, char* argv[]) {
+    static const bench_mode_t modes[] = {
+        {"sync", 0, 0, 0},
+        {"reader", 1, 0, 0},
+        {"reader-rt", 1, 0, 50},
+        {"low-latency", 1, 1, 0},
+        {"low-latency-rt", 1, 1, 50},
+    };
+    double rate_mb = 1.0;
+    int payload = 1000;
+    int duration_ms = 2000;
+    double p50[5] = {0};
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate_mb = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--frame=", 8) == 0) {
+            payload = atoi(argv[i] + 8);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (rate_mb <= 0) rate_mb = 1.0;
+    if (payload < USB_FRAME_TIMESTAMP_SIZE) payload = 1000;
+    if (duration_ms <= 0) duration_ms = 2000;
+    bench_rate = rate_mb * 1024 * 1024;
+    bench_frame_bytes = payload + USB_FRAME_HEADER_SIZE;
+    if (bench_frame_bytes > BENCH_TRANSFER) {
+        printf("Frame too large (max %d bytes)\n", BENCH_TRANSFER - USB_FRAME_HEADER_SIZE);
+        return 1;
+    }
+    bench_cpus = usb_cpu_count();
+    int rt = realtime_permitted();
+
+    printf("Arrival -> consumer latency, %.2f MB/s, %d-byte frames (%.0f frames/s), %d ms, %d CPU(s)%s\n", rate_mb,
+           bench_frame_bytes, bench_rate / bench_frame_bytes, duration_ms, bench_cpus,
+           rt ? "" : ", no real-time privileges");
+    printf("%-15s %8s %9s %9s %9s %9s %8s\n", "mode", "frames", "p50 us", "p99 us", "p99.9 us", "max us", "CPU");
+    for (int i = 0; i < (int)(sizeof(modes) / sizeof(modes[0])); i++) {
+        double cpu_pct = 0;
+        if (modes[i].realtime && !rt) {
+            printf("%-15s %8s\n", modes[i].name, "skipped");
+            continue;
+        }
+        int r = run_mode(&modes[i], duration_ms, &cpu_pct);
+        if (r < 0) {
+            printf("%-15s failed: %s\n", modes[i].name, libusb_error_name(r));
+            continue;
+        }
+        if (num_samples == 0) {
+            printf("%-15s %8s\n", modes[i].name, "no samples");
+            continue;
+        }
+        qsort(samples, (size_t)num_samples, sizeof(uint64_t), compare_u64);
+        p50[i] = samples[num_samples / 2] / 1000.0;
+        printf("%-15s %8d %9.1f %9.1f %9.1f %9.1f %7.1f%%\n", modes[i].name, num_samples, p50[i],
+               samples[(size_t)((double)num_samples * 0.99)] / 1000.0,
+               samples[(size_t)((double)num_samples * 0.999)] / 1000.0, samples[num_samples - 1] / 1000.0, cpu_pct);
+    }
+    if (p50[1] > 0 && p50[3] > 0) {
+        printf("p50 low-latency vs reader: %.2fx\n", p50[1] / p50[3]);
+    }
+    return 0;
+}
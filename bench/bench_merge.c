@@ -0,0 +1,338 @@
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_merge.h"
+
+// 多设备按时间合并的基准
+//   1. 合并吞吐量: N个生产者线程各自按时间顺序加入记录 (时间交错)，消费者取出并检查输出有序，
+//      矩阵: 输入数 1/4/16 x 记录大小，报告 记录/s、MB/s、乱序数
+//   2. 16台模拟设备: 帧带设备时间戳，各设备时钟有不同的偏移和漂移 (±ppm)，每个传输合并多帧并有完成抖动。
+//      分别按主机时间戳和设备时间戳合并，用模拟设备的真实时钟检查:
+//      对齐误差 (合并时间 - 帧的真实产生时间) 各设备均值的差 (设备间偏差) 和每台设备内的抖动，
+//      按真实时间的逆序数 (比已输出的帧早产生100us以上) 和最大逆序量，以及估计的漂移与设定值的误差。
+//      开始的0.5秒 (时钟估计收敛前) 不计入
+//   3. 漂移估计检查: 4台时钟没有漂移的模拟设备运行6秒 (拟合窗口填满)，估计的漂移超过容差时返回1
+//
+// 用法: bench_merge [--duration=ms] [--devices=N] [--rate=每台MB/s] [--ppm=X] [--jitter=us] [--frame=负载字节]
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+#define BENCH_WARMUP_MS    500      // 时钟估计收敛前的记录不计入统计
+#define BENCH_INVERSION_NS 100000   // 只统计超过100us的逆序
+#define BENCH_CHECK_DEVICES 4
+#define BENCH_CHECK_MS      6000
+#define BENCH_CHECK_PPM     15.0     // 见 usb_merge.h 的精度说明
+
+static const int bench_inputs[] = {1, 4, 16};
+static const int bench_sizes[] = {64, 1024, 16 * 1024};
+
+// ---- 1. 合并吞吐量 ----
+
+typedef struct {
+    usb_merge_t* merge;
+    int input;
+    int inputs;
+    int size;
+    int records;
+    uint64_t base_ns;
+} producer_t;
+
+static void* producer_thread(void* arg) {
+    producer_t* p = (producer_t*)arg;
+    unsigned char* data = (unsigned char*)calloc(1, (size_t)p->size);
+    for (int i = 0; i < p->records; i++) {
+        // 所有输入的时间交错: 输入k的第i条记录在 i*inputs + k (us)
+        uint64_t t = p->base_ns + ((uint64_t)i * (uint64_t)p->inputs + (uint64_t)p->input) * 1000ull;
+        memcpy(data, &t, sizeof(t) < (size_t)p->size ? sizeof(t) : (size_t)p->size);
+        usb_merge_push(p->merge, p->input, t, NULL, (uint32_t)i, data, p->size);
+    }
+    usb_merge_close_input(p->merge, p->input);
+    free(data);
+    return NULL;
+}
+
+static void bench_throughput(int duration_ms) {
+    printf("Merge throughput (producer threads -> heap merge -> consumer):\n");
+    printf("%-7s %7s %12s %10s %8s %8s\n", "inputs", "size", "records/s", "MB/s", "late", "unsorted");
+    for (int a = 0; a < COUNT(bench_inputs); a++) {
+        for (int b = 0; b < COUNT(bench_sizes); b++) {
+            int inputs = bench_inputs[a];
+            int size = bench_sizes[b];
+            usb_merge_config_t cfg;
+            memset(&cfg, 0, sizeof(cfg));
+            cfg.inputs = inputs;
+            cfg.max_record = size;
+            usb_merge_t* merge = usb_merge_create(&cfg);
+            if (!merge) {
+                printf("usb_merge_create failed\n");
+                return;
+            }
+
+            // 按记录大小估计一个大约持续duration_ms的记录数
+            int total = (int)((size <= 1024 ? 4000000.0 : 400000.0) * duration_ms / 1000.0);
+            producer_t producers[USB_MERGE_MAX_INPUTS];
+            usb_thread_t threads[USB_MERGE_MAX_INPUTS];
+            uint64_t base = usb_time_ns() + 3600ull * 1000000000ull;  // 远在将来: 不会因为等待超时而强制输出
+            uint64_t start = usb_time_ns();
+            for (int i = 0; i < inputs; i++) {
+                producers[i].merge = merge;
+                producers[i].input = i;
+                producers[i].inputs = inputs;
+                producers[i].size = size;
+                producers[i].records = total / inputs;
+                producers[i].base_ns = base;
+                usb_thread_create(&threads[i], producer_thread, &producers[i]);
+            }
+
+            usb_merge_record_t rec;
+            uint64_t records = 0, bytes = 0, unsorted = 0, last = 0;
+            while (usb_merge_pop(merge, &rec, 1000) == 0) {
+                if (rec.time_ns < last) unsorted++;
+                last = rec.time_ns;
+                records++;
+                bytes += (uint64_t)rec.length;
+            }
+            double sec = (double)(usb_time_ns() - start) / 1e9;
+            for (int i = 0; i < inputs; i++) {
+                usb_thread_join(threads[i]);
+            }
+
+            usb_merge_stats_t st;
+            usb_merge_get_stats(merge, &st);
+            printf("%-7d %7d %12.0f %10.1f %8llu %8llu\n", inputs, size, (double)records / sec,
+                   (double)bytes / sec / (1024.0 * 1024.0), (unsigned long long)st.late, (unsigned long long)unsorted);
+            usb_merge_destroy(merge);
+        }
+    }
+}
+
+// ---- 2. 模拟设备 ----
+
+typedef struct {
+    int index;
+    int use_device_ts;
+    usb_merge_t* merge;
+    usb_frame_splitter_t* splitter;
+} device_ctx_t;
+
+static void on_frame(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data) {
+    device_ctx_t* d = (device_ctx_t*)user_data;
+    uint64_t host_ns = usb_frame_time_ns(d->splitter);
+    if (d->use_device_ts) {
+        usb_merge_push_frame(d->merge, d->index, host_ns, header, payload, length);
+    } else {
+        usb_merge_push(d->merge, d->index, host_ns, NULL, header->seq, payload, length);
+    }
+}
+
+static void on_data(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    (void)length;
+    (void)user_data;
+}
+
+typedef struct {
+    double sum, sum2;
+    uint64_t n;
+} moments_t;
+
+// 不链接libm
+static double bench_sqrt(double v) {
+    double x = v > 1 ? v : 1;
+    for (int i = 0; i < 64; i++) {
+        x = 0.5 * (x + v / x);
+    }
+    return x;
+}
+
+// *drift_err: 按设备时间戳合并时各设备估计漂移与设定值之差的最大绝对值 (ppm)
+static int run_devices(int num_devices, int use_device_ts, int payload, double ppm, int duration_ms, double* drift_err) {
+    device_info_t devices[MAX_DEVICES];
+    usb_device_t* handles[MAX_DEVICES];
+    usb_stream_t* streams[MAX_DEVICES];
+    device_ctx_t ctx[MAX_DEVICES];
+    moments_t err[MAX_DEVICES];
+    usb_merge_config_t cfg;
+    int opened = 0;
+    int r;
+
+    int n = USB_ScanDevice(devices, MAX_DEVICES);
+    if (n < num_devices) {
+        printf("only %d device(s) found\n", n);
+        return -1;
+    }
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.inputs = num_devices;
+    cfg.max_record = payload;
+    cfg.depth = 1024;
+    usb_merge_t* merge = usb_merge_create(&cfg);
+    memset(err, 0, sizeof(err));
+
+    for (opened = 0; opened < num_devices; opened++) {
+        usb_stream_config_t scfg;
+        ctx[opened].index = opened;
+        ctx[opened].use_device_ts = use_device_ts;
+        ctx[opened].merge = merge;
+        ctx[opened].splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, payload, on_frame, &ctx[opened]);
+        memset(&scfg, 0, sizeof(scfg));
+        scfg.num_transfers = 4;
+        scfg.transfer_size = 16 * 1024;
+        scfg.splitter = ctx[opened].splitter;
+        if ((r = USB_OpenDeviceEx(devices[opened].serial, &handles[opened])) < 0) break;
+        if ((r = usb_stream_start(&streams[opened], handles[opened], &scfg, on_data, &ctx[opened])) < 0) {
+            USB_CloseDeviceEx(handles[opened]);
+            break;
+        }
+    }
+
+    uint64_t records = 0, inversions = 0, max_inversion = 0, max_true = 0;
+    if (opened == num_devices) {
+        usb_merge_record_t rec;
+        uint64_t start = usb_time_ns();
+        uint64_t warmup = start + BENCH_WARMUP_MS * 1000000ull;
+        uint64_t end = warmup + (uint64_t)duration_ms * 1000000ull;
+        while (usb_time_ns() < end) {
+            if (usb_merge_pop(merge, &rec, 100) < 0) continue;
+            uint64_t ts, truth;
+            if (rec.length < USB_FRAME_TIMESTAMP_SIZE) continue;
+            // 负载前8字节是设备时间戳 (按主机时间戳合并时也用它检查)
+            memcpy(&ts, rec.data, sizeof(ts));
+            usb_sim_device_to_host(rec.input, ts, &truth);
+            if (truth < max_true) {
+                if (max_true - truth > BENCH_INVERSION_NS && rec.host_ns >= warmup) inversions++;
+                if (max_true - truth > max_inversion && rec.host_ns >= warmup) max_inversion = max_true - truth;
+            } else {
+                max_true = truth;
+            }
+            if (rec.host_ns < warmup) continue;
+            double e = (double)(int64_t)(rec.time_ns - truth);
+            err[rec.input].sum += e;
+            err[rec.input].sum2 += e * e;
+            err[rec.input].n++;
+            records++;
+        }
+    }
+
+    usb_merge_stats_t st;
+    usb_merge_get_stats(merge, &st);
+    for (int i = 0; i < opened; i++) {
+        usb_merge_close_input(merge, i);  // 先关闭输入，阻塞在满输入上的事件线程返回
+    }
+    for (int i = 0; i < opened; i++) {
+        usb_stream_stop(streams[i]);
+        USB_CloseDeviceEx(handles[i]);
+    }
+    for (int i = 0; i < num_devices; i++) {
+        usb_frame_splitter_destroy(ctx[i].splitter);
+    }
+    usb_merge_destroy(merge);
+    if (opened < num_devices) {
+        return -1;
+    }
+
+    // 设备间偏差: 各设备平均误差的范围；抖动: 设备内误差的标准差的最大值
+    double min_mean = 0, max_mean = 0, max_sd = 0, max_drift_err = 0;
+    for (int i = 0; i < num_devices; i++) {
+        if (err[i].n == 0) continue;
+        double mean = err[i].sum / (double)err[i].n;
+        double var = err[i].sum2 / (double)err[i].n - mean * mean;
+        double sd = var > 0 ? bench_sqrt(var) : 0;
+        if (i == 0 || mean < min_mean) min_mean = mean;
+        if (i == 0 || mean > max_mean) max_mean = mean;
+        if (sd > max_sd) max_sd = sd;
+        if (use_device_ts) {
+            double expect = ppm * (i + 1) * (i % 2 ? -1 : 1);
+            double d = st.input[i].drift_ppm - expect;
+            if (d < 0) d = -d;
+            if (d > max_drift_err) max_drift_err = d;
+        }
+    }
+    printf("%-7s %10llu %10.0f %9.1f %9.1f %10llu %10.1f %7llu %8llu ", use_device_ts ? "device" : "host",
+           (unsigned long long)records, (double)records * 1000.0 / duration_ms, (max_mean - min_mean) / 1000.0,
+           max_sd / 1000.0, (unsigned long long)inversions, (double)max_inversion / 1000.0,
+           (unsigned long long)st.late, (unsigned long long)st.forced);
+    *drift_err = max_drift_err;
+    if (use_device_ts) {
+        printf("%10.2f\n", max_drift_err);
+    } else {
+        printf("%10s\n", "-");
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int duration_ms = 2000;
+    int num_devices = MAX_DEVICES;
+    double rate = 2;
+    double ppm = 50;
+    int jitter_us = 500;
+    int payload = 1008;  // 帧长1024，正好是包长的整数倍: 一个传输合并多帧
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--devices=", 10) == 0) {
+            num_devices = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--ppm=", 6) == 0) {
+            ppm = atof(argv[i] + 6);
+        } else if (strncmp(argv[i], "--jitter=", 9) == 0) {
+            jitter_us = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--frame=", 8) == 0) {
+            payload = atoi(argv[i] + 8);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 2000;
+    if (num_devices <= 0 || num_devices > MAX_DEVICES) num_devices = MAX_DEVICES;
+    if (rate <= 0) rate = 2;
+    if (payload < USB_FRAME_TIMESTAMP_SIZE) payload = 1008;
+
+    bench_throughput(duration_ms / 4 > 0 ? duration_ms / 4 : 1);
+
+    usb_sim_config_t sim;
+    memset(&sim, 0, sizeof(sim));
+    sim.num_devices = num_devices;
+    sim.bytes_per_sec = rate * 1024 * 1024;
+    sim.frame_payload = payload;
+    sim.timestamps = 1;
+    sim.clock_ppm = ppm;
+    sim.jitter_us = jitter_us;
+    sim.seed = 1;
+    if (usb_control_init_sim(&sim) < 0) {
+        return 1;
+    }
+
+    printf("\n%d simulated devices, %.1f MB/s each, %d-byte frames, clocks +-%.0f..%.0f ppm, %d us completion jitter, %d ms:\n",
+           num_devices, rate, payload, ppm, ppm * num_devices, jitter_us, duration_ms);
+    printf("%-7s %10s %10s %9s %9s %10s %10s %7s %8s %10s\n", "time", "records", "records/s", "skew us",
+           "jitter us", "inv>100us", "max inv us", "late", "forced", "drift err");
+    double drift_err = 0;
+    for (int use_device_ts = 0; use_device_ts <= 1; use_device_ts++) {
+        if (run_devices(num_devices, use_device_ts, payload, ppm, duration_ms, &drift_err) < 0) {
+            printf("%-7s failed\n", use_device_ts ? "device" : "host");
+        }
+    }
+    usb_control_exit();
+
+    sim.num_devices = BENCH_CHECK_DEVICES;
+    sim.clock_ppm = 0;
+    sim.jitter_us = 500;
+    if (usb_control_init_sim(&sim) < 0) {
+        return 1;
+    }
+    printf("\nDrift check: %d simulated devices, clocks 0 ppm, %d us completion jitter, %d ms:\n", BENCH_CHECK_DEVICES,
+           sim.jitter_us, BENCH_CHECK_MS);
+    printf("%-7s %10s %10s %9s %9s %10s %10s %7s %8s %10s\n", "time", "records", "records/s", "skew us",
+           "jitter us", "inv>100us", "max inv us", "late", "forced", "drift err");
+    int r = run_devices(BENCH_CHECK_DEVICES, 1, payload, 0, BENCH_CHECK_MS, &drift_err);
+    usb_control_exit();
+    if (r < 0 || drift_err > BENCH_CHECK_PPM) {
+        printf("FAILED: drift error %.2f ppm exceeds %.0f ppm\n", drift_err, BENCH_CHECK_PPM);
+        return 1;
+    }
+    printf("OK: drift error %.2f ppm (tolerance %.0f ppm)\n", drift_err, BENCH_CHECK_PPM);
+    return 0;
+}
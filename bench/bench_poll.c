@@ -0,0 +1,279 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_events.h"
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
+
+// 外部事件循环的唤醒延迟基准 (模拟设备)
+//   每台设备一个流、一个挂起的传输，模拟设备固定完成延迟 --latency-us、不限速、无抖动，
+//   所以第k个传输在第k-1个回调之后正好 latency 就绪: 唤醒延迟 = 两次回调的间隔 - latency。
+//   thread: 每个流自己的事件线程 (默认方式)
+//   epoll:  所有流 external_events，主线程一个epoll循环同时监视后端的fd和一个管道 (代表服务自己的socket)，
+//           另一个线程每毫秒往管道写一次时间戳，同时报告管道的唤醒延迟
+//   矩阵: 设备数 1/4/16
+//   报告: 唤醒延迟 p50/p99/max、CPU占用、epoll每次返回处理的传输数
+//
+// 用法: bench_poll [--duration=ms] [--latency-us=N]
+
+#define BENCH_DEVICES     16
+#define BENCH_MAX_SAMPLES (1 << 18)
+
+static const int bench_counts[] = {1, 4, 16};
+
+typedef struct {
+    uint64_t last_ns;
+    uint64_t* samples;
+    int num_samples;
+} bench_device_t;
+
+static bench_device_t bench_devs[BENCH_DEVICES];
+static uint64_t bench_latency_ns;
+static atomic_int bench_measuring;
+
+static void on_stream_data(const unsigned char* data, int length, void* user_data) {
+    bench_device_t* d = (bench_device_t*)user_data;
+    uint64_t now = usb_time_ns();
+    (void)data;
+    (void)length;
+    if (atomic_load_explicit(&bench_measuring, memory_order_relaxed) && d->last_ns && d->num_samples < BENCH_MAX_SAMPLES) {
+        uint64_t gap = now - d->last_ns;
+        d->samples[d->num_samples++] = gap > bench_latency_ns ? gap - bench_latency_ns : 0;
+    }
+    d->last_ns = now;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// 所有设备的样本合并后排序，打印一行
+static void report(const char* mode, int count, uint64_t* merged, int n, double cpu_pct, double per_wakeup) {
+    if (n == 0) {
+        printf("%-7s %7d %10s\n", mode, count, "no samples");
+        return;
+    }
+    qsort(merged, (size_t)n, sizeof(uint64_t), compare_u64);
+    printf("%-7s %7d %10.1f %10.1f %10.1f %8.1f%% ", mode, count, merged[n / 2] / 1000.0,
+           merged[(size_t)((double)n * 0.99)] / 1000.0, merged[n - 1] / 1000.0, cpu_pct);
+    if (per_wakeup > 0) {
+        printf("%12.2f\n", per_wakeup);
+    } else {
+        printf("%12s\n", "-");
+    }
+}
+
+static int merge_samples(uint64_t* merged, int count) {
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        memcpy(merged + n, bench_devs[i].samples, sizeof(uint64_t) * (size_t)bench_devs[i].num_samples);
+        n += bench_devs[i].num_samples;
+    }
+    return n;
+}
+
+static int start_streams(usb_device_t** devices, usb_stream_t** streams, int count, int external) {
+    usb_stream_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_transfers = 1;
+    cfg.transfer_size = 512;
+    cfg.external_events = external;
+    for (int i = 0; i < count; i++) {
+        bench_devs[i].last_ns = 0;
+        bench_devs[i].num_samples = 0;
+        int r = usb_stream_start(&streams[i], devices[i], &cfg, on_stream_data, &bench_devs[i]);
+        if (r < 0) {
+            while (--i >= 0) usb_stream_stop(streams[i]);
+            return r;
+        }
+    }
+    return 0;
+}
+
+static void run_thread(usb_device_t** devices, int count, int duration_ms, uint64_t* merged) {
+    usb_stream_t* streams[BENCH_DEVICES];
+    if (start_streams(devices, streams, count, 0) < 0) return;
+    usb_sleep_ms(50);
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    atomic_store(&bench_measuring, 1);
+    usb_sleep_ms((unsigned int)duration_ms);
+    atomic_store(&bench_measuring, 0);
+    double cpu_pct = (double)(usb_cpu_time_ns() - cpu) * 100.0 / (double)(usb_time_ns() - start);
+    for (int i = 0; i < count; i++) usb_stream_stop(streams[i]);
+    report("thread", count, merged, merge_samples(merged, count), cpu_pct, 0);
+}
+
+#ifdef __linux__
+typedef struct {
+    int fd;
+    atomic_int running;
+} bench_pipe_t;
+
+// 代表服务自己的socket: 每毫秒写一次写入时间
+static void* pipe_writer(void* arg) {
+    bench_pipe_t* p = (bench_pipe_t*)arg;
+    uint64_t next = usb_time_ns();
+    while (atomic_load(&p->running)) {
+        next += 1000000;
+        usb_sleep_until_ns(next);
+        uint64_t now = usb_time_ns();
+        if (write(p->fd, &now, sizeof(now)) != (ssize_t)sizeof(now)) break;
+    }
+    return NULL;
+}
+
+static void run_epoll(usb_device_t** devices, int count, int duration_ms, uint64_t* merged) {
+    usb_stream_t* streams[BENCH_DEVICES];
+    struct libusb_pollfd fds[8];
+    struct epoll_event ev, events[16];
+    int pipefd[2];
+    bench_pipe_t writer;
+    usb_thread_t thread;
+    static uint64_t pipe_samples[BENCH_MAX_SAMPLES];
+    int num_pipe = 0;
+
+    int n = usb_control_get_pollfds(fds, 8);
+    if (n < 0) {
+        printf("epoll: %s\n", libusb_error_name(n));
+        return;
+    }
+    int ep = epoll_create1(0);
+    if (ep < 0 || pipe(pipefd) != 0) return;
+    for (int i = 0; i < n; i++) {
+        ev.events = EPOLLIN;
+        ev.data.fd = fds[i].fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, fds[i].fd, &ev);
+    }
+    ev.events = EPOLLIN;
+    ev.data.fd = pipefd[0];
+    epoll_ctl(ep, EPOLL_CTL_ADD, pipefd[0], &ev);
+
+    if (start_streams(devices, streams, count, 1) < 0) {
+        close(ep);
+        return;
+    }
+    writer.fd = pipefd[1];
+    atomic_store(&writer.running, 1);
+    usb_thread_create(&thread, pipe_writer, &writer);
+
+    uint64_t wakeups = 0, transfers = 0, cpu = 0, start = 0;
+    uint64_t warmup_end = usb_time_ns() + 50000000ull;
+    uint64_t end = warmup_end + (uint64_t)duration_ms * 1000000ull;
+    for (;;) {
+        uint64_t now = usb_time_ns();
+        if (now >= end) break;
+        if (!start && now >= warmup_end) {
+            start = now;
+            cpu = usb_cpu_time_ns();
+            atomic_store(&bench_measuring, 1);
+        }
+        int k = epoll_wait(ep, events, 16, usb_control_get_next_timeout());
+        int usb_ready = 0;
+        for (int i = 0; i < k; i++) {
+            if (events[i].data.fd == pipefd[0]) {
+                uint64_t sent;
+                uint64_t got = usb_time_ns();
+                while (read(pipefd[0], &sent, sizeof(sent)) == (ssize_t)sizeof(sent)) {
+                    if (start && num_pipe < BENCH_MAX_SAMPLES) pipe_samples[num_pipe++] = got - sent;
+                    break;
+                }
+            } else {
+                usb_ready = 1;
+            }
+        }
+        if (usb_ready || k == 0) {
+            uint64_t before = 0;
+            for (int i = 0; i < count; i++) before += (uint64_t)bench_devs[i].num_samples;
+            usb_control_process_events();
+            if (start) {
+                uint64_t after = 0;
+                for (int i = 0; i < count; i++) after += (uint64_t)bench_devs[i].num_samples;
+                transfers += after - before;
+                wakeups++;
+            }
+        }
+    }
+    atomic_store(&bench_measuring, 0);
+    double cpu_pct = (double)(usb_cpu_time_ns() - cpu) * 100.0 / (double)(usb_time_ns() - start);
+
+    atomic_store(&writer.running, 0);
+    usb_thread_join(thread);
+    for (int i = 0; i < count; i++) usb_stream_stop(streams[i]);
+    report("epoll", count, merged, merge_samples(merged, count), cpu_pct,
+           wakeups ? (double)transfers / (double)wakeups : 0);
+    if (num_pipe > 0) {
+        qsort(pipe_samples, (size_t)num_pipe, sizeof(uint64_t), compare_u64);
+        printf("  pipe  %7s %10.1f %10.1f %10.1f\n", "", pipe_samples[num_pipe / 2] / 1000.0,
+               pipe_samples[(size_t)((double)num_pipe * 0.99)] / 1000.0, pipe_samples[num_pipe - 1] / 1000.0);
+    }
+    close(pipefd[0]);
+    close(pipefd[1]);
+    close(ep);
+}
+#endif
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int main(int argc, char* argv[]) {
+    int duration_ms = 1000;
+    int latency_us = 1000;
+    usb_sim_config_t sim_cfg;
+    device_info_t infos[MAX_DEVICES];
+    usb_device_t* devices[BENCH_DEVICES];
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--latency-us=", 13) == 0) {
+            latency_us = atoi(argv[i] + 13);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 1000;
+    if (latency_us <= 0) latency_us = 1000;
+    bench_latency_ns = (uint64_t)latency_us * 1000ull;
+
+    memset(&sim_cfg, 0, sizeof(sim_cfg));
+    sim_cfg.num_devices = BENCH_DEVICES;
+    sim_cfg.latency_us = latency_us;
+    if (usb_control_init_sim(&sim_cfg) < 0) return 1;
+    int found = USB_ScanDevice(infos, MAX_DEVICES);
+    if (found < BENCH_DEVICES) {
+        usb_control_exit();
+        return 1;
+    }
+    for (int i = 0; i < BENCH_DEVICES; i++) {
+        bench_devs[i].samples = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_MAX_SAMPLES);
+        if (!bench_devs[i].samples || USB_OpenDeviceEx(infos[i].serial, &devices[i]) < 0) {
+            usb_control_exit();
+            return 1;
+        }
+    }
+    uint64_t* merged = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_MAX_SAMPLES * BENCH_DEVICES);
+    if (!merged) return 1;
+
+    printf("\nsim latency=%d us, 1 transfer in flight per device, duration=%d ms\n", latency_us, duration_ms);
+    printf("%-7s %7s %10s %10s %10s %9s %12s\n", "mode", "devices", "p50 us", "p99 us", "max us", "cpu", "xfers/wakeup");
+    for (int c = 0; c < COUNT(bench_counts); c++) {
+        run_thread(devices, bench_counts[c], duration_ms, merged);
+#ifdef __linux__
+        run_epoll(devices, bench_counts[c], duration_ms, merged);
+#else
+        printf("epoll   %7d (needs Linux)\n", bench_counts[c]);
+#endif
+    }
+
+    for (int i = 0; i < BENCH_DEVICES; i++) {
+        USB_CloseDeviceEx(devices[i]);
+        free(bench_devs[i].samples);
+    }
+    free(merged);
+    usb_control_exit();
+    return 0;
+}
@@ -0,0 +1,260 @@
+#include <stdatomic.h>
+#include <errno.h>
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_ring.h"
+#include "usb_pool.h"
+
+// 传输缓冲区池基准
+//   get/release: 单线程取还一次的开销
+//   stream: 流式读取 -> 消费者线程，比较两种交接方式
+//     malloc - 回调里malloc一份副本交给消费者，消费者free (原来的做法)
+//     pool   - 回调里对池缓冲区加引用交给消费者，消费者release (零拷贝)
+//   报告: MB/s、每MB的CPU时间、稳态时的堆分配次数、池耗尽次数
+// 稳态 = 预热之后的测量窗口；池模式下应为0次堆分配。
+//
+// 用法: bench_pool [--backend=sim|null] [--rate=MB/s] [--duration=ms]
+// 堆分配通过替换 malloc/calloc/realloc/posix_memalign 计数 (仅glibc)。
+
+#if defined(__GLIBC__)
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+
+static atomic_uint_least64_t bench_allocs;
+
+void* malloc(size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    *ptr = __libc_memalign(alignment, size);
+    return *ptr ? 0 : ENOMEM;
+}
+
+#define ALLOC_COUNT() atomic_load(&bench_allocs)
+#define ALLOC_COUNTED 1
+#else
+#define ALLOC_COUNT() 0
+#define ALLOC_COUNTED 0
+#endif
+
+#define BENCH_WARMUP_MS 100
+#define BENCH_QUEUE     256
+
+static const int bench_sizes[] = {4096, 64 * 1024, 1024 * 1024};
+
+// 交给消费者的一项: 池缓冲区或malloc的副本
+typedef struct {
+    usb_buffer_t* buffer;
+    unsigned char* copy;
+    int length;
+} bench_item_t;
+
+typedef struct {
+    usb_ring_t* queue;
+    atomic_int running;
+    uint64_t bytes;
+    uint64_t checksum;
+} bench_consumer_t;
+
+static void* consumer_thread(void* arg) {
+    bench_consumer_t* c = (bench_consumer_t*)arg;
+    bench_item_t item;
+    while (atomic_load(&c->running)) {
+        if (usb_ring_pop(c->queue, (unsigned char*)&item, sizeof(item), 10) != (int)sizeof(item)) {
+            continue;
+        }
+        const unsigned char* data = item.buffer ? item.buffer->data : item.copy;
+        c->checksum += data[0] + data[item.length - 1];  // 确实读取了数据
+        c->bytes += (uint64_t)item.length;
+        if (item.buffer) {
+            usb_buffer_release(item.buffer);
+        } else {
+            free(item.copy);
+        }
+    }
+    return NULL;
+}
+
+// malloc模式: 数据回调复制一份
+static void on_stream_data(const unsigned char* data, int length, void* user_data) {
+    bench_consumer_t* c = (bench_consumer_t*)user_data;
+    bench_item_t item = {NULL, (unsigned char*)malloc((size_t)length), length};
+    if (!item.copy) return;
+    memcpy(item.copy, data, (size_t)length);
+    if (usb_ring_push(c->queue, (const unsigned char*)&item, sizeof(item)) != 0) {
+        free(item.copy);
+    }
+}
+
+// 池模式: 缓冲区回调加一个引用
+static void on_stream_buffer(usb_buffer_t* buffer, void* user_data) {
+    bench_consumer_t* c = (bench_consumer_t*)user_data;
+    bench_item_t item = {buffer, NULL, buffer->length};
+    usb_buffer_ref(buffer);
+    if (usb_ring_push(c->queue, (const unsigned char*)&item, sizeof(item)) != 0) {
+        usb_buffer_release(buffer);
+    }
+}
+
+static void run_get_release(void) {
+    usb_pool_t* pool = usb_pool_create(64, 4096, 0);
+    const int n = 10000000;
+    if (!pool) return;
+    uint64_t start = usb_time_ns();
+    for (int i = 0; i < n; i++) {
+        usb_buffer_t* b = usb_pool_get(pool);
+        usb_buffer_release(b);
+    }
+    double pool_ns = (double)(usb_time_ns() - start) / n;
+
+    start = usb_time_ns();
+    for (int i = 0; i < n; i++) {
+        void* p = malloc(4096);
+        ((volatile unsigned char*)p)[0] = 0;
+        free(p);
+    }
+    double malloc_ns = (double)(usb_time_ns() - start) / n;
+    printf("get+release %.1f ns, malloc+free(4096) %.1f ns\n", pool_ns, malloc_ns);
+    usb_pool_destroy(pool);
+}
+
+static int run_stream(const char* mode, int size, int duration_ms) {
+    bench_consumer_t c;
+    usb_stream_t* stream;
+    usb_stream_config_t cfg;
+    usb_stream_stats_t stats;
+    usb_pool_t* pool = NULL;
+    int use_pool = strcmp(mode, "pool") == 0;
+
+    memset(&c, 0, sizeof(c));
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.num_transfers = 8;
+    cfg.transfer_size = size;
+    c.queue = usb_ring_create(BENCH_QUEUE, sizeof(bench_item_t), USB_RING_DROP_NEWEST);
+    if (use_pool) {
+        // 挂起的传输 + 队列中的 + 消费者正在处理的
+        pool = usb_pool_create(cfg.num_transfers + BENCH_QUEUE + 8, size, 0);
+        cfg.pool = pool;
+        cfg.buffer_cb = on_stream_buffer;
+    }
+    if (!c.queue || (use_pool && !pool)) return LIBUSB_ERROR_NO_MEM;
+
+    usb_thread_t thread;
+    atomic_store(&c.running, 1);
+    usb_thread_create(&thread, consumer_thread, &c);
+    int r = usb_stream_start(&stream, NULL, &cfg, use_pool ? NULL : on_stream_data, &c);
+    if (r < 0) {
+        atomic_store(&c.running, 0);
+        usb_thread_join(thread);
+        return r;
+    }
+
+    usb_sleep_ms(BENCH_WARMUP_MS);
+    uint64_t allocs = ALLOC_COUNT();
+    uint64_t bytes = c.bytes;
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    usb_sleep_ms((unsigned int)duration_ms);
+    uint64_t wall = usb_time_ns() - start;
+    uint64_t cpu_used = usb_cpu_time_ns() - cpu;
+    allocs = ALLOC_COUNT() - allocs;
+    bytes = c.bytes - bytes;
+
+    usb_stream_get_stats(stream, &stats);
+    usb_stream_stop(stream);
+    atomic_store(&c.running, 0);
+    usb_thread_join(thread);
+
+    usb_pool_stats_t pool_stats;
+    memset(&pool_stats, 0, sizeof(pool_stats));
+    if (pool) {
+        // 消费者退出后队列里剩下的引用
+        bench_item_t item;
+        while (usb_ring_pop(c.queue, (unsigned char*)&item, sizeof(item), 0) == (int)sizeof(item)) {
+            usb_buffer_release(item.buffer);
+        }
+        usb_pool_get_stats(pool, &pool_stats);
+        usb_pool_destroy(pool);
+    }
+    usb_ring_destroy(c.queue);
+
+    double mb = (double)bytes / (1024.0 * 1024.0);
+    printf("%-7s %8d %10.2f %9.3f %10llu %9llu %9llu\n", mode, size, mb / ((double)wall / 1e9),
+           mb > 0 ? (double)cpu_used / 1e6 / mb : 0, (unsigned long long)allocs,
+           (unsigned long long)pool_stats.exhausted, (unsigned long long)stats.pool_waits);
+    return 0;
+}
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int main(int argc, char* argv[]) {
+    const char* backend = "sim";
+    double rate = 0;
+    int duration_ms = 500;
+    usb_sim_config_t sim_cfg;
+    int r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--backend=", 10) == 0) {
+            backend = argv[i] + 10;
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 500;
+
+    if (strcmp(backend, "null") == 0) {
+        r = usb_control_init_null();
+    } else if (strcmp(backend, "sim") == 0) {
+        memset(&sim_cfg, 0, sizeof(sim_cfg));
+        sim_cfg.num_devices = 1;
+        sim_cfg.bytes_per_sec = rate * 1024 * 1024;
+        r = usb_control_init_sim(&sim_cfg);
+    } else {
+        printf("Unknown backend: %s\n", backend);
+        return 1;
+    }
+    if (r < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        return 1;
+    }
+
+    printf("\nbackend=%s duration=%d ms%s\n", backend, duration_ms,
+           ALLOC_COUNTED ? "" : " (heap allocation counting needs glibc)");
+    run_get_release();
+    printf("%-7s %8s %10s %9s %10s %9s %9s\n", "mode", "size", "MB/s", "cpu ms/MB", "heap allocs", "exhausted", "waits");
+
+    static const char* modes[] = {"malloc", "pool"};
+    for (int s = 0; s < COUNT(bench_sizes); s++) {
+        for (int m = 0; m < COUNT(modes); m++) {
+            r = run_stream(modes[m], bench_sizes[s], duration_ms);
+            if (r < 0) {
+                printf("%s size %d failed: %s\n", modes[m], bench_sizes[s], libusb_error_name(r));
+            }
+        }
+    }
+
+    USB_CloseDevice();
+    usb_control_exit();
+    return 0;
+}
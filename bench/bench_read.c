@@ -0,0 +1,397 @@
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_reader.h"
+
+// 读取路径的吞吐量和延迟基准
+//   读取方式: sync (usb_control_read) / stream (回调) / reader (读取线程+环形缓冲)
+//   矩阵: 传输大小 x 挂起传输数 x 消费者开销(每个传输的处理时间)
+//   报告: MB/s, 传输/s, 每MB的CPU时间, 单个传输 提交->完成 延迟的 p50/p99/p99.9
+// 延迟通过包装当前后端的 bulk_transfer / submit_transfer 测量，库本身不需要改动。
+//
+// 用法: bench_read [--backend=sim|null] [--rate=MB/s] [--duration=ms] [--quick]
+//                  [--no-stats] [--json=FILE] [--csv=FILE]
+// --no-stats 关闭库内的延迟统计 (usb_stats)，与默认结果对比得到统计本身的开销
+// 默认使用不限速的模拟设备，测量主机端开销 + 数据填充。
+
+#define BENCH_MAX_SLOTS   64
+#define BENCH_MAX_SAMPLES (1 << 20)
+
+static const int bench_sizes[] = {64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+static const int bench_depths[] = {1, 4, 16};
+static const int bench_costs[] = {0, 10000};  // ns
+
+typedef struct {
+    const char* mode;
+    int size;
+    int depth;
+    int cost_ns;
+    uint64_t bytes;
+    uint64_t transfers;
+    uint64_t errors;
+    double mb_per_sec;
+    double transfers_per_sec;
+    double cpu_ms_per_mb;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+} bench_result_t;
+
+// ---- 延迟测量: 包装后端 ----
+
+typedef struct {
+    struct libusb_transfer* transfer;
+    libusb_transfer_cb_fn callback;
+    uint64_t submit_ns;
+} bench_slot_t;
+
+static const usb_transport_t* bench_base;
+static usb_transport_t bench_transport;
+static bench_slot_t bench_slots[BENCH_MAX_SLOTS];
+static uint64_t* bench_samples;
+static int bench_num_samples;  // 同一时间只有一个线程记录 (调用者或事件线程)
+
+static void bench_record(uint64_t ns) {
+    if (bench_num_samples < BENCH_MAX_SAMPLES) {
+        bench_samples[bench_num_samples++] = ns;
+    }
+}
+
+static bench_slot_t* bench_slot(struct libusb_transfer* transfer) {
+    for (int i = 0; i < BENCH_MAX_SLOTS; i++) {
+        if (bench_slots[i].transfer == transfer) return &bench_slots[i];
+    }
+    for (int i = 0; i < BENCH_MAX_SLOTS; i++) {
+        if (!bench_slots[i].transfer) {
+            bench_slots[i].transfer = transfer;
+            return &bench_slots[i];
+        }
+    }
+    return NULL;
+}
+
+static void bench_transfer_cb(struct libusb_transfer* transfer) {
+    bench_slot_t* slot = bench_slot(transfer);
+    if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+        bench_record(usb_time_ns() - slot->submit_ns);
+    }
+    slot->callback(transfer);
+}
+
+static int bench_submit_transfer(struct libusb_transfer* transfer) {
+    bench_slot_t* slot = bench_slot(transfer);
+    if (!slot) {
+        return bench_base->submit_transfer(transfer);
+    }
+    if (transfer->callback != bench_transfer_cb) {
+        slot->callback = transfer->callback;
+        transfer->callback = bench_transfer_cb;
+    }
+    slot->submit_ns = usb_time_ns();
+    return bench_base->submit_transfer(transfer);
+}
+
+static int bench_bulk_transfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data, int length, int* transferred, unsigned int timeout) {
+    uint64_t start = usb_time_ns();
+    int r = bench_base->bulk_transfer(handle, endpoint, data, length, transferred, timeout);
+    if (r == 0 && endpoint == 0x81) {
+        bench_record(usb_time_ns() - start);
+    }
+    return r;
+}
+
+static void bench_reset(void) {
+    memset(bench_slots, 0, sizeof(bench_slots));
+    bench_num_samples = 0;
+}
+
+// ---- 消费者 ----
+
+static void consume(int cost_ns) {
+    if (cost_ns > 0) {
+        uint64_t end = usb_time_ns() + (uint64_t)cost_ns;
+        while (usb_time_ns() < end) {
+        }
+    }
+}
+
+typedef struct {
+    int cost_ns;
+} stream_ctx_t;
+
+static void on_stream_data(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    (void)length;
+    consume(((stream_ctx_t*)user_data)->cost_ns);
+}
+
+// ---- 单个测试点 ----
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(double p) {
+    if (bench_num_samples == 0) return 0;
+    int i = (int)(p * (double)(bench_num_samples - 1) + 0.5);
+    return (double)bench_samples[i] / 1000.0;
+}
+
+static void finish(bench_result_t* res, uint64_t wall_ns, uint64_t cpu_ns) {
+    double mb = (double)res->bytes / (1024.0 * 1024.0);
+    double sec = (double)wall_ns / 1e9;
+    res->mb_per_sec = mb / sec;
+    res->transfers_per_sec = (double)res->transfers / sec;
+    res->cpu_ms_per_mb = mb > 0 ? (double)cpu_ns / 1e6 / mb : 0;
+
+    qsort(bench_samples, (size_t)bench_num_samples, sizeof(uint64_t), cmp_u64);
+    res->p50_us = percentile_us(0.50);
+    res->p99_us = percentile_us(0.99);
+    res->p999_us = percentile_us(0.999);
+}
+
+static int run_sync(bench_result_t* res, unsigned char* buffer, int duration_ms) {
+    int transferred;
+    bench_reset();
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now;
+    do {
+        int r = usb_control_read(buffer, res->size, &transferred);
+        if (r == 0) {
+            res->bytes += (uint64_t)transferred;
+            res->transfers++;
+            consume(res->cost_ns);
+        } else {
+            res->errors++;
+            if (r == LIBUSB_ERROR_NO_DEVICE) return r;
+        }
+        now = usb_time_ns();
+    } while (now < end);
+    finish(res, now - start, usb_cpu_time_ns() - cpu);
+    return 0;
+}
+
+static int run_stream(bench_result_t* res, int duration_ms) {
+    usb_stream_t* stream;
+    usb_stream_stats_t stats;
+    usb_stream_config_t cfg = {res->depth, res->size, 0};
+    stream_ctx_t ctx = {res->cost_ns};
+
+    bench_reset();
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    int r = usb_stream_start(&stream, NULL, &cfg, on_stream_data, &ctx);
+    if (r < 0) return r;
+    usb_sleep_ms((unsigned int)duration_ms);
+    usb_stream_get_stats(stream, &stats);
+    uint64_t wall = usb_time_ns() - start;
+    uint64_t cpu_used = usb_cpu_time_ns() - cpu;
+    usb_stream_stop(stream);
+
+    res->bytes = stats.bytes;
+    res->transfers = stats.transfers;
+    res->errors = stats.errors;
+    finish(res, wall, cpu_used);
+    return 0;
+}
+
+static int run_reader(bench_result_t* res, int duration_ms) {
+    usb_reader_t* reader;
+    usb_reader_config_t cfg;
+    usb_stream_stats_t stats;
+    const unsigned char* data;
+    int transferred;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.stream.num_transfers = res->depth;
+    cfg.stream.transfer_size = res->size;
+    cfg.ring_slots = (16 * 1024 * 1024) / res->size;  // 环形缓冲区最多16MB
+    if (cfg.ring_slots < 8) cfg.ring_slots = 8;
+    if (cfg.ring_slots > USB_READER_DEFAULT_SLOTS) cfg.ring_slots = USB_READER_DEFAULT_SLOTS;
+    cfg.policy = USB_RING_BLOCK;
+
+    bench_reset();
+    uint64_t cpu = usb_cpu_time_ns();
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    int r = usb_reader_start(&reader, NULL, &cfg);
+    if (r < 0) return r;
+    while (usb_time_ns() < end) {
+        if (usb_reader_peek(reader, &data, &transferred, 10) == 0) {
+            consume(res->cost_ns);
+            usb_reader_release(reader);
+            res->bytes += (uint64_t)transferred;  // 按消费者实际取走的数据计算
+            res->transfers++;
+        }
+    }
+    usb_reader_get_stats(reader, &stats, NULL);
+    uint64_t wall = usb_time_ns() - start;
+    uint64_t cpu_used = usb_cpu_time_ns() - cpu;
+    usb_reader_stop(reader);
+
+    res->errors = stats.errors;
+    finish(res, wall, cpu_used);
+    return 0;
+}
+
+// ---- 输出 ----
+
+static void print_result(const bench_result_t* r) {
+    printf("%-7s %8d %5d %7d %10.2f %11.0f %9.3f %9.1f %9.1f %9.1f\n",
+           r->mode, r->size, r->depth, r->cost_ns, r->mb_per_sec, r->transfers_per_sec,
+           r->cpu_ms_per_mb, r->p50_us, r->p99_us, r->p999_us);
+}
+
+static void write_json(const char* path, const char* backend, double rate, int duration_ms,
+                       const bench_result_t* results, int n) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("Cannot write %s\n", path);
+        return;
+    }
+    fprintf(f, "{\n  \"backend\": \"%s\",\n  \"rate_mb_per_sec\": %.2f,\n  \"duration_ms\": %d,\n  \"results\": [\n",
+            backend, rate, duration_ms);
+    for (int i = 0; i < n; i++) {
+        const bench_result_t* r = &results[i];
+        fprintf(f, "    {\"mode\": \"%s\", \"size\": %d, \"depth\": %d, \"cost_ns\": %d, "
+                   "\"bytes\": %llu, \"transfers\": %llu, \"errors\": %llu, "
+                   "\"mb_per_sec\": %.3f, \"transfers_per_sec\": %.1f, \"cpu_ms_per_mb\": %.4f, "
+                   "\"p50_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f}%s\n",
+                r->mode, r->size, r->depth, r->cost_ns,
+                (unsigned long long)r->bytes, (unsigned long long)r->transfers, (unsigned long long)r->errors,
+                r->mb_per_sec, r->transfers_per_sec, r->cpu_ms_per_mb,
+                r->p50_us, r->p99_us, r->p999_us, i + 1 < n ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+}
+
+static void write_csv(const char* path, const bench_result_t* results, int n) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("Cannot write %s\n", path);
+        return;
+    }
+    fprintf(f, "mode,size,depth,cost_ns,bytes,transfers,errors,mb_per_sec,transfers_per_sec,cpu_ms_per_mb,p50_us,p99_us,p999_us\n");
+    for (int i = 0; i < n; i++) {
+        const bench_result_t* r = &results[i];
+        fprintf(f, "%s,%d,%d,%d,%llu,%llu,%llu,%.3f,%.1f,%.4f,%.2f,%.2f,%.2f\n",
+                r->mode, r->size, r->depth, r->cost_ns,
+                (unsigned long long)r->bytes, (unsigned long long)r->transfers, (unsigned long long)r->errors,
+                r->mb_per_sec, r->transfers_per_sec, r->cpu_ms_per_mb, r->p50_us, r->p99_us, r->p999_us);
+    }
+    fclose(f);
+}
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+int main(int argc, char* argv[]) {
+    const char* backend = "sim";
+    const char* json_path = NULL;
+    const char* csv_path = NULL;
+    double rate = 0;
+    int duration_ms = 200;
+    int quick = 0;
+    usb_sim_config_t sim_cfg;
+    int r;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--backend=", 10) == 0) {
+            backend = argv[i] + 10;
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "--no-stats") == 0) {
+            usb_stats_set_enabled(0);
+        } else if (strncmp(argv[i], "--json=", 7) == 0) {
+            json_path = argv[i] + 7;
+        } else if (strncmp(argv[i], "--csv=", 6) == 0) {
+            csv_path = argv[i] + 6;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 200;
+
+    // 用包装表替换后端，记录每个传输的延迟
+    if (strcmp(backend, "null") == 0) {
+        bench_base = &usb_transport_null;
+    } else if (strcmp(backend, "sim") == 0) {
+        memset(&sim_cfg, 0, sizeof(sim_cfg));
+        sim_cfg.num_devices = 1;
+        sim_cfg.bytes_per_sec = rate * 1024 * 1024;
+        usb_sim_setup(&sim_cfg);
+        bench_base = &usb_transport_sim;
+    } else {
+        printf("Unknown backend: %s\n", backend);
+        return 1;
+    }
+    bench_transport = *bench_base;
+    bench_transport.submit_transfer = bench_submit_transfer;
+    bench_transport.bulk_transfer = bench_bulk_transfer;
+
+    bench_samples = (uint64_t*)malloc(BENCH_MAX_SAMPLES * sizeof(uint64_t));
+    unsigned char* buffer = (unsigned char*)malloc(1024 * 1024);
+    bench_result_t* results = (bench_result_t*)calloc(256, sizeof(bench_result_t));
+    if (!bench_samples || !buffer || !results) {
+        return 1;
+    }
+
+    r = usb_control_init_transport(&bench_transport);
+    if (r < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        return 1;
+    }
+
+    if (rate > 0) {
+        printf("\nbackend=%s rate=%.1f MB/s duration=%d ms\n", backend, rate, duration_ms);
+    } else {
+        printf("\nbackend=%s rate=unlimited duration=%d ms\n", backend, duration_ms);
+    }
+    printf("%-7s %8s %5s %7s %10s %11s %9s %9s %9s %9s\n",
+           "mode", "size", "depth", "cost_ns", "MB/s", "xfers/s", "cpu ms/MB", "p50 us", "p99 us", "p99.9 us");
+
+    static const char* modes[] = {"sync", "stream", "reader"};
+    int n = 0;
+    for (int m = 0; m < COUNT(modes); m++) {
+        for (int s = 0; s < COUNT(bench_sizes); s++) {
+            if (quick && (s % 2)) continue;
+            for (int d = 0; d < COUNT(bench_depths); d++) {
+                if (m == 0 && d > 0) break;  // 同步读取没有挂起深度
+                if (quick && d == 1) continue;
+                for (int c = 0; c < COUNT(bench_costs); c++) {
+                    bench_result_t* res = &results[n];
+                    res->mode = modes[m];
+                    res->size = bench_sizes[s];
+                    res->depth = bench_depths[d];
+                    res->cost_ns = bench_costs[c];
+                    if (m == 0) r = run_sync(res, buffer, duration_ms);
+                    else if (m == 1) r = run_stream(res, duration_ms);
+                    else r = run_reader(res, duration_ms);
+                    if (r < 0) {
+                        printf("%s size %d failed: %s\n", res->mode, res->size, libusb_error_name(r));
+                        continue;
+                    }
+                    print_result(res);
+                    n++;
+                }
+            }
+        }
+    }
+
+    if (json_path) write_json(json_path, backend, rate, duration_ms, results, n);
+    if (csv_path) write_csv(csv_path, results, n);
+
+    USB_CloseDevice();
+    usb_control_exit();
+    free(results);
+    free(buffer);
+    free(bench_samples);
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_capture.h"
+#include "usb_replay.h"
+
+// 采集文件读取和回放的基准
+//   先写一个 --size MB 的采集 (一台设备，每条记录 --record 字节，16MB一段，负载为 (seq + i) 的低8位)
+//   open:   打开所有段并读入块索引的耗时
+//   read:   读取器顺序读完所有记录，校验序号和负载
+//   seek:   随机时间点定位的平均耗时，校验定位结果 (第一条时间 >= t 的记录)
+//   replay: 回放后端 --speed=0，USB_OpenDevice + 流式读取到回调，校验负载，报告消费者能达到的 MB/s
+//   empty:  在第1个段的位置插入一个空段 (没有记录，例如没有写入就关闭的采集)，重复 read/seek/replay 的校验
+//
+// 用法: bench_replay [--dir=DIR] [--size=MB] [--record=字节] [--keep]
+
+#define BENCH_SEGMENT (16u * 1024 * 1024)
+#define BENCH_SEEKS   10000
+
+static char bench_path[1024];
+
+static int check_payload(const unsigned char* data, int length, uint64_t seq) {
+    return data[0] == (uint8_t)seq && data[length - 1] == (uint8_t)(seq + (uint64_t)length - 1);
+}
+
+static int write_capture(int record, uint64_t count, usb_capture_stats_t* stats) {
+    usb_capture_t* cap;
+    usb_capture_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = bench_path;
+    cfg.segment_size = BENCH_SEGMENT;
+    int r = usb_capture_open(&cap, &cfg);
+    if (r < 0) return r;
+
+    unsigned char* data = (unsigned char*)malloc((size_t)record);
+    usb_capture_sink_t* sink = usb_capture_add_device(cap, "REPLAY0001");
+    if (!data || !sink) {
+        free(data);
+        usb_capture_close(cap);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    for (uint64_t seq = 0; seq < count; seq++) {
+        for (int i = 0; i < record; i++) data[i] = (uint8_t)(seq + (uint64_t)i);
+        usb_capture_write(sink, data, record);
+    }
+    usb_capture_get_stats(cap, stats);
+    free(data);
+    return usb_capture_close(cap);
+}
+
+static int run_read(usb_capture_reader_t* reader, uint64_t* bad) {
+    usb_capture_record_t rec;
+    const unsigned char* payload;
+    uint64_t bytes = 0, records = 0;
+    int r;
+
+    uint64_t start = usb_time_ns();
+    while ((r = usb_capture_reader_next(reader, &rec, &payload)) == 1) {
+        if (rec.seq != records || !check_payload(payload, (int)rec.length, rec.seq)) (*bad)++;
+        bytes += rec.length;
+        records++;
+    }
+    uint64_t wall = usb_time_ns() - start;
+    if (r < 0) return r;
+    printf("read    %10.2f MB/s %12.0f records/s %llu records\n", (double)bytes / (1024.0 * 1024.0) / ((double)wall / 1e9),
+           (double)records / ((double)wall / 1e9), (unsigned long long)records);
+    return 0;
+}
+
+static int run_seek(usb_capture_reader_t* reader, const usb_capture_info_t* info, uint64_t* bad) {
+    usb_capture_record_t rec;
+    const unsigned char* payload;
+    uint64_t span = info->end_ns - info->start_ns + 1;
+    uint64_t rng = 0x9E3779B97F4A7C15ull;
+    uint64_t total = 0;
+
+    for (int i = 0; i < BENCH_SEEKS; i++) {
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        uint64_t t = info->start_ns + rng % span;
+        uint64_t start = usb_time_ns();
+        int r = usb_capture_reader_seek(reader, t);
+        total += usb_time_ns() - start;
+        if (r < 0) return r;
+        if (usb_capture_reader_next(reader, &rec, &payload) != 1 || rec.time_ns < t) (*bad)++;
+    }
+    printf("seek    %10.0f ns per seek (%d random seeks)\n", (double)total / BENCH_SEEKS, BENCH_SEEKS);
+    return 0;
+}
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t records;
+    uint64_t bad;
+} bench_consumer_t;
+
+static void on_replay_data(const unsigned char* data, int length, void* user_data) {
+    bench_consumer_t* c = (bench_consumer_t*)user_data;
+    if (!check_payload(data, length, c->records)) c->bad++;
+    c->bytes += (uint64_t)length;
+    c->records++;
+}
+
+static int run_replay(int record, uint64_t expected, uint64_t* bad) {
+    usb_replay_config_t cfg;
+    usb_stream_config_t stream_cfg;
+    usb_stream_t* stream;
+    bench_consumer_t c;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = bench_path;
+    int r = usb_control_init_replay(&cfg);
+    if (r < 0) return r;
+    if ((r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        return r;
+    }
+
+    memset(&c, 0, sizeof(c));
+    memset(&stream_cfg, 0, sizeof(stream_cfg));
+    stream_cfg.num_transfers = 8;
+    stream_cfg.transfer_size = record;
+    uint64_t start = usb_time_ns();
+    r = usb_stream_start(&stream, NULL, &stream_cfg, on_replay_data, &c);
+    if (r == 0) {
+        while (!usb_replay_finished()) {
+            usb_sleep_ms(1);
+        }
+        usb_stream_stop(stream);
+    }
+    uint64_t wall = usb_time_ns() - start;
+    USB_CloseDevice();
+    usb_control_exit();
+    if (r < 0) return r;
+
+    if (c.bytes != expected) (*bad)++;
+    *bad += c.bad;
+    printf("replay  %10.2f MB/s %12.0f transfers/s (speed=0, stream %d x %d)\n",
+           (double)c.bytes / (1024.0 * 1024.0) / ((double)wall / 1e9), (double)c.records / ((double)wall / 1e9),
+           stream_cfg.num_transfers, record);
+    return 0;
+}
+
+// 空段插入为第1段，后面的段依次后移，成功时 *segments 加1
+static int insert_empty_segment(uint64_t* segments) {
+    char empty[1040], from[1100], to[1100];
+    usb_capture_t* cap;
+    usb_capture_config_t cfg;
+
+    snprintf(empty, sizeof(empty), "%s_empty", bench_path);
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = empty;
+    int r = usb_capture_open(&cap, &cfg);
+    if (r < 0) return r;
+    if ((r = usb_capture_close(cap)) < 0) return r;
+
+    for (uint64_t i = *segments; i-- > 1;) {
+        snprintf(from, sizeof(from), "%s.%06u.cap", bench_path, (unsigned int)i);
+        snprintf(to, sizeof(to), "%s.%06u.cap", bench_path, (unsigned int)(i + 1));
+        if (rename(from, to) != 0) return LIBUSB_ERROR_IO;
+    }
+    snprintf(from, sizeof(from), "%s.%06u.cap", empty, 0u);
+    snprintf(to, sizeof(to), "%s.%06u.cap", bench_path, 1u);
+    if (rename(from, to) != 0) return LIBUSB_ERROR_IO;
+    (*segments)++;
+    return 0;
+}
+
+// 打开采集，顺序读取和随机定位
+static int run_reader(uint64_t* bad) {
+    usb_capture_reader_t* reader;
+    usb_capture_info_t info;
+    uint64_t start = usb_time_ns();
+    int r = usb_capture_reader_open(&reader, bench_path);
+    if (r < 0) {
+        printf("Failed to open capture: %s\n", libusb_error_name(r));
+        return r;
+    }
+    usb_capture_reader_get_info(reader, &info);
+    printf("open    %10.3f ms (%d segments, %d recovered)\n", (double)(usb_time_ns() - start) / 1e6,
+           info.num_segments, info.recovered);
+
+    r = run_read(reader, bad);
+    if (r == 0) r = run_seek(reader, &info, bad);
+    usb_capture_reader_close(reader);
+    return r;
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = ".";
+    int size_mb = 256;
+    int record = 16 * 1024;
+    int keep = 0;
+    uint64_t bad = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--dir=", 6) == 0) {
+            dir = argv[i] + 6;
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            size_mb = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--record=", 9) == 0) {
+            record = atoi(argv[i] + 9);
+        } else if (strcmp(argv[i], "--keep") == 0) {
+            keep = 1;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (size_mb <= 0) size_mb = 256;
+    // 回放时每条记录正好是一个传输
+    if (record < USB_REPLAY_PACKET) record = USB_REPLAY_PACKET;
+    record -= record % USB_REPLAY_PACKET;
+    snprintf(bench_path, sizeof(bench_path), "%s/bench_replay", dir);
+
+    uint64_t count = (uint64_t)size_mb * 1024 * 1024 / (uint64_t)record;
+    usb_capture_stats_t stats;
+    int r = write_capture(record, count, &stats);
+    if (r < 0) {
+        printf("Failed to write capture: %s\n", libusb_error_name(r));
+        return 1;
+    }
+    printf("\ncapture %s: %llu records of %d bytes, %llu segments\n", bench_path, (unsigned long long)stats.records,
+           record, (unsigned long long)stats.segments);
+
+    // 文件字节 = 每个已开始的段一个文件头 + 对齐后的记录；预备段不计入，也不留在磁盘上
+    uint64_t rec_bytes = (sizeof(usb_capture_record_t) + (uint64_t)record + USB_CAPTURE_ALIGN - 1) &
+                         ~(uint64_t)(USB_CAPTURE_ALIGN - 1);
+    uint64_t expect_bytes = stats.segments * USB_CAPTURE_HEADER_SIZE + stats.records * rec_bytes;
+    char spare[1100];
+    snprintf(spare, sizeof(spare), "%s.%06u.cap", bench_path, (unsigned int)stats.segments);
+    FILE* leftover = fopen(spare, "rb");
+    if (stats.file_bytes != expect_bytes || leftover) {
+        printf("stats   file_bytes %llu, expected %llu%s\n", (unsigned long long)stats.file_bytes,
+               (unsigned long long)expect_bytes, leftover ? ", spare segment left on disk" : "");
+        bad++;
+    }
+    if (leftover) fclose(leftover);
+
+    uint64_t segments = stats.segments;
+    r = run_reader(&bad);
+    if (r == 0) r = run_replay(record, stats.bytes, &bad);
+    if (r == 0 && segments >= 2) {
+        r = insert_empty_segment(&segments);
+        if (r == 0) {
+            printf("\nempty segment inserted at 1 (%llu segments):\n", (unsigned long long)segments);
+            r = run_reader(&bad);
+        }
+        if (r == 0) r = run_replay(record, stats.bytes, &bad);
+    }
+    if (r < 0) {
+        printf("Failed: %s\n", libusb_error_name(r));
+    }
+    printf("check   %s (%llu errors)\n", bad ? "FAILED" : "ok", (unsigned long long)bad);
+
+    if (!keep) {
+        char name[1100];
+        for (uint64_t i = 0; i < segments; i++) {
+            snprintf(name, sizeof(name), "%s.%06u.cap", bench_path, (unsigned int)i);
+            remove(name);
+        }
+    }
+    return r < 0 || bad ? 1 : 0;
+}
@@ -0,0 +1,223 @@
+#include "usb_internal.h"
+#include "usb_shm.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// 共享内存发布的基准: 本进程发布记录，fork出的读者进程附加后零拷贝读取并校验
+//   每条记录的负载首尾8字节是记录序号，读者检查它们 (release确认读取期间没有被覆盖)
+//   矩阵: 读者数 1/2/4 x 发布速率 (--rate MB/s 限速 / 不限速)
+//   再加一轮: 一个正常读者 + 一个每条记录睡1ms的慢读者，生产者不受影响，慢读者的落后被检测到
+//   报告: 发布 MB/s、最慢读者的 MB/s、发布->读到 的延迟 p50/p99 (限速时)、覆盖次数/丢失字节、校验错误、唤醒次数
+//
+// 用法: bench_shm [--duration=ms] [--record=字节] [--rate=MB/s] [--size=MB]
+
+#define BENCH_MAX_READERS 4
+#define BENCH_MAX_SAMPLES (1 << 20)
+#define BENCH_NAME        "usb_bench_shm"
+
+typedef struct {
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t overruns;
+    uint64_t lost_bytes;
+    uint64_t bad;            // 校验失败
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    double sec;
+} bench_result_t;
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+#ifndef _WIN32
+// 读者进程: 读到生产者关闭，结果写入管道
+static void reader_main(int ready_fd, int result_fd, int slow) {
+    usb_shm_reader_t* reader;
+    usb_shm_record_t rec;
+    const unsigned char* payload;
+    bench_result_t res;
+    uint64_t* samples = (uint64_t*)malloc(sizeof(uint64_t) * BENCH_MAX_SAMPLES);
+    int n = 0;
+    char ok = 1;
+
+    memset(&res, 0, sizeof(res));
+    if (!samples || usb_shm_reader_open(&reader, BENCH_NAME) < 0) {
+        ok = 0;
+        if (write(ready_fd, &ok, 1) != 1) {}
+        _exit(1);
+    }
+    if (write(ready_fd, &ok, 1) != 1) _exit(1);
+
+    uint64_t start = 0;
+    for (;;) {
+        int r = usb_shm_reader_next(reader, &rec, &payload, 1000);
+        if (r == LIBUSB_ERROR_NO_DEVICE) break;
+        if (r <= 0) continue;  // 超时，或落后 (已跳到最新位置)
+        uint64_t now = usb_time_ns();
+        if (!start) start = now;
+        if (n < BENCH_MAX_SAMPLES) samples[n++] = now - rec.time_ns;
+        uint64_t head = 0, tail = 0;
+        if (rec.length >= 16) {
+            memcpy(&head, payload, 8);
+            memcpy(&tail, payload + rec.length - 8, 8);
+        }
+        if (slow) usb_sleep_ms(1);
+        if (usb_shm_reader_release(reader) == 0 && rec.length >= 16 && (head != rec.seq || tail != rec.seq)) {
+            res.bad++;
+        }
+    }
+
+    usb_shm_reader_stats_t st;
+    usb_shm_reader_get_stats(reader, &st);
+    res.records = st.records;
+    res.bytes = st.bytes;
+    res.overruns = st.overruns;
+    res.lost_bytes = st.lost_bytes;
+    res.sec = start ? (double)(usb_time_ns() - start) / 1e9 : 0;
+    if (n > 0) {
+        qsort(samples, (size_t)n, sizeof(uint64_t), compare_u64);
+        res.p50_ns = samples[n / 2];
+        res.p99_ns = samples[(size_t)((double)n * 0.99)];
+    }
+    usb_shm_reader_close(reader);
+    if (write(result_fd, &res, sizeof(res)) != (ssize_t)sizeof(res)) _exit(1);
+    _exit(0);
+}
+
+static void run(int readers, int slow_reader, double rate, int record, size_t size, int duration_ms) {
+    usb_shm_publisher_t* pub;
+    usb_shm_config_t cfg;
+    usb_shm_stats_t st;
+    int ready[2], results[2];
+    pid_t pids[BENCH_MAX_READERS + 1];
+    int total = readers + (slow_reader ? 1 : 0);
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.name = BENCH_NAME;
+    cfg.size = size;
+    cfg.serial = "BENCH";
+    if (usb_shm_publisher_create(&pub, &cfg) < 0 || pipe(ready) != 0 || pipe(results) != 0) {
+        return;
+    }
+    fflush(stdout);
+    for (int i = 0; i < total; i++) {
+        pids[i] = fork();
+        if (pids[i] == 0) {
+            reader_main(ready[1], results[1], i == readers);
+        }
+    }
+    for (int i = 0; i < total; i++) {
+        char ok = 0;
+        if (read(ready[0], &ok, 1) != 1 || !ok) {
+            printf("reader failed to attach\n");
+        }
+    }
+
+    unsigned char* data = (unsigned char*)malloc((size_t)record);
+    memset(data, 0x5A, (size_t)record);
+    double ns_per_record = rate > 0 ? (double)record * 1e9 / (rate * 1024 * 1024) : 0;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t cpu = usb_cpu_time_ns();
+    for (uint64_t seq = 0;; seq++) {
+        uint64_t now = usb_time_ns();
+        if (now >= end) break;
+        if (ns_per_record > 0) {
+            usb_sleep_until_ns(start + (uint64_t)(ns_per_record * (double)seq));
+        }
+        memcpy(data, &seq, 8);
+        memcpy(data + record - 8, &seq, 8);
+        usb_shm_publish(pub, data, record);
+    }
+    double sec = (double)(usb_time_ns() - start) / 1e9;
+    double cpu_us = (double)(usb_cpu_time_ns() - cpu) / 1e3;
+    usb_shm_publisher_get_stats(pub, &st);
+    usb_shm_publisher_destroy(pub);
+
+    bench_result_t res[BENCH_MAX_READERS + 1];
+    for (int i = 0; i < total; i++) {
+        if (read(results[0], &res[i], sizeof(res[i])) != (ssize_t)sizeof(res[i])) memset(&res[i], 0, sizeof(res[i]));
+    }
+    for (int i = 0; i < total; i++) waitpid(pids[i], NULL, 0);
+    close(ready[0]);
+    close(ready[1]);
+    close(results[0]);
+    close(results[1]);
+    free(data);
+
+    // 结果按完成顺序到达，慢读者是记录最少的那个
+    double min_rate = -1;
+    uint64_t p50 = 0, p99 = 0, overruns = 0, lost = 0, bad = 0;
+    int slow_index = -1;
+    for (int i = 0; i < total; i++) {
+        if (slow_reader && (slow_index < 0 || res[i].records < res[slow_index].records)) slow_index = i;
+    }
+    for (int i = 0; i < total; i++) {
+        bad += res[i].bad;
+        if (i == slow_index) continue;
+        double r = res[i].sec > 0 ? (double)res[i].bytes / res[i].sec / (1024 * 1024) : 0;
+        if (min_rate < 0 || r < min_rate) min_rate = r;
+        if (res[i].p50_ns > p50) p50 = res[i].p50_ns;
+        if (res[i].p99_ns > p99) p99 = res[i].p99_ns;
+        overruns += res[i].overruns;
+        lost += res[i].lost_bytes;
+    }
+    char label[32];
+    snprintf(label, sizeof(label), "%d%s", readers, slow_reader ? "+slow" : "");
+    printf("%-7s %8s %10.1f %10.1f %9.2f %9.1f %9.1f %9llu %10llu %5llu %8llu\n", label,
+           rate > 0 ? "paced" : "max", (double)st.bytes / sec / (1024 * 1024), min_rate,
+           st.records ? cpu_us / (double)st.records : 0, p50 / 1000.0, p99 / 1000.0, (unsigned long long)overruns,
+           (unsigned long long)lost, (unsigned long long)bad, (unsigned long long)st.wakeups);
+    if (slow_index >= 0) {
+        printf("  slow reader: %llu records, %llu overruns, %.1f MB lost (lagging detected, producer not blocked)\n",
+               (unsigned long long)res[slow_index].records, (unsigned long long)res[slow_index].overruns,
+               (double)res[slow_index].lost_bytes / (1024 * 1024));
+    }
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    int duration_ms = 1000;
+    int record = 16384;
+    double rate = 100;
+    int size_mb = 16;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--record=", 9) == 0) {
+            record = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            size_mb = atoi(argv[i] + 7);
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 1000;
+    if (record < 16) record = 16;
+    if (size_mb <= 0) size_mb = 16;
+
+#ifdef _WIN32
+    printf("bench_shm needs fork() (POSIX)\n");
+    (void)rate;
+    return 0;
+#else
+    static const int counts[] = {1, 2, 4};
+    printf("\nrecord=%d bytes, ring=%d MB, paced rate=%.0f MB/s, duration=%d ms\n", record, size_mb, rate, duration_ms);
+    printf("%-7s %8s %10s %10s %9s %9s %9s %9s %10s %5s %8s\n", "readers", "rate", "pub MB/s", "min rd MB/s",
+           "us/rec", "p50 us", "p99 us", "overruns", "lost B", "bad", "wakeups");
+    for (int c = 0; c < 3; c++) {
+        run(counts[c], 0, rate, record, (size_t)size_mb << 20, duration_ms);
+        run(counts[c], 0, 0, record, (size_t)size_mb << 20, duration_ms);
+    }
+    run(1, 1, rate, record, (size_t)size_mb << 20, duration_ms);
+    return 0;
+#endif
+}
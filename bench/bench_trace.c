@@ -0,0 +1,276 @@
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_trace.h"
+
+// 跟踪日志的开销
+//   1. 每个事件的ns (单线程连续写入):
+//      off       事件级别低于当前级别，只有一次比较
+//      binary    后台线程写二进制文件
+//      text      后台线程格式化为文本
+//      fprintf   直接格式化输出 (原来的printf)，全缓冲 / 行缓冲 (终端上stdout是行缓冲)
+//      binary-paced  每1ms写100条，接近实际的事件速率
+//      报告丢弃的比例: 连续写入比后台线程输出快，环满时丢弃 (单核机器上后台线程要等写入线程让出CPU)
+//   2. 空设备上的流式读取，每个传输一个DEBUG事件 (STREAM_TRANSFER):
+//      级别info (事件关闭) / debug写二进制 / debug写文本 / 回调中每个传输一次fprintf
+//      报告 MB/s、传输/s 和丢弃的事件数/比例。吞吐量只在丢弃很少时才有意义:
+//      binary-paced 丢弃了事件、或 debug-binary 丢弃超过 BENCH_MAX_DROP_PCT 时返回1
+// 输出都写到空设备 (/dev/null，--out 可以改)，只测量库这一侧的开销。
+//
+// 用法: bench_trace [--duration=ms] [--size=传输字节] [--out=PATH]
+
+#ifdef _WIN32
+#define BENCH_NULL_PATH "NUL"
+#else
+#define BENCH_NULL_PATH "/dev/null"
+#endif
+
+#define BENCH_MAX_DROP_PCT 10.0
+
+static const char* bench_out = BENCH_NULL_PATH;
+
+static double drop_pct(uint64_t written, uint64_t dropped) {
+    uint64_t total = written + dropped;
+    return total ? 100.0 * (double)dropped / (double)total : 0.0;
+}
+
+// ---- 每个事件的开销 ----
+
+typedef struct {
+    const char* name;
+    double ns;
+    uint64_t written;
+    uint64_t dropped;
+} event_result_t;
+
+static uint64_t stats_written, stats_dropped;
+
+static void snapshot_stats(void) {
+    usb_trace_stats_t st;
+    usb_trace_get_stats(&st);
+    stats_written = st.written;
+    stats_dropped = st.dropped;
+}
+
+static void diff_stats(uint64_t* written, uint64_t* dropped) {
+    usb_trace_stats_t st;
+    usb_trace_get_stats(&st);
+    *written = st.written - stats_written;
+    *dropped = st.dropped - stats_dropped;
+}
+
+static int start_trace(int binary, FILE* text) {
+    usb_trace_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.path = binary ? bench_out : NULL;
+    cfg.text = text;
+    return usb_trace_start(&cfg);
+}
+
+static double trace_loop(int n) {
+    uint64_t start = usb_time_ns();
+    for (int i = 0; i < n; i++) {
+        USB_TRACE(STREAM_TRANSFER, i, 0);
+    }
+    return (double)(usb_time_ns() - start) / n;
+}
+
+static void run_events(event_result_t* res, const char* name, int n, int level, int binary, FILE* text) {
+    memset(res, 0, sizeof(*res));
+    res->name = name;
+    usb_trace_set_level((usb_trace_level_t)level);
+    if (start_trace(binary, text) < 0) {
+        res->ns = -1;
+        return;
+    }
+    snapshot_stats();
+    res->ns = trace_loop(n);
+    usb_trace_stop();
+    diff_stats(&res->written, &res->dropped);
+}
+
+static void run_fprintf(event_result_t* res, const char* name, int n, FILE* f) {
+    memset(res, 0, sizeof(*res));
+    res->name = name;
+    uint64_t start = usb_time_ns();
+    for (int i = 0; i < n; i++) {
+        fprintf(f, "stream transfer %d bytes, status %d\n", i, 0);
+    }
+    fflush(f);
+    res->ns = (double)(usb_time_ns() - start) / n;
+    res->written = (uint64_t)n;
+}
+
+// 返回 binary-paced 丢弃的事件数
+static uint64_t bench_events(void) {
+    enum { N = 1000000 };
+    event_result_t res[6];
+    FILE* text = fopen(bench_out, "w");
+    FILE* line = fopen(bench_out, "w");
+
+    if (!text || !line) {
+        printf("Cannot open %s\n", bench_out);
+        if (text) fclose(text);
+        if (line) fclose(line);
+        return 0;
+    }
+    setvbuf(line, NULL, _IOLBF, 4096);
+
+    run_events(&res[0], "off", N, USB_TRACE_INFO, 0, text);
+    run_events(&res[1], "binary", N, USB_TRACE_DEBUG, 1, text);
+    run_events(&res[2], "text", N, USB_TRACE_DEBUG, 0, text);
+    run_fprintf(&res[3], "fprintf", N, text);
+    run_fprintf(&res[4], "fprintf-line", N, line);
+    // 有间歇的写入: 每1ms写100条 (10万条/s)，后台线程有时间输出，不应丢弃
+    usb_trace_set_level(USB_TRACE_DEBUG);
+    res[5].name = "binary-paced";
+    if (start_trace(1, text) == 0) {
+        uint64_t busy = 0;
+        snapshot_stats();
+        for (int i = 0; i < N / 10; i += 100) {
+            uint64_t start = usb_time_ns();
+            for (int j = i; j < i + 100; j++) {
+                USB_TRACE(STREAM_TRANSFER, j, 0);
+            }
+            busy += usb_time_ns() - start;
+            usb_sleep_ms(1);
+        }
+        res[5].ns = (double)busy / (N / 10);
+        usb_trace_stop();
+        diff_stats(&res[5].written, &res[5].dropped);
+    }
+
+    printf("Per event, %d events back to back (binary-paced: %d events, 100 per ms):\n", N, N / 10);
+    printf("%-13s %9s %10s %10s %8s\n", "mode", "ns/event", "written", "dropped", "drop%");
+    for (int i = 0; i < 6; i++) {
+        printf("%-13s %9.1f %10llu %10llu %7.1f%%\n", res[i].name, res[i].ns, (unsigned long long)res[i].written,
+               (unsigned long long)res[i].dropped, drop_pct(res[i].written, res[i].dropped));
+    }
+    fclose(text);
+    fclose(line);
+    return res[5].dropped;
+}
+
+// ---- 流式读取 ----
+
+typedef struct {
+    const char* name;
+    double mb_per_sec;
+    double transfers_per_sec;
+    uint64_t events;
+    uint64_t dropped;
+} stream_result_t;
+
+static void on_data(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    (void)length;
+    (void)user_data;
+}
+
+static void on_data_fprintf(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    fprintf((FILE*)user_data, "stream transfer %d bytes, status %d\n", length, 0);
+}
+
+// mode: 0 关闭, 1 二进制, 2 文本, 3 fprintf
+static int run_stream(stream_result_t* res, const char* name, int mode, FILE* text, int size, int duration_ms) {
+    usb_stream_t* stream;
+    usb_stream_config_t cfg;
+    usb_stream_stats_t st;
+    int r;
+
+    memset(res, 0, sizeof(*res));
+    res->name = name;
+    usb_trace_set_level(mode == 1 || mode == 2 ? USB_TRACE_DEBUG : USB_TRACE_INFO);
+    if ((r = start_trace(mode == 1, text)) < 0) {
+        return r;
+    }
+    if ((r = usb_control_init_null()) < 0 || (r = USB_OpenDevice(NULL)) < 0) {
+        usb_control_exit();
+        usb_trace_stop();
+        return r;
+    }
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.transfer_size = size;
+    snapshot_stats();
+    r = usb_stream_start(&stream, NULL, &cfg, mode == 3 ? on_data_fprintf : on_data, text);
+    if (r == 0) {
+        usb_sleep_ms((unsigned int)duration_ms);
+        usb_stream_get_stats(stream, &st);
+        usb_stream_stop(stream);
+        res->mb_per_sec = st.mb_per_sec;
+        res->transfers_per_sec = st.elapsed_sec > 0 ? (double)st.transfers / st.elapsed_sec : 0;
+    }
+    USB_CloseDevice();
+    usb_control_exit();
+    usb_trace_stop();
+    diff_stats(&res->events, &res->dropped);
+    if (mode == 3) {
+        res->events = (uint64_t)(res->transfers_per_sec * duration_ms / 1000);
+    }
+    return r;
+}
+
+// 返回 debug-binary 丢弃事件的比例 (%)
+static double bench_stream(int size, int duration_ms) {
+    static const char* const names[] = {"off", "debug-binary", "debug-text", "fprintf-line"};
+    stream_result_t res[4];
+    FILE* text = fopen(bench_out, "w");
+
+    if (!text) {
+        printf("Cannot open %s\n", bench_out);
+        return 0;
+    }
+    memset(res, 0, sizeof(res));
+    setvbuf(text, NULL, _IOLBF, 4096);
+    printf("\nNull-device stream, %d-byte transfers, %d ms each, one event per transfer:\n", size, duration_ms);
+    printf("%-13s %10s %12s %10s %10s %8s\n", "mode", "MB/s", "transfers/s", "events", "dropped", "drop%");
+    for (int i = 0; i < 4; i++) {
+        int r = run_stream(&res[i], names[i], i, text, size, duration_ms);
+        if (r < 0) {
+            printf("%-13s failed: %s\n", names[i], libusb_error_name(r));
+            continue;
+        }
+        printf("%-13s %10.1f %12.0f %10llu %10llu %7.1f%%\n", res[i].name, res[i].mb_per_sec, res[i].transfers_per_sec,
+               (unsigned long long)res[i].events, (unsigned long long)res[i].dropped,
+               drop_pct(res[i].events, res[i].dropped));
+    }
+    if (res[0].transfers_per_sec > 0) {
+        // 丢弃的事件没有格式化和写出，吞吐量要和丢弃比例一起看
+        printf("Throughput vs off: debug-binary %.1f%% (%.1f%% dropped), debug-text %.1f%% (%.1f%% dropped), "
+               "fprintf-line %.1f%%\n",
+               100.0 * res[1].transfers_per_sec / res[0].transfers_per_sec, drop_pct(res[1].events, res[1].dropped),
+               100.0 * res[2].transfers_per_sec / res[0].transfers_per_sec, drop_pct(res[2].events, res[2].dropped),
+               100.0 * res[3].transfers_per_sec / res[0].transfers_per_sec);
+    }
+    fclose(text);
+    return drop_pct(res[1].events, res[1].dropped);
+}
+
+int main(int argc, char* argv[]) {
+    int duration_ms = 1000;
+    int size = 512;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--size=", 7) == 0) {
+            size = atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--out=", 6) == 0) {
+            bench_out = argv[i] + 6;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (duration_ms <= 0) duration_ms = 1000;
+    if (size <= 0) size = 512;
+
+    uint64_t paced_dropped = bench_events();
+    double stream_drop = bench_stream(size, duration_ms);
+    if (paced_dropped > 0 || stream_drop > BENCH_MAX_DROP_PCT) {
+        printf("FAILED: binary-paced dropped %llu event(s), debug-binary stream dropped %.1f%% (max %.0f%%)\n",
+               (unsigned long long)paced_dropped, stream_drop, BENCH_MAX_DROP_PCT);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,281 @@
+#include "usb_internal.h"
+#include "usb_capture.h"
+#include "usb_decode.h"
+#include "usb_trigger.h"
+
+// 触发采集: 条件检查的吞吐量和按线速运行时节省的写盘量
+//   check:  记录在内存中循环送入 (不限速)，不触发，测量每种条件的处理速度 (MB/s，按原始字节)
+//           threshold 包括 s16 解包 + 检查，pattern 和 external 包括写入预触发环
+//   paced:  按 --rate 的线速实时产生记录: s16 噪声 (幅度 ±200)，每 --interval ms 一个事件
+//           (一段幅度20000的脉冲，中间带4字节标记 A5 5A C3 3C)。比较:
+//             full      所有数据写入采集文件
+//             threshold |样本| >= 10000 触发
+//             pattern   标记触发
+//             external  另一个线程在事件时调用 usb_trigger_fire
+//   报告: 输入/写盘的MB、节省的写盘量、触发次数、窗口被截断的记录数、检出延迟和窗口写出时间 (平均/最大)
+//
+// 用法: bench_trigger [--rate=MB/s] [--record=字节] [--interval=ms] [--pre=ms] [--post=ms]
+//                     [--duration=ms] [--dir=DIR] [--quick]
+
+#define BENCH_RECORDS   64
+#define BENCH_NOISE     200
+#define BENCH_PULSE     20000
+#define BENCH_THRESHOLD 10000
+
+static const unsigned char bench_marker[] = {0xA5, 0x5A, 0xC3, 0x3C};
+
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t next_rand(void) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)rng;
+}
+
+static char bench_path[1024];
+static int bench_record = 16 * 1024;
+static size_t bench_ring = 0;
+static unsigned char* noise[BENCH_RECORDS];
+static unsigned char* event_record;
+static int32_t* samples;
+
+static void put_s16(unsigned char* p, int v) {
+    p[0] = (unsigned char)(v & 0xFF);
+    p[1] = (unsigned char)((v >> 8) & 0xFF);
+}
+
+static void make_data(void) {
+    for (int r = 0; r < BENCH_RECORDS; r++) {
+        noise[r] = (unsigned char*)malloc((size_t)bench_record);
+        for (int i = 0; i + 1 < bench_record; i += 2) {
+            put_s16(noise[r] + i, (int)(next_rand() % (2 * BENCH_NOISE + 1)) - BENCH_NOISE);
+        }
+    }
+    // 事件: 记录中间的一段脉冲，标记在脉冲中间
+    event_record = (unsigned char*)malloc((size_t)bench_record);
+    memcpy(event_record, noise[0], (size_t)bench_record);
+    int mid = bench_record / 2 & ~1;
+    for (int i = mid - 256; i < mid + 256 && i + 1 < bench_record; i += 2) {
+        if (i >= 0) put_s16(event_record + i, (i / 2) % 2 ? BENCH_PULSE : -BENCH_PULSE);
+    }
+    memcpy(event_record + mid, bench_marker, sizeof(bench_marker));
+    samples = (int32_t*)malloc(sizeof(int32_t) * (size_t)(bench_record / 2));
+}
+
+static void remove_segments(uint64_t segments) {
+    char name[1100];
+    for (uint64_t i = 0; i <= segments; i++) {
+        snprintf(name, sizeof(name), "%s.%06u.cap", bench_path, (unsigned int)i);
+        remove(name);
+    }
+}
+
+static usb_trigger_t* make_trigger(usb_trigger_mode_t mode, unsigned int pre_ms, unsigned int post_ms,
+                                   usb_capture_sink_t* sink) {
+    usb_trigger_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.mode = mode;
+    cfg.threshold = BENCH_THRESHOLD;
+    cfg.pattern = bench_marker;
+    cfg.pattern_length = (int)sizeof(bench_marker);
+    cfg.pre_ms = pre_ms;
+    cfg.post_ms = post_ms;
+    cfg.ring_size = bench_ring;
+    return usb_trigger_create(&cfg, sink);
+}
+
+// 一条记录经过触发器: threshold 模式先写入再解包检查 (同流式读取 + 解码器)
+static void feed(usb_trigger_t* trig, usb_trigger_mode_t mode, uint64_t time_ns, const unsigned char* data) {
+    usb_trigger_write(trig, time_ns, data, bench_record);
+    if (mode == USB_TRIGGER_THRESHOLD) {
+        int count = bench_record / 2;
+        usb_decode_unpack(USB_SAMPLE_S16, data, count, samples);
+        usb_trigger_check_samples(trig, time_ns, samples, count);
+    }
+}
+
+static void run_check(usb_trigger_mode_t mode, int duration_ms) {
+    usb_capture_t* cap;
+    usb_capture_config_t cap_cfg;
+    memset(&cap_cfg, 0, sizeof(cap_cfg));
+    cap_cfg.path = bench_path;
+    if (usb_capture_open(&cap, &cap_cfg) < 0) {
+        printf("Failed to open capture %s\n", bench_path);
+        return;
+    }
+    usb_trigger_t* trig = make_trigger(mode, 100, 100, usb_capture_add_device(cap, "bench"));
+    uint64_t records = 0;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t now = start;
+    while (now < end) {
+        for (int i = 0; i < BENCH_RECORDS; i++) {
+            feed(trig, mode, now, noise[i]);
+        }
+        records += BENCH_RECORDS;
+        now = usb_time_ns();
+    }
+    double sec = (double)(now - start) / 1e9;
+    double mb = (double)records * bench_record / (1024.0 * 1024.0);
+    usb_trigger_stats_t st;
+    usb_trigger_get_stats(trig, &st);
+    printf("%-9s %10.0f %12.1f %9llu\n", usb_trigger_mode_name(mode), mb / sec, sec * 1e9 / (double)records,
+           (unsigned long long)st.triggers);
+    usb_trigger_destroy(trig);
+    usb_capture_stats_t cs;
+    usb_capture_get_stats(cap, &cs);
+    usb_capture_close(cap);
+    remove_segments(cs.segments);
+}
+
+typedef struct {
+    usb_trigger_t* trig;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint64_t interval_ns;
+} fire_ctx_t;
+
+// 外部触发: 在每个事件的时间调用 usb_trigger_fire
+static void* fire_thread(void* arg) {
+    fire_ctx_t* ctx = (fire_ctx_t*)arg;
+    for (uint64_t t = ctx->start_ns + ctx->interval_ns; t < ctx->end_ns; t += ctx->interval_ns) {
+        usb_sleep_until_ns(t);
+        usb_trigger_fire(ctx->trig);
+    }
+    return NULL;
+}
+
+// mode < 0: 全部写入
+static void run_paced(int mode, double rate, int interval_ms, unsigned int pre_ms, unsigned int post_ms,
+                      int duration_ms) {
+    usb_capture_t* cap;
+    usb_capture_config_t cap_cfg;
+    memset(&cap_cfg, 0, sizeof(cap_cfg));
+    cap_cfg.path = bench_path;
+    if (usb_capture_open(&cap, &cap_cfg) < 0) {
+        printf("Failed to open capture %s\n", bench_path);
+        return;
+    }
+    usb_capture_sink_t* sink = usb_capture_add_device(cap, "bench");
+    usb_trigger_t* trig = mode >= 0 ? make_trigger((usb_trigger_mode_t)mode, pre_ms, post_ms, sink) : NULL;
+
+    uint64_t record_ns = (uint64_t)((double)bench_record / (rate * 1024 * 1024) * 1e9);
+    uint64_t interval_ns = (uint64_t)interval_ms * 1000000ull;
+    uint64_t start = usb_time_ns();
+    uint64_t end = start + (uint64_t)duration_ms * 1000000ull;
+    uint64_t next_event = start + interval_ns;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    uint64_t cpu = usb_cpu_time_ns();
+    fire_ctx_t fire;
+    usb_thread_t thread;
+    int threaded = 0;
+
+    if (mode == USB_TRIGGER_EXTERNAL) {
+        fire.trig = trig;
+        fire.start_ns = start;
+        fire.end_ns = end;
+        fire.interval_ns = interval_ns;
+        threaded = usb_thread_create(&thread, fire_thread, &fire) == 0;
+    }
+    for (uint64_t t = start + record_ns; t < end; t += record_ns) {
+        usb_sleep_until_ns(t);
+        uint64_t now = usb_time_ns();  // 记录到达 (传输完成) 的时间
+        const unsigned char* data = noise[records % BENCH_RECORDS];
+        if (t >= next_event) {
+            data = event_record;
+            next_event += interval_ns;
+        }
+        if (trig) {
+            feed(trig, (usb_trigger_mode_t)mode, now, data);
+        } else {
+            usb_capture_write_at(sink, now, data, bench_record);
+        }
+        records++;
+        bytes += (uint64_t)bench_record;
+    }
+    if (threaded) {
+        usb_thread_join(thread);
+    }
+    cpu = usb_cpu_time_ns() - cpu;
+
+    usb_trigger_stats_t st;
+    memset(&st, 0, sizeof(st));
+    if (trig) {
+        usb_trigger_get_stats(trig, &st);
+        usb_trigger_destroy(trig);
+    }
+    usb_capture_stats_t cs;
+    usb_capture_get_stats(cap, &cs);
+    usb_capture_close(cap);
+    remove_segments(cs.segments);
+
+    double in_mb = (double)bytes / (1024.0 * 1024.0);
+    double out_mb = (double)cs.file_bytes / (1024.0 * 1024.0);
+    uint64_t detections = st.triggers + st.retriggers;
+    printf("%-9s %8.1f %8.1f %6.1f%% %8llu %9llu %10.1f %10.1f %10.1f %10.1f %9.2f\n",
+           mode < 0 ? "full" : usb_trigger_mode_name((usb_trigger_mode_t)mode), in_mb, out_mb,
+           in_mb > 0 ? 100.0 * (1.0 - out_mb / in_mb) : 0, (unsigned long long)st.triggers,
+           (unsigned long long)st.truncated, detections ? (double)st.detect_sum_ns / detections / 1000.0 : 0,
+           (double)st.detect_max_ns / 1000.0, st.triggers ? (double)st.flush_sum_ns / st.triggers / 1000.0 : 0,
+           (double)st.flush_max_ns / 1000.0, in_mb > 0 ? (double)cpu / 1e6 / in_mb : 0);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = ".";
+    double rate = 40;
+    int interval_ms = 1000;
+    unsigned int pre_ms = 100;
+    unsigned int post_ms = 100;
+    int duration_ms = 5000;
+    int quick = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--rate=", 7) == 0) {
+            rate = atof(argv[i] + 7);
+        } else if (strncmp(argv[i], "--record=", 9) == 0) {
+            bench_record = atoi(argv[i] + 9);
+        } else if (strncmp(argv[i], "--interval=", 11) == 0) {
+            interval_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--pre=", 6) == 0) {
+            pre_ms = (unsigned int)atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--post=", 7) == 0) {
+            post_ms = (unsigned int)atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--duration=", 11) == 0) {
+            duration_ms = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--dir=", 6) == 0) {
+            dir = argv[i] + 6;
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else {
+            printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (rate <= 0) rate = 40;
+    if (bench_record < 1024) bench_record = 1024;
+    if (interval_ms <= 0) interval_ms = 1000;
+    if (duration_ms <= 0) duration_ms = 5000;
+    if (quick) duration_ms = 2000;
+    snprintf(bench_path, sizeof(bench_path), "%s/bench_trigger", dir);
+    make_data();
+    // 预触发环: pre_ms 的数据 + 记录头，留25%余量
+    bench_ring = (size_t)(rate * 1024 * 1024 * pre_ms / 1000.0 * 1.25) + 4 * (size_t)bench_record;
+
+    printf("\ncheck: record=%d bytes, unpaced, %s kernels\n", bench_record,
+           usb_decode_level_name(usb_decode_get_level()));
+    printf("%-9s %10s %12s %9s\n", "mode", "MB/s", "ns/record", "triggers");
+    for (int m = USB_TRIGGER_THRESHOLD; m <= USB_TRIGGER_EXTERNAL; m++) {
+        run_check((usb_trigger_mode_t)m, quick ? 300 : 1000);
+    }
+
+    printf("\npaced: rate=%.1f MB/s record=%d bytes, event every %d ms, window -%u/+%u ms, ring %.1f MB, duration=%d ms\n",
+           rate, bench_record, interval_ms, pre_ms, post_ms, (double)bench_ring / (1024.0 * 1024.0), duration_ms);
+    printf("%-9s %8s %8s %7s %8s %9s %10s %10s %10s %10s %9s\n", "mode", "in MB", "disk MB", "saved", "triggers",
+           "truncated", "detect us", "max us", "flush us", "max us", "cpu ms/MB");
+    for (int m = -1; m <= USB_TRIGGER_EXTERNAL; m++) {
+        run_paced(m, rate, interval_ms, pre_ms, post_ms, duration_ms);
+    }
+    return 0;
+}
@@ -1,18 +1,729 @@
 #include "usb_control.h"
+#include "usb_sim.h"
+#include "usb_transport.h"
+#include "usb_stream.h"
+#include "usb_reader.h"
+#include "usb_stats.h"
+#include "usb_capture.h"
+#include "usb_replay.h"
+#include "usb_events.h"
+#include "usb_supervisor.h"
+#include "usb_shm.h"
+#include "usb_decode.h"
+#include "usb_merge.h"
+#include "usb_trigger.h"
+#include "usb_trace.h"
+#include "usb_aggregate.h"
+#include "usb_hub.h"
+
+// 流式模式的数据回调，只做计数
+static void on_stream_data(const unsigned char* data, int length, void* user_data) {
+    (void)data;
+    (void)length;
+    (*(int*)user_data)++;
+}
+
+// 帧回调，只做计数
+static void on_frame(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data) {
+    (void)header;
+    (void)payload;
+    (void)length;
+    (*(int*)user_data)++;
+}
+
+// 解码回调: 计数，并打印第一帧的前几个样本
+static void on_decoded(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data) {
+    int* frames = (int*)user_data;
+    if ((*frames)++ == 0) {
+        printf("Frame %u: %d samples:", header->seq, count);
+        for (int i = 0; i < count && i < 8; i++) {
+            printf(" %d", samples[i]);
+        }
+        printf("%s\n", count > 8 ? " ..." : "");
+    }
+}
+
+// 解码后的样本送入触发器检查和窗口统计，时间为帧所在传输的完成时间
+typedef struct {
+    int* frames;
+    usb_trigger_t* trigger;
+    usb_aggregate_t* aggregate;
+    usb_decoder_t* decoder;
+} sample_decode_ctx_t;
+
+static void on_decoded_samples(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data) {
+    sample_decode_ctx_t* c = (sample_decode_ctx_t*)user_data;
+    uint64_t time_ns = usb_frame_time_ns(usb_decoder_splitter(c->decoder));
+    (void)header;
+    (*c->frames)++;
+    if (c->trigger) {
+        usb_trigger_check_samples(c->trigger, time_ns, samples, count);
+    }
+    if (c->aggregate) {
+        usb_aggregate_feed(c->aggregate, samples, count, time_ns);
+    }
+}
+
+// 窗口统计的输出: 每个窗口一行CSV，最粗一级的窗口结束时打印并刷新文件，采集过程中就可以读取
+typedef struct {
+    FILE* out;
+    int levels;
+    int channels;
+} aggregate_out_t;
+
+static void on_window(const usb_aggregate_window_t* w, const usb_aggregate_value_t* values, void* user_data) {
+    aggregate_out_t* o = (aggregate_out_t*)user_data;
+    int channels = o->channels;
+    if (o->out) {
+        for (int c = 0; c < channels; c++) {
+            fprintf(o->out, "%d,%llu,%llu,%u,%d,%d,%d,%.3f,%.3f\n", w->level, (unsigned long long)w->index,
+                    (unsigned long long)w->first_sample, w->count, c, values[c].min, values[c].max, values[c].mean,
+                    values[c].rms);
+        }
+    }
+    if (w->level == o->levels - 1) {
+        printf("Window %llu (%u samples from %llu):", (unsigned long long)w->index, w->count,
+               (unsigned long long)w->first_sample);
+        for (int c = 0; c < channels && c < 4; c++) {
+            printf(" ch%d min %d max %d mean %.1f rms %.1f", c, values[c].min, values[c].max, values[c].mean,
+                   values[c].rms);
+        }
+        printf("%s\n", channels > 4 ? " ..." : "");
+        if (o->out) fflush(o->out);
+    }
+}
+
+// 不分帧的流式数据直接送入窗口统计
+static void on_stream_aggregate(const unsigned char* data, int length, void* user_data) {
+    usb_aggregate_feed_bytes((usb_aggregate_t*)user_data, data, length, usb_time_ns());
+}
+
+static int open_aggregate(usb_aggregate_t** agg, usb_aggregate_config_t* cfg, aggregate_out_t* out, const char* path) {
+    memset(out, 0, sizeof(*out));
+    out->levels = cfg->levels;
+    out->channels = cfg->channels > 0 ? cfg->channels : 1;
+    *agg = usb_aggregate_create(cfg, on_window, out);
+    if (!*agg) {
+        printf("Invalid --aggregate: each window must be a multiple of the previous one, --channels 1-%d\n",
+               USB_AGGREGATE_MAX_CHANNELS);
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (path) {
+        out->out = fopen(path, "w");
+        if (!out->out) {
+            printf("Cannot open %s\n", path);
+            usb_aggregate_destroy(*agg);
+            *agg = NULL;
+            return LIBUSB_ERROR_IO;
+        }
+        fprintf(out->out, "level,index,first_sample,count,channel,min,max,mean,rms\n");
+    }
+    return 0;
+}
+
+// 输出未满的窗口，打印每一级的窗口数
+static void close_aggregate(usb_aggregate_t* agg, aggregate_out_t* out) {
+    usb_aggregate_stats_t st;
+    if (!agg) {
+        return;
+    }
+    usb_aggregate_flush(agg);
+    usb_aggregate_get_stats(agg, &st);
+    printf("Aggregated %llu samples into", (unsigned long long)st.samples);
+    for (int k = 0; k < out->levels; k++) {
+        printf("%s %llu", k ? "," : "", (unsigned long long)st.windows[k]);
+    }
+    printf(" window(s)\n");
+    usb_aggregate_destroy(agg);
+    if (out->out) {
+        fclose(out->out);
+    }
+}
+
+// --hub: 流的池缓冲区经集线器分发，每个订阅者一个线程按自己的速度读取:
+// recorder 不丢数据 (BLOCK)，display 只取1/100且只保留最新的几条，其余订阅者跟不上时丢弃最旧的
+#define HUB_MAX_SUBS 64
+#define HUB_DEPTH    64
+
+typedef struct {
+    usb_hub_sub_t* sub;
+    usb_thread_t thread;
+} hub_reader_t;
+
+typedef struct {
+    usb_hub_t* hub;
+    usb_pool_t* pool;
+    hub_reader_t readers[HUB_MAX_SUBS];
+    int count;
+} hub_out_t;
+
+static void* hub_reader_thread(void* arg) {
+    hub_reader_t* h = (hub_reader_t*)arg;
+    usb_hub_msg_t msg;
+    int r;
+    while ((r = usb_hub_next(h->sub, &msg, 100)) != LIBUSB_ERROR_INTERRUPTED) {
+        if (r == 0) {
+            usb_hub_release(&msg);
+        }
+    }
+    return NULL;
+}
+
+static int open_hub(hub_out_t* out, int subs, usb_stream_config_t* cfg) {
+    memset(out, 0, sizeof(*out));
+    if (subs > HUB_MAX_SUBS) subs = HUB_MAX_SUBS;
+    // 每个订阅者最多持有 深度+1 个缓冲区，池不够时流会暂停
+    out->pool = usb_pool_create(USB_STREAM_DEFAULT_TRANSFERS + subs * (HUB_DEPTH + 1), USB_STREAM_DEFAULT_SIZE, 0);
+    out->hub = usb_hub_create(0, 0);
+    if (!out->pool || !out->hub) {
+        usb_hub_destroy(out->hub);
+        usb_pool_destroy(out->pool);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    for (int i = 0; i < subs; i++) {
+        usb_hub_sub_config_t sub_cfg;
+        char name[32];
+        memset(&sub_cfg, 0, sizeof(sub_cfg));
+        sub_cfg.depth = HUB_DEPTH;
+        if (i == 0) {
+            sub_cfg.name = "recorder";
+            sub_cfg.policy = USB_RING_BLOCK;
+        } else if (i == 1) {
+            sub_cfg.name = "display";
+            sub_cfg.depth = 4;
+            sub_cfg.policy = USB_RING_DROP_OLDEST;
+            sub_cfg.sample_every = 100;
+        } else {
+            snprintf(name, sizeof(name), "sub%d", i);
+            sub_cfg.name = name;
+            sub_cfg.policy = USB_RING_DROP_OLDEST;
+        }
+        hub_reader_t* h = &out->readers[out->count];
+        h->sub = usb_hub_subscribe(out->hub, &sub_cfg);
+        if (!h->sub) break;
+        if (usb_thread_create(&h->thread, hub_reader_thread, h) != 0) {
+            usb_hub_unsubscribe(h->sub);
+            break;
+        }
+        out->count++;
+    }
+    cfg->pool = out->pool;
+    cfg->buffer_cb = usb_hub_stream_buffer_cb;
+    printf("Fan-out hub with %d subscriber(s)\n", out->count);
+    return 0;
+}
+
+// 在流停止之后调用: 订阅者取完队列后退出，所有缓冲区回到池中
+static void close_hub(hub_out_t* out) {
+    usb_hub_stats_t st;
+    if (!out->hub) {
+        return;
+    }
+    usb_hub_close(out->hub);
+    usb_hub_get_stats(out->hub, &st);
+    printf("Hub published %llu messages (%llu bytes), %llu deliveries by reference\n", (unsigned long long)st.published,
+           (unsigned long long)st.bytes, (unsigned long long)st.deliveries);
+    for (int i = 0; i < out->count; i++) {
+        usb_hub_sub_stats_t sub_st;
+        usb_thread_join(out->readers[i].thread);
+        usb_hub_sub_get_stats(out->readers[i].sub, &sub_st);
+        printf("  %-9s received %llu, filtered %llu, dropped %llu, queue high-water %d/%d, blocked %.1f ms\n", sub_st.name,
+               (unsigned long long)sub_st.received, (unsigned long long)sub_st.filtered,
+               (unsigned long long)sub_st.dropped, sub_st.high_water, sub_st.depth, (double)sub_st.blocked_ns / 1e6);
+        usb_hub_unsubscribe(out->readers[i].sub);
+    }
+    usb_hub_destroy(out->hub);
+    usb_pool_destroy(out->pool);
+}
+
+// 外部触发: 标准输入每读到一行触发一次。线程阻塞在读取上不能等待它退出，触发器在锁内取消
+static usb_mutex_t stdin_trigger_lock;
+static usb_trigger_t* stdin_trigger;
+
+static void* stdin_trigger_thread(void* arg) {
+    char line[256];
+    (void)arg;
+    while (fgets(line, sizeof(line), stdin)) {
+        usb_mutex_lock(&stdin_trigger_lock);
+        if (stdin_trigger) {
+            usb_trigger_fire(stdin_trigger);
+            USB_TRACE(EXTERNAL_TRIGGER);
+        }
+        usb_mutex_unlock(&stdin_trigger_lock);
+    }
+    return NULL;
+}
+
+// 十六进制字节序列，返回字节数，格式错误返回-1
+static int parse_hex(const char* s, unsigned char* out, int max) {
+    int n = 0;
+    while (s[0] && s[1] && n < max) {
+        unsigned int v;
+        if (sscanf(s, "%2x", &v) != 1) return -1;
+        out[n++] = (unsigned char)v;
+        s += 2;
+    }
+    return s[0] ? -1 : n;
+}
+
+static void print_trigger(usb_trigger_t* trig, usb_trigger_mode_t mode) {
+    usb_trigger_stats_t st;
+    usb_trigger_get_stats(trig, &st);
+    uint64_t detections = st.triggers + st.retriggers;
+    printf("Trigger (%s): %llu window(s), %llu retrigger(s), wrote %.2f of %.2f MB (%.1f%% less I/O), %llu truncated\n",
+           usb_trigger_mode_name(mode), (unsigned long long)st.triggers, (unsigned long long)st.retriggers,
+           (double)st.saved_bytes / (1024.0 * 1024.0), (double)st.bytes / (1024.0 * 1024.0),
+           st.bytes ? 100.0 * (1.0 - (double)st.saved_bytes / (double)st.bytes) : 0.0,
+           (unsigned long long)st.truncated);
+    if (detections) {
+        printf("  detect latency mean %.1f us max %.1f us, pre-trigger flush mean %.1f us max %.1f us\n",
+               (double)st.detect_sum_ns / (double)detections / 1000.0, (double)st.detect_max_ns / 1000.0,
+               st.triggers ? (double)st.flush_sum_ns / (double)st.triggers / 1000.0 : 0.0,
+               (double)st.flush_max_ns / 1000.0);
+    }
+}
+
+// 完整性统计: 缺失的帧按原因分开
+static void print_integrity(usb_integrity_t* integrity) {
+    usb_integrity_stats_t st;
+    usb_integrity_get_stats(integrity, &st);
+    printf("Integrity: %llu frames, %llu lost in %llu gap(s), %llu duplicate(s), %llu reordered, %llu restart(s)\n",
+           (unsigned long long)st.frames, (unsigned long long)st.lost, (unsigned long long)st.gaps,
+           (unsigned long long)st.duplicates, (unsigned long long)st.reordered, (unsigned long long)st.restarts);
+    for (int c = 0; c < USB_LOSS_CAUSES; c++) {
+        if (st.lost_by[c] || st.gaps_by[c]) {
+            printf("  %s: %llu frames in %llu gap(s)\n", usb_loss_cause_name((usb_loss_cause_t)c),
+                   (unsigned long long)st.lost_by[c], (unsigned long long)st.gaps_by[c]);
+        }
+    }
+}
+
+// 合并模式下每台设备的帧送入合并器
+typedef struct {
+    usb_merge_t* merge;
+    int input;
+    usb_frame_splitter_t* splitter;
+} merge_input_ctx_t;
+
+static void on_merge_frame(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data) {
+    merge_input_ctx_t* c = (merge_input_ctx_t*)user_data;
+    usb_merge_push_frame(c->merge, c->input, usb_frame_time_ns(c->splitter), header, payload, length);
+}
+
+// 在本线程中取出合并后的帧，直到duration_ms，然后报告顺序和各设备的时钟
+static void merge_drain(usb_merge_t* merge, device_info_t* devices, int num_devices, unsigned int duration_ms) {
+    usb_merge_record_t rec;
+    usb_merge_stats_t st;
+    uint64_t end = usb_time_ns() + (uint64_t)duration_ms * 1000000ull;
+    uint64_t first = 0, last = 0;
+
+    while (usb_time_ns() < end) {
+        if (usb_merge_pop(merge, &rec, 100) == 0) {
+            if (first == 0) first = rec.time_ns;
+            last = rec.time_ns;
+        }
+    }
+    usb_merge_get_stats(merge, &st);
+    printf("Merged %llu frames spanning %.1f ms: %llu late, %llu forced, max delay %.2f ms\n",
+           (unsigned long long)st.records, (double)(last - first) / 1e6, (unsigned long long)st.late,
+           (unsigned long long)st.forced, (double)st.max_delay_ns / 1e6);
+    for (int i = 0; i < num_devices; i++) {
+        if (st.input[i].has_clock) {
+            printf("  %s: clock offset %.3f ms, drift %+.1f ppm\n", devices[i].serial,
+                   (double)st.input[i].offset_ns / 1e6, st.input[i].drift_ppm);
+        } else {
+            printf("  %s: no device timestamps\n", devices[i].serial);
+        }
+    }
+}
+
+// 同时从所有设备采集2秒，报告每台设备和总的速率。
+// merge: 按帧 (frame_payload) 拆分，所有设备的帧按时间合并为一个流
+static int capture_all(device_info_t* devices, int num_devices, int frame_payload, int merge) {
+    usb_device_t* handles[MAX_DEVICES];
+    usb_stream_t* streams[MAX_DEVICES];
+    merge_input_ctx_t inputs[MAX_DEVICES];
+    usb_stream_config_t cfg;
+    usb_merge_t* merger = NULL;
+    int packets[MAX_DEVICES];
+    int opened = 0;
+    int r = 0;
+
+    if (num_devices > MAX_DEVICES) {
+        printf("Capturing from the first %d of %d devices\n", MAX_DEVICES, num_devices);
+        num_devices = MAX_DEVICES;
+    }
+    memset(packets, 0, sizeof(packets));
+    memset(inputs, 0, sizeof(inputs));
+    if (merge && frame_payload > 0 && num_devices > 0) {
+        usb_merge_config_t merge_cfg;
+        memset(&merge_cfg, 0, sizeof(merge_cfg));
+        merge_cfg.inputs = num_devices;
+        merge_cfg.max_record = frame_payload;
+        merger = usb_merge_create(&merge_cfg);
+    }
+    for (opened = 0; opened < num_devices; opened++) {
+        r = USB_OpenDeviceEx(devices[opened].serial, &handles[opened]);
+        if (r < 0) {
+            break;
+        }
+        memset(&cfg, 0, sizeof(cfg));
+        if (merger) {
+            inputs[opened].merge = merger;
+            inputs[opened].input = opened;
+            inputs[opened].splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, frame_payload, on_merge_frame, &inputs[opened]);
+            cfg.splitter = inputs[opened].splitter;
+        }
+        r = usb_stream_start(&streams[opened], handles[opened], &cfg, on_stream_data, &packets[opened]);
+        if (r < 0) {
+            printf("Failed to start stream: %s\n", libusb_error_name(r));
+            USB_CloseDeviceEx(handles[opened]);
+            break;
+        }
+    }
+
+    if (r == 0) {
+        printf("Capturing from %d device(s) for 2 seconds...\n", opened);
+        if (merger) {
+            merge_drain(merger, devices, opened, 2000);
+        } else {
+            usb_sleep_ms(2000);
+        }
+    }
+
+    // 消费者不再取记录，BLOCK的输入满后事件线程会一直等待: 先关闭输入，流才能停止
+    for (int i = 0; merger && i < opened; i++) {
+        usb_merge_close_input(merger, i);
+    }
+    double total = 0;
+    for (int i = 0; i < opened; i++) {
+        usb_stream_stats_t stats;
+        usb_stream_get_stats(streams[i], &stats);
+        usb_stream_stop(streams[i]);
+        printf("  %s: %llu bytes in %d transfers, %.2f MB/s\n", devices[i].serial,
+               (unsigned long long)stats.bytes, packets[i], stats.mb_per_sec);
+        total += stats.mb_per_sec;
+    }
+    printf("Aggregate: %.2f MB/s\n", total);
+
+    for (int i = 0; i < opened; i++) {
+        USB_CloseDeviceEx(handles[i]);
+    }
+    for (int i = 0; i < num_devices; i++) {
+        usb_frame_splitter_destroy(inputs[i].splitter);
+    }
+    usb_merge_destroy(merger);
+    return r;
+}
+
+typedef struct {
+    int packets;
+    int gaps;
+    usb_capture_sink_t* sink;
+} supervised_ctx_t;
+
+static void on_supervised_data(const unsigned char* data, int length, void* user_data) {
+    supervised_ctx_t* c = (supervised_ctx_t*)user_data;
+    c->packets++;
+    if (c->sink) {
+        usb_capture_write(c->sink, data, length);
+    }
+}
+
+// 中断标记: 打印并写入采集文件
+static void on_gap(const usb_gap_t* gap, void* user_data) {
+    supervised_ctx_t* c = (supervised_ctx_t*)user_data;
+    c->gaps++;
+    if (gap->resumed_ns) {
+        printf("Gap: %.1f ms without data (%s)\n", (gap->resumed_ns - gap->lost_ns) / 1e6, libusb_error_name(gap->error));
+    } else {
+        printf("Gap: device still lost at stop (%s)\n", libusb_error_name(gap->error));
+    }
+    if (c->sink) {
+        usb_capture_write_gap(c->sink, gap->lost_ns, gap->resumed_ns, gap->error);
+    }
+}
+
+// 受监护的流式读取2秒: 设备断开后自动重连，报告中断次数和断开时间
+static int stream_supervised(const char* serial, const char* capture_path, int frame_payload) {
+    usb_supervisor_t* sup;
+    usb_supervisor_config_t cfg;
+    usb_supervisor_stats_t stats;
+    usb_capture_t* capture = NULL;
+    supervised_ctx_t c;
+    int frames = 0;
+    int r;
+
+    memset(&c, 0, sizeof(c));
+    memset(&cfg, 0, sizeof(cfg));
+    if (frame_payload > 0) {
+        // 拆分帧并按帧序号检查，断开期间的缺失记为 disconnect
+        cfg.stream.splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, frame_payload, on_frame, &frames);
+        cfg.stream.integrity = usb_integrity_create();
+    }
+    if (capture_path) {
+        usb_capture_config_t capture_cfg;
+        memset(&capture_cfg, 0, sizeof(capture_cfg));
+        capture_cfg.path = capture_path;
+        r = usb_capture_open(&capture, &capture_cfg);
+        if (r < 0) {
+            printf("Failed to open capture: %s\n", libusb_error_name(r));
+            return r;
+        }
+        c.sink = usb_capture_add_device(capture, serial);
+    }
+
+    r = usb_supervisor_start(&sup, serial, &cfg, on_supervised_data, on_gap, &c);
+    if (r < 0) {
+        printf("Failed to start supervised stream: %s\n", libusb_error_name(r));
+    } else {
+        printf("Reading data for 2 seconds (supervised)...\n");
+        for (int i = 0; i < 4; i++) {
+            usb_sleep_ms(500);
+            usb_supervisor_get_stats(sup, &stats);
+            printf("Received %llu bytes in %llu transfers, %s, %d reconnect(s), downtime %.1f ms (max %.1f ms)\n",
+                   (unsigned long long)stats.bytes, (unsigned long long)stats.transfers,
+                   stats.connected ? "connected" : "disconnected", stats.reconnects, stats.downtime_ns / 1e6,
+                   stats.max_downtime_ns / 1e6);
+        }
+        usb_supervisor_stop(sup);
+        printf("Supervised stream: %d transfers delivered, %d gap(s) marked\n", c.packets, c.gaps);
+        if (cfg.stream.integrity) {
+            print_integrity(cfg.stream.integrity);
+        }
+    }
+    usb_frame_splitter_destroy(cfg.stream.splitter);
+    usb_integrity_destroy(cfg.stream.integrity);
+    if (capture) {
+        usb_capture_close(capture);
+    }
+    return r;
+}
+
+// 作为读者附加到另一个进程发布的共享内存环，读取2秒并报告
+static int subscribe(const char* name) {
+    usb_shm_reader_t* reader;
+    usb_shm_reader_stats_t stats;
+    usb_shm_record_t rec;
+    const unsigned char* payload;
+    int r = usb_shm_reader_open(&reader, name);
+    if (r < 0) {
+        printf("Failed to attach to %s: %s\n", name ? name : USB_SHM_DEFAULT_NAME, libusb_error_name(r));
+        return r;
+    }
+
+    printf("Reading from device %s via shared memory for 2 seconds...\n", usb_shm_reader_serial(reader));
+    uint32_t start_time = usb_time_ms();
+    while (usb_time_ms() - start_time < 2000) {
+        r = usb_shm_reader_next(reader, &rec, &payload, 100);
+        if (r == LIBUSB_ERROR_NO_DEVICE) {
+            printf("Publisher closed\n");
+            break;
+        }
+        if (r == 1) {
+            usb_shm_reader_release(reader);
+        }
+    }
+    usb_shm_reader_get_stats(reader, &stats);
+    printf("Received %llu records (%llu bytes), %llu overrun(s), %llu bytes lost\n",
+           (unsigned long long)stats.records, (unsigned long long)stats.bytes,
+           (unsigned long long)stats.overruns, (unsigned long long)stats.lost_bytes);
+    usb_shm_reader_close(reader);
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     int r;
-    device_info_t devices[MAX_DEVICES];
+    device_info_t* devices = NULL;  // 扫描到的设备，数量不限
+    char serial[MAX_STR_LENGTH];    // 选中的设备
     int selected_device = 0;  // 默认选择第一个设备
+    const char* device_arg = NULL;
+    int use_sim = 0;     // --sim[=N]: 使用N台模拟设备
+    int use_null = 0;    // --null: 使用空设备，测量主机端开销
+    int use_stream = 0;  // --stream: 使用异步流式读取
+    int use_all = 0;     // --all: 同时从所有设备采集
+    int merge = 0;       // --merge: --all 时所有设备的帧按时间合并
+    int frame_payload = 0;  // --frame=N: 设备按N字节负载分帧输出，流式读取时拆分并校验
+    int adaptive = 0;    // --adaptive: 流式读取按速率自动调整传输大小
+    int use_poll = 0;    // --poll: 流式读取由本线程的poll循环驱动，不创建事件线程
+    int supervise = 0;   // --supervise: 流式读取在设备断开后自动重连
+    const char* capture_path = NULL;  // --capture=PATH: 流式读取的数据写入段文件 PATH.NNNNNN.cap
+    int decode = -1;     // --decode=s16|s24|s32: 分帧数据 (--frame) 解码为样本
+    int publish = 0;                  // --publish[=NAME]: 流式读取的数据发布到共享内存环
+    const char* shm_name = NULL;
+    int trigger = 0;                  // --trigger=level:N|pattern:HEX|ext: --capture 只写入触发前后的窗口
+    usb_trigger_config_t trigger_cfg;
+    unsigned char trigger_pattern[USB_TRIGGER_MAX_PATTERN];
+    usb_replay_config_t replay_cfg;   // --replay=PATH [--speed=X]: 回放采集文件
+    usb_sim_config_t sim_cfg;
+    usb_trace_config_t trace_cfg;     // --trace=LEVEL --trace-file=PATH --trace-prefix: 日志级别和输出
+    int aggregate = 0;                // --aggregate=W1,W2,... [--channels=N] [--aggregate-out=PATH]: 解码后的样本按窗口统计
+    usb_aggregate_config_t aggregate_cfg;
+    const char* aggregate_path = NULL;
+    int low_latency = 0;              // --low-latency[=CPU]: 事件线程忙轮询并绑定到CPU (默认最后一个)，读取时自旋等待
+    int latency_cpu = -1;
+    int realtime = 0;                 // --realtime[=PRIO]: 事件线程使用实时调度 (默认优先级50)
+    uint64_t latency_mask = 0;
+    int hub_subs = 0;                 // --hub[=N]: --stream 的数据经集线器分发给N个订阅者线程 (默认4)
+
+    memset(&sim_cfg, 0, sizeof(sim_cfg));
+    memset(&trace_cfg, 0, sizeof(trace_cfg));
+    memset(&replay_cfg, 0, sizeof(replay_cfg));
+    memset(&trigger_cfg, 0, sizeof(trigger_cfg));
+    memset(&aggregate_cfg, 0, sizeof(aggregate_cfg));
+    replay_cfg.speed = 1.0;
+    sim_cfg.num_devices = 1;
+    sim_cfg.bytes_per_sec = USB_SIM_DEFAULT_RATE;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--sim", 5) == 0) {
+            use_sim = 1;
+            if (argv[i][5] == '=') {
+                sim_cfg.num_devices = atoi(argv[i] + 6);
+            }
+        } else if (strcmp(argv[i], "--null") == 0) {
+            use_null = 1;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            use_stream = 1;
+        } else if (strcmp(argv[i], "--all") == 0) {
+            use_all = 1;
+        } else if (strcmp(argv[i], "--merge") == 0) {
+            merge = 1;
+        } else if (strncmp(argv[i], "--timestamps", 12) == 0) {
+            sim_cfg.timestamps = 1;
+            if (argv[i][12] == '=') {
+                sim_cfg.clock_ppm = atof(argv[i] + 13);
+            }
+        } else if (strncmp(argv[i], "--frame=", 8) == 0) {
+            frame_payload = atoi(argv[i] + 8);
+            sim_cfg.frame_payload = frame_payload;
+        } else if (strcmp(argv[i], "--adaptive") == 0) {
+            adaptive = 1;
+        } else if (strcmp(argv[i], "--poll") == 0) {
+            use_poll = 1;
+        } else if (strcmp(argv[i], "--supervise") == 0) {
+            supervise = 1;
+        } else if (strncmp(argv[i], "--dropout=", 10) == 0) {
+            sim_cfg.dropout_interval_ms = atoi(argv[i] + 10);
+        } else if (strncmp(argv[i], "--capture=", 10) == 0) {
+            capture_path = argv[i] + 10;
+        } else if (strncmp(argv[i], "--decode=", 9) == 0) {
+            const char* f = argv[i] + 9;
+            decode = strcmp(f, "s16") == 0 ? USB_SAMPLE_S16 : strcmp(f, "s24") == 0 ? USB_SAMPLE_S24
+                   : strcmp(f, "s32") == 0 ? USB_SAMPLE_S32 : -1;
+            if (decode < 0) {
+                printf("Unknown sample format: %s (s16, s24, s32)\n", f);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--trigger=", 10) == 0) {
+            const char* t = argv[i] + 10;
+            trigger = 1;
+            if (strncmp(t, "level:", 6) == 0 && atoi(t + 6) > 0) {
+                trigger_cfg.mode = USB_TRIGGER_THRESHOLD;
+                trigger_cfg.threshold = atoi(t + 6);
+            } else if (strncmp(t, "pattern:", 8) == 0 &&
+                       (trigger_cfg.pattern_length = parse_hex(t + 8, trigger_pattern, USB_TRIGGER_MAX_PATTERN)) > 0) {
+                trigger_cfg.mode = USB_TRIGGER_PATTERN;
+                trigger_cfg.pattern = trigger_pattern;
+            } else if (strcmp(t, "ext") == 0) {
+                trigger_cfg.mode = USB_TRIGGER_EXTERNAL;
+            } else {
+                printf("Unknown trigger: %s (level:N, pattern:HEX or ext)\n", t);
+                return -1;
+            }
+        } else if (strncmp(argv[i], "--pre=", 6) == 0) {
+            trigger_cfg.pre_ms = (unsigned int)atoi(argv[i] + 6);
+        } else if (strncmp(argv[i], "--post=", 7) == 0) {
+            trigger_cfg.post_ms = (unsigned int)atoi(argv[i] + 7);
+        } else if (strncmp(argv[i], "--publish", 9) == 0) {
+            publish = 1;
+            if (argv[i][9] == '=') {
+                shm_name = argv[i] + 10;
+            }
+        } else if (strncmp(argv[i], "--hub", 5) == 0) {
+            hub_subs = argv[i][5] == '=' ? atoi(argv[i] + 6) : 4;
+            if (hub_subs < 1) hub_subs = 1;
+        } else if (strncmp(argv[i], "--subscribe", 11) == 0) {
+            // 读者模式不打开USB
+            return subscribe(argv[i][11] == '=' ? argv[i] + 12 : NULL);
+        } else if (strncmp(argv[i], "--aggregate=", 12) == 0) {
+            if (usb_aggregate_parse_windows(argv[i] + 12, &aggregate_cfg) < 0) {
+                printf("Invalid windows: %s (e.g. 100,1000,10000)\n", argv[i] + 12);
+                return -1;
+            }
+            aggregate = 1;
+        } else if (strncmp(argv[i], "--channels=", 11) == 0) {
+            aggregate_cfg.channels = atoi(argv[i] + 11);
+        } else if (strncmp(argv[i], "--aggregate-out=", 16) == 0) {
+            aggregate_path = argv[i] + 16;
+        } else if (strncmp(argv[i], "--low-latency", 13) == 0) {
+            low_latency = 1;
+            if (argv[i][13] == '=') {
+                latency_cpu = atoi(argv[i] + 14);
+            }
+        } else if (strncmp(argv[i], "--realtime", 10) == 0) {
+            realtime = argv[i][10] == '=' ? atoi(argv[i] + 11) : 50;
+        } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+            int level = usb_trace_parse_level(argv[i] + 8);
+            if (level < 0) {
+                printf("Unknown trace level: %s (off, error, warn, info, debug)\n", argv[i] + 8);
+                return -1;
+            }
+            usb_trace_set_level((usb_trace_level_t)level);
+        } else if (strncmp(argv[i], "--trace-file=", 13) == 0) {
+            trace_cfg.path = argv[i] + 13;
+        } else if (strcmp(argv[i], "--trace-prefix") == 0) {
+            trace_cfg.prefix = 1;
+        } else if (strncmp(argv[i], "--trace-decode=", 15) == 0) {
+            // 解码二进制日志后退出
+            r = usb_trace_decode(argv[i] + 15, stdout);
+            return r < 0 ? r : 0;
+        } else if (strncmp(argv[i], "--replay=", 9) == 0) {
+            replay_cfg.path = argv[i] + 9;
+        } else if (strncmp(argv[i], "--speed=", 8) == 0) {
+            replay_cfg.speed = atof(argv[i] + 8);
+        } else {
+            device_arg = argv[i];
+        }
+    }
+
+    // 低延迟: 事件线程独占一个CPU，本线程 (消费者) 绑定到其余CPU，避免两个自旋的线程抢同一个CPU
+    if (low_latency) {
+        int cpus = usb_cpu_count();
+        if (latency_cpu < 0 || latency_cpu >= cpus || latency_cpu >= 64) {
+            latency_cpu = cpus - 1 < 63 ? cpus - 1 : 63;
+        }
+        if (cpus >= 2) {
+            latency_mask = 1ull << latency_cpu;
+            uint64_t others = (cpus >= 64 ? ~0ull : (1ull << cpus) - 1) & ~latency_mask;
+            if (usb_thread_set_affinity(others) < 0) {
+                printf("Cannot pin main thread away from CPU %d\n", latency_cpu);
+            }
+        }
+    }
+
+    // 日志由后台线程输出，本线程的printf之前先 usb_trace_flush 保持顺序
+    r = usb_trace_start(&trace_cfg);
+    if (r < 0) {
+        return r;
+    }
+    atexit(usb_trace_stop);
 
     // Initialize USB control
-    r = usb_control_init();
+    if (replay_cfg.path) {
+        r = usb_control_init_replay(&replay_cfg);
+    } else if (use_null) {
+        r = usb_control_init_null();
+    } else {
+        r = use_sim ? usb_control_init_sim(&sim_cfg) : usb_control_init();
+    }
     if (r < 0) {
         return r;
     }
 
     // Get all matching devices
-    r = USB_ScanDevice(devices, MAX_DEVICES);
+    r = USB_ScanDeviceList(&devices, 0);
+    usb_trace_flush();
     if (r < 0) {
         printf("Failed to get device list: %s\n", libusb_error_name(r));
         usb_control_exit();
@@ -31,55 +742,339 @@ int main(int argc, char* argv[]) {
         printf("\n");
     }
 
+    if (use_all) {
+        r = capture_all(devices, num_devices, frame_payload, merge);
+        free(devices);
+        usb_control_exit();
+        return r;
+    }
+
     // Check command line arguments
-    if (argc > 1) {
-        selected_device = atoi(argv[1]) - 1;  // Convert from 1-based to 0-based index
+    if (device_arg) {
+        selected_device = atoi(device_arg) - 1;  // Convert from 1-based to 0-based index
         if (selected_device < 0 || selected_device >= num_devices) {
             printf("Invalid device number. Please select 1-%d\n", num_devices);
+            free(devices);
             usb_control_exit();
             return -1;
         }
     }
+    memcpy(serial, devices[selected_device].serial, sizeof(serial));
+    free(devices);
+
+    if (use_stream && supervise) {
+        r = stream_supervised(serial, capture_path, frame_payload);
+        usb_control_exit();
+        return r;
+    }
 
     // Open selected device
     printf("Opening device %d (S/N: %s)\n", 
-           selected_device + 1, devices[selected_device].serial);
+           selected_device + 1, serial);
 
            
-    r = USB_OpenDevice(devices[selected_device].serial);
+    r = USB_OpenDevice(serial);
+    usb_trace_flush();
     if (r < 0) {
         usb_control_exit();
         return r;
     }
 
+    usb_aggregate_t* agg = NULL;
+    aggregate_out_t aggregate_out;
+    if (aggregate) {
+        if (decode < 0 || (frame_payload <= 0 && use_stream && (capture_path || publish))) {
+            printf("--aggregate needs --decode (and --frame with --capture or --publish)\n");
+            r = -1;
+        } else {
+            aggregate_cfg.format = (usb_sample_format_t)decode;
+            r = open_aggregate(&agg, &aggregate_cfg, &aggregate_out, aggregate_path);
+        }
+        if (r < 0) {
+            USB_CloseDevice();
+            usb_control_exit();
+            return r;
+        }
+    }
+
     // Read data for 2 seconds
     printf("Reading data for 2 seconds...\n");
-    DWORD start_time = GetTickCount();
-    unsigned char data[64];
-    int transferred;
-    
-    while (GetTickCount() - start_time < 2000) {
-        r = usb_control_read(data, sizeof(data), &transferred);
-        if (r == 0 && transferred > 0) {
-            printf("Received %d bytes: ", transferred);
-            for (int i = 0; i < transferred && i < 16; i++) {  // 最多显示16字节
-                printf("%02X ", data[i]);
-            }
-            if (transferred > 16) printf("...");
-            printf("\n");
-        }
-        else if (r < 0 && r != LIBUSB_ERROR_TIMEOUT) {
-            printf("Read error: %s\n", libusb_error_name(r));
-            break;
+    uint32_t start_time = usb_time_ms();
+
+    if (use_stream) {
+        usb_stream_t* stream;
+        usb_stream_stats_t stats;
+        usb_stream_config_t stream_cfg;
+        usb_capture_t* capture = NULL;
+        usb_capture_sink_t* sink = NULL;
+        usb_shm_publisher_t* publisher = NULL;
+        usb_decoder_t* decoder = NULL;
+        usb_integrity_t* integrity = NULL;
+        usb_trigger_t* trig = NULL;
+        hub_out_t hub;
+        sample_decode_ctx_t sample_decode;
+        int packets = 0;
+        int frames = 0;
+
+        if (trigger && (!capture_path || (trigger_cfg.mode == USB_TRIGGER_THRESHOLD && (frame_payload <= 0 || decode < 0)))) {
+            printf("--trigger needs --capture (and --frame with --decode for level)\n");
+            USB_CloseDevice();
+            usb_control_exit();
+            return -1;
+        }
+        memset(&sample_decode, 0, sizeof(sample_decode));
+        sample_decode.frames = &frames;
+        sample_decode.aggregate = agg;
+        memset(&stream_cfg, 0, sizeof(stream_cfg));
+        if (frame_payload > 0) {
+            integrity = usb_integrity_create();
+            stream_cfg.integrity = integrity;
+        }
+        stream_cfg.adaptive = adaptive;
+        stream_cfg.external_events = use_poll;
+        stream_cfg.busy_poll = low_latency;
+        stream_cfg.cpu_mask = latency_mask;
+        stream_cfg.realtime = realtime;
+        if (frame_payload > 0 && decode >= 0 && ((trigger && trigger_cfg.mode == USB_TRIGGER_THRESHOLD) || agg)) {
+            decoder = usb_decoder_create((usb_sample_format_t)decode, frame_payload, on_decoded_samples, &sample_decode);
+            sample_decode.decoder = decoder;
+            stream_cfg.splitter = decoder ? usb_decoder_splitter(decoder) : NULL;
+        } else if (frame_payload > 0 && decode >= 0) {
+            decoder = usb_decoder_create((usb_sample_format_t)decode, frame_payload, on_decoded, &frames);
+            stream_cfg.splitter = decoder ? usb_decoder_splitter(decoder) : NULL;
+        } else if (frame_payload > 0) {
+            stream_cfg.splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, frame_payload, on_frame, &frames);
+        }
+
+        if (capture_path) {
+            usb_capture_config_t capture_cfg;
+            memset(&capture_cfg, 0, sizeof(capture_cfg));
+            capture_cfg.path = capture_path;
+            r = usb_capture_open(&capture, &capture_cfg);
+            if (r < 0) {
+                printf("Failed to open capture: %s\n", libusb_error_name(r));
+                USB_CloseDevice();
+                usb_control_exit();
+                return r;
+            }
+            sink = usb_capture_add_device(capture, serial);
+            if (trigger) {
+                trig = usb_trigger_create(&trigger_cfg, sink);
+                if (!trig) {
+                    printf("Failed to create trigger\n");
+                } else if (trigger_cfg.mode == USB_TRIGGER_EXTERNAL) {
+                    usb_thread_t thread;
+                    usb_mutex_init(&stdin_trigger_lock);
+                    stdin_trigger = trig;
+                    usb_thread_create(&thread, stdin_trigger_thread, NULL);
+                    printf("Press Enter to trigger\n");
+                }
+                sample_decode.trigger = trigger_cfg.mode == USB_TRIGGER_THRESHOLD ? trig : NULL;
+            }
+        }
+
+        if (publish && !capture) {
+            usb_shm_config_t shm_cfg;
+            memset(&shm_cfg, 0, sizeof(shm_cfg));
+            shm_cfg.name = shm_name;
+            shm_cfg.serial = serial;
+            r = usb_shm_publisher_create(&publisher, &shm_cfg);
+            if (r < 0) {
+                printf("Failed to create shared memory: %s\n", libusb_error_name(r));
+                USB_CloseDevice();
+                usb_control_exit();
+                return r;
+            }
+            printf("Publishing to shared memory %s\n", shm_name ? shm_name : USB_SHM_DEFAULT_NAME);
+        }
+
+        memset(&hub, 0, sizeof(hub));
+        if (hub_subs > 0 && !capture && !publisher && !agg && (r = open_hub(&hub, hub_subs, &stream_cfg)) < 0) {
+            printf("Failed to create hub: %s\n", libusb_error_name(r));
+        }
+
+        if (trig) {
+            r = usb_stream_start(&stream, NULL, &stream_cfg, usb_trigger_stream_cb, trig);
+        } else if (capture) {
+            r = usb_stream_start(&stream, NULL, &stream_cfg, usb_capture_stream_cb, sink);
+        } else if (publisher) {
+            r = usb_stream_start(&stream, NULL, &stream_cfg, usb_shm_stream_cb, publisher);
+        } else if (agg && !stream_cfg.splitter) {
+            r = usb_stream_start(&stream, NULL, &stream_cfg, on_stream_aggregate, agg);
+        } else if (hub.hub) {
+            r = usb_stream_start(&stream, NULL, &stream_cfg, NULL, hub.hub);
+        } else {
+            r = usb_stream_start(&stream, NULL, &stream_cfg, on_stream_data, &packets);
+        }
+        if (r < 0) {
+            printf("Failed to start stream: %s\n", libusb_error_name(r));
+        } else {
+            usb_stats_snapshot_t prev, now, delta;
+            usb_device_get_stats(NULL, &prev);
+            while (usb_time_ms() - start_time < 2000) {
+                if (use_poll) {
+                    // 等待后端的fd，500ms内处理完成事件
+                    uint32_t report_time = usb_time_ms() + 500;
+                    while ((int32_t)(report_time - usb_time_ms()) > 0 && r >= 0) {
+                        r = usb_control_wait_events((int)(report_time - usb_time_ms()));
+                    }
+                    if (r < 0) {
+                        printf("Event loop error: %s\n", libusb_error_name(r));
+                        break;
+                    }
+                } else {
+                    usb_sleep_ms(500);
+                }
+                usb_stream_get_stats(stream, &stats);
+                usb_device_get_stats(NULL, &now);
+                usb_stats_delta(&now, &prev, &delta);
+                prev = now;
+                printf("Received %llu bytes in %d transfers of %d bytes, %.2f MB/s, latency p50 %.1f us p99 %.1f us max %.1f us\n",
+                       (unsigned long long)stats.bytes, (int)stats.transfers, stats.transfer_size, stats.mb_per_sec,
+                       usb_stats_percentile(&delta, 0.5) / 1000.0, usb_stats_percentile(&delta, 0.99) / 1000.0,
+                       now.max_ns / 1000.0);
+            }
+            r = usb_stream_stop(stream);
+            if (r < 0) {
+                printf("Stream error: %s\n", libusb_error_name(r));
+            }
+        }
+        if (stream_cfg.splitter) {
+            usb_frame_stats_t frame_stats;
+            usb_frame_get_stats(stream_cfg.splitter, &frame_stats);
+            printf("Frames: %d ok, %llu CRC errors, %llu resyncs (%llu bytes skipped)\n", frames,
+                   (unsigned long long)frame_stats.crc_errors, (unsigned long long)frame_stats.resyncs,
+                   (unsigned long long)frame_stats.skipped_bytes);
+            print_integrity(integrity);
+            if (decoder) {
+                usb_decode_stats_t decode_stats;
+                usb_decoder_get_stats(decoder, &decode_stats);
+                printf("Decoded %llu samples (%s kernels)\n", (unsigned long long)decode_stats.samples,
+                       usb_decode_level_name(usb_decode_get_level()));
+                usb_decoder_destroy(decoder);
+            } else {
+                usb_frame_splitter_destroy(stream_cfg.splitter);
+            }
+        }
+        close_aggregate(agg, &aggregate_out);
+        close_hub(&hub);
+        usb_integrity_destroy(integrity);
+        if (trig) {
+            print_trigger(trig, trigger_cfg.mode);
+            if (trigger_cfg.mode == USB_TRIGGER_EXTERNAL) {
+                usb_mutex_lock(&stdin_trigger_lock);
+                stdin_trigger = NULL;
+                usb_mutex_unlock(&stdin_trigger_lock);
+            }
+            usb_trigger_destroy(trig);
+        }
+        if (capture) {
+            usb_capture_stats_t capture_stats;
+            usb_capture_get_stats(capture, &capture_stats);
+            usb_capture_close(capture);
+            printf("Captured %llu records (%llu bytes) in %llu segment(s) to %s.*.cap, %llu dropped\n",
+                   (unsigned long long)capture_stats.records, (unsigned long long)capture_stats.bytes,
+                   (unsigned long long)capture_stats.segments, capture_path,
+                   (unsigned long long)capture_stats.dropped);
+        }
+        if (publisher) {
+            usb_shm_stats_t shm_stats;
+            usb_shm_publisher_get_stats(publisher, &shm_stats);
+            usb_shm_publisher_destroy(publisher);
+            printf("Published %llu records (%llu bytes), %d reader(s), %llu overrun(s), %llu wakeup(s)\n",
+                   (unsigned long long)shm_stats.records, (unsigned long long)shm_stats.bytes, shm_stats.readers,
+                   (unsigned long long)shm_stats.overruns, (unsigned long long)shm_stats.wakeups);
+        }
+    } else {
+        // 读取线程把数据放入环形缓冲区，打印在本线程进行，不会拖慢总线读取
+        usb_reader_t* reader;
+        usb_reader_config_t reader_cfg;
+        usb_stream_stats_t stream_stats;
+        usb_ring_stats_t ring_stats;
+        usb_decoder_t* decoder = NULL;
+        usb_integrity_t* integrity = NULL;
+        sample_decode_ctx_t sample_decode;
+        int frames = 0;
+        int timeouts = 0;
+        int transferred;
+
+        memset(&reader_cfg, 0, sizeof(reader_cfg));
+        reader_cfg.stream.transfer_size = USB_STREAM_DEFAULT_SIZE;
+        reader_cfg.policy = USB_RING_DROP_OLDEST;
+        reader_cfg.low_latency = low_latency;
+        reader_cfg.stream.cpu_mask = latency_mask;
+        reader_cfg.stream.realtime = realtime;
+        unsigned char* data = (unsigned char*)malloc(USB_STREAM_DEFAULT_SIZE);
+        memset(&sample_decode, 0, sizeof(sample_decode));
+        sample_decode.frames = &frames;
+        sample_decode.aggregate = agg;
+        if (frame_payload > 0 && decode >= 0) {
+            decoder = agg ? usb_decoder_create((usb_sample_format_t)decode, frame_payload, on_decoded_samples, &sample_decode)
+                          : usb_decoder_create((usb_sample_format_t)decode, frame_payload, on_decoded, &frames);
+            sample_decode.decoder = decoder;
+            integrity = decoder ? usb_integrity_create() : NULL;
+            if (integrity) {
+                // 环形缓冲区的丢弃和传输错误由读取线程报告，解码时按帧序号检查
+                reader_cfg.stream.integrity = integrity;
+                usb_frame_set_integrity(usb_decoder_splitter(decoder), integrity);
+            }
+        }
+
+        r = data ? usb_reader_start(&reader, NULL, &reader_cfg) : LIBUSB_ERROR_NO_MEM;
+        if (r < 0) {
+            printf("Failed to start reader: %s\n", libusb_error_name(r));
+        } else {
+            while (usb_time_ms() - start_time < 2000) {
+                r = usb_reader_read(reader, data, USB_STREAM_DEFAULT_SIZE, &transferred, 100);
+                if (r == 0 && transferred > 0 && decoder) {
+                    usb_decoder_feed(decoder, data, transferred);
+                } else if (r == 0 && transferred > 0 && agg) {
+                    usb_aggregate_feed_bytes(agg, data, transferred, usb_time_ns());
+                } else if (r == 0 && transferred > 0) {
+                    // 最多显示16字节，格式化在后台线程
+                    USB_TRACE_BYTES(DATA_RECEIVED, data, transferred < 16 ? transferred : 16, transferred);
+                }
+                else if (r == LIBUSB_ERROR_TIMEOUT) {
+                    timeouts++;
+                }
+                else if (r < 0) {
+                    printf("Read error: %s\n", libusb_error_name(r));
+                    break;
+                }
+            }
+            usb_trace_flush();
+
+            if (decoder) {
+                usb_decode_stats_t decode_stats;
+                usb_decoder_get_stats(decoder, &decode_stats);
+                printf("Decoded %d frames, %llu samples, %llu CRC errors, %llu resyncs (%s kernels)\n", frames,
+                       (unsigned long long)decode_stats.samples, (unsigned long long)decode_stats.frames.crc_errors,
+                       (unsigned long long)decode_stats.frames.resyncs, usb_decode_level_name(usb_decode_get_level()));
+            }
+            if (integrity) {
+                print_integrity(integrity);
+            }
+            usb_reader_get_stats(reader, &stream_stats, &ring_stats);
+            printf("Ring high-water %u/%u slots, dropped %llu bytes, %d read timeout(s)\n",
+                   ring_stats.high_water, ring_stats.capacity, (unsigned long long)ring_stats.dropped_bytes, timeouts);
+            r = usb_reader_stop(reader);
+            if (r < 0) {
+                printf("Read error: %s\n", libusb_error_name(r));
+            }
         }
+        close_aggregate(agg, &aggregate_out);
+        usb_decoder_destroy(decoder);
+        usb_integrity_destroy(integrity);
+        free(data);
     }
 
     // Wait for 2 seconds
     printf("Waiting for 2 seconds...\n");
-    Sleep(2000);
+    usb_sleep_ms(2000);
 
     // Close device
     r = USB_CloseDevice();
+    usb_trace_flush();
     if (r < 0) {
         usb_control_exit();
         return r;
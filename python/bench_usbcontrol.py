@@ -0,0 +1,109 @@
+"""usbcontrol Python扩展的开销: 同一个流，数据只在C里计数 vs 交给Python。
+
+  C         Stream(queue=False): 事件线程里只有统计，不经过Python (C路径的基线)
+  py/1      Stream.read(max_buffers=1): 每次调用取一个传输
+  py/batch  Stream.read(max_buffers=64): 每次调用取一批
+  numpy     同 py/batch，每个传输用 numpy.frombuffer 包装并读取首尾元素 (没有安装numpy时跳过)
+
+null后端的传输立即完成，吞吐量只受CPU限制，报告每MB的CPU时间和相对C的额外开销；
+sim后端限速 (--rate)，报告能否跟上和CPU占用。
+
+用法: make python && python3 python/bench_usbcontrol.py [--duration=ms] [--size=传输字节] [--rate=MB/s]
+"""
+
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import usbcontrol  # noqa: E402
+
+try:
+    import numpy
+except ImportError:
+    numpy = None
+
+
+def consume(stream, mode, end):
+    touched = 0
+    batch = 1 if mode == "py/1" else 64
+    while time.monotonic() < end:
+        for buf in stream.read(max_buffers=batch, timeout_ms=50):
+            if mode == "numpy":
+                a = numpy.frombuffer(buf, dtype=numpy.uint8)
+                touched += int(a[0]) + int(a[-1])
+            else:
+                mv = memoryview(buf)
+                touched += mv[0] + mv[-1]
+                mv.release()
+    return touched
+
+
+def run(dev, mode, size, duration):
+    stream = dev.stream(transfer_size=size, queue=(mode != "C"))
+    cpu = time.process_time()
+    start = time.monotonic()
+    end = start + duration
+    if mode == "C":
+        time.sleep(duration)
+    else:
+        consume(stream, mode, end)
+    stats = stream.stats()
+    sec = time.monotonic() - start
+    cpu = time.process_time() - cpu
+    stream.close()
+    mb = stats["bytes"] / (1024 * 1024)
+    return {
+        "mb_s": mb / sec,
+        "us_per_mb": cpu * 1e6 / mb if mb else 0,
+        "cpu": cpu / sec * 100,
+        "calls_per_s": stats["transfers"] / sec,
+        "waits": stats["pool_waits"],
+        "dropped": stats["dropped"],
+    }
+
+
+def bench(backend, size, duration, rate):
+    if backend == "sim":
+        usbcontrol.init("sim", rate=rate * 1024 * 1024)
+    else:
+        usbcontrol.init(backend)
+    modes = ["C", "py/1", "py/batch"] + (["numpy"] if numpy else [])
+    print("\nbackend=%s transfer=%d bytes%s" % (backend, size, " rate=%.0f MB/s" % rate if backend == "sim" else ""))
+    print("%-9s %10s %11s %10s %8s %10s %10s %8s" % ("mode", "MB/s", "transfers/s", "CPU us/MB", "CPU %",
+                                                     "vs C us/MB", "pool waits", "dropped"))
+    with usbcontrol.Device() as dev:
+        base = None
+        for mode in modes:
+            r = run(dev, mode, size, duration)
+            if base is None:
+                base = r["us_per_mb"]
+            print("%-9s %10.1f %11.0f %10.1f %8.1f %+10.1f %10d %8d" % (
+                mode, r["mb_s"], r["calls_per_s"], r["us_per_mb"], r["cpu"], r["us_per_mb"] - base,
+                r["waits"], r["dropped"]))
+    usbcontrol.exit()
+
+
+def main():
+    duration = 1.0
+    size = 16384
+    rate = 100.0
+    for arg in sys.argv[1:]:
+        if arg.startswith("--duration="):
+            duration = int(arg[11:]) / 1000.0
+        elif arg.startswith("--size="):
+            size = int(arg[7:])
+        elif arg.startswith("--rate="):
+            rate = float(arg[7:])
+        else:
+            print("Unknown option: %s" % arg)
+            return 1
+    if numpy is None:
+        print("numpy not installed, skipping the numpy mode")
+    bench("null", size, duration, rate)
+    bench("sim", size, duration, rate)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
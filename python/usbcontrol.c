@@ -0,0 +1,930 @@
+// Python扩展模块 usbcontrol: 扫描、打开、流式读取、关闭，供 serial_tool 等Python代码直接调用，不再解析 usb_control.exe 的输出。
+//
+// 流式读取的数据不复制: 流使用缓冲区池，事件线程把完成的池缓冲区 (加一个引用) 放入队列，
+// Stream.read() 一次取出一批，每个包成为一个 usbcontrol.Buffer 对象，它通过缓冲区协议直接暴露池缓冲区:
+//     memoryview(buf) / numpy.frombuffer(buf, dtype=numpy.uint8) / bytes(buf) (这个会复制)
+// Buffer 被回收 (或调用 release()) 时缓冲区回到池中。Python持有的缓冲区太多时池会用完，流暂停等待
+// (统计中的 pool_waits)，不会丢数据也不会覆盖Python正在看的数据。
+//
+// 事件线程不接触Python对象，不需要GIL；Stream.read() 等待数据时、打开/关闭/停止时释放GIL。
+//
+// 编译: make python  (生成 python/usbcontrol<扩展名后缀>，把 python 目录加入 PYTHONPATH 或复制到 serial_tool 旁边)
+//
+//     import usbcontrol
+//     usbcontrol.init("sim")                       # "usb" (默认) / "sim" / "null"
+//     for d in usbcontrol.scan(): print(d["serial"])
+//     with usbcontrol.Device() as dev, dev.stream() as s:
+//         for buf in s.read(max_buffers=64, timeout_ms=100):
+//             process(memoryview(buf))
+//     usbcontrol.exit()
+//
+// 窗口统计 (不需要init，可以对任何bytes-like使用，包括Buffer):
+//     agg = usbcontrol.Aggregator([100, 1000], channels=2, format="s16")
+//     for level, index, first_sample, count, values in agg.feed(buf, buf.time_ns): ...   # values: 每通道 (min, max, mean, rms)
+//     agg.flush()                                  # 采集结束时输出未满的窗口
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_ring.h"
+#include "usb_sim.h"
+#include "usb_transport.h"
+#include "usb_aggregate.h"
+
+#define PY_DEFAULT_BUFFERS 64    // 池缓冲区数 (同时挂起的传输 + 队列中 + Python持有)
+#define PY_DEFAULT_BATCH   64
+
+static int initialized;
+
+static PyObject* raise_usb_error(int r) {
+    PyErr_Format(PyExc_OSError, "%s (%d)", libusb_error_name(r), r);
+    return NULL;
+}
+
+// ---- Device ----
+
+typedef struct {
+    PyObject_HEAD
+    usb_device_t* device;    // 关闭后为NULL
+    int streams;             // 未关闭的流数，有流时不能关闭设备
+} DeviceObject;
+
+// ---- Stream ----
+
+typedef struct {
+    PyObject_HEAD
+    DeviceObject* device;
+    usb_stream_t* stream;    // 停止后为NULL
+    usb_pool_t* pool;        // 所有Buffer回收后才能销毁，所以在dealloc中销毁 (Buffer持有Stream的引用)
+    usb_ring_t* queue;       // usb_buffer_t* 队列，单生产者 (事件线程) 单消费者 (持有read_lock的线程)
+    usb_mutex_t read_lock;
+    usb_stream_stats_t final_stats;  // 停止时的统计
+} StreamObject;
+
+// ---- Buffer ----
+
+typedef struct {
+    PyObject_HEAD
+    usb_buffer_t* buffer;    // release之后为NULL
+    StreamObject* owner;
+    Py_ssize_t exports;      // 导出的视图数，有视图时不能release
+} BufferObject;
+
+// ---- Aggregator ----
+
+typedef struct {
+    PyObject_HEAD
+    usb_aggregate_t* agg;
+    int levels;
+    int channels;
+    PyObject* windows;       // feed/flush 期间结束的窗口，出错时为NULL
+} AggregatorObject;
+
+static PyTypeObject DeviceType;
+static PyTypeObject StreamType;
+static PyTypeObject BufferType;
+static PyTypeObject AggregatorType;
+
+static void buffer_do_release(BufferObject* self) {
+    if (self->buffer) {
+        usb_buffer_release(self->buffer);
+        self->buffer = NULL;
+    }
+}
+
+static void Buffer_dealloc(BufferObject* self) {
+    buffer_do_release(self);
+    Py_XDECREF(self->owner);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int Buffer_getbuffer(BufferObject* self, Py_buffer* view, int flags) {
+    if (!self->buffer) {
+        PyErr_SetString(PyExc_ValueError, "buffer already released");
+        return -1;
+    }
+    if (PyBuffer_FillInfo(view, (PyObject*)self, self->buffer->data, self->buffer->length, 1, flags) < 0) {
+        return -1;
+    }
+    self->exports++;
+    return 0;
+}
+
+static void Buffer_releasebuffer(BufferObject* self, Py_buffer* view) {
+    (void)view;
+    self->exports--;
+}
+
+static Py_ssize_t Buffer_length(BufferObject* self) {
+    return self->buffer ? self->buffer->length : 0;
+}
+
+static PyObject* Buffer_release(BufferObject* self, PyObject* unused) {
+    (void)unused;
+    if (self->exports > 0) {
+        PyErr_SetString(PyExc_BufferError, "buffer still has exported views");
+        return NULL;
+    }
+    buffer_do_release(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject* Buffer_get_time_ns(BufferObject* self, void* closure) {
+    (void)closure;
+    return PyLong_FromUnsignedLongLong(self->buffer ? self->buffer->time_ns : 0);
+}
+
+static PyBufferProcs Buffer_as_buffer = {
+    (getbufferproc)Buffer_getbuffer,
+    (releasebufferproc)Buffer_releasebuffer,
+};
+
+static PySequenceMethods Buffer_as_sequence = {
+    .sq_length = (lenfunc)Buffer_length,
+};
+
+static PyMethodDef Buffer_methods[] = {
+    {"release", (PyCFunction)Buffer_release, METH_NOARGS, "立即把缓冲区还给池 (不能有未释放的memoryview)"},
+    {NULL}
+};
+
+static PyGetSetDef Buffer_getset[] = {
+    {"time_ns", (getter)Buffer_get_time_ns, NULL, "传输完成的时间 (单调时钟ns)", NULL},
+    {NULL}
+};
+
+static PyTypeObject BufferType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "usbcontrol.Buffer",
+    .tp_basicsize = sizeof(BufferObject),
+    .tp_dealloc = (destructor)Buffer_dealloc,
+    .tp_as_sequence = &Buffer_as_sequence,
+    .tp_as_buffer = &Buffer_as_buffer,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "一个传输的数据，通过缓冲区协议零拷贝访问池缓冲区",
+    .tp_methods = Buffer_methods,
+    .tp_getset = Buffer_getset,
+};
+
+// 事件线程: 给缓冲区加一个引用放入队列，队列满时丢弃 (计入队列的dropped)
+static void stream_buffer_cb(usb_buffer_t* buffer, void* user_data) {
+    StreamObject* self = (StreamObject*)user_data;
+    usb_buffer_ref(buffer);
+    if (usb_ring_push(self->queue, (const unsigned char*)&buffer, sizeof(buffer)) != 0) {
+        usb_buffer_release(buffer);
+    }
+}
+
+// 停止流 (释放GIL)，释放队列中剩下的缓冲区。Python持有的Buffer不受影响
+static int stream_do_close(StreamObject* self) {
+    usb_buffer_t* buffer;
+    int r = 0;
+    if (!self->stream) {
+        return 0;
+    }
+    // 持有GIL时取走指针: 同时关闭的其他线程 (close 与 __exit__、另一个线程中的dealloc) 看到已关闭，
+    // 不会重复停止同一个流。streams 由取走指针的线程在停止完成后减一，停止期间设备不能关闭
+    usb_stream_t* stream = self->stream;
+    usb_stream_get_stats(stream, &self->final_stats);
+    self->stream = NULL;
+    Py_BEGIN_ALLOW_THREADS
+    usb_mutex_lock(&self->read_lock);
+    r = usb_stream_stop(stream);
+    if (self->queue) {
+        usb_ring_close(self->queue);
+        while (usb_ring_pop(self->queue, (unsigned char*)&buffer, sizeof(buffer), 0) == (int)sizeof(buffer)) {
+            usb_buffer_release(buffer);
+        }
+    }
+    usb_mutex_unlock(&self->read_lock);
+    Py_END_ALLOW_THREADS
+    self->device->streams--;
+    return r;
+}
+
+static void Stream_dealloc(StreamObject* self) {
+    if (self->device) {
+        stream_do_close(self);
+        usb_mutex_destroy(&self->read_lock);
+    }
+    if (self->queue) usb_ring_destroy(self->queue);
+    if (self->pool) usb_pool_destroy(self->pool);
+    Py_XDECREF(self->device);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int Stream_init(StreamObject* self, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"device", "transfer_size", "transfers", "buffers", "queue", "adaptive", NULL};
+    DeviceObject* device;
+    usb_stream_config_t cfg;
+    int buffers = PY_DEFAULT_BUFFERS;
+    int queue = 1;
+    int r;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.transfer_size = USB_STREAM_DEFAULT_SIZE;
+    cfg.num_transfers = USB_STREAM_DEFAULT_TRANSFERS;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O!|iiipp", kwlist, &DeviceType, &device, &cfg.transfer_size,
+                                     &cfg.num_transfers, &buffers, &queue, &cfg.adaptive)) {
+        return -1;
+    }
+    if (self->device) {
+        PyErr_SetString(PyExc_RuntimeError, "stream already initialized");
+        return -1;
+    }
+    if (!device->device) {
+        PyErr_SetString(PyExc_ValueError, "device is closed");
+        return -1;
+    }
+    if (cfg.transfer_size <= 0 || cfg.num_transfers <= 0 || buffers < cfg.num_transfers) {
+        PyErr_SetString(PyExc_ValueError, "need transfer_size > 0 and buffers >= transfers > 0");
+        return -1;
+    }
+
+    // queue=False: 数据在事件线程中丢弃，只有统计 (测量不经过Python的C路径)
+    if (queue) {
+        // 池缓冲区按页对齐，不小于按包长取整后的传输大小
+        self->pool = usb_pool_create(buffers, cfg.transfer_size, 0);
+        self->queue = usb_ring_create(buffers, sizeof(usb_buffer_t*), USB_RING_DROP_NEWEST);
+        if (!self->pool || !self->queue) {
+            PyErr_NoMemory();
+            return -1;
+        }
+        cfg.pool = self->pool;
+        cfg.buffer_cb = stream_buffer_cb;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    r = usb_stream_start(&self->stream, device->device, &cfg, NULL, self);
+    Py_END_ALLOW_THREADS
+    if (r < 0) {
+        self->stream = NULL;
+        raise_usb_error(r);
+        return -1;
+    }
+    usb_mutex_init(&self->read_lock);
+    Py_INCREF(device);
+    self->device = device;
+    device->streams++;
+    return 0;
+}
+
+static PyObject* Stream_read(StreamObject* self, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"max_buffers", "timeout_ms", NULL};
+    int max_buffers = PY_DEFAULT_BATCH;
+    unsigned int timeout_ms = 100;
+    usb_buffer_t* batch[256];
+    int n = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|iI", kwlist, &max_buffers, &timeout_ms)) {
+        return NULL;
+    }
+    if (!self->stream) {
+        PyErr_SetString(PyExc_ValueError, "stream is closed");
+        return NULL;
+    }
+    if (!self->queue) {
+        PyErr_SetString(PyExc_ValueError, "stream was started with queue=False");
+        return NULL;
+    }
+    if (max_buffers <= 0) {
+        max_buffers = PY_DEFAULT_BATCH;
+    }
+    if (max_buffers > (int)(sizeof(batch) / sizeof(batch[0]))) {
+        max_buffers = (int)(sizeof(batch) / sizeof(batch[0]));
+    }
+
+    // 第一个最多等timeout_ms，之后取出已经到达的，一次调用交付一批
+    Py_BEGIN_ALLOW_THREADS
+    usb_mutex_lock(&self->read_lock);
+    unsigned int wait = timeout_ms;
+    while (n < max_buffers &&
+           usb_ring_pop(self->queue, (unsigned char*)&batch[n], sizeof(batch[n]), wait) == (int)sizeof(batch[n])) {
+        n++;
+        wait = 0;
+    }
+    usb_mutex_unlock(&self->read_lock);
+    Py_END_ALLOW_THREADS
+
+    PyObject* list = PyList_New(n);
+    for (int i = 0; i < n; i++) {
+        BufferObject* b = list ? PyObject_New(BufferObject, &BufferType) : NULL;
+        if (!b) {
+            for (int j = i; j < n; j++) usb_buffer_release(batch[j]);
+            Py_XDECREF(list);
+            return NULL;
+        }
+        b->buffer = batch[i];
+        b->exports = 0;
+        Py_INCREF(self);
+        b->owner = self;
+        PyList_SET_ITEM(list, i, (PyObject*)b);
+    }
+    return list;
+}
+
+static PyObject* Stream_close(StreamObject* self, PyObject* unused) {
+    (void)unused;
+    int r = stream_do_close(self);
+    if (r < 0 && r != LIBUSB_ERROR_NO_DEVICE) {
+        return raise_usb_error(r);
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* Stream_stats(StreamObject* self, PyObject* unused) {
+    (void)unused;
+    usb_stream_stats_t st = self->final_stats;
+    usb_ring_stats_t ring;
+    memset(&ring, 0, sizeof(ring));
+    if (self->stream) {
+        usb_stream_get_stats(self->stream, &st);
+    }
+    if (self->queue) {
+        usb_ring_get_stats(self->queue, &ring);
+    }
+    return Py_BuildValue("{s:K,s:K,s:K,s:K,s:i,s:i,s:K,s:i,s:d,s:d,s:K,s:I}",
+                         "bytes", (unsigned long long)st.bytes, "transfers", (unsigned long long)st.transfers,
+                         "timeouts", (unsigned long long)st.timeouts, "errors", (unsigned long long)st.errors,
+                         "last_error", st.last_error, "transfer_size", st.transfer_size,
+                         "pool_waits", (unsigned long long)st.pool_waits, "in_flight", st.in_flight,
+                         "elapsed_sec", st.elapsed_sec, "mb_per_sec", st.mb_per_sec,
+                         "dropped", (unsigned long long)ring.dropped, "queued", ring.count);
+}
+
+static PyObject* Stream_enter(PyObject* self, PyObject* unused) {
+    (void)unused;
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject* Stream_exit(StreamObject* self, PyObject* args) {
+    (void)args;
+    return Stream_close(self, NULL);
+}
+
+static PyMethodDef Stream_methods[] = {
+    {"read", (PyCFunction)(void (*)(void))Stream_read, METH_VARARGS | METH_KEYWORDS,
+     "read(max_buffers=64, timeout_ms=100) -> list[Buffer]: 等待第一个传输最多timeout_ms，返回已到达的一批 (超时为空列表)"},
+    {"close", (PyCFunction)Stream_close, METH_NOARGS, "停止流式读取，已经取出的Buffer仍然有效"},
+    {"stats", (PyCFunction)Stream_stats, METH_NOARGS, "流的统计 (dict)，dropped 为队列满丢弃的传输数"},
+    {"__enter__", (PyCFunction)Stream_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Stream_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyTypeObject StreamType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "usbcontrol.Stream",
+    .tp_basicsize = sizeof(StreamObject),
+    .tp_dealloc = (destructor)Stream_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Stream(device, transfer_size=16384, transfers=8, buffers=64, queue=True, adaptive=False)\n"
+              "在设备上开始异步流式读取，数据以池缓冲区交付",
+    .tp_methods = Stream_methods,
+    .tp_init = (initproc)Stream_init,
+    .tp_new = PyType_GenericNew,
+};
+
+// ---- Device 方法 ----
+
+static void Device_dealloc(DeviceObject* self) {
+    if (self->device) {
+        USB_CloseDeviceEx(self->device);
+    }
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int Device_init(DeviceObject* self, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"serial", NULL};
+    const char* serial = NULL;
+    int r;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|z", kwlist, &serial)) {
+        return -1;
+    }
+    if (!initialized) {
+        PyErr_SetString(PyExc_RuntimeError, "usbcontrol.init() has not been called");
+        return -1;
+    }
+    if (self->device) {
+        PyErr_SetString(PyExc_RuntimeError, "device already open");
+        return -1;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    r = USB_OpenDeviceEx(serial, &self->device);
+    Py_END_ALLOW_THREADS
+    if (r < 0) {
+        self->device = NULL;
+        raise_usb_error(r);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject* Device_close(DeviceObject* self, PyObject* unused) {
+    (void)unused;
+    int r = 0;
+    if (self->streams > 0) {
+        PyErr_SetString(PyExc_RuntimeError, "close the device's streams first");
+        return NULL;
+    }
+    if (self->device) {
+        usb_device_t* device = self->device;
+        self->device = NULL;
+        Py_BEGIN_ALLOW_THREADS
+        r = USB_CloseDeviceEx(device);
+        Py_END_ALLOW_THREADS
+    }
+    if (r < 0 && r != LIBUSB_ERROR_NO_DEVICE) {
+        return raise_usb_error(r);
+    }
+    Py_RETURN_NONE;
+}
+
+static int device_check(DeviceObject* self) {
+    if (!self->device) {
+        PyErr_SetString(PyExc_ValueError, "device is closed");
+        return -1;
+    }
+    return 0;
+}
+
+// 同步读取到调用者的可写缓冲区 (bytearray、numpy数组...)，返回读到的字节数
+static PyObject* Device_readinto(DeviceObject* self, PyObject* args) {
+    Py_buffer view;
+    int transferred = 0;
+    int r;
+
+    if (!PyArg_ParseTuple(args, "w*", &view)) {
+        return NULL;
+    }
+    if (device_check(self) < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    int length = view.len > INT_MAX ? INT_MAX : (int)view.len;
+    Py_BEGIN_ALLOW_THREADS
+    r = usb_device_read(self->device, (unsigned char*)view.buf, length, &transferred);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    if (r < 0 && r != LIBUSB_ERROR_TIMEOUT) {
+        return raise_usb_error(r);
+    }
+    return PyLong_FromLong(transferred);
+}
+
+static PyObject* Device_read(DeviceObject* self, PyObject* args) {
+    int length = USB_STREAM_DEFAULT_SIZE;
+    int transferred = 0;
+    int r;
+
+    if (!PyArg_ParseTuple(args, "|i", &length) || device_check(self) < 0) {
+        return NULL;
+    }
+    if (length <= 0) {
+        PyErr_SetString(PyExc_ValueError, "length must be positive");
+        return NULL;
+    }
+    PyObject* result = PyBytes_FromStringAndSize(NULL, length);
+    if (!result) {
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    r = usb_device_read(self->device, (unsigned char*)PyBytes_AS_STRING(result), length, &transferred);
+    Py_END_ALLOW_THREADS
+    if (r < 0 && r != LIBUSB_ERROR_TIMEOUT) {
+        Py_DECREF(result);
+        return raise_usb_error(r);
+    }
+    if (_PyBytes_Resize(&result, transferred) < 0) {
+        return NULL;
+    }
+    return result;
+}
+
+static PyObject* Device_write(DeviceObject* self, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"data", "timeout_ms", NULL};
+    Py_buffer view;
+    unsigned int timeout_ms = 0;
+    int transferred = 0;
+    int r;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|I", kwlist, &view, &timeout_ms)) {
+        return NULL;
+    }
+    if (device_check(self) < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    int length = view.len > INT_MAX ? INT_MAX : (int)view.len;
+    Py_BEGIN_ALLOW_THREADS
+    r = usb_device_write(self->device, (const unsigned char*)view.buf, length, &transferred, timeout_ms);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    if (r < 0) {
+        return raise_usb_error(r);
+    }
+    return PyLong_FromLong(transferred);
+}
+
+static PyObject* Device_stream(DeviceObject* self, PyObject* args, PyObject* kwds) {
+    PyObject* full_args = NULL;
+    Py_ssize_t n = PyTuple_GET_SIZE(args);
+
+    // Stream(self, *args, **kwds)
+    full_args = PyTuple_New(n + 1);
+    if (!full_args) {
+        return NULL;
+    }
+    Py_INCREF(self);
+    PyTuple_SET_ITEM(full_args, 0, (PyObject*)self);
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject* item = PyTuple_GET_ITEM(args, i);
+        Py_INCREF(item);
+        PyTuple_SET_ITEM(full_args, i + 1, item);
+    }
+    PyObject* stream = PyObject_Call((PyObject*)&StreamType, full_args, kwds);
+    Py_DECREF(full_args);
+    return stream;
+}
+
+static PyObject* Device_get_serial(DeviceObject* self, void* closure) {
+    (void)closure;
+    if (device_check(self) < 0) {
+        return NULL;
+    }
+    return PyUnicode_FromString(usb_device_get_serial(self->device));
+}
+
+static PyObject* Device_enter(PyObject* self, PyObject* unused) {
+    (void)unused;
+    Py_INCREF(self);
+    return self;
+}
+
+static PyObject* Device_exit(DeviceObject* self, PyObject* args) {
+    (void)args;
+    return Device_close(self, NULL);
+}
+
+static PyMethodDef Device_methods[] = {
+    {"close", (PyCFunction)Device_close, METH_NOARGS, "发送关闭命令并关闭设备"},
+    {"read", (PyCFunction)Device_read, METH_VARARGS, "read(length=16384) -> bytes: 同步读取一次"},
+    {"readinto", (PyCFunction)Device_readinto, METH_VARARGS,
+     "readinto(buffer) -> int: 同步读取到可写缓冲区 (bytearray/numpy数组)，不复制"},
+    {"write", (PyCFunction)(void (*)(void))Device_write, METH_VARARGS | METH_KEYWORDS,
+     "write(data, timeout_ms=0) -> int: 写EP 0x01 (命令)"},
+    {"stream", (PyCFunction)(void (*)(void))Device_stream, METH_VARARGS | METH_KEYWORDS,
+     "stream(**kwargs) -> Stream: 等同于 Stream(device, **kwargs)"},
+    {"__enter__", (PyCFunction)Device_enter, METH_NOARGS, NULL},
+    {"__exit__", (PyCFunction)Device_exit, METH_VARARGS, NULL},
+    {NULL}
+};
+
+static PyGetSetDef Device_getset[] = {
+    {"serial", (getter)Device_get_serial, NULL, "设备序列号", NULL},
+    {NULL}
+};
+
+static PyTypeObject DeviceType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "usbcontrol.Device",
+    .tp_basicsize = sizeof(DeviceObject),
+    .tp_dealloc = (destructor)Device_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Device(serial=None): 按序列号打开设备 (None为第一台)，认领接口0并发送打开命令",
+    .tp_methods = Device_methods,
+    .tp_getset = Device_getset,
+    .tp_init = (initproc)Device_init,
+    .tp_new = PyType_GenericNew,
+};
+
+// ---- Aggregator ----
+
+// 在feed/flush的线程中 (持有GIL) 调用
+static void aggregator_window_cb(const usb_aggregate_window_t* w, const usb_aggregate_value_t* values, void* user_data) {
+    AggregatorObject* self = (AggregatorObject*)user_data;
+    if (!self->windows) {
+        return;
+    }
+    PyObject* list = PyList_New(self->channels);
+    for (int c = 0; list && c < self->channels; c++) {
+        PyObject* v = Py_BuildValue("(iidd)", values[c].min, values[c].max, values[c].mean, values[c].rms);
+        if (!v) {
+            Py_CLEAR(list);
+            break;
+        }
+        PyList_SET_ITEM(list, c, v);
+    }
+    PyObject* item = list ? Py_BuildValue("(iKKIN)", w->level, (unsigned long long)w->index,
+                                          (unsigned long long)w->first_sample, w->count, list)
+                          : NULL;
+    if (!item || PyList_Append(self->windows, item) < 0) {
+        Py_CLEAR(self->windows);
+    }
+    Py_XDECREF(item);
+}
+
+static void Aggregator_dealloc(AggregatorObject* self) {
+    usb_aggregate_destroy(self->agg);
+    Py_XDECREF(self->windows);
+    Py_TYPE(self)->tp_free((PyObject*)self);
+}
+
+static int Aggregator_init(AggregatorObject* self, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"windows", "channels", "format", NULL};
+    PyObject* windows;
+    const char* format = "s16";
+    usb_aggregate_config_t cfg;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.channels = 1;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|is", kwlist, &windows, &cfg.channels, &format)) {
+        return -1;
+    }
+    if (self->agg) {
+        PyErr_SetString(PyExc_RuntimeError, "already initialized");
+        return -1;
+    }
+    PyObject* seq = PySequence_Fast(windows, "windows must be a sequence of window lengths");
+    if (!seq) {
+        return -1;
+    }
+    cfg.levels = (int)PySequence_Fast_GET_SIZE(seq);
+    for (int k = 0; k < cfg.levels && k < USB_AGGREGATE_MAX_LEVELS; k++) {
+        cfg.window[k] = (uint32_t)PyLong_AsUnsignedLong(PySequence_Fast_GET_ITEM(seq, k));
+    }
+    Py_DECREF(seq);
+    if (PyErr_Occurred()) {
+        return -1;
+    }
+    if (strcmp(format, "s16") == 0) {
+        cfg.format = USB_SAMPLE_S16;
+    } else if (strcmp(format, "s24") == 0) {
+        cfg.format = USB_SAMPLE_S24;
+    } else if (strcmp(format, "s32") == 0) {
+        cfg.format = USB_SAMPLE_S32;
+    } else {
+        PyErr_Format(PyExc_ValueError, "unknown sample format '%s' (s16, s24, s32)", format);
+        return -1;
+    }
+    self->agg = usb_aggregate_create(&cfg, aggregator_window_cb, self);
+    if (!self->agg) {
+        PyErr_Format(PyExc_ValueError, "invalid windows or channels: 1-%d levels, each a multiple of the previous, "
+                     "channels 1-%d", USB_AGGREGATE_MAX_LEVELS, USB_AGGREGATE_MAX_CHANNELS);
+        return -1;
+    }
+    self->levels = cfg.levels;
+    self->channels = cfg.channels;
+    return 0;
+}
+
+// 准备收集窗口，返回0；没有初始化时设置异常返回-1
+static int aggregator_begin(AggregatorObject* self) {
+    if (!self->agg) {
+        PyErr_SetString(PyExc_RuntimeError, "Aggregator not initialized");
+        return -1;
+    }
+    Py_XDECREF(self->windows);
+    self->windows = PyList_New(0);
+    return self->windows ? 0 : -1;
+}
+
+static PyObject* aggregator_end(AggregatorObject* self) {
+    PyObject* windows = self->windows;
+    self->windows = NULL;
+    if (!windows && !PyErr_Occurred()) {
+        PyErr_NoMemory();
+    }
+    return windows;
+}
+
+static PyObject* Aggregator_feed(AggregatorObject* self, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"data", "time_ns", NULL};
+    Py_buffer view;
+    unsigned long long time_ns = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "y*|K", kwlist, &view, &time_ns)) {
+        return NULL;
+    }
+    if (aggregator_begin(self) < 0) {
+        PyBuffer_Release(&view);
+        return NULL;
+    }
+    // 回调中创建Python对象，不释放GIL
+    usb_aggregate_feed_bytes(self->agg, (const unsigned char*)view.buf, (int)view.len, time_ns);
+    PyBuffer_Release(&view);
+    return aggregator_end(self);
+}
+
+static PyObject* Aggregator_flush(AggregatorObject* self, PyObject* unused) {
+    (void)unused;
+    if (aggregator_begin(self) < 0) {
+        return NULL;
+    }
+    usb_aggregate_flush(self->agg);
+    return aggregator_end(self);
+}
+
+static PyObject* Aggregator_stats(AggregatorObject* self, PyObject* unused) {
+    usb_aggregate_stats_t st;
+    (void)unused;
+    if (!self->agg) {
+        PyErr_SetString(PyExc_RuntimeError, "Aggregator not initialized");
+        return NULL;
+    }
+    usb_aggregate_get_stats(self->agg, &st);
+    PyObject* windows = PyList_New(0);
+    for (int k = 0; windows && k < self->levels; k++) {
+        PyObject* n = PyLong_FromUnsignedLongLong(st.windows[k]);
+        if (!n || PyList_Append(windows, n) < 0) {
+            Py_XDECREF(n);
+            Py_CLEAR(windows);
+            break;
+        }
+        Py_DECREF(n);
+    }
+    if (!windows) {
+        return NULL;
+    }
+    return Py_BuildValue("{s:K,s:N}", "samples", (unsigned long long)st.samples, "windows", windows);
+}
+
+static PyMethodDef Aggregator_methods[] = {
+    {"feed", (PyCFunction)(void (*)(void))Aggregator_feed, METH_VARARGS | METH_KEYWORDS,
+     "feed(data, time_ns=0) -> list: 原始样本字节 (bytes-like / Buffer)，返回这次结束的窗口 "
+     "(level, index, first_sample, count, [(min, max, mean, rms), ...])"},
+    {"flush", (PyCFunction)Aggregator_flush, METH_NOARGS, "flush() -> list: 输出所有级别未满的窗口"},
+    {"stats", (PyCFunction)Aggregator_stats, METH_NOARGS, "统计 (dict): samples, windows (每一级的窗口数)"},
+    {NULL}
+};
+
+static PyTypeObject AggregatorType = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "usbcontrol.Aggregator",
+    .tp_basicsize = sizeof(AggregatorObject),
+    .tp_dealloc = (destructor)Aggregator_dealloc,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = "Aggregator(windows, channels=1, format='s16'): 多级窗口的 min/max/mean/RMS，"
+              "每一级的窗口是前一级的整数倍 (SIMD内核，与解码使用同一级别)",
+    .tp_methods = Aggregator_methods,
+    .tp_init = (initproc)Aggregator_init,
+    .tp_new = PyType_GenericNew,
+};
+
+// ---- 模块函数 ----
+
+static PyObject* py_init(PyObject* module, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"backend", "devices", "rate", "frame", NULL};
+    const char* backend = "usb";
+    usb_sim_config_t sim_cfg;
+    int r;
+
+    (void)module;
+    memset(&sim_cfg, 0, sizeof(sim_cfg));
+    sim_cfg.num_devices = 1;
+    sim_cfg.bytes_per_sec = USB_SIM_DEFAULT_RATE;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|sidi", kwlist, &backend, &sim_cfg.num_devices,
+                                     &sim_cfg.bytes_per_sec, &sim_cfg.frame_payload)) {
+        return NULL;
+    }
+    if (initialized) {
+        PyErr_SetString(PyExc_RuntimeError, "already initialized");
+        return NULL;
+    }
+    if (strcmp(backend, "sim") != 0 && strcmp(backend, "null") != 0 && strcmp(backend, "usb") != 0) {
+        PyErr_Format(PyExc_ValueError, "unknown backend '%s' (usb, sim, null)", backend);
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    if (strcmp(backend, "sim") == 0) {
+        r = usb_control_init_sim(&sim_cfg);
+    } else if (strcmp(backend, "null") == 0) {
+        r = usb_control_init_null();
+    } else {
+        r = usb_control_init();
+    }
+    Py_END_ALLOW_THREADS
+    if (r < 0) {
+        return raise_usb_error(r);
+    }
+    initialized = 1;
+    Py_RETURN_NONE;
+}
+
+static PyObject* py_exit(PyObject* module, PyObject* unused) {
+    (void)module;
+    (void)unused;
+    if (initialized) {
+        Py_BEGIN_ALLOW_THREADS
+        usb_control_exit();
+        Py_END_ALLOW_THREADS
+        initialized = 0;
+    }
+    Py_RETURN_NONE;
+}
+
+static PyObject* device_info_dict(const device_info_t* info) {
+    return Py_BuildValue("{s:s,s:s,s:s}", "manufacturer", info->manufacturer, "product", info->product, "serial",
+                         info->serial);
+}
+
+static PyObject* py_scan(PyObject* module, PyObject* args, PyObject* kwds) {
+    static char* kwlist[] = {"lazy", NULL};
+    device_info_t* devices;
+    int lazy = 0;
+    int r;
+
+    (void)module;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|p", kwlist, &lazy)) {
+        return NULL;
+    }
+    if (!initialized) {
+        PyErr_SetString(PyExc_RuntimeError, "usbcontrol.init() has not been called");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    r = USB_ScanDeviceList(&devices, lazy ? USB_SCAN_LAZY : 0);
+    Py_END_ALLOW_THREADS
+    if (r < 0) {
+        return raise_usb_error(r);
+    }
+    PyObject* list = PyList_New(r);
+    for (int i = 0; list && i < r; i++) {
+        PyObject* d = device_info_dict(&devices[i]);
+        if (!d) {
+            Py_DECREF(list);
+            list = NULL;
+            break;
+        }
+        PyList_SET_ITEM(list, i, d);
+    }
+    free(devices);
+    return list;
+}
+
+static PyObject* py_info(PyObject* module, PyObject* args) {
+    const char* serial;
+    device_info_t info;
+    int r;
+
+    (void)module;
+    if (!PyArg_ParseTuple(args, "s", &serial)) {
+        return NULL;
+    }
+    if (!initialized) {
+        PyErr_SetString(PyExc_RuntimeError, "usbcontrol.init() has not been called");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    r = USB_GetDeviceInfo(serial, &info);
+    Py_END_ALLOW_THREADS
+    if (r < 0) {
+        return raise_usb_error(r);
+    }
+    return device_info_dict(&info);
+}
+
+static PyMethodDef module_methods[] = {
+    {"init", (PyCFunction)(void (*)(void))py_init, METH_VARARGS | METH_KEYWORDS,
+     "init(backend='usb', devices=1, rate=8MB/s, frame=0): 初始化。backend: usb (libusb DLL) / sim / null，"
+     "devices/rate/frame 只用于模拟设备 (rate=0不限速)"},
+    {"exit", (PyCFunction)py_exit, METH_NOARGS, "释放库 (先关闭所有设备)"},
+    {"scan", (PyCFunction)(void (*)(void))py_scan, METH_VARARGS | METH_KEYWORDS,
+     "scan(lazy=False) -> list[dict]: manufacturer, product, serial。lazy时只读取序列号，厂商/产品为空"},
+    {"info", (PyCFunction)py_info, METH_VARARGS, "info(serial) -> dict: 按需读取厂商/产品字符串"},
+    {NULL}
+};
+
+static struct PyModuleDef usbcontrol_module = {
+    PyModuleDef_HEAD_INIT,
+    "usbcontrol",
+    "USB设备的扫描、打开和零拷贝流式读取",
+    -1,
+    module_methods,
+};
+
+PyMODINIT_FUNC PyInit_usbcontrol(void) {
+    if (PyType_Ready(&BufferType) < 0 || PyType_Ready(&StreamType) < 0 || PyType_Ready(&DeviceType) < 0 ||
+        PyType_Ready(&AggregatorType) < 0) {
+        return NULL;
+    }
+    PyObject* m = PyModule_Create(&usbcontrol_module);
+    if (!m) {
+        return NULL;
+    }
+    Py_INCREF(&DeviceType);
+    Py_INCREF(&StreamType);
+    Py_INCREF(&BufferType);
+    Py_INCREF(&AggregatorType);
+    if (PyModule_AddObject(m, "Device", (PyObject*)&DeviceType) < 0 ||
+        PyModule_AddObject(m, "Stream", (PyObject*)&StreamType) < 0 ||
+        PyModule_AddObject(m, "Buffer", (PyObject*)&BufferType) < 0 ||
+        PyModule_AddObject(m, "Aggregator", (PyObject*)&AggregatorType) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -0,0 +1,434 @@
+#include "usb_aggregate.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define USB_AGGREGATE_X86 1
+#include <immintrin.h>
+#endif
+
+#define AGG_LANES 8
+#define AGG_CHUNK 4096   // feed_bytes 每次解包的样本数
+
+// 内核的8个通道 (lane): 第i个样本进入 i%8 号lane。通道数整除8时，一个lane里只有一个通道的样本
+typedef struct {
+    int32_t min[AGG_LANES];
+    int32_t max[AGG_LANES];
+    int64_t sum[AGG_LANES];
+    double sumsq[AGG_LANES];
+} agg_lanes_t;
+
+// 一个通道在一个级别的当前窗口
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    double sumsq;
+    uint64_t n;
+} agg_acc_t;
+
+// 计算n个样本在8个lane上的统计，结果写入lanes (不需要事先初始化)
+typedef void (*agg_kernel_fn)(const int32_t* s, int n, agg_lanes_t* lanes);
+
+struct usb_aggregate {
+    usb_aggregate_config_t cfg;
+    usb_aggregate_cb cb;
+    void* user_data;
+    int channels;
+    int simd;                                   // 通道数整除8，使用lane内核
+    agg_kernel_fn kernel;
+    agg_acc_t* acc;                             // [levels][channels]
+    usb_aggregate_value_t* values;              // [channels]，回调用
+    uint64_t filled[USB_AGGREGATE_MAX_LEVELS];  // 第0级: 当前窗口的样本数 (所有通道)；其他级: 已合并的下一级窗口数
+    uint64_t ratio[USB_AGGREGATE_MAX_LEVELS];   // 窗口满时的 filled
+    uint64_t index[USB_AGGREGATE_MAX_LEVELS];
+    uint64_t first_sample[USB_AGGREGATE_MAX_LEVELS];
+    uint64_t start_ns[USB_AGGREGATE_MAX_LEVELS];
+    uint64_t end_ns[USB_AGGREGATE_MAX_LEVELS];
+    uint64_t samples;                           // 送入的样本总数
+    int channel;                                // 下一个样本的通道 (samples % channels)
+    uint64_t windows[USB_AGGREGATE_MAX_LEVELS];
+    int sample_size;                            // feed_bytes
+    unsigned char pending[4];
+    int pending_length;
+    int32_t* scratch;
+};
+
+// ---- 内核 ----
+
+// 累加到已有的lanes上，也是SIMD内核不足8个样本的尾部
+static void lanes_add(const int32_t* s, int n, agg_lanes_t* L) {
+    int i = 0;
+    for (; i + AGG_LANES <= n; i += AGG_LANES) {
+        for (int l = 0; l < AGG_LANES; l++) {
+            int32_t v = s[i + l];
+            if (v < L->min[l]) L->min[l] = v;
+            if (v > L->max[l]) L->max[l] = v;
+            L->sum[l] += v;
+            L->sumsq[l] += (double)v * v;
+        }
+    }
+    for (int l = 0; i < n; i++, l++) {
+        int32_t v = s[i];
+        if (v < L->min[l]) L->min[l] = v;
+        if (v > L->max[l]) L->max[l] = v;
+        L->sum[l] += v;
+        L->sumsq[l] += (double)v * v;
+    }
+}
+
+static void lanes_scalar(const int32_t* s, int n, agg_lanes_t* L) {
+    for (int l = 0; l < AGG_LANES; l++) {
+        L->min[l] = INT32_MAX;
+        L->max[l] = INT32_MIN;
+        L->sum[l] = 0;
+        L->sumsq[l] = 0;
+    }
+    lanes_add(s, n, L);
+}
+
+#ifdef USB_AGGREGATE_X86
+// ---- SSE4.2 (用到SSE4.1的 pminsd/pmaxsd/pmovsxdq) ----
+
+__attribute__((target("sse4.2")))
+static void lanes_sse42(const int32_t* s, int n, agg_lanes_t* L) {
+    // 初值直接在寄存器中生成: 先逐个写入再按向量读回会使存储转发失败，窗口短时很明显
+    __m128i min0 = _mm_set1_epi32(INT32_MAX), min1 = min0;
+    __m128i max0 = _mm_set1_epi32(INT32_MIN), max1 = max0;
+    __m128i sum0 = _mm_setzero_si128(), sum1 = sum0, sum2 = sum0, sum3 = sum0;
+    __m128d sq0 = _mm_setzero_pd(), sq1 = sq0, sq2 = sq0, sq3 = sq0;
+    int i = 0;
+    for (; i + AGG_LANES <= n; i += AGG_LANES) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s + i + 4));
+        __m128i ah = _mm_srli_si128(a, 8), bh = _mm_srli_si128(b, 8);
+        min0 = _mm_min_epi32(min0, a);
+        min1 = _mm_min_epi32(min1, b);
+        max0 = _mm_max_epi32(max0, a);
+        max1 = _mm_max_epi32(max1, b);
+        sum0 = _mm_add_epi64(sum0, _mm_cvtepi32_epi64(a));
+        sum1 = _mm_add_epi64(sum1, _mm_cvtepi32_epi64(ah));
+        sum2 = _mm_add_epi64(sum2, _mm_cvtepi32_epi64(b));
+        sum3 = _mm_add_epi64(sum3, _mm_cvtepi32_epi64(bh));
+        __m128d da = _mm_cvtepi32_pd(a), dah = _mm_cvtepi32_pd(ah);
+        __m128d db = _mm_cvtepi32_pd(b), dbh = _mm_cvtepi32_pd(bh);
+        sq0 = _mm_add_pd(sq0, _mm_mul_pd(da, da));
+        sq1 = _mm_add_pd(sq1, _mm_mul_pd(dah, dah));
+        sq2 = _mm_add_pd(sq2, _mm_mul_pd(db, db));
+        sq3 = _mm_add_pd(sq3, _mm_mul_pd(dbh, dbh));
+    }
+    _mm_storeu_si128((__m128i*)L->min, min0);
+    _mm_storeu_si128((__m128i*)(L->min + 4), min1);
+    _mm_storeu_si128((__m128i*)L->max, max0);
+    _mm_storeu_si128((__m128i*)(L->max + 4), max1);
+    _mm_storeu_si128((__m128i*)L->sum, sum0);
+    _mm_storeu_si128((__m128i*)(L->sum + 2), sum1);
+    _mm_storeu_si128((__m128i*)(L->sum + 4), sum2);
+    _mm_storeu_si128((__m128i*)(L->sum + 6), sum3);
+    _mm_storeu_pd(L->sumsq, sq0);
+    _mm_storeu_pd(L->sumsq + 2, sq1);
+    _mm_storeu_pd(L->sumsq + 4, sq2);
+    _mm_storeu_pd(L->sumsq + 6, sq3);
+    lanes_add(s + i, n - i, L);  // 不足8个的尾部从lane 0开始，与整组的对应关系不变
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+static void lanes_avx2(const int32_t* s, int n, agg_lanes_t* L) {
+    __m256i min = _mm256_set1_epi32(INT32_MAX);
+    __m256i max = _mm256_set1_epi32(INT32_MIN);
+    __m256i sum0 = _mm256_setzero_si256(), sum1 = sum0;
+    __m256d sq0 = _mm256_setzero_pd(), sq1 = sq0;
+    int i = 0;
+    for (; i + AGG_LANES <= n; i += AGG_LANES) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(s + i));
+        __m128i lo = _mm256_castsi256_si128(v), hi = _mm256_extracti128_si256(v, 1);
+        min = _mm256_min_epi32(min, v);
+        max = _mm256_max_epi32(max, v);
+        sum0 = _mm256_add_epi64(sum0, _mm256_cvtepi32_epi64(lo));
+        sum1 = _mm256_add_epi64(sum1, _mm256_cvtepi32_epi64(hi));
+        __m256d dlo = _mm256_cvtepi32_pd(lo), dhi = _mm256_cvtepi32_pd(hi);
+        sq0 = _mm256_add_pd(sq0, _mm256_mul_pd(dlo, dlo));
+        sq1 = _mm256_add_pd(sq1, _mm256_mul_pd(dhi, dhi));
+    }
+    _mm256_storeu_si256((__m256i*)L->min, min);
+    _mm256_storeu_si256((__m256i*)L->max, max);
+    _mm256_storeu_si256((__m256i*)L->sum, sum0);
+    _mm256_storeu_si256((__m256i*)(L->sum + 4), sum1);
+    _mm256_storeu_pd(L->sumsq, sq0);
+    _mm256_storeu_pd(L->sumsq + 4, sq1);
+    // 尾部是非VEX编码的代码，gcc在尾调用前不会自动加vzeroupper，每个窗口都会付出AVX/SSE切换的代价
+    _mm256_zeroupper();
+    lanes_add(s + i, n - i, L);
+}
+#endif
+
+// 按 usb_decode 的级别排列
+static const agg_kernel_fn agg_kernels[] = {
+    lanes_scalar,
+#ifdef USB_AGGREGATE_X86
+    lanes_sse42,
+    lanes_avx2,
+#endif
+};
+
+// 不链接libm
+static double agg_sqrt(double x) {
+    if (x <= 0) return 0;
+#ifdef USB_AGGREGATE_X86
+    return _mm_cvtsd_f64(_mm_sqrt_sd(_mm_setzero_pd(), _mm_set_sd(x)));
+#else
+    double r = x > 1 ? x / 2 : 1;
+    for (int i = 0; i < 64; i++) {
+        double next = 0.5 * (r + x / r);
+        if (next == r) break;
+        r = next;
+    }
+    return r;
+#endif
+}
+
+// ---- 窗口 ----
+
+static void acc_reset(agg_acc_t* a, int channels) {
+    for (int c = 0; c < channels; c++) {
+        a[c].min = INT32_MAX;
+        a[c].max = INT32_MIN;
+        a[c].sum = 0;
+        a[c].sumsq = 0;
+        a[c].n = 0;
+    }
+}
+
+static void acc_merge(agg_acc_t* dst, const agg_acc_t* src, int channels) {
+    for (int c = 0; c < channels; c++) {
+        if (src[c].min < dst[c].min) dst[c].min = src[c].min;
+        if (src[c].max > dst[c].max) dst[c].max = src[c].max;
+        dst[c].sum += src[c].sum;
+        dst[c].sumsq += src[c].sumsq;
+        dst[c].n += src[c].n;
+    }
+}
+
+static void agg_emit(usb_aggregate_t* agg, int level) {
+    const agg_acc_t* a = agg->acc + (size_t)level * agg->channels;
+    usb_aggregate_window_t w;
+
+    for (int c = 0; c < agg->channels; c++) {
+        usb_aggregate_value_t* v = &agg->values[c];
+        if (a[c].n) {
+            v->min = a[c].min;
+            v->max = a[c].max;
+            v->mean = (double)a[c].sum / (double)a[c].n;
+            v->rms = agg_sqrt(a[c].sumsq / (double)a[c].n);
+        } else {
+            memset(v, 0, sizeof(*v));  // 刷新时不足一轮通道的窗口
+        }
+    }
+    w.level = level;
+    w.index = agg->index[level]++;
+    w.first_sample = agg->first_sample[level];
+    w.count = (uint32_t)a[0].n;
+    w.start_ns = agg->start_ns[level];
+    w.end_ns = agg->end_ns[level];
+    agg->windows[level]++;
+    agg->cb(&w, agg->values, agg->user_data);
+}
+
+// 结束level的当前窗口: 输出，合并到上一级，上一级满了也结束
+static void agg_close(usb_aggregate_t* agg, int level) {
+    agg_acc_t* a = agg->acc + (size_t)level * agg->channels;
+
+    agg_emit(agg, level);
+    if (level + 1 < agg->cfg.levels) {
+        int up = level + 1;
+        if (agg->filled[up] == 0) {
+            agg->first_sample[up] = agg->first_sample[level];
+            agg->start_ns[up] = agg->start_ns[level];
+        }
+        agg->end_ns[up] = agg->end_ns[level];
+        acc_merge(agg->acc + (size_t)up * agg->channels, a, agg->channels);
+        agg->filled[up]++;
+        acc_reset(a, agg->channels);
+        agg->filled[level] = 0;
+        if (agg->filled[up] == agg->ratio[up]) {
+            agg_close(agg, up);
+        }
+    } else {
+        acc_reset(a, agg->channels);
+        agg->filled[level] = 0;
+    }
+}
+
+// n个样本加入第0级的当前窗口 (不跨窗口)
+static void agg_accumulate(usb_aggregate_t* agg, const int32_t* s, int n) {
+    agg_acc_t* a = agg->acc;
+    int channel = agg->channel;
+
+    if (agg->simd) {
+        agg_lanes_t L;
+        agg->kernel(s, n, &L);
+        for (int l = 0; l < AGG_LANES && l < n; l++) {
+            agg_acc_t* c = &a[channel];
+            if (L.min[l] < c->min) c->min = L.min[l];
+            if (L.max[l] > c->max) c->max = L.max[l];
+            c->sum += L.sum[l];
+            c->sumsq += L.sumsq[l];
+            c->n += (uint64_t)(n / AGG_LANES + (l < n % AGG_LANES));
+            if (++channel == agg->channels) channel = 0;
+        }
+        // 通道数整除8，下一个样本的通道只与 n%8 有关
+        agg->channel = (agg->channel + n) & (agg->channels - 1);
+    } else {
+        for (int i = 0; i < n; i++) {
+            agg_acc_t* c = &a[channel];
+            int32_t v = s[i];
+            if (v < c->min) c->min = v;
+            if (v > c->max) c->max = v;
+            c->sum += v;
+            c->sumsq += (double)v * v;
+            c->n++;
+            if (++channel == agg->channels) channel = 0;
+        }
+        agg->channel = channel;
+    }
+}
+
+/* 创建聚合器 */
+usb_aggregate_t* usb_aggregate_create(const usb_aggregate_config_t* cfg, usb_aggregate_cb cb, void* user_data) {
+    if (!cfg || !cb || cfg->levels < 1 || cfg->levels > USB_AGGREGATE_MAX_LEVELS) {
+        return NULL;
+    }
+    int channels = cfg->channels > 0 ? cfg->channels : 1;
+    if (channels > USB_AGGREGATE_MAX_CHANNELS || usb_sample_size(cfg->format) == 0) {
+        return NULL;
+    }
+    for (int k = 0; k < cfg->levels; k++) {
+        if (cfg->window[k] == 0 || (k > 0 && cfg->window[k] % cfg->window[k - 1] != 0)) {
+            return NULL;
+        }
+    }
+
+    usb_aggregate_t* agg = (usb_aggregate_t*)calloc(1, sizeof(usb_aggregate_t));
+    if (!agg) return NULL;
+    agg->cfg = *cfg;
+    agg->cfg.channels = channels;
+    agg->cb = cb;
+    agg->user_data = user_data;
+    agg->channels = channels;
+    agg->simd = AGG_LANES % channels == 0;
+    agg->kernel = agg_kernels[usb_decode_get_level()];
+    agg->sample_size = usb_sample_size(cfg->format);
+    agg->acc = (agg_acc_t*)malloc(sizeof(agg_acc_t) * (size_t)cfg->levels * (size_t)channels);
+    agg->values = (usb_aggregate_value_t*)malloc(sizeof(usb_aggregate_value_t) * (size_t)channels);
+    if (!agg->acc || !agg->values) {
+        usb_aggregate_destroy(agg);
+        return NULL;
+    }
+    for (int k = 0; k < cfg->levels; k++) {
+        acc_reset(agg->acc + (size_t)k * channels, channels);
+        agg->ratio[k] = k == 0 ? (uint64_t)cfg->window[0] * (uint64_t)channels : cfg->window[k] / cfg->window[k - 1];
+    }
+    return agg;
+}
+
+void usb_aggregate_destroy(usb_aggregate_t* agg) {
+    if (agg) {
+        free(agg->acc);
+        free(agg->values);
+        free(agg->scratch);
+        free(agg);
+    }
+}
+
+/* 送入样本 */
+void usb_aggregate_feed(usb_aggregate_t* agg, const int32_t* samples, int count, uint64_t time_ns) {
+    while (count > 0) {
+        uint64_t room = agg->ratio[0] - agg->filled[0];
+        int n = (uint64_t)count < room ? count : (int)room;
+        if (agg->filled[0] == 0) {
+            agg->first_sample[0] = agg->samples / (uint64_t)agg->channels;
+            agg->start_ns[0] = time_ns;
+        }
+        agg_accumulate(agg, samples, n);
+        agg->samples += (uint64_t)n;
+        agg->filled[0] += (uint64_t)n;
+        agg->end_ns[0] = time_ns;
+        samples += n;
+        count -= n;
+        if (agg->filled[0] == agg->ratio[0]) {
+            agg_close(agg, 0);
+        }
+    }
+}
+
+/* 送入原始字节 */
+void usb_aggregate_feed_bytes(usb_aggregate_t* agg, const unsigned char* data, int length, uint64_t time_ns) {
+    int size = agg->sample_size;
+
+    if (!agg->scratch) {
+        agg->scratch = (int32_t*)malloc(sizeof(int32_t) * AGG_CHUNK);
+        if (!agg->scratch) return;
+    }
+    // 上一次剩下的半个样本
+    if (agg->pending_length > 0) {
+        int n = size - agg->pending_length < length ? size - agg->pending_length : length;
+        memcpy(agg->pending + agg->pending_length, data, (size_t)n);
+        agg->pending_length += n;
+        data += n;
+        length -= n;
+        if (agg->pending_length < size) {
+            return;
+        }
+        usb_decode_unpack(agg->cfg.format, agg->pending, 1, agg->scratch);
+        usb_aggregate_feed(agg, agg->scratch, 1, time_ns);
+        agg->pending_length = 0;
+    }
+    while (length >= size) {
+        int count = length / size < AGG_CHUNK ? length / size : AGG_CHUNK;
+        int used = usb_decode_unpack(agg->cfg.format, data, count, agg->scratch);
+        usb_aggregate_feed(agg, agg->scratch, count, time_ns);
+        data += used;
+        length -= used;
+    }
+    memcpy(agg->pending, data, (size_t)length);
+    agg->pending_length = length;
+}
+
+void usb_aggregate_flush(usb_aggregate_t* agg) {
+    for (int k = 0; k < agg->cfg.levels; k++) {
+        if (agg->filled[k] > 0) {
+            agg_close(agg, k);
+        }
+    }
+}
+
+void usb_aggregate_decode_cb(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data) {
+    (void)header;
+    usb_aggregate_feed((usb_aggregate_t*)user_data, samples, count, usb_time_ns());
+}
+
+void usb_aggregate_get_stats(usb_aggregate_t* agg, usb_aggregate_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->samples = agg->samples;
+    memcpy(stats->windows, agg->windows, sizeof(stats->windows));
+}
+
+int usb_aggregate_parse_windows(const char* s, usb_aggregate_config_t* cfg) {
+    int levels = 0;
+    while (*s) {
+        char* end;
+        unsigned long w = strtoul(s, &end, 10);
+        if (end == s || w == 0 || w > UINT32_MAX || levels == USB_AGGREGATE_MAX_LEVELS) {
+            return -1;
+        }
+        cfg->window[levels++] = (uint32_t)w;
+        s = end;
+        if (*s == ',') {
+            s++;
+        } else if (*s) {
+            return -1;
+        }
+    }
+    cfg->levels = levels;
+    return levels > 0 ? levels : -1;
+}
@@ -0,0 +1,75 @@
+#ifndef USB_AGGREGATE_H
+#define USB_AGGREGATE_H
+
+#include "usb_control.h"
+#include "usb_decode.h"
+
+// 窗口统计和降采样: 解码后的样本 (usb_decode.h) 按固定长度的窗口计算每个通道的 min/max/mean/RMS，
+// 每个窗口结束时立即回调，不需要等采集结束。
+// 多个级别 (多分辨率): 第0级的窗口直接从样本计算 (标量 / SSE4.2 / AVX2，与 usb_decode 使用同一级别)，
+// 之后每一级的窗口必须是前一级的整数倍，由前一级的窗口合并得到，几乎没有额外开销。
+// 每一级的mean序列就是按窗口长度抽取的降采样输出 (盒式滤波)，min/max 给出同一段的包络。
+//
+// 多通道的样本交错存放 (ch0 ch1 ... chN-1 ch0 ...)，窗口长度按每个通道的样本数计算。
+// 通道数为 1/2/4/8 时使用SIMD，其他通道数使用标量实现。
+// 同一个聚合器只能在一个线程中使用 (通常是流的事件线程或读取线程)。
+//
+// 接入方式:
+//   分帧数据: usb_decoder_create(..., usb_aggregate_decode_cb, agg)，或在自己的解码回调中调用 usb_aggregate_feed
+//   不分帧的原始数据 (usb_control_read / 流式读取的回调): usb_aggregate_feed_bytes
+
+#define USB_AGGREGATE_MAX_LEVELS   8
+#define USB_AGGREGATE_MAX_CHANNELS 64
+
+typedef struct {
+    int levels;                  // 级别数，1 ~ USB_AGGREGATE_MAX_LEVELS
+    uint32_t window[USB_AGGREGATE_MAX_LEVELS];  // 每一级的窗口长度 (每通道样本数)，后一级是前一级的整数倍
+    int channels;                // 交错的通道数，默认1
+    usb_sample_format_t format;  // usb_aggregate_feed_bytes 的样本格式
+} usb_aggregate_config_t;
+
+typedef struct {
+    int level;
+    uint64_t index;              // 窗口在这一级中的序号，从0开始
+    uint64_t first_sample;       // 窗口第一个样本的序号 (每通道)
+    uint32_t count;              // 窗口内每通道的样本数，只有 usb_aggregate_flush 输出的最后一个窗口小于窗口长度
+    uint64_t start_ns;           // 窗口第一批样本和最后一批样本送入时的时间 (feed的time_ns)
+    uint64_t end_ns;
+} usb_aggregate_window_t;
+
+typedef struct {
+    int32_t min;
+    int32_t max;
+    double mean;
+    double rms;
+} usb_aggregate_value_t;
+
+// 每个窗口结束时调用 (在feed的线程中)，values[channels]，回调返回后失效。
+// 同一批样本结束多个级别的窗口时，先回调低级别
+typedef void (*usb_aggregate_cb)(const usb_aggregate_window_t* window, const usb_aggregate_value_t* values, void* user_data);
+
+typedef struct {
+    uint64_t samples;            // 送入的样本数 (所有通道)
+    uint64_t windows[USB_AGGREGATE_MAX_LEVELS];  // 每一级输出的窗口数
+} usb_aggregate_stats_t;
+
+typedef struct usb_aggregate usb_aggregate_t;
+
+// 窗口长度为0、不是前一级的整数倍或通道数无效时返回NULL
+usb_aggregate_t* usb_aggregate_create(const usb_aggregate_config_t* cfg, usb_aggregate_cb cb, void* user_data);
+void usb_aggregate_destroy(usb_aggregate_t* agg);
+
+// count为所有通道的样本总数，不需要是通道数的整数倍 (下一次接着上一次的通道)
+void usb_aggregate_feed(usb_aggregate_t* agg, const int32_t* samples, int count, uint64_t time_ns);
+// 原始字节按 cfg.format 解包后送入，不足一个样本的字节留到下一次
+void usb_aggregate_feed_bytes(usb_aggregate_t* agg, const unsigned char* data, int length, uint64_t time_ns);
+// 输出所有级别中未满的窗口 (采集结束时)，之后从新的窗口开始
+void usb_aggregate_flush(usb_aggregate_t* agg);
+// usb_decode_cb 适配，user_data为聚合器，时间取回调时的 usb_time_ns
+void usb_aggregate_decode_cb(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data);
+
+void usb_aggregate_get_stats(usb_aggregate_t* agg, usb_aggregate_stats_t* stats);
+// "100,1000,10000" 解析为各级窗口长度，返回级别数，格式错误返回-1
+int usb_aggregate_parse_windows(const char* s, usb_aggregate_config_t* cfg);
+
+#endif // USB_AGGREGATE_H
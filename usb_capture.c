@@ -0,0 +1,458 @@
+#include <stdatomic.h>
+#include "usb_capture.h"
+#include "usb_trace.h"
+
+#define CAPTURE_PATH_LENGTH 1024
+
+typedef struct capture_segment {
+    struct capture_segment* next;   // 待关闭链表
+    usb_file_map_t map;
+    uint32_t index;
+    size_t used;                    // 下一条记录的偏移，持有lock修改
+    size_t flushed;                 // 已发起写回的位置，只在刷盘线程中使用
+    uint64_t start_ns;
+    // 正在向本段复制数据的写入者，按分配空间时的epoch分两组计数 (epoch持有lock修改)。
+    // 刷盘线程记下used并切换epoch，旧epoch的写入者都复制完后 [flushed, commit_end) 的内容才完整
+    atomic_int writers[2];
+    int epoch;
+    size_t commit_end;              // 等待旧epoch写入者的写回终点，0表示没有，只在刷盘线程中使用
+
+    // 块索引，持有lock修改，关闭时写到文件末尾
+    usb_capture_chunk_t* chunks;
+    uint32_t num_chunks;
+    uint32_t max_chunks;
+    size_t next_chunk;              // 下一个块的起始偏移
+    uint64_t records;
+    uint64_t end_ns;
+} capture_segment_t;
+
+struct usb_capture_sink {
+    usb_capture_t* capture;
+    uint8_t device;
+    uint64_t seq;                   // 持有lock修改
+};
+
+struct usb_capture {
+    usb_capture_config_t cfg;
+    char path[CAPTURE_PATH_LENGTH];
+
+    usb_mutex_t lock;
+    usb_cond_t cond;                // 刷盘线程等待工作 / 写入者等待下一个段
+    usb_thread_t thread;
+    int running;
+    int error;                      // 刷盘线程创建段失败的错误码
+
+    capture_segment_t* current;
+    capture_segment_t* spare;       // 刷盘线程预先创建的下一个段
+    capture_segment_t* retired;     // 写满待关闭的段
+    uint32_t next_index;            // 下一个要创建的段序号
+    size_t data_limit;              // 记录区的结束偏移，之后留给块索引和文件尾
+    uint64_t last_ns;               // 最后一条记录的时间
+
+    usb_capture_sink_t sinks[MAX_DEVICES];
+    char serials[MAX_DEVICES][USB_CAPTURE_SERIAL_LENGTH];
+    int num_devices;
+
+    usb_capture_stats_t stats;
+};
+
+static size_t record_size(int length) {
+    size_t n = sizeof(usb_capture_record_t) + (size_t)length;
+    return (n + USB_CAPTURE_ALIGN - 1) & ~(size_t)(USB_CAPTURE_ALIGN - 1);
+}
+
+static void segment_name(usb_capture_t* cap, uint32_t index, char* name, size_t size) {
+    snprintf(name, size, "%s.%06u.cap", cap->path, index);
+}
+
+// 创建并映射一个段文件，不持有lock
+static capture_segment_t* segment_create(usb_capture_t* cap, uint32_t index) {
+    char name[CAPTURE_PATH_LENGTH + 16];
+    capture_segment_t* seg = (capture_segment_t*)calloc(1, sizeof(capture_segment_t));
+    if (!seg) return NULL;
+
+    // 每个块至少 chunk_size 字节，块数有上限
+    seg->max_chunks = (uint32_t)(cap->cfg.segment_size / cap->cfg.chunk_size + 1);
+    seg->chunks = (usb_capture_chunk_t*)malloc(sizeof(usb_capture_chunk_t) * seg->max_chunks);
+    if (!seg->chunks) {
+        free(seg);
+        return NULL;
+    }
+
+    segment_name(cap, index, name, sizeof(name));
+    if (usb_file_map_create(&seg->map, name, cap->cfg.segment_size) != 0) {
+        USB_TRACE_STR(SEGMENT_FAILED, name);
+        free(seg->chunks);
+        free(seg);
+        return NULL;
+    }
+    seg->index = index;
+    seg->used = USB_CAPTURE_HEADER_SIZE;
+    seg->next_chunk = USB_CAPTURE_HEADER_SIZE;
+    atomic_init(&seg->writers[0], 0);
+    atomic_init(&seg->writers[1], 0);
+    return seg;
+}
+
+// 写入当前的设备表，持有lock
+static void segment_write_devices(usb_capture_t* cap, capture_segment_t* seg) {
+    usb_capture_file_header_t* h = (usb_capture_file_header_t*)seg->map.addr;
+    memcpy(h->serials, cap->serials, sizeof(h->serials));
+    h->num_devices = (uint32_t)cap->num_devices;
+}
+
+// 段开始使用: 填写文件头，持有lock。段数和文件头字节只在这里计入，预备段被丢弃时不计
+static void segment_begin(usb_capture_t* cap, capture_segment_t* seg, uint64_t now) {
+    usb_capture_file_header_t* h = (usb_capture_file_header_t*)seg->map.addr;
+    memcpy(h->magic, USB_CAPTURE_MAGIC, sizeof(h->magic));
+    h->version = USB_CAPTURE_VERSION;
+    h->header_size = USB_CAPTURE_HEADER_SIZE;
+    h->segment = seg->index;
+    h->start_ns = now;
+    h->start_wall_ns = usb_wall_time_ns() - (usb_time_ns() - now);
+    segment_write_devices(cap, seg);
+    seg->start_ns = now;
+    cap->stats.segments++;
+    cap->stats.file_bytes += USB_CAPTURE_HEADER_SIZE;
+}
+
+static int segment_writers(capture_segment_t* seg) {
+    return atomic_load_explicit(&seg->writers[0], memory_order_acquire) +
+           atomic_load_explicit(&seg->writers[1], memory_order_acquire);
+}
+
+// 在记录之后写END记录、块索引和文件尾，写回并关闭，截断到实际长度
+static void segment_close(usb_capture_t* cap, capture_segment_t* seg) {
+    usb_capture_footer_t footer;
+    size_t index_offset = seg->used + sizeof(usb_capture_record_t);  // END记录在预分配的文件中已经是0
+    size_t index_size = sizeof(usb_capture_chunk_t) * seg->num_chunks;
+    memcpy(seg->map.addr + index_offset, seg->chunks, index_size);
+
+    memset(&footer, 0, sizeof(footer));
+    memcpy(footer.magic, USB_CAPTURE_INDEX_MAGIC, sizeof(footer.magic));
+    footer.num_chunks = seg->num_chunks;
+    footer.index_offset = index_offset;
+    footer.records = seg->records;
+    footer.end_ns = seg->end_ns;
+    memcpy(seg->map.addr + index_offset + index_size, &footer, sizeof(footer));
+
+    size_t end = index_offset + index_size + sizeof(footer);
+    usb_file_map_flush(&seg->map, seg->flushed, end - seg->flushed, 1);
+    usb_file_map_close(&seg->map, end);
+    (void)cap;
+    free(seg->chunks);
+    free(seg);
+}
+
+// 丢弃未使用的预备段 (它没有经过segment_begin，不在统计中)
+static void segment_discard(usb_capture_t* cap, capture_segment_t* seg) {
+    char name[CAPTURE_PATH_LENGTH + 16];
+    segment_name(cap, seg->index, name, sizeof(name));
+    usb_file_map_close(&seg->map, 0);
+    remove(name);
+    free(seg->chunks);
+    free(seg);
+}
+
+// 换到下一个段，持有lock。预备段还没有准备好时等待刷盘线程
+static int capture_rotate(usb_capture_t* cap, uint64_t now) {
+    if (cap->current) {
+        capture_segment_t** tail = &cap->retired;
+        while (*tail) tail = &(*tail)->next;
+        cap->current->next = NULL;
+        *tail = cap->current;
+        cap->current = NULL;
+    }
+
+    if (!cap->spare && !cap->error) {
+        cap->stats.stalls++;
+        while (!cap->spare && !cap->error && cap->running) {
+            usb_cond_broadcast(&cap->cond);
+            usb_cond_wait_until(&cap->cond, &cap->lock, usb_time_ns() + 10000000ull);
+        }
+    }
+    if (!cap->spare) {
+        return cap->error ? cap->error : LIBUSB_ERROR_IO;
+    }
+
+    cap->current = cap->spare;
+    cap->spare = NULL;
+    segment_begin(cap, cap->current, now);
+    usb_cond_broadcast(&cap->cond);  // 让刷盘线程准备下一个段、关闭写满的段
+    return LIBUSB_SUCCESS;
+}
+
+// 后台刷盘线程: 准备下一个段，关闭写满的段，周期性写回当前段
+static void* capture_thread(void* arg) {
+    usb_capture_t* cap = (usb_capture_t*)arg;
+
+    usb_mutex_lock(&cap->lock);
+    while (cap->running) {
+        if (!cap->spare && !cap->error) {
+            uint32_t index = cap->next_index;
+            usb_mutex_unlock(&cap->lock);
+            capture_segment_t* seg = segment_create(cap, index);
+            usb_mutex_lock(&cap->lock);
+            if (seg) {
+                cap->spare = seg;
+                cap->next_index++;
+            } else {
+                cap->error = LIBUSB_ERROR_IO;
+            }
+            usb_cond_broadcast(&cap->cond);
+        }
+
+        // 取出没有写入者的段，关闭时不持有lock
+        capture_segment_t* done = NULL;
+        int pending = 0;
+        capture_segment_t** p = &cap->retired;
+        while (*p) {
+            capture_segment_t* seg = *p;
+            if (segment_writers(seg) == 0) {
+                *p = seg->next;
+                seg->next = done;
+                done = seg;
+            } else {
+                p = &seg->next;
+                pending = 1;
+            }
+        }
+
+        // 当前段: 记下已分配的位置，之后分配的写入者计入新的epoch
+        capture_segment_t* cur = cap->current;
+        int epoch = 0;
+        if (cur) {
+            if (cur->commit_end == 0 && cur->used > cur->flushed) {
+                cur->commit_end = cur->used;
+                cur->epoch ^= 1;
+            }
+            epoch = cur->epoch ^ 1;
+        }
+        usb_mutex_unlock(&cap->lock);
+
+        while (done) {
+            capture_segment_t* seg = done;
+            done = seg->next;
+            segment_close(cap, seg);
+        }
+        // 当前段只由本线程关闭，不持有lock也不会被释放
+        // 只写回已经复制完的部分，旧epoch还有写入者时下一轮再检查
+        int flushed = 0;
+        if (cur && cur->commit_end) {
+            if (atomic_load_explicit(&cur->writers[epoch], memory_order_acquire) == 0) {
+                usb_file_map_flush(&cur->map, cur->flushed, cur->commit_end - cur->flushed, cap->cfg.durable);
+                cur->flushed = cur->commit_end;
+                cur->commit_end = 0;
+                flushed = 1;
+            } else {
+                pending = 1;
+            }
+        }
+
+        usb_mutex_lock(&cap->lock);
+        cap->stats.flushes += (uint64_t)flushed;
+        if (cap->running && (cap->spare || cap->error) && !pending) {
+            usb_cond_wait_until(&cap->cond, &cap->lock, usb_time_ns() + (uint64_t)cap->cfg.flush_ms * 1000000ull);
+        } else if (pending) {
+            // 写入者复制完成后马上就能关闭段或写回
+            usb_cond_wait_until(&cap->cond, &cap->lock, usb_time_ns() + 1000000ull);
+        }
+    }
+    usb_mutex_unlock(&cap->lock);
+    return NULL;
+}
+
+/* 打开采集，创建第一个段并启动刷盘线程 */
+int usb_capture_open(usb_capture_t** capture, const usb_capture_config_t* cfg) {
+    if (capture == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    usb_capture_t* cap = (usb_capture_t*)calloc(1, sizeof(usb_capture_t));
+    if (!cap) return LIBUSB_ERROR_NO_MEM;
+    if (cfg) cap->cfg = *cfg;
+    snprintf(cap->path, sizeof(cap->path), "%s", cap->cfg.path ? cap->cfg.path : "capture");
+    cap->cfg.path = cap->path;
+    if (cap->cfg.segment_size == 0) cap->cfg.segment_size = USB_CAPTURE_DEFAULT_SEGMENT;
+    if (cap->cfg.flush_ms == 0) cap->cfg.flush_ms = USB_CAPTURE_DEFAULT_FLUSH;
+    if (cap->cfg.chunk_size == 0) cap->cfg.chunk_size = USB_CAPTURE_DEFAULT_CHUNK;
+    // 段大小按页对齐，至少能放下文件头和一条记录
+    size_t page = usb_page_size();
+    if (cap->cfg.segment_size < USB_CAPTURE_HEADER_SIZE + page) {
+        cap->cfg.segment_size = USB_CAPTURE_HEADER_SIZE + page;
+    }
+    cap->cfg.segment_size = (cap->cfg.segment_size + page - 1) / page * page;
+    if (cap->cfg.chunk_size > cap->cfg.segment_size) cap->cfg.chunk_size = cap->cfg.segment_size;
+    // 段尾预留END记录、最多的块索引和文件尾
+    cap->data_limit = cap->cfg.segment_size - sizeof(usb_capture_record_t) - sizeof(usb_capture_footer_t) -
+                      sizeof(usb_capture_chunk_t) * (cap->cfg.segment_size / cap->cfg.chunk_size + 1);
+
+    cap->spare = segment_create(cap, 0);
+    if (!cap->spare) {
+        free(cap);
+        return LIBUSB_ERROR_IO;
+    }
+    cap->next_index = 1;
+
+    usb_mutex_init(&cap->lock);
+    usb_cond_init(&cap->cond);
+    cap->running = 1;
+    usb_mutex_lock(&cap->lock);
+    capture_rotate(cap, usb_time_ns());
+    usb_mutex_unlock(&cap->lock);
+
+    if (usb_thread_create(&cap->thread, capture_thread, cap) != 0) {
+        segment_discard(cap, cap->current);
+        usb_cond_destroy(&cap->cond);
+        usb_mutex_destroy(&cap->lock);
+        free(cap);
+        return LIBUSB_ERROR_OTHER;
+    }
+
+    *capture = cap;
+    return LIBUSB_SUCCESS;
+}
+
+/* 停止刷盘线程，关闭所有段 */
+int usb_capture_close(usb_capture_t* capture) {
+    if (capture == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    usb_mutex_lock(&capture->lock);
+    capture->running = 0;
+    usb_cond_broadcast(&capture->cond);
+    usb_mutex_unlock(&capture->lock);
+    usb_thread_join(capture->thread);
+
+    // 调用者已停止写入，剩下的段可以直接关闭
+    while (capture->retired) {
+        capture_segment_t* seg = capture->retired;
+        capture->retired = seg->next;
+        segment_close(capture, seg);
+    }
+    if (capture->current) {
+        segment_close(capture, capture->current);
+    }
+    if (capture->spare) {
+        segment_discard(capture, capture->spare);
+    }
+
+    int r = capture->error;
+    usb_cond_destroy(&capture->cond);
+    usb_mutex_destroy(&capture->lock);
+    free(capture);
+    return r;
+}
+
+/* 注册一台设备 */
+usb_capture_sink_t* usb_capture_add_device(usb_capture_t* capture, const char* serial) {
+    usb_capture_sink_t* sink = NULL;
+
+    usb_mutex_lock(&capture->lock);
+    if (capture->num_devices < MAX_DEVICES) {
+        int i = capture->num_devices++;
+        snprintf(capture->serials[i], USB_CAPTURE_SERIAL_LENGTH, "%s", serial ? serial : "");
+        sink = &capture->sinks[i];
+        sink->capture = capture;
+        sink->device = (uint8_t)i;
+        sink->seq = 0;
+        if (capture->current) {
+            segment_write_devices(capture, capture->current);
+        }
+    }
+    usb_mutex_unlock(&capture->lock);
+    return sink;
+}
+
+// 写入一条记录: 持有lock只分配空间，复制在锁外进行。time_ns为0时取当前时间
+static int capture_append(usb_capture_sink_t* sink, uint8_t type, uint64_t time_ns, const unsigned char* data,
+                          int length) {
+    usb_capture_t* cap = sink->capture;
+    usb_capture_record_t rec;
+    size_t need = record_size(length);
+
+    usb_mutex_lock(&cap->lock);
+    // 持锁取时间，文件中记录的时间按顺序递增，按时间定位才能二分查找
+    uint64_t now = time_ns ? time_ns : usb_time_ns();
+    if (now < cap->last_ns) {
+        now = cap->last_ns;
+    }
+    if (length < 0 || need > cap->data_limit - USB_CAPTURE_HEADER_SIZE) {
+        cap->stats.dropped++;
+        usb_mutex_unlock(&cap->lock);
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+    capture_segment_t* seg = cap->current;
+    if (!seg || seg->used + need > cap->data_limit ||
+        (cap->cfg.segment_ms && now - seg->start_ns >= (uint64_t)cap->cfg.segment_ms * 1000000ull)) {
+        int r = capture_rotate(cap, now);
+        if (r < 0) {
+            cap->stats.dropped++;
+            usb_mutex_unlock(&cap->lock);
+            return r;
+        }
+        seg = cap->current;
+    }
+    size_t offset = seg->used;
+    seg->used += need;
+    if (offset >= seg->next_chunk && seg->num_chunks < seg->max_chunks) {
+        seg->chunks[seg->num_chunks].time_ns = now;
+        seg->chunks[seg->num_chunks].offset = offset;
+        seg->num_chunks++;
+        seg->next_chunk = offset + cap->cfg.chunk_size;
+    }
+    seg->records++;
+    seg->end_ns = now;
+    cap->last_ns = now;
+    int epoch = seg->epoch;
+    atomic_fetch_add_explicit(&seg->writers[epoch], 1, memory_order_relaxed);
+    rec.length = (uint32_t)length;
+    rec.type = type;
+    rec.device = sink->device;
+    rec.flags = 0;
+    rec.seq = sink->seq++;
+    rec.time_ns = now;
+    cap->stats.records++;
+    cap->stats.bytes += (uint64_t)length;
+    cap->stats.file_bytes += need;
+    usb_mutex_unlock(&cap->lock);
+
+    // 负载先写，记录头最后写 (对齐填充在预分配的文件中已经是0)
+    memcpy(seg->map.addr + offset + sizeof(rec), data, (size_t)length);
+    memcpy(seg->map.addr + offset, &rec, sizeof(rec));
+    atomic_fetch_sub_explicit(&seg->writers[epoch], 1, memory_order_release);
+    return LIBUSB_SUCCESS;
+}
+
+/* 写入一条记录 */
+int usb_capture_write(usb_capture_sink_t* sink, const unsigned char* data, int length) {
+    return capture_append(sink, USB_CAPTURE_DATA, 0, data, length);
+}
+
+int usb_capture_write_at(usb_capture_sink_t* sink, uint64_t time_ns, const unsigned char* data, int length) {
+    return capture_append(sink, USB_CAPTURE_DATA, time_ns, data, length);
+}
+
+int usb_capture_write_trigger(usb_capture_sink_t* sink, uint64_t time_ns, const usb_capture_trigger_t* trigger) {
+    return capture_append(sink, USB_CAPTURE_TRIGGER, time_ns, (const unsigned char*)trigger, (int)sizeof(*trigger));
+}
+
+int usb_capture_write_gap(usb_capture_sink_t* sink, uint64_t lost_ns, uint64_t resumed_ns, int error) {
+    usb_capture_gap_t gap;
+    memset(&gap, 0, sizeof(gap));
+    gap.lost_ns = lost_ns;
+    gap.resumed_ns = resumed_ns;
+    gap.error = error;
+    return capture_append(sink, USB_CAPTURE_GAP, 0, (const unsigned char*)&gap, (int)sizeof(gap));
+}
+
+void usb_capture_stream_cb(const unsigned char* data, int length, void* user_data) {
+    usb_capture_write((usb_capture_sink_t*)user_data, data, length);
+}
+
+void usb_capture_get_stats(usb_capture_t* capture, usb_capture_stats_t* stats) {
+    usb_mutex_lock(&capture->lock);
+    *stats = capture->stats;
+    usb_mutex_unlock(&capture->lock);
+}
@@ -0,0 +1,154 @@
+#ifndef USB_CAPTURE_H
+#define USB_CAPTURE_H
+
+#include "usb_control.h"
+
+// 采集落盘: 传输数据写入预分配、内存映射的段文件，按大小或时间轮换。
+// 每条记录 = 记录头 + 负载，负载从传输缓冲区直接复制到映射的页中 (唯一的一次复制)，
+// 写回磁盘、创建下一个段、关闭写满的段都在后台刷盘线程中进行，不占用读取线程。
+//
+// 段文件: <path>.<段序号6位>.cap
+//   [usb_capture_file_header_t, 共 USB_CAPTURE_HEADER_SIZE 字节][记录][记录]...[END记录][块索引][usb_capture_footer_t]
+//   记录按8字节对齐，type为0的记录头(或文件结束)表示记录结束。
+//   记录按块索引: 每约 chunk_size 字节开始一个新块，索引保存块内第一条记录的时间和偏移，
+//   段正常关闭时写在文件末尾，按时间定位时二分查找段和块。没有文件尾的段 (进程异常退出) 读取时顺序扫描重建索引。
+//   所有字段为主机字节序 (x86/ARM均为小端)。
+
+#define USB_CAPTURE_MAGIC           "USBCAP01"
+#define USB_CAPTURE_VERSION         1
+#define USB_CAPTURE_HEADER_SIZE     4096
+#define USB_CAPTURE_ALIGN           8
+#define USB_CAPTURE_SERIAL_LENGTH   64
+#define USB_CAPTURE_DEFAULT_SEGMENT (64u * 1024 * 1024)
+#define USB_CAPTURE_DEFAULT_FLUSH   100
+#define USB_CAPTURE_DEFAULT_CHUNK   (1024 * 1024)
+#define USB_CAPTURE_INDEX_MAGIC     "USBIDX01"
+
+typedef enum {
+    USB_CAPTURE_END = 0,     // 段结束 (预分配空间未写入的部分)
+    USB_CAPTURE_DATA = 1,    // 一个传输的数据
+    USB_CAPTURE_GAP = 2,     // 数据中断 (设备断开后重新连接)，负载为 usb_capture_gap_t
+    USB_CAPTURE_TRIGGER = 3  // 触发采集 (usb_trigger.h) 的一个窗口开始，负载为 usb_capture_trigger_t
+} usb_capture_type_t;
+
+typedef struct {
+    uint32_t length;         // 负载长度 (不含记录头和对齐填充)
+    uint8_t type;            // usb_capture_type_t
+    uint8_t device;          // 设备序号，对应文件头的序列号表
+    uint16_t flags;          // 保留
+    uint64_t seq;            // 每台设备的记录序号，从0开始，跨段连续
+    uint64_t time_ns;        // 写入时的单调时钟 (usb_time_ns)
+} usb_capture_record_t;
+
+// GAP记录的负载: 这台设备在 lost_ns 到 resumed_ns 之间没有数据 (resumed_ns为0表示直到采集结束)
+typedef struct {
+    uint64_t lost_ns;        // 发现断开的时间 (usb_time_ns)
+    uint64_t resumed_ns;     // 重新连接、恢复读取的时间
+    int32_t error;           // 断开的原因 (LIBUSB_ERROR_*)
+    uint32_t reserved;
+} usb_capture_gap_t;
+
+// TRIGGER记录的负载: 之后的记录是 [trigger_ns - pre_ns, trigger_ns + post_ns] 内的数据 (再次触发时窗口延长)
+typedef struct {
+    uint64_t trigger_ns;     // 触发条件满足的数据的时间
+    uint64_t pre_ns;
+    uint64_t post_ns;
+    int32_t condition;       // usb_trigger_mode_t
+    uint32_t reserved;
+} usb_capture_trigger_t;
+
+typedef struct {
+    char magic[8];           // USB_CAPTURE_MAGIC
+    uint32_t version;
+    uint32_t header_size;    // 第一条记录的偏移
+    uint32_t segment;        // 段序号，从0开始
+    uint32_t num_devices;
+    uint64_t start_ns;       // 段开始时的单调时钟
+    uint64_t start_wall_ns;  // 同一时刻的墙上时间，用于把记录时间换算为绝对时间
+    char serials[MAX_DEVICES][USB_CAPTURE_SERIAL_LENGTH];
+} usb_capture_file_header_t;
+
+// 块索引项
+typedef struct {
+    uint64_t time_ns;        // 块内第一条记录的时间
+    uint64_t offset;         // 块内第一条记录在段文件中的偏移
+} usb_capture_chunk_t;
+
+// 文件尾，位于段文件的最后
+typedef struct {
+    char magic[8];           // USB_CAPTURE_INDEX_MAGIC
+    uint32_t num_chunks;
+    uint32_t reserved;
+    uint64_t index_offset;   // 块索引在段文件中的偏移
+    uint64_t records;        // 段内的记录数
+    uint64_t end_ns;         // 段内最后一条记录的时间
+} usb_capture_footer_t;
+
+typedef struct {
+    const char* path;        // 段文件路径前缀，默认 "capture"
+    size_t segment_size;     // 段文件大小 (写满后轮换)，默认64MB
+    unsigned int segment_ms; // 段的最长时间，0表示只按大小轮换
+    unsigned int flush_ms;   // 后台写回周期，默认100ms
+    int durable;             // 写回时等待数据落盘 (关闭段时总是等待)
+    size_t chunk_size;       // 块索引的粒度，默认1MB
+} usb_capture_config_t;
+
+typedef struct {
+    uint64_t records;        // 写入的记录数
+    uint64_t bytes;          // 写入的负载字节数
+    uint64_t file_bytes;     // 段文件中已使用的字节数 (含文件头、记录头和填充)
+    uint64_t segments;       // 已开始的段数
+    uint64_t dropped;        // 丢弃的记录数 (超过段大小或文件错误)
+    uint64_t stalls;         // 轮换时下一个段还没准备好、写入者等待的次数
+    uint64_t flushes;        // 后台写回次数
+} usb_capture_stats_t;
+
+typedef struct usb_capture usb_capture_t;
+typedef struct usb_capture_sink usb_capture_sink_t;
+
+int usb_capture_open(usb_capture_t** capture, const usb_capture_config_t* cfg);
+// 关闭前先停止所有写入的流；最后一个段截断到实际使用的长度
+int usb_capture_close(usb_capture_t* capture);
+
+// 注册一台设备，返回的sink用于写入 (序号按注册顺序分配)，失败返回NULL
+usb_capture_sink_t* usb_capture_add_device(usb_capture_t* capture, const char* serial);
+// 写入一条记录，可以从多个线程调用 (同一个sink只能在一个线程中写入)
+int usb_capture_write(usb_capture_sink_t* sink, const unsigned char* data, int length);
+// 写入一条时间为time_ns的记录 (先缓冲、之后才写入的数据)。文件中的时间保持递增，
+// time_ns早于已经写入的记录时按最后一条记录的时间写入
+int usb_capture_write_at(usb_capture_sink_t* sink, uint64_t time_ns, const unsigned char* data, int length);
+// 写入一条TRIGGER记录，time_ns同 usb_capture_write_at
+int usb_capture_write_trigger(usb_capture_sink_t* sink, uint64_t time_ns, const usb_capture_trigger_t* trigger);
+// 写入一条GAP记录，标记数据中断 (序号与数据记录连续)
+int usb_capture_write_gap(usb_capture_sink_t* sink, uint64_t lost_ns, uint64_t resumed_ns, int error);
+// usb_stream_cb 适配，user_data为 usb_capture_add_device 返回的sink
+void usb_capture_stream_cb(const unsigned char* data, int length, void* user_data);
+
+void usb_capture_get_stats(usb_capture_t* capture, usb_capture_stats_t* stats);
+
+// ---- 读取 ----
+// 打开 <path>.000000.cap 起连续编号的所有段。段文件按需逐个映射，同一时间只映射一个。
+
+typedef struct usb_capture_reader usb_capture_reader_t;
+
+typedef struct {
+    int num_segments;
+    int num_devices;
+    char serials[MAX_DEVICES][USB_CAPTURE_SERIAL_LENGTH];
+    uint64_t records;        // 总记录数
+    uint64_t start_ns;       // 第一条记录的时间
+    uint64_t end_ns;         // 最后一条记录的时间
+    uint64_t start_wall_ns;  // 第一个段开始时的墙上时间
+    int recovered;           // 没有文件尾、扫描重建索引的段数
+} usb_capture_info_t;
+
+int usb_capture_reader_open(usb_capture_reader_t** reader, const char* path);
+void usb_capture_reader_close(usb_capture_reader_t* reader);
+void usb_capture_reader_get_info(usb_capture_reader_t* reader, usb_capture_info_t* info);
+// 读取下一条记录，payload指向映射的文件内容，读到下一个段之前有效。
+// 成功返回1，读完返回0，失败返回负的 LIBUSB_ERROR_*
+int usb_capture_reader_next(usb_capture_reader_t* reader, usb_capture_record_t* record, const unsigned char** payload);
+// 定位到时间 >= time_ns 的第一条记录 (二分查找段和块，块内顺序扫描)，之后的 next 从这里开始
+int usb_capture_reader_seek(usb_capture_reader_t* reader, uint64_t time_ns);
+
+#endif // USB_CAPTURE_H
@@ -0,0 +1,275 @@
+#include "usb_capture.h"
+#include "usb_trace.h"
+
+#define READER_PATH_LENGTH 1100
+
+// 打开时从文件尾读入 (或扫描重建) 的段信息，之后不需要映射就能定位
+typedef struct {
+    char name[READER_PATH_LENGTH];
+    usb_capture_chunk_t* chunks;
+    uint32_t num_chunks;
+    uint64_t records;
+    uint64_t end_ns;
+    size_t data_end;         // 记录区结束的偏移
+} reader_segment_t;
+
+struct usb_capture_reader {
+    reader_segment_t* segments;
+    int num_segments;
+    usb_capture_info_t info;
+
+    // 游标: 当前段和段内下一条记录的偏移
+    int seg;
+    size_t offset;
+    int mapped;              // 当前映射的段，-1表示没有
+    usb_file_map_t map;
+};
+
+static size_t record_size(uint32_t length) {
+    size_t n = sizeof(usb_capture_record_t) + (size_t)length;
+    return (n + USB_CAPTURE_ALIGN - 1) & ~(size_t)(USB_CAPTURE_ALIGN - 1);
+}
+
+// 读取文件尾的索引，成功返回1
+static int segment_load_footer(reader_segment_t* sg, const usb_file_map_t* map) {
+    usb_capture_footer_t footer;
+    if (map->size < USB_CAPTURE_HEADER_SIZE + sizeof(footer)) {
+        return 0;
+    }
+    memcpy(&footer, map->addr + map->size - sizeof(footer), sizeof(footer));
+    size_t index_size = sizeof(usb_capture_chunk_t) * footer.num_chunks;
+    if (memcmp(footer.magic, USB_CAPTURE_INDEX_MAGIC, sizeof(footer.magic)) != 0 ||
+        footer.index_offset < USB_CAPTURE_HEADER_SIZE + sizeof(usb_capture_record_t) ||
+        footer.index_offset + index_size + sizeof(footer) != map->size) {
+        return 0;
+    }
+
+    sg->chunks = (usb_capture_chunk_t*)malloc(index_size ? index_size : 1);
+    if (!sg->chunks) return 0;
+    memcpy(sg->chunks, map->addr + footer.index_offset, index_size);
+    sg->num_chunks = footer.num_chunks;
+    sg->records = footer.records;
+    sg->end_ns = footer.end_ns;
+    sg->data_end = (size_t)footer.index_offset - sizeof(usb_capture_record_t);
+    return 1;
+}
+
+// 没有文件尾: 顺序扫描记录，按写入时相同的规则重建块索引
+static int segment_scan(reader_segment_t* sg, const usb_file_map_t* map) {
+    usb_capture_record_t rec;
+    size_t offset = USB_CAPTURE_HEADER_SIZE;
+    size_t next_chunk = offset;
+    uint32_t max_chunks = 0;
+
+    sg->num_chunks = 0;
+    while (offset + sizeof(rec) <= map->size) {
+        memcpy(&rec, map->addr + offset, sizeof(rec));
+        if (rec.type == USB_CAPTURE_END || offset + sizeof(rec) + rec.length > map->size) {
+            break;
+        }
+        if (offset >= next_chunk) {
+            if (sg->num_chunks == max_chunks) {
+                max_chunks = max_chunks ? max_chunks * 2 : 64;
+                usb_capture_chunk_t* chunks = (usb_capture_chunk_t*)realloc(sg->chunks, sizeof(usb_capture_chunk_t) * max_chunks);
+                if (!chunks) return 0;
+                sg->chunks = chunks;
+            }
+            sg->chunks[sg->num_chunks].time_ns = rec.time_ns;
+            sg->chunks[sg->num_chunks].offset = offset;
+            sg->num_chunks++;
+            next_chunk = offset + USB_CAPTURE_DEFAULT_CHUNK;
+        }
+        sg->records++;
+        sg->end_ns = rec.time_ns;
+        offset += record_size(rec.length);
+    }
+    sg->data_end = offset;
+    return 1;
+}
+
+static void reader_unmap(usb_capture_reader_t* r) {
+    if (r->mapped >= 0) {
+        usb_file_map_close(&r->map, 0);
+        r->mapped = -1;
+    }
+}
+
+// 映射游标所在的段
+static int reader_map(usb_capture_reader_t* r) {
+    if (r->mapped == r->seg) {
+        return LIBUSB_SUCCESS;
+    }
+    reader_unmap(r);
+    if (usb_file_map_open(&r->map, r->segments[r->seg].name) != 0) {
+        return LIBUSB_ERROR_IO;
+    }
+    r->mapped = r->seg;
+    return LIBUSB_SUCCESS;
+}
+
+/* 打开采集的所有段并读入索引 */
+int usb_capture_reader_open(usb_capture_reader_t** reader, const char* path) {
+    if (reader == NULL || path == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    usb_capture_reader_t* r = (usb_capture_reader_t*)calloc(1, sizeof(usb_capture_reader_t));
+    if (!r) return LIBUSB_ERROR_NO_MEM;
+    r->mapped = -1;
+    r->info.start_ns = UINT64_MAX;
+
+    for (uint32_t index = 0;; index++) {
+        char name[READER_PATH_LENGTH];
+        usb_file_map_t map;
+        snprintf(name, sizeof(name), "%s.%06u.cap", path, index);
+        if (usb_file_map_open(&map, name) != 0) {
+            break;
+        }
+
+        usb_capture_file_header_t header;
+        if (map.size < sizeof(header) ||
+            (memcpy(&header, map.addr, sizeof(header)), memcmp(header.magic, USB_CAPTURE_MAGIC, sizeof(header.magic)) != 0)) {
+            USB_TRACE_STR(NOT_A_SEGMENT, name);
+            usb_file_map_close(&map, 0);
+            break;
+        }
+
+        reader_segment_t* segments = (reader_segment_t*)realloc(r->segments, sizeof(reader_segment_t) * (index + 1));
+        if (!segments) {
+            usb_file_map_close(&map, 0);
+            usb_capture_reader_close(r);
+            return LIBUSB_ERROR_NO_MEM;
+        }
+        r->segments = segments;
+        reader_segment_t* sg = &r->segments[index];
+        memset(sg, 0, sizeof(*sg));
+        snprintf(sg->name, sizeof(sg->name), "%s", name);
+        r->num_segments++;
+
+        if (!segment_load_footer(sg, &map)) {
+            segment_scan(sg, &map);
+            r->info.recovered++;
+        }
+        usb_file_map_close(&map, 0);
+
+        // 设备表只会增长，以最后一个段为准
+        r->info.num_devices = (int)header.num_devices;
+        memcpy(r->info.serials, header.serials, sizeof(r->info.serials));
+        if (index == 0) {
+            r->info.start_wall_ns = header.start_wall_ns;
+        }
+        if (sg->num_chunks > 0 && r->info.start_ns == UINT64_MAX) {
+            r->info.start_ns = sg->chunks[0].time_ns;
+        }
+        if (sg->records > 0) {
+            r->info.end_ns = sg->end_ns;
+        } else if (index > 0) {
+            // 空段 (没有记录) 取前一个段的最后时间，各段的end_ns保持递增，按时间定位才能二分查找
+            sg->end_ns = r->segments[index - 1].end_ns;
+        }
+        r->info.records += sg->records;
+    }
+
+    if (r->num_segments == 0) {
+        USB_TRACE_STR(NO_SEGMENTS, path);
+        usb_capture_reader_close(r);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    if (r->info.start_ns == UINT64_MAX) {
+        r->info.start_ns = 0;
+    }
+    r->info.num_segments = r->num_segments;
+    r->offset = USB_CAPTURE_HEADER_SIZE;
+    *reader = r;
+    return LIBUSB_SUCCESS;
+}
+
+void usb_capture_reader_close(usb_capture_reader_t* reader) {
+    if (reader) {
+        reader_unmap(reader);
+        for (int i = 0; i < reader->num_segments; i++) {
+            free(reader->segments[i].chunks);
+        }
+        free(reader->segments);
+        free(reader);
+    }
+}
+
+void usb_capture_reader_get_info(usb_capture_reader_t* reader, usb_capture_info_t* info) {
+    *info = reader->info;
+}
+
+// 取游标处的记录，不移动游标；当前段读完时转到下一个段
+static int reader_peek(usb_capture_reader_t* r, usb_capture_record_t* record, const unsigned char** payload) {
+    while (r->seg < r->num_segments) {
+        reader_segment_t* sg = &r->segments[r->seg];
+        if (r->offset + sizeof(*record) <= sg->data_end) {
+            int rc = reader_map(r);
+            if (rc < 0) {
+                return rc;
+            }
+            memcpy(record, r->map.addr + r->offset, sizeof(*record));
+            if (record->type != USB_CAPTURE_END && r->offset + sizeof(*record) + record->length <= sg->data_end) {
+                *payload = r->map.addr + r->offset + sizeof(*record);
+                return 1;
+            }
+        }
+        r->seg++;
+        r->offset = USB_CAPTURE_HEADER_SIZE;
+    }
+    reader_unmap(r);
+    return 0;
+}
+
+int usb_capture_reader_next(usb_capture_reader_t* reader, usb_capture_record_t* record, const unsigned char** payload) {
+    int r = reader_peek(reader, record, payload);
+    if (r == 1) {
+        reader->offset += record_size(record->length);
+    }
+    return r;
+}
+
+/* 按时间定位 */
+int usb_capture_reader_seek(usb_capture_reader_t* reader, uint64_t time_ns) {
+    // 第一个最后记录时间 >= time_ns 的段
+    int lo = 0, hi = reader->num_segments;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        reader_segment_t* sg = &reader->segments[mid];
+        if (sg->end_ns >= time_ns) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    reader->seg = lo;
+    reader->offset = USB_CAPTURE_HEADER_SIZE;
+    if (lo == reader->num_segments) {
+        reader_unmap(reader);
+        return LIBUSB_SUCCESS;
+    }
+
+    // 段内最后一个开始时间 <= time_ns 的块
+    reader_segment_t* sg = &reader->segments[lo];
+    uint32_t clo = 0, chi = sg->num_chunks;
+    while (chi - clo > 1) {
+        uint32_t mid = (clo + chi) / 2;
+        if (sg->chunks[mid].time_ns <= time_ns) {
+            clo = mid;
+        } else {
+            chi = mid;
+        }
+    }
+    if (sg->num_chunks > 0) {
+        reader->offset = (size_t)sg->chunks[clo].offset;
+    }
+
+    // 块内顺序扫描
+    usb_capture_record_t record;
+    const unsigned char* payload;
+    int r;
+    while ((r = reader_peek(reader, &record, &payload)) == 1 && record.time_ns < time_ns) {
+        reader->offset += record_size(record.length);
+    }
+    return r < 0 ? r : LIBUSB_SUCCESS;
+}
@@ -0,0 +1,425 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_command.h"
+#include "usb_trace.h"
+
+#define COMMAND_MAX_EXPIRE 32  // 一次最多在锁外回调的到期命令数
+#define COMMAND_MAX_SUBMIT 8   // 一次最多在锁外提交的传输数
+
+typedef struct {
+    usb_command_cb cb;
+    void* user_data;
+    uint64_t submit_ns;      // 提交时的 usb_stats_clock()
+    uint64_t deadline_ns;    // 到期时间 (usb_time_ns)
+    int length;
+    int expired;             // 在队列中到期，已经回调，发送时跳过
+} command_entry_t;
+
+typedef struct {
+    usb_command_queue_t* queue;
+    struct libusb_transfer* transfer;
+    unsigned char* buffer;
+    command_entry_t* batch;  // 这次写传输包含的命令
+    int count;
+    int busy;
+} command_slot_t;
+
+struct usb_command_queue {
+    libusb_device_handle* handle;
+    usb_command_config_t cfg;
+    usb_stats_t* stats;
+
+    // 以下由 lock 保护
+    usb_mutex_t lock;
+    usb_cond_t cond;
+    command_entry_t* entries;       // 环形队列
+    unsigned char* data;            // 第i条命令的数据在 data + i * max_command
+    int head;
+    int count;
+    uint64_t next_deadline;         // 队列中最早到期时间的下界
+    command_slot_t* slots;
+    int* free_slots;
+    int num_free;
+    int in_flight;
+    int running;
+
+    usb_thread_t thread;
+    atomic_uint_least64_t sent;
+    atomic_uint_least64_t completed;
+    atomic_uint_least64_t timeouts;
+    atomic_uint_least64_t errors;
+    atomic_uint_least64_t rejected;
+    atomic_uint_least64_t transfers;
+    atomic_uint_least64_t bytes;
+};
+
+static int transfer_error(enum libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_COMPLETED: return 0;
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        case LIBUSB_TRANSFER_CANCELLED: return LIBUSB_ERROR_INTERRUPTED;
+        default: return LIBUSB_ERROR_IO;
+    }
+}
+
+// 回调一条命令的结果，不持有锁
+static void command_deliver(usb_command_queue_t* q, const command_entry_t* e, int status) {
+    usb_stats_record(q->stats, e->submit_ns, e->length, status == 0 ? e->length : 0, status);
+    if (status == 0) {
+        atomic_fetch_add_explicit(&q->completed, 1, memory_order_relaxed);
+    } else if (status == LIBUSB_ERROR_TIMEOUT) {
+        atomic_fetch_add_explicit(&q->timeouts, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&q->errors, 1, memory_order_relaxed);
+    }
+    if (e->cb) {
+        e->cb(status, e->user_data);
+    }
+}
+
+static void command_pop(usb_command_queue_t* q) {
+    q->head = (q->head + 1) % q->cfg.queue_length;
+    q->count--;
+}
+
+// 把队首的命令合并到空闲的传输里，没有可发送的命令返回0。调用时持有锁
+static int command_pack(usb_command_queue_t* q, command_slot_t* slot, uint64_t now) {
+    uint64_t deadline = UINT64_MAX;
+    int used = 0;
+
+    slot->count = 0;
+    while (q->count > 0) {
+        command_entry_t* e = &q->entries[q->head];
+        if (!e->expired) {
+            if (used + e->length > q->cfg.batch_size) {
+                break;
+            }
+            memcpy(slot->buffer + used, q->data + (size_t)q->head * (size_t)q->cfg.max_command, (size_t)e->length);
+            used += e->length;
+            slot->batch[slot->count++] = *e;
+            if (e->deadline_ns < deadline) deadline = e->deadline_ns;
+        }
+        command_pop(q);
+    }
+    if (slot->count == 0) {
+        return 0;
+    }
+
+    unsigned int timeout = deadline > now ? (unsigned int)((deadline - now + 999999) / 1000000) : 1;
+    libusb_fill_bulk_transfer(slot->transfer, q->handle, 0x01, slot->buffer, used, NULL, slot, timeout);
+    return 1;
+}
+
+// 在队列中到期的命令: 标记并复制出来，队首的直接出队。调用时持有锁，返回个数
+static int command_expire(usb_command_queue_t* q, uint64_t now, command_entry_t* out) {
+    int n = 0;
+    uint64_t next = UINT64_MAX;
+
+    if (now < q->next_deadline) {
+        return 0;
+    }
+    for (int i = 0; i < q->count; i++) {
+        command_entry_t* e = &q->entries[(q->head + i) % q->cfg.queue_length];
+        if (e->expired) {
+            continue;
+        }
+        if (e->deadline_ns <= now && n < COMMAND_MAX_EXPIRE) {
+            e->expired = 1;
+            out[n++] = *e;
+        } else if (e->deadline_ns < next) {
+            next = e->deadline_ns;
+        }
+    }
+    while (q->count > 0 && q->entries[q->head].expired) {
+        command_pop(q);
+    }
+    // 还有没来得及复制出来的到期命令时，下一次立即再扫描
+    q->next_deadline = n == COMMAND_MAX_EXPIRE ? now : next;
+    if (n > 0) {
+        usb_cond_broadcast(&q->cond);
+    }
+    return n;
+}
+
+static void command_transfer_cb(struct libusb_transfer* transfer);
+
+// 一个写传输结束 (或提交失败): 回调其中所有命令，传输回到空闲列表
+static void command_finish(usb_command_queue_t* q, command_slot_t* slot, int status) {
+    atomic_fetch_add_explicit(&q->transfers, 1, memory_order_relaxed);
+    if (status == 0) {
+        atomic_fetch_add_explicit(&q->bytes, (uint64_t)slot->transfer->actual_length, memory_order_relaxed);
+    }
+    for (int i = 0; i < slot->count; i++) {
+        command_deliver(q, &slot->batch[i], status);
+    }
+
+    usb_mutex_lock(&q->lock);
+    slot->busy = 0;
+    q->free_slots[q->num_free++] = (int)(slot - q->slots);
+    q->in_flight--;
+    usb_cond_broadcast(&q->cond);
+    usb_mutex_unlock(&q->lock);
+}
+
+// 处理到期的命令 (expire为1时，只在事件线程中)，用空闲的传输发送队列中的命令
+static void command_service(usb_command_queue_t* q, int expire) {
+    command_entry_t expired[COMMAND_MAX_EXPIRE];
+    command_slot_t* packed[COMMAND_MAX_SUBMIT];
+    int num_expired, num_packed, num_failed;
+
+    do {
+        num_expired = 0;
+        num_packed = 0;
+        num_failed = 0;
+        usb_mutex_lock(&q->lock);
+        uint64_t now = usb_time_ns();
+        if (expire) {
+            num_expired = command_expire(q, now, expired);
+        }
+        while (q->running && q->num_free > 0 && q->count > 0 && num_packed < COMMAND_MAX_SUBMIT) {
+            command_slot_t* slot = &q->slots[q->free_slots[q->num_free - 1]];
+            if (!command_pack(q, slot, now)) {
+                break;
+            }
+            q->num_free--;
+            q->in_flight++;
+            slot->busy = 1;
+            slot->transfer->callback = command_transfer_cb;
+            packed[num_packed++] = slot;
+        }
+        usb_mutex_unlock(&q->lock);
+
+        for (int i = 0; i < num_expired; i++) {
+            command_deliver(q, &expired[i], LIBUSB_ERROR_TIMEOUT);
+        }
+        // 在锁外提交: 后端提交时加自己的锁，完成回调 (可能在别的线程、也可能同步) 会再加队列的锁。
+        // 传输已经从空闲列表取出，关闭时来不及取消的会在它的超时内完成
+        for (int i = 0; i < num_packed; i++) {
+            int r = usb_transport->submit_transfer(packed[i]->transfer);
+            if (r < 0) {
+                command_finish(q, packed[i], r);
+                num_failed++;
+            }
+        }
+    } while (num_expired == COMMAND_MAX_EXPIRE || num_failed > 0 || num_packed == COMMAND_MAX_SUBMIT);
+}
+
+static void command_transfer_cb(struct libusb_transfer* transfer) {
+    command_slot_t* slot = (command_slot_t*)transfer->user_data;
+    usb_command_queue_t* q = slot->queue;
+    int status = transfer_error(transfer->status);
+    if (status == 0 && transfer->actual_length < transfer->length) {
+        status = LIBUSB_ERROR_IO;  // 设备没有收下全部数据
+    }
+    command_finish(q, slot, status);
+    command_service(q, 1);
+}
+
+// 事件线程: 处理写传输的完成，按队列中最早的到期时间醒来处理超时
+static void* command_event_thread(void* arg) {
+    usb_command_queue_t* q = (usb_command_queue_t*)arg;
+    libusb_context* ctx = usb_control_context();
+
+    for (;;) {
+        usb_mutex_lock(&q->lock);
+        int done = !q->running && q->in_flight == 0;
+        uint64_t wait_ns = 100000000ull;
+        if (q->count > 0) {
+            uint64_t now = usb_time_ns();
+            wait_ns = q->next_deadline > now ? q->next_deadline - now : 0;
+            if (wait_ns > 100000000ull) wait_ns = 100000000ull;
+            if (wait_ns < 1000000ull) wait_ns = 1000000ull;
+        }
+        usb_mutex_unlock(&q->lock);
+        if (done) {
+            break;
+        }
+
+        struct timeval tv = {0, (long)(wait_ns / 1000)};
+        usb_transport->handle_events_timeout_completed(ctx, &tv, NULL);
+        command_service(q, 1);
+    }
+    return NULL;
+}
+
+static void command_free(usb_command_queue_t* q) {
+    for (int i = 0; q->slots && i < q->cfg.max_in_flight; i++) {
+        if (q->slots[i].transfer) usb_transport->free_transfer(q->slots[i].transfer);
+        free(q->slots[i].buffer);
+        free(q->slots[i].batch);
+    }
+    usb_stats_destroy(q->stats);
+    free(q->slots);
+    free(q->free_slots);
+    free(q->entries);
+    free(q->data);
+    free(q);
+}
+
+/* 创建命令队列 */
+int usb_command_open(usb_command_queue_t** queue, usb_device_t* device, const usb_command_config_t* cfg) {
+    libusb_device_handle* handle = usb_device_handle(device);
+    if (queue == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (!handle) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    usb_command_queue_t* q = (usb_command_queue_t*)calloc(1, sizeof(usb_command_queue_t));
+    if (!q) return LIBUSB_ERROR_NO_MEM;
+    q->handle = handle;
+    if (cfg) q->cfg = *cfg;
+    if (q->cfg.max_in_flight <= 0) q->cfg.max_in_flight = USB_COMMAND_DEFAULT_IN_FLIGHT;
+    if (q->cfg.batch_size <= 0) q->cfg.batch_size = USB_COMMAND_DEFAULT_BATCH;
+    if (q->cfg.max_command <= 0) q->cfg.max_command = USB_COMMAND_DEFAULT_MAX;
+    if (q->cfg.max_command > q->cfg.batch_size) q->cfg.max_command = q->cfg.batch_size;
+    if (q->cfg.queue_length <= 0) q->cfg.queue_length = USB_COMMAND_DEFAULT_QUEUE;
+    if (q->cfg.timeout_ms == 0) q->cfg.timeout_ms = USB_COMMAND_DEFAULT_TIMEOUT;
+
+    q->stats = usb_stats_create();
+    q->entries = (command_entry_t*)calloc((size_t)q->cfg.queue_length, sizeof(command_entry_t));
+    q->data = (unsigned char*)malloc((size_t)q->cfg.queue_length * (size_t)q->cfg.max_command);
+    q->slots = (command_slot_t*)calloc((size_t)q->cfg.max_in_flight, sizeof(command_slot_t));
+    q->free_slots = (int*)calloc((size_t)q->cfg.max_in_flight, sizeof(int));
+    if (!q->stats || !q->entries || !q->data || !q->slots || !q->free_slots) {
+        command_free(q);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    for (int i = 0; i < q->cfg.max_in_flight; i++) {
+        command_slot_t* slot = &q->slots[i];
+        slot->queue = q;
+        slot->transfer = usb_transport->alloc_transfer(0);
+        slot->buffer = (unsigned char*)malloc((size_t)q->cfg.batch_size);
+        slot->batch = (command_entry_t*)malloc(sizeof(command_entry_t) * (size_t)q->cfg.batch_size);
+        if (!slot->transfer || !slot->buffer || !slot->batch) {
+            command_free(q);
+            return LIBUSB_ERROR_NO_MEM;
+        }
+        q->free_slots[q->num_free++] = q->cfg.max_in_flight - 1 - i;
+    }
+
+    usb_mutex_init(&q->lock);
+    usb_cond_init(&q->cond);
+    q->next_deadline = UINT64_MAX;
+    q->running = 1;
+    if (usb_thread_create(&q->thread, command_event_thread, q) != 0) {
+        USB_TRACE_STR(THREAD_FAILED, "command");
+        usb_cond_destroy(&q->cond);
+        usb_mutex_destroy(&q->lock);
+        command_free(q);
+        return LIBUSB_ERROR_OTHER;
+    }
+
+    *queue = q;
+    return 0;
+}
+
+/* 提交命令 */
+int usb_command_send(usb_command_queue_t* queue, const unsigned char* data, int length, unsigned int timeout_ms,
+                     usb_command_cb cb, void* user_data) {
+    if (!queue || !data || length <= 0 || length > queue->cfg.max_command) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (timeout_ms == 0) timeout_ms = queue->cfg.timeout_ms;
+
+    usb_mutex_lock(&queue->lock);
+    if (!queue->running) {
+        usb_mutex_unlock(&queue->lock);
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    if (queue->count == queue->cfg.queue_length) {
+        usb_mutex_unlock(&queue->lock);
+        atomic_fetch_add_explicit(&queue->rejected, 1, memory_order_relaxed);
+        return LIBUSB_ERROR_BUSY;
+    }
+    int index = (queue->head + queue->count) % queue->cfg.queue_length;
+    command_entry_t* e = &queue->entries[index];
+    e->cb = cb;
+    e->user_data = user_data;
+    e->submit_ns = usb_stats_clock();
+    e->deadline_ns = usb_time_ns() + (uint64_t)timeout_ms * 1000000ull;
+    e->length = length;
+    e->expired = 0;
+    memcpy(queue->data + (size_t)index * (size_t)queue->cfg.max_command, data, (size_t)length);
+    queue->count++;
+    if (e->deadline_ns < queue->next_deadline) queue->next_deadline = e->deadline_ns;
+    usb_mutex_unlock(&queue->lock);
+    atomic_fetch_add_explicit(&queue->sent, 1, memory_order_relaxed);
+
+    // 有空闲的传输时立即发送，否则留给正在进行的传输完成后合并发送
+    command_service(queue, 0);
+    return 0;
+}
+
+int usb_command_flush(usb_command_queue_t* queue, unsigned int timeout_ms) {
+    if (!queue) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    uint64_t deadline = usb_time_ns() + (uint64_t)timeout_ms * 1000000ull;
+    int r = 0;
+    usb_mutex_lock(&queue->lock);
+    while (queue->count > 0 || queue->in_flight > 0) {
+        if (usb_time_ns() >= deadline) {
+            r = LIBUSB_ERROR_TIMEOUT;
+            break;
+        }
+        usb_cond_wait_until(&queue->cond, &queue->lock, deadline);
+    }
+    usb_mutex_unlock(&queue->lock);
+    return r;
+}
+
+/* 关闭命令队列 */
+int usb_command_close(usb_command_queue_t* queue) {
+    if (!queue) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    int r = usb_command_flush(queue, queue->cfg.timeout_ms);
+
+    // 还没发出的命令以INTERRUPTED完成，挂起的传输取消
+    usb_mutex_lock(&queue->lock);
+    queue->running = 0;
+    while (queue->count > 0) {
+        command_entry_t e = queue->entries[queue->head];
+        command_pop(queue);
+        if (!e.expired) {
+            usb_mutex_unlock(&queue->lock);
+            command_deliver(queue, &e, LIBUSB_ERROR_INTERRUPTED);
+            usb_mutex_lock(&queue->lock);
+        }
+    }
+    for (int i = 0; i < queue->cfg.max_in_flight; i++) {
+        if (queue->slots[i].busy) {
+            usb_transport->cancel_transfer(queue->slots[i].transfer);
+        }
+    }
+    usb_mutex_unlock(&queue->lock);
+
+    usb_thread_join(queue->thread);
+    usb_cond_destroy(&queue->cond);
+    usb_mutex_destroy(&queue->lock);
+    command_free(queue);
+    return r;
+}
+
+void usb_command_get_stats(usb_command_queue_t* queue, usb_command_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!queue) {
+        return;
+    }
+    stats->sent = atomic_load_explicit(&queue->sent, memory_order_relaxed);
+    stats->completed = atomic_load_explicit(&queue->completed, memory_order_relaxed);
+    stats->timeouts = atomic_load_explicit(&queue->timeouts, memory_order_relaxed);
+    stats->errors = atomic_load_explicit(&queue->errors, memory_order_relaxed);
+    stats->rejected = atomic_load_explicit(&queue->rejected, memory_order_relaxed);
+    stats->transfers = atomic_load_explicit(&queue->transfers, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&queue->bytes, memory_order_relaxed);
+    usb_mutex_lock(&queue->lock);
+    stats->queued = queue->count;
+    usb_mutex_unlock(&queue->lock);
+    usb_stats_snapshot(queue->stats, &stats->latency);
+}
@@ -0,0 +1,62 @@
+#ifndef USB_COMMAND_H
+#define USB_COMMAND_H
+
+#include "usb_control.h"
+#include "usb_stats.h"
+
+// 异步命令队列 (EP 0x01): 发送不阻塞，命令先进入队列，由多个同时挂起的写传输发出。
+// 所有写传输都在忙时，新命令在队列中累积，下一个空闲的传输把它们合并成一次写入 (不额外等待)，
+// 所以低速时每条命令单独发送、延迟最低，高速时自动成批。
+// 命令按提交顺序写入，设备需要能从连续的字节流中解析命令 (命令的边界由调用者的协议决定)。
+// 写传输和读取 (EP 0x81) 的传输互相独立，发送命令不会阻塞流式读取。
+//
+// 每条命令有自己的超时: 在队列中等待的时间也计算在内，到期还没发出的命令以 LIBUSB_ERROR_TIMEOUT 完成，不再发送；
+// 已经合并到传输中的命令按整个传输的结果完成 (传输的超时取其中最早的到期时间)。
+
+typedef struct usb_command_queue usb_command_queue_t;
+
+// 命令完成回调，status为0或 LIBUSB_ERROR_*，不持有队列的锁。
+// 传输完成时在处理上下文事件的线程中执行: 队列的事件线程，或共享同一上下文的其他事件线程 (例如流的事件线程)；
+// 提交失败和关闭时未发出的命令在调用 usb_command_send / usb_command_close 的线程中执行
+typedef void (*usb_command_cb)(int status, void* user_data);
+
+typedef struct {
+    int max_in_flight;       // 同时挂起的写传输数，默认4
+    int batch_size;          // 一次写传输最多合并的字节数，默认4096
+    int max_command;         // 单条命令的最大长度，默认64 (不能超过batch_size)
+    int queue_length;        // 队列能容纳的命令数，默认4096，满时 usb_command_send 返回BUSY
+    unsigned int timeout_ms; // 命令的默认超时，默认1000
+} usb_command_config_t;
+
+#define USB_COMMAND_DEFAULT_IN_FLIGHT 4
+#define USB_COMMAND_DEFAULT_BATCH     4096
+#define USB_COMMAND_DEFAULT_MAX       64
+#define USB_COMMAND_DEFAULT_QUEUE     4096
+#define USB_COMMAND_DEFAULT_TIMEOUT   1000
+
+typedef struct {
+    uint64_t sent;           // 提交的命令数
+    uint64_t completed;      // 成功完成的命令数
+    uint64_t timeouts;       // 超时的命令数 (包括在队列中到期的)
+    uint64_t errors;         // 出错的命令数
+    uint64_t rejected;       // 队列满被拒绝的次数
+    uint64_t transfers;      // 写传输数
+    uint64_t bytes;          // 写出的字节数
+    int queued;              // 当前在队列中的命令数
+    usb_stats_snapshot_t latency;  // 命令 提交->完成 的延迟
+} usb_command_stats_t;
+
+// 在已打开的设备上创建命令队列，device为NULL时使用USB_OpenDevice打开的设备，cfg为NULL时使用默认配置
+int usb_command_open(usb_command_queue_t** queue, usb_device_t* device, const usb_command_config_t* cfg);
+// 等待已提交的命令完成 (最多默认超时)，取消剩下的，然后释放队列
+int usb_command_close(usb_command_queue_t* queue);
+
+// 提交一条命令 (复制数据，立即返回)。timeout_ms为0时使用默认超时，cb可以为NULL
+int usb_command_send(usb_command_queue_t* queue, const unsigned char* data, int length, unsigned int timeout_ms,
+                     usb_command_cb cb, void* user_data);
+// 等待队列中和挂起的命令全部完成，超时返回 LIBUSB_ERROR_TIMEOUT
+int usb_command_flush(usb_command_queue_t* queue, unsigned int timeout_ms);
+
+void usb_command_get_stats(usb_command_queue_t* queue, usb_command_stats_t* stats);
+
+#endif // USB_COMMAND_H
@@ -1,31 +1,68 @@
-#include "usb_control.h"
+#include "usb_internal.h"
+#include "usb_registry.h"
+#include "usb_stats.h"
+#include "usb_trace.h"
+
+// 打开/关闭命令 (EP 0x01) 的超时(ms)，设备不响应时不会一直阻塞
+#define USB_COMMAND_TIMEOUT 1000
 
 // Global variables
-static HMODULE dll = NULL;
 static libusb_context* ctx = NULL;
-static libusb_device_handle* dev_handle = NULL;
-
-// Function pointers
-static libusb_init_t libusb_init = NULL;
-static libusb_exit_t libusb_exit = NULL;
-static libusb_get_device_list_t libusb_get_device_list = NULL;
-static libusb_free_device_list_t libusb_free_device_list = NULL;
-static libusb_get_device_descriptor_t libusb_get_device_descriptor = NULL;
-static libusb_open_t libusb_open = NULL;
-static libusb_close_t libusb_close = NULL;
-static libusb_set_configuration_t libusb_set_configuration = NULL;
-static libusb_claim_interface_t libusb_claim_interface = NULL;
-static libusb_release_interface_t libusb_release_interface = NULL;
-static libusb_bulk_transfer_t libusb_bulk_transfer = NULL;
-static libusb_get_string_descriptor_ascii_t libusb_get_string_descriptor_ascii = NULL;
+static usb_device_t* default_device = NULL;  // 旧接口 USB_OpenDevice 打开的设备
+const usb_transport_t* usb_transport = NULL;
+
+// 已打开的设备
+struct usb_device {
+    libusb_device_handle* handle;
+    char serial[MAX_STR_LENGTH];
+    usb_stats_t* stats;
+};
+
+libusb_context* usb_control_context(void) {
+    return ctx;
+}
+
+libusb_device_handle* usb_device_handle(usb_device_t* device) {
+    if (device == NULL) {
+        device = default_device;
+    }
+    return device ? device->handle : NULL;
+}
+
+usb_stats_t* usb_device_stats(usb_device_t* device) {
+    if (device == NULL) {
+        device = default_device;
+    }
+    return device ? device->stats : NULL;
+}
+
+static usb_device_t* device_alloc(libusb_device_handle* handle, const char* serial) {
+    usb_device_t* d = (usb_device_t*)calloc(1, sizeof(usb_device_t));
+    if (!d) {
+        return NULL;
+    }
+    d->stats = usb_stats_create();
+    if (!d->stats) {
+        free(d);
+        return NULL;
+    }
+    d->handle = handle;
+    snprintf(d->serial, sizeof(d->serial), "%s", serial);
+    return d;
+}
+
+static void device_free(usb_device_t* d) {
+    usb_stats_destroy(d->stats);
+    free(d);
+}
 
 // Helper function to get device string descriptor
 static int get_string_descriptor(libusb_device_handle* handle, uint8_t desc_index, unsigned char* data, int length) {
     if (desc_index == 0) return 0;
     
-    int r = libusb_get_string_descriptor_ascii(handle, desc_index, data, length);
+    int r = usb_transport->get_string_descriptor_ascii(handle, desc_index, data, length);
     if (r < 0) {
-        printf(" Failed: %s", libusb_error_name(r));
+        USB_TRACE(STRING_FAILED, desc_index, r);
         return r;
     }
     return r;
@@ -58,245 +95,236 @@ static const char* error_name(int error_code) {
     }
 }
 
-//初始化
-int usb_control_init(void) {
-    // Load DLL
-    dll = LoadLibraryA(LIBUSB_DLL_PATH);
-    if (!dll) {
-        printf("Failed to load %s\n", LIBUSB_DLL_PATH);
-        return -1;
-    }
-    printf("Loaded %s\n", LIBUSB_DLL_PATH);
-
-    // Get function pointers
-    libusb_init = (libusb_init_t)GetProcAddress(dll, "libusb_init");
-    libusb_exit = (libusb_exit_t)GetProcAddress(dll, "libusb_exit");
-    libusb_get_device_list = (libusb_get_device_list_t)GetProcAddress(dll, "libusb_get_device_list");
-    libusb_free_device_list = (libusb_free_device_list_t)GetProcAddress(dll, "libusb_free_device_list");
-    libusb_get_device_descriptor = (libusb_get_device_descriptor_t)GetProcAddress(dll, "libusb_get_device_descriptor");
-    libusb_open = (libusb_open_t)GetProcAddress(dll, "libusb_open");
-    libusb_close = (libusb_close_t)GetProcAddress(dll, "libusb_close");
-    libusb_set_configuration = (libusb_set_configuration_t)GetProcAddress(dll, "libusb_set_configuration");
-    libusb_claim_interface = (libusb_claim_interface_t)GetProcAddress(dll, "libusb_claim_interface");
-    libusb_release_interface = (libusb_release_interface_t)GetProcAddress(dll, "libusb_release_interface");
-    libusb_bulk_transfer = (libusb_bulk_transfer_t)GetProcAddress(dll, "libusb_bulk_transfer");
-    libusb_get_string_descriptor_ascii = (libusb_get_string_descriptor_ascii_t)GetProcAddress(dll, "libusb_get_string_descriptor_ascii");
-
-    if (!libusb_init || !libusb_exit || !libusb_get_device_list || !libusb_free_device_list || 
-        !libusb_get_device_descriptor || !libusb_open || !libusb_close || !libusb_set_configuration ||
-        !libusb_claim_interface || !libusb_release_interface || !libusb_bulk_transfer ||
-        !libusb_get_string_descriptor_ascii) {
-        printf("Failed to get function pointers\n");
-        FreeLibrary(dll);
-        return -1;
-    }
-    printf("Got function pointers\n");
+//使用指定后端初始化
+int usb_control_init_transport(const usb_transport_t* transport) {
+    if (transport == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    usb_transport = transport;
 
     // Initialize libusb
-    int r = libusb_init(&ctx);
+    int r = usb_transport->init(&ctx);
     if (r < 0) {
-        printf("Init Error: %s\n", libusb_error_name(r));
-        FreeLibrary(dll);
+        USB_TRACE(INIT_FAILED, r);
+        usb_transport = NULL;
         return r;
     }
-    printf("libusb initialized successfully\n");
+    USB_TRACE_STR(INIT_OK, usb_transport->name);
 
+    r = usb_registry_init(ctx);
+    if (r < 0) {
+        // 注册表可能已扫描了一部分设备，先释放它再退出后端
+        USB_TRACE(INIT_FAILED, r);
+        usb_registry_exit();
+        usb_transport->exit(ctx);
+        ctx = NULL;
+        usb_transport = NULL;
+        return r;
+    }
     return 0;
 }
 
+//初始化
+int usb_control_init(void) {
+    const usb_transport_t* transport;
+    int r = usb_transport_libusb_load(&transport);
+    if (r < 0) {
+        return r;
+    }
+
+    r = usb_control_init_transport(transport);
+    if (r < 0) {
+        usb_transport_libusb_unload();
+    }
+    return r;
+}
 
+//使用模拟设备初始化
+int usb_control_init_sim(const usb_sim_config_t* cfg) {
+    usb_sim_setup(cfg);
+    return usb_control_init_transport(&usb_transport_sim);
+}
+
+//使用采集文件回放初始化
+int usb_control_init_replay(const usb_replay_config_t* cfg) {
+    int r = usb_replay_setup(cfg);
+    if (r < 0) {
+        return r;
+    }
+    return usb_control_init_transport(&usb_transport_replay);
+}
+
+//使用空设备初始化
+int usb_control_init_null(void) {
+    return usb_control_init_transport(&usb_transport_null);
+}
+
+const usb_transport_t* usb_control_transport(void) {
+    return usb_transport;
+}
 
 //清理和释放资源
 void usb_control_exit(void) {
-    if (dev_handle) {
-        libusb_release_interface(dev_handle, 0);
-        libusb_close(dev_handle);
-        dev_handle = NULL;
+    if (default_device) {
+        usb_transport->release_interface(default_device->handle, 0);
+        usb_transport->close(default_device->handle);
+        device_free(default_device);
+        default_device = NULL;
     }
     
     if (ctx) {
-        libusb_exit(ctx);
+        usb_registry_exit();
+        usb_transport->exit(ctx);
         ctx = NULL;
     }
     
-    if (dll) {
-        FreeLibrary(dll);
-        dll = NULL;
-    }
+    usb_transport_libusb_unload();
+    usb_transport = NULL;
 }
 
 
-/* 获取USB vad  0x1733 pad 0xAABB 设备序列号 */
+/* 获取USB vad  0x1733 pad 0xAABB 设备序列号 (来自设备注册表缓存) */
+static void copy_device_info(device_info_t* info, const usb_registry_entry_t* entry) {
+    memcpy(info->serial, entry->serial, sizeof(info->serial));
+    memcpy(info->manufacturer, entry->manufacturer, sizeof(info->manufacturer));
+    memcpy(info->product, entry->product, sizeof(info->product));
+}
+
+// 从注册表复制最多max_devices台有序列号的设备
+static int collect_devices(device_info_t* devices, int count, int max_devices) {
+    usb_registry_entry_t entry;
+    int found = 0;
+
+    for (int i = 0; i < count && found < max_devices; i++) {
+        if (usb_registry_get(i, &entry) < 0 || entry.serial[0] == 0) {
+            continue;
+        }
+        copy_device_info(&devices[found++], &entry);
+    }
+
+    if (found == 0) {
+        USB_TRACE(NO_DEVICES);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    
+    USB_TRACE(DEVICES_FOUND, found);
+    return found;
+}
+
 int USB_ScanDevice(device_info_t* devices, int max_devices) {
     if (devices == NULL || max_devices <= 0) {
         return LIBUSB_ERROR_INVALID_PARAM;
     }
+    return collect_devices(devices, usb_registry_refresh(), max_devices);
+}
 
-    libusb_device** devs;
-    libusb_device* dev;
-    struct libusb_device_descriptor desc;
-    ssize_t cnt;
-    int r, i = 0;
-    int found = 0;
-    
-    // Get device list
-    cnt = libusb_get_device_list(ctx, &devs);
-    if (cnt < 0) {
-        printf("Get Device Error: %s\n", libusb_error_name((int)cnt));
-        return (int)cnt;
+/* 扫描所有设备，列表按实际数量分配 */
+int USB_ScanDeviceList(device_info_t** devices, int flags) {
+    if (devices == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
     }
-    printf("Found %d USB devices\n", (int)cnt);
-    
-    // Find our devices by VID/PID
-    while ((dev = devs[i++]) != NULL && found < max_devices) {
-        r = libusb_get_device_descriptor(dev, &desc);
-        if (r < 0) {
-            printf("Failed to get device descriptor: %s\n", libusb_error_name(r));
-            continue;
-        }
+    *devices = NULL;
 
-        // Check if this is our target device by VID/PID
-        if (desc.idVendor == VENDOR_ID && desc.idProduct == PRODUCT_ID) {
-            libusb_device_handle* handle;
-            r = libusb_open(dev, &handle);
-            if (r < 0) {
-                printf("Device %d: VID=0x%04x, PID=0x%04x (Cannot open device: %s)\n", 
-                       found + 1, desc.idVendor, desc.idProduct, libusb_error_name(r));
-                continue;
-            }
+    int count = usb_registry_refresh_ex(!(flags & USB_SCAN_LAZY));
+    device_info_t* list = (device_info_t*)malloc(sizeof(device_info_t) * (size_t)(count > 0 ? count : 1));
+    if (!list) {
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    // 刷新之后有设备拔出时实际复制的会少于count
+    int found = collect_devices(list, count, count);
+    if (found < 0) {
+        free(list);
+        return found;
+    }
+    *devices = list;
+    return found;
+}
 
-            device_info_t* dev_info = &devices[found];
-            memset(dev_info, 0, sizeof(device_info_t));
+/* 按序列号取设备信息，厂商/产品字符串按需读取 */
+int USB_GetDeviceInfo(const char* serial, device_info_t* info) {
+    usb_registry_entry_t entry;
 
-            // Get manufacturer string
-            r = get_string_descriptor(handle, desc.iManufacturer, (unsigned char*)dev_info->manufacturer, sizeof(dev_info->manufacturer));
-            
-            // Get product string
-            r = get_string_descriptor(handle, desc.iProduct, (unsigned char*)dev_info->product, sizeof(dev_info->product));
-            
-            // Get serial number
-            r = get_string_descriptor(handle, desc.iSerialNumber, (unsigned char*)dev_info->serial, sizeof(dev_info->serial));
-            
-            libusb_close(handle);
-            
-            if (r < 0) {
-                continue;
-            }
+    if (serial == NULL || info == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    int r = usb_registry_fetch_strings(serial, &entry);
+    if (r < 0) {
+        return r;
+    }
+    copy_device_info(info, &entry);
+    return 0;
+}
 
-            // printf("Device %d:\n", found + 1);
-            // printf("  VID/PID: 0x%04x/0x%04x\n", desc.idVendor, desc.idProduct);
-            // printf("  Manufacturer: %s\n", dev_info->manufacturer);
-            // printf("  Product: %s\n", dev_info->product);
-            // printf("  S/N: %s\n", dev_info->serial);
-            // printf("\n");
+/* 打开SN，返回设备句柄。通过注册表按序列号定位，只打开目标设备 */
+int USB_OpenDeviceEx(const char* target_serial, usb_device_t** device) {
+    char serial[MAX_STR_LENGTH];
+    libusb_device_handle* handle;
+    int r;
 
-            found++;
-        }
+    if (device == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
     }
+    *device = NULL;
 
-    // Free device list
-    libusb_free_device_list(devs, 1);
-    
-    if (found == 0) {
-        printf("No matching devices found\n");
+    libusb_device* dev = usb_registry_find(target_serial, serial, sizeof(serial));
+    if (!dev) {
+        USB_TRACE(TARGET_NOT_FOUND);
         return LIBUSB_ERROR_NOT_FOUND;
     }
-    
-    printf("Found %d matching device(s)\n", found);
-    return found;
-}
 
-/* 打开SN */
-int USB_OpenDevice(const char* target_serial) {
-    libusb_device** devs;
-    libusb_device* dev;
-    struct libusb_device_descriptor desc;
-    ssize_t cnt;
-    int r, i = 0;
-    unsigned char string[MAX_STR_LENGTH];
-    int found = 0;
-    
-    // Get device list
-    cnt = libusb_get_device_list(ctx, &devs);
-    if (cnt < 0) {
-        printf("Get Device Error: %s\n", libusb_error_name((int)cnt));
-        return (int)cnt;
+    r = usb_transport->open(dev, &handle);
+    usb_transport->unref_device(dev);
+    if (r < 0) {
+        USB_TRACE(OPEN_FAILED, r);
+        return r;
     }
-    
-    // Find our device by VID/PID and serial
-    while ((dev = devs[i++]) != NULL) {
-        r = libusb_get_device_descriptor(dev, &desc);
-        if (r < 0) {
-            continue;
-        }
-
-        // Check if this is our target device by VID/PID
-        if (desc.idVendor == VENDOR_ID && desc.idProduct == PRODUCT_ID) {
-            libusb_device_handle* handle;
-            r = libusb_open(dev, &handle);
-            if (r < 0) {
-                continue;
-            }
+    USB_TRACE_STR(OPENING, serial);
 
-            // Get serial number
-            memset(string, 0, sizeof(string));
-            r = get_string_descriptor(handle, desc.iSerialNumber, string, sizeof(string));
-            if (r < 0) {
-                libusb_close(handle);
-                continue;
-            }
+    // Set configuration
+    r = usb_transport->set_configuration(handle, 1);
+    if (r < 0) {
+        USB_TRACE(SET_CONFIG_FAILED, r);
+        usb_transport->close(handle);
+        return r;
+    }
 
-            // Check if this is our target device
-            if (target_serial == NULL || strcmp((char*)string, target_serial) == 0) {
-                printf("Opening device with S/N: %s\n", string);
-
-                // Set configuration
-                r = libusb_set_configuration(handle, 1);
-                if (r < 0) {
-                    printf("Failed to set configuration: %s\n", libusb_error_name(r));
-                    libusb_close(handle);
-                    libusb_free_device_list(devs, 1);
-                    return r;
-                }
+    // Claim interface
+    r = usb_transport->claim_interface(handle, 0);
+    if (r < 0) {
+        USB_TRACE(CLAIM_FAILED, r);
+        usb_transport->close(handle);
+        return r;
+    }
 
-                // Claim interface
-                r = libusb_claim_interface(handle, 0);
-                if (r < 0) {
-                    printf("Failed to claim interface: %s\n", libusb_error_name(r));
-                    libusb_close(handle);
-                    libusb_free_device_list(devs, 1);
-                    return r;
-                }
+    // Save handle and send open command
+    usb_device_t* d = device_alloc(handle, serial);
+    if (!d) {
+        usb_transport->release_interface(handle, 0);
+        usb_transport->close(handle);
+        return LIBUSB_ERROR_NO_MEM;
+    }
 
-                // Save handle and send open command
-                dev_handle = handle;
-                printf("Sending open command...\n");
-                unsigned char data = 0x01;
-                int transferred;
-                r = libusb_bulk_transfer(dev_handle, 0x01, &data, 1, &transferred, 0);
-                if (r < 0) {
-                    printf("Failed to send open command: %s\n", libusb_error_name(r));
-                    USB_CloseDevice();
-                    libusb_free_device_list(devs, 1);
-                    return r;
-                }
-                printf("Device opened successfully (transferred %d bytes)\n", transferred);
+    USB_TRACE(OPEN_COMMAND);
+    unsigned char data = 0x01;
+    int transferred;
+    r = usb_transport->bulk_transfer(d->handle, 0x01, &data, 1, &transferred, USB_COMMAND_TIMEOUT);
+    if (r < 0) {
+        USB_TRACE(OPEN_COMMAND_FAILED, r);
+        USB_CloseDeviceEx(d);
+        return r;
+    }
+    USB_TRACE(OPENED, transferred);
 
-                // Free device list and return success
-                libusb_free_device_list(devs, 1);
-                return 0;
-            }
+    *device = d;
+    return 0;
+}
 
-            // Not our target device, close it
-            libusb_close(handle);
-            found++;
-        }
+/* 打开SN (旧接口，使用默认设备) */
+int USB_OpenDevice(const char* target_serial) {
+    if (default_device) {
+        return LIBUSB_ERROR_BUSY;
     }
-
-    // Free device list
-    libusb_free_device_list(devs, 1);
-    printf("Target device not found\n");
-    return LIBUSB_ERROR_NOT_FOUND;
+    return USB_OpenDeviceEx(target_serial, &default_device);
 }
 
 /* 关闭设备 */
@@ -309,42 +337,42 @@ int usb_control_open(const char* target_serial) {
     unsigned char string[MAX_STR_LENGTH];
     
     // Get device list
-    cnt = libusb_get_device_list(ctx, &devs);
+    cnt = usb_transport->get_device_list(ctx, &devs);
     if (cnt < 0) {
-        printf("Get Device Error: %s\n", libusb_error_name((int)cnt));
+        USB_TRACE(DEVICE_LIST_FAILED, cnt);
         return (int)cnt;
     }
-    printf("Found %d devices\n", (int)cnt);
+    USB_TRACE(DEVICE_LIST, cnt);
     
     // Find our device
     while ((dev = devs[i++]) != NULL) {
-        r = libusb_get_device_descriptor(dev, &desc);
+        r = usb_transport->get_device_descriptor(dev, &desc);
         if (r < 0) {
-            printf("Failed to get device descriptor: %s\n", libusb_error_name(r));
+            USB_TRACE(DESCRIPTOR_FAILED, r);
             continue;
         }
 
         // Check if this is our target device by VID/PID
         if (desc.idVendor == VENDOR_ID && desc.idProduct == PRODUCT_ID) {
             libusb_device_handle* handle;
-            r = libusb_open(dev, &handle);
+            r = usb_transport->open(dev, &handle);
             if (r < 0) {
-                printf(" (Cannot open device: %s)\n", libusb_error_name(r));
+                USB_TRACE(OPEN_FAILED, r);
                 continue;
             }
 
             // Set configuration and claim interface
-            r = libusb_set_configuration(handle, 1);
+            r = usb_transport->set_configuration(handle, 1);
             if (r < 0) {
-                printf("\n  Failed to set configuration: %s", libusb_error_name(r));
-                libusb_close(handle);
+                USB_TRACE(SET_CONFIG_FAILED, r);
+                usb_transport->close(handle);
                 continue;
             }
 
-            r = libusb_claim_interface(handle, 0);
+            r = usb_transport->claim_interface(handle, 0);
             if (r < 0) {
-                printf("\n  Failed to claim interface: %s", libusb_error_name(r));
-                libusb_close(handle);
+                USB_TRACE(CLAIM_FAILED, r);
+                usb_transport->close(handle);
                 continue;
             }
 
@@ -352,80 +380,132 @@ int usb_control_open(const char* target_serial) {
             memset(string, 0, sizeof(string));
             r = get_string_descriptor(handle, desc.iSerialNumber, string, sizeof(string));
             if (r < 0) {
-                libusb_release_interface(handle, 0);
-                libusb_close(handle);
+                usb_transport->release_interface(handle, 0);
+                usb_transport->close(handle);
                 continue;
             }
 
-            printf(", S/N: %s", string);
+            USB_TRACE_STR(CANDIDATE, (const char*)string);
 
             // Check if this is our target device by serial number
             if (target_serial == NULL || strcmp((char*)string, target_serial) == 0) {
-                printf("\nFound target device!\n");
-                dev_handle = handle;  // Save the handle
+                USB_TRACE(TARGET_FOUND);
+                default_device = device_alloc(handle, (char*)string);  // Save the handle
+                if (!default_device) {
+                    usb_transport->release_interface(handle, 0);
+                    usb_transport->close(handle);
+                }
                 break;
             }
 
             // Not our target device, close it
-            libusb_release_interface(handle, 0);
-            libusb_close(handle);
+            usb_transport->release_interface(handle, 0);
+            usb_transport->close(handle);
         }
-        printf("\n");
     }
 
     // Free device list
-    libusb_free_device_list(devs, 1);
+    usb_transport->free_device_list(devs, 1);
 
-    if (dev_handle == NULL) {
-        printf("Target device not found\n");
+    if (default_device == NULL) {
+        USB_TRACE(TARGET_NOT_FOUND);
         return LIBUSB_ERROR_NOT_FOUND;
     }
 
     // Send open command
-    printf("Sending open command...\n");
+    USB_TRACE(OPEN_COMMAND);
     unsigned char data = 0x01;
     int transferred;
-    r = libusb_bulk_transfer(dev_handle, 0x01, &data, 1, &transferred, 0);
+    r = usb_transport->bulk_transfer(default_device->handle, 0x01, &data, 1, &transferred, USB_COMMAND_TIMEOUT);
     if (r < 0) {
-        printf("Failed to send open command: %s\n", libusb_error_name(r));
+        USB_TRACE(OPEN_COMMAND_FAILED, r);
         USB_CloseDevice();
         return r;
     }
-    printf("Device opened successfully (transferred %d bytes)\n", transferred);
+    USB_TRACE(OPENED, transferred);
 
     return 0;
 }
 
 /* 从设备读取数据 */
+int usb_device_read(usb_device_t* device, unsigned char* data, int length, int* transferred) {
+    if (!device) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    uint64_t start = usb_stats_clock();
+    *transferred = 0;  // 提交失败 (例如设备断开) 时后端不写transferred
+    int r = usb_transport->bulk_transfer(device->handle, 0x81, data, length, transferred, 1000);  // 1秒超时
+    usb_stats_record(device->stats, start, length, *transferred, r);
+    USB_TRACE(DEVICE_READ, *transferred, length, r);
+    return r;
+}
+
 int usb_control_read(unsigned char* data, int length, int* transferred) {
-    if (!dev_handle) {
+    return usb_device_read(default_device, data, length, transferred);
+}
+
+/* 向设备写命令 (同步) */
+int usb_device_write(usb_device_t* device, const unsigned char* data, int length, int* transferred, unsigned int timeout) {
+    if (!device) {
         return LIBUSB_ERROR_NO_DEVICE;
     }
+    return usb_transport->bulk_transfer(device->handle, 0x01, (unsigned char*)data, length, transferred,
+                                        timeout ? timeout : USB_COMMAND_TIMEOUT);
+}
 
-    return libusb_bulk_transfer(dev_handle, 0x81, data, length, transferred, 1000);  // 1秒超时
+int usb_device_get_stats(usb_device_t* device, usb_stats_snapshot_t* snap) {
+    usb_stats_t* stats = usb_device_stats(device);
+    if (!stats) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    usb_stats_snapshot(stats, snap);
+    return 0;
+}
+
+int usb_device_get_max_packet_size(usb_device_t* device) {
+    libusb_device_handle* handle = usb_device_handle(device);
+    if (!handle) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    return usb_transport->get_max_packet_size(usb_transport->get_device(handle), 0x81);
+}
+
+const char* usb_device_get_serial(usb_device_t* device) {
+    return device ? device->serial : NULL;
 }
 
 /* 关闭设备 */
-int USB_CloseDevice(void) {
-    if (!dev_handle) {
+int USB_CloseDeviceEx(usb_device_t* device) {
+    if (!device) {
         return LIBUSB_ERROR_NOT_FOUND;
     }
 
     // Send close command
     unsigned char data = 0;
     int transferred;
-    printf("Sending close command...\n");
+    USB_TRACE(CLOSE_COMMAND);
     
-    int r = libusb_bulk_transfer(dev_handle, 0x01, &data, 1, &transferred, 0);
+    int r = usb_transport->bulk_transfer(device->handle, 0x01, &data, 1, &transferred, USB_COMMAND_TIMEOUT);
     if (r == 0) {
-        printf("Device closed successfully (transferred %d bytes)\n", transferred);
+        USB_TRACE(CLOSED, transferred);
     } else {
-        printf("Error in bulk transfer: %s\n", libusb_error_name(r));
+        USB_TRACE(CLOSE_FAILED, r);
     }
 
-    libusb_release_interface(dev_handle, 0);
-    libusb_close(dev_handle);
-    dev_handle = NULL;
+    usb_transport->release_interface(device->handle, 0);
+    usb_transport->close(device->handle);
+    device_free(device);
+
+    return r;
+}
+
+int USB_CloseDevice(void) {
+    if (!default_device) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
 
+    int r = USB_CloseDeviceEx(default_device);
+    default_device = NULL;
     return r;
 }
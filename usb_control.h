@@ -5,10 +5,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
-#include <windows.h>
+#include "usb_platform.h"
 
 // DLL path
+#ifdef _WIN32
 #define LIBUSB_DLL_PATH "libs/windows/x86_64/libusb-1.0.dll"
+#else
+#define LIBUSB_DLL_PATH "libusb-1.0.so.0"
+#endif
 
 // Device IDs
 #define VENDOR_ID  0x1733
@@ -48,6 +52,76 @@ typedef struct {
     char product[MAX_STR_LENGTH];
 } device_info_t;
 
+// Asynchronous transfer (与libusb-1.0的结构体布局一致)
+enum libusb_transfer_status {
+    LIBUSB_TRANSFER_COMPLETED,
+    LIBUSB_TRANSFER_ERROR,
+    LIBUSB_TRANSFER_TIMED_OUT,
+    LIBUSB_TRANSFER_CANCELLED,
+    LIBUSB_TRANSFER_STALL,
+    LIBUSB_TRANSFER_NO_DEVICE,
+    LIBUSB_TRANSFER_OVERFLOW
+};
+
+#define LIBUSB_TRANSFER_TYPE_BULK 2
+
+struct libusb_transfer;
+typedef void (*libusb_transfer_cb_fn)(struct libusb_transfer* transfer);
+
+struct libusb_iso_packet_descriptor {
+    unsigned int length;
+    unsigned int actual_length;
+    enum libusb_transfer_status status;
+};
+
+struct libusb_transfer {
+    libusb_device_handle* dev_handle;
+    uint8_t flags;
+    unsigned char endpoint;
+    unsigned char type;
+    unsigned int timeout;
+    enum libusb_transfer_status status;
+    int length;
+    int actual_length;
+    libusb_transfer_cb_fn callback;
+    void* user_data;
+    unsigned char* buffer;
+    int num_iso_packets;
+    struct libusb_iso_packet_descriptor iso_packet_desc[];
+};
+
+static inline void libusb_fill_bulk_transfer(struct libusb_transfer* transfer,
+    libusb_device_handle* dev_handle, unsigned char endpoint, unsigned char* buffer,
+    int length, libusb_transfer_cb_fn callback, void* user_data, unsigned int timeout) {
+    transfer->dev_handle = dev_handle;
+    transfer->endpoint = endpoint;
+    transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+    transfer->timeout = timeout;
+    transfer->buffer = buffer;
+    transfer->length = length;
+    transfer->user_data = user_data;
+    transfer->callback = callback;
+}
+
+// Hotplug
+typedef enum {
+    LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED = 1,
+    LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT = 2
+} libusb_hotplug_event;
+
+#define LIBUSB_HOTPLUG_ENUMERATE  1
+#define LIBUSB_HOTPLUG_MATCH_ANY  -1
+
+// 事件循环集成 (与libusb-1.0相同): 调用者poll这些fd，可读/可写或超时后处理事件
+struct libusb_pollfd {
+    int fd;
+    short events;            // POLLIN / POLLOUT
+};
+
+typedef int libusb_hotplug_callback_handle;
+typedef int (*libusb_hotplug_callback_fn)(libusb_context* ctx, libusb_device* device,
+                                          libusb_hotplug_event event, void* user_data);
+
 // Function types
 typedef int (*libusb_init_t)(libusb_context**);
 typedef void (*libusb_exit_t)(libusb_context*);
@@ -61,6 +135,23 @@ typedef int (*libusb_claim_interface_t)(libusb_device_handle*, int);
 typedef int (*libusb_release_interface_t)(libusb_device_handle*, int);
 typedef int (*libusb_bulk_transfer_t)(libusb_device_handle*, unsigned char, unsigned char*, int, int*, unsigned int);
 typedef int (*libusb_get_string_descriptor_ascii_t)(libusb_device_handle*, uint8_t, unsigned char*, int);
+typedef struct libusb_transfer* (*libusb_alloc_transfer_t)(int);
+typedef void (*libusb_free_transfer_t)(struct libusb_transfer*);
+typedef int (*libusb_submit_transfer_t)(struct libusb_transfer*);
+typedef int (*libusb_cancel_transfer_t)(struct libusb_transfer*);
+typedef int (*libusb_handle_events_timeout_completed_t)(libusb_context*, struct timeval*, int*);
+typedef uint8_t (*libusb_get_bus_number_t)(libusb_device*);
+typedef int (*libusb_get_port_numbers_t)(libusb_device*, uint8_t*, int);
+typedef libusb_device* (*libusb_ref_device_t)(libusb_device*);
+typedef void (*libusb_unref_device_t)(libusb_device*);
+typedef libusb_device* (*libusb_get_device_t)(libusb_device_handle*);
+typedef int (*libusb_get_max_packet_size_t)(libusb_device*, unsigned char);
+typedef int (*libusb_hotplug_register_callback_t)(libusb_context*, int, int, int, int, int,
+                                                  libusb_hotplug_callback_fn, void*, libusb_hotplug_callback_handle*);
+typedef void (*libusb_hotplug_deregister_callback_t)(libusb_context*, libusb_hotplug_callback_handle);
+typedef const struct libusb_pollfd** (*libusb_get_pollfds_t)(libusb_context*);
+typedef void (*libusb_free_pollfds_t)(const struct libusb_pollfd**);
+typedef int (*libusb_get_next_timeout_t)(libusb_context*, struct timeval*);
 
 // Error codes
 #define LIBUSB_SUCCESS             0
@@ -78,13 +169,29 @@ typedef int (*libusb_get_string_descriptor_ascii_t)(libusb_device_handle*, uint8
 #define LIBUSB_ERROR_NOT_SUPPORTED -12
 #define LIBUSB_ERROR_OTHER       -99
 
+// 已打开设备的句柄 (不透明)
+typedef struct usb_device usb_device_t;
+
 // Function declarations
 extern const char* libusb_error_name(int error_code);
 int usb_control_init(void);
 void usb_control_exit(void);
 int USB_ScanDevice(device_info_t* devices, int max_devices);  // 返回找到的设备数量
+// 扫描所有匹配的设备 (数量不受 MAX_DEVICES 限制)，*devices 为malloc分配的数组，由调用者free。返回设备数量
+// flags 为 USB_SCAN_LAZY 时只读取序列号，厂商/产品为空字符串，需要时用 USB_GetDeviceInfo 读取
+#define USB_SCAN_LAZY 1
+int USB_ScanDeviceList(device_info_t** devices, int flags);
+int USB_GetDeviceInfo(const char* serial, device_info_t* info);  // 按序列号返回设备信息，字符串没有读取过时打开设备读取
 int USB_OpenDevice(const char* target_serial);  // 如果target_serial为NULL，打开第一个设备
 int USB_CloseDevice(void);
 int usb_control_read(unsigned char* data, int length, int* transferred);
 
+// 多设备接口: 每个打开的设备一个句柄，可以同时从多台设备读取
+int USB_OpenDeviceEx(const char* target_serial, usb_device_t** device);  // 如果target_serial为NULL，打开第一个设备
+int USB_CloseDeviceEx(usb_device_t* device);
+int usb_device_read(usb_device_t* device, unsigned char* data, int length, int* transferred);
+int usb_device_write(usb_device_t* device, const unsigned char* data, int length, int* transferred, unsigned int timeout);  // 写EP 0x01，timeout为0时1秒
+const char* usb_device_get_serial(usb_device_t* device);
+int usb_device_get_max_packet_size(usb_device_t* device);  // EP 0x81的最大包长，device为NULL时使用默认设备
+
 #endif // USB_CONTROL_H
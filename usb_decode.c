@@ -0,0 +1,366 @@
+#include <stdatomic.h>
+#include "usb_decode.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define USB_DECODE_X86 1
+#include <immintrin.h>
+#endif
+
+// 同步字的小端字节
+#define SYNC0 (USB_FRAME_SYNC & 0xFF)
+#define SYNC1 (USB_FRAME_SYNC >> 8)
+
+typedef struct {
+    int (*find_sync)(const unsigned char* p, int from, int n);
+    uint32_t (*crc32c)(uint32_t crc, const unsigned char* p, size_t n);  // 不做首尾取反
+    void (*unpack_s16)(const unsigned char* p, int count, int32_t* out);
+    void (*unpack_s24)(const unsigned char* p, int count, int32_t* out);
+} decode_kernels_t;
+
+// ---- 标量 ----
+
+// CRC-32C (Castagnoli)，反射多项式 0x82F63B78，按字节查表。
+// 表在编译时生成 (第i项为字节i按位计算8次的结果)，不需要运行时初始化，多线程直接使用
+static const uint32_t crc32c_table[256] = {
+    0x00000000u, 0xF26B8303u, 0xE13B70F7u, 0x1350F3F4u, 0xC79A971Fu, 0x35F1141Cu, 0x26A1E7E8u, 0xD4CA64EBu,
+    0x8AD958CFu, 0x78B2DBCCu, 0x6BE22838u, 0x9989AB3Bu, 0x4D43CFD0u, 0xBF284CD3u, 0xAC78BF27u, 0x5E133C24u,
+    0x105EC76Fu, 0xE235446Cu, 0xF165B798u, 0x030E349Bu, 0xD7C45070u, 0x25AFD373u, 0x36FF2087u, 0xC494A384u,
+    0x9A879FA0u, 0x68EC1CA3u, 0x7BBCEF57u, 0x89D76C54u, 0x5D1D08BFu, 0xAF768BBCu, 0xBC267848u, 0x4E4DFB4Bu,
+    0x20BD8EDEu, 0xD2D60DDDu, 0xC186FE29u, 0x33ED7D2Au, 0xE72719C1u, 0x154C9AC2u, 0x061C6936u, 0xF477EA35u,
+    0xAA64D611u, 0x580F5512u, 0x4B5FA6E6u, 0xB93425E5u, 0x6DFE410Eu, 0x9F95C20Du, 0x8CC531F9u, 0x7EAEB2FAu,
+    0x30E349B1u, 0xC288CAB2u, 0xD1D83946u, 0x23B3BA45u, 0xF779DEAEu, 0x05125DADu, 0x1642AE59u, 0xE4292D5Au,
+    0xBA3A117Eu, 0x4851927Du, 0x5B016189u, 0xA96AE28Au, 0x7DA08661u, 0x8FCB0562u, 0x9C9BF696u, 0x6EF07595u,
+    0x417B1DBCu, 0xB3109EBFu, 0xA0406D4Bu, 0x522BEE48u, 0x86E18AA3u, 0x748A09A0u, 0x67DAFA54u, 0x95B17957u,
+    0xCBA24573u, 0x39C9C670u, 0x2A993584u, 0xD8F2B687u, 0x0C38D26Cu, 0xFE53516Fu, 0xED03A29Bu, 0x1F682198u,
+    0x5125DAD3u, 0xA34E59D0u, 0xB01EAA24u, 0x42752927u, 0x96BF4DCCu, 0x64D4CECFu, 0x77843D3Bu, 0x85EFBE38u,
+    0xDBFC821Cu, 0x2997011Fu, 0x3AC7F2EBu, 0xC8AC71E8u, 0x1C661503u, 0xEE0D9600u, 0xFD5D65F4u, 0x0F36E6F7u,
+    0x61C69362u, 0x93AD1061u, 0x80FDE395u, 0x72966096u, 0xA65C047Du, 0x5437877Eu, 0x4767748Au, 0xB50CF789u,
+    0xEB1FCBADu, 0x197448AEu, 0x0A24BB5Au, 0xF84F3859u, 0x2C855CB2u, 0xDEEEDFB1u, 0xCDBE2C45u, 0x3FD5AF46u,
+    0x7198540Du, 0x83F3D70Eu, 0x90A324FAu, 0x62C8A7F9u, 0xB602C312u, 0x44694011u, 0x5739B3E5u, 0xA55230E6u,
+    0xFB410CC2u, 0x092A8FC1u, 0x1A7A7C35u, 0xE811FF36u, 0x3CDB9BDDu, 0xCEB018DEu, 0xDDE0EB2Au, 0x2F8B6829u,
+    0x82F63B78u, 0x709DB87Bu, 0x63CD4B8Fu, 0x91A6C88Cu, 0x456CAC67u, 0xB7072F64u, 0xA457DC90u, 0x563C5F93u,
+    0x082F63B7u, 0xFA44E0B4u, 0xE9141340u, 0x1B7F9043u, 0xCFB5F4A8u, 0x3DDE77ABu, 0x2E8E845Fu, 0xDCE5075Cu,
+    0x92A8FC17u, 0x60C37F14u, 0x73938CE0u, 0x81F80FE3u, 0x55326B08u, 0xA759E80Bu, 0xB4091BFFu, 0x466298FCu,
+    0x1871A4D8u, 0xEA1A27DBu, 0xF94AD42Fu, 0x0B21572Cu, 0xDFEB33C7u, 0x2D80B0C4u, 0x3ED04330u, 0xCCBBC033u,
+    0xA24BB5A6u, 0x502036A5u, 0x4370C551u, 0xB11B4652u, 0x65D122B9u, 0x97BAA1BAu, 0x84EA524Eu, 0x7681D14Du,
+    0x2892ED69u, 0xDAF96E6Au, 0xC9A99D9Eu, 0x3BC21E9Du, 0xEF087A76u, 0x1D63F975u, 0x0E330A81u, 0xFC588982u,
+    0xB21572C9u, 0x407EF1CAu, 0x532E023Eu, 0xA145813Du, 0x758FE5D6u, 0x87E466D5u, 0x94B49521u, 0x66DF1622u,
+    0x38CC2A06u, 0xCAA7A905u, 0xD9F75AF1u, 0x2B9CD9F2u, 0xFF56BD19u, 0x0D3D3E1Au, 0x1E6DCDEEu, 0xEC064EEDu,
+    0xC38D26C4u, 0x31E6A5C7u, 0x22B65633u, 0xD0DDD530u, 0x0417B1DBu, 0xF67C32D8u, 0xE52CC12Cu, 0x1747422Fu,
+    0x49547E0Bu, 0xBB3FFD08u, 0xA86F0EFCu, 0x5A048DFFu, 0x8ECEE914u, 0x7CA56A17u, 0x6FF599E3u, 0x9D9E1AE0u,
+    0xD3D3E1ABu, 0x21B862A8u, 0x32E8915Cu, 0xC083125Fu, 0x144976B4u, 0xE622F5B7u, 0xF5720643u, 0x07198540u,
+    0x590AB964u, 0xAB613A67u, 0xB831C993u, 0x4A5A4A90u, 0x9E902E7Bu, 0x6CFBAD78u, 0x7FAB5E8Cu, 0x8DC0DD8Fu,
+    0xE330A81Au, 0x115B2B19u, 0x020BD8EDu, 0xF0605BEEu, 0x24AA3F05u, 0xD6C1BC06u, 0xC5914FF2u, 0x37FACCF1u,
+    0x69E9F0D5u, 0x9B8273D6u, 0x88D28022u, 0x7AB90321u, 0xAE7367CAu, 0x5C18E4C9u, 0x4F48173Du, 0xBD23943Eu,
+    0xF36E6F75u, 0x0105EC76u, 0x12551F82u, 0xE03E9C81u, 0x34F4F86Au, 0xC69F7B69u, 0xD5CF889Du, 0x27A40B9Eu,
+    0x79B737BAu, 0x8BDCB4B9u, 0x988C474Du, 0x6AE7C44Eu, 0xBE2DA0A5u, 0x4C4623A6u, 0x5F16D052u, 0xAD7D5351u
+};
+
+static uint32_t crc32c_scalar(uint32_t crc, const unsigned char* p, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        crc = crc32c_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static int find_sync_scalar(const unsigned char* p, int from, int n) {
+    for (int i = from; i < n; i++) {
+        if (p[i] == SYNC0 && (i + 1 == n || p[i + 1] == SYNC1)) {
+            return i;
+        }
+    }
+    return n;
+}
+
+static void unpack_s16_scalar(const unsigned char* p, int count, int32_t* out) {
+    for (int i = 0; i < count; i++) {
+        out[i] = (int16_t)(p[2 * i] | (p[2 * i + 1] << 8));
+    }
+}
+
+static void unpack_s24_scalar(const unsigned char* p, int count, int32_t* out) {
+    for (int i = 0; i < count; i++) {
+        uint32_t v = (uint32_t)p[3 * i] << 8 | (uint32_t)p[3 * i + 1] << 16 | (uint32_t)p[3 * i + 2] << 24;
+        out[i] = (int32_t)v >> 8;  // 算术右移得到符号扩展
+    }
+}
+
+static void unpack_s32(const unsigned char* p, int count, int32_t* out) {
+    for (int i = 0; i < count; i++) {
+        out[i] = (int32_t)((uint32_t)p[4 * i] | (uint32_t)p[4 * i + 1] << 8 | (uint32_t)p[4 * i + 2] << 16 |
+                           (uint32_t)p[4 * i + 3] << 24);
+    }
+}
+
+#ifdef USB_DECODE_X86
+// ---- SSE4.2 ----
+
+__attribute__((target("sse4.2")))
+static int find_sync_sse42(const unsigned char* p, int from, int n) {
+    const __m128i s0 = _mm_set1_epi8((char)SYNC0);
+    const __m128i s1 = _mm_set1_epi8((char)SYNC1);
+    int i = from;
+    // 同时比较 p[i] 和 p[i+1]，所以每次需要17个字节
+    for (; i + 17 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(p + i + 1));
+        int m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, s0), _mm_cmpeq_epi8(b, s1)));
+        if (m) {
+            return i + __builtin_ctz((unsigned)m);
+        }
+    }
+    return find_sync_scalar(p, i, n);
+}
+
+// crc32指令计算的正是CRC-32C
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char* p, size_t n) {
+    while (n > 0 && ((uintptr_t)p & 7)) {
+        crc = _mm_crc32_u8(crc, *p++);
+        n--;
+    }
+#ifdef __x86_64__
+    uint64_t c = crc;
+    for (; n >= 8; p += 8, n -= 8) {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    crc = (uint32_t)c;
+#endif
+    for (; n >= 4; p += 4, n -= 4) {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+    while (n-- > 0) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2")))
+static void unpack_s16_sse42(const unsigned char* p, int count, int32_t* out) {
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + 2 * i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_cvtepi16_epi32(v));
+        _mm_storeu_si128((__m128i*)(out + i + 4), _mm_cvtepi16_epi32(_mm_srli_si128(v, 8)));
+    }
+    unpack_s16_scalar(p + 2 * i, count - i, out + i);
+}
+
+// 4个3字节样本放到每个32位的高3字节，再算术右移8位
+#define S24_SHUFFLE -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11
+
+__attribute__((target("sse4.2")))
+static void unpack_s24_sse42(const unsigned char* p, int count, int32_t* out) {
+    const __m128i shuffle = _mm_setr_epi8(S24_SHUFFLE);
+    int i = 0;
+    // 每次用12字节但读取16字节
+    for (; 3 * i + 16 <= 3 * count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(p + 3 * i));
+        _mm_storeu_si128((__m128i*)(out + i), _mm_srai_epi32(_mm_shuffle_epi8(v, shuffle), 8));
+    }
+    unpack_s24_scalar(p + 3 * i, count - i, out + i);
+}
+
+// ---- AVX2 ----
+
+__attribute__((target("avx2")))
+static int find_sync_avx2(const unsigned char* p, int from, int n) {
+    const __m256i s0 = _mm256_set1_epi8((char)SYNC0);
+    const __m256i s1 = _mm256_set1_epi8((char)SYNC1);
+    int i = from;
+    for (; i + 33 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(p + i + 1));
+        unsigned m = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, s0), _mm256_cmpeq_epi8(b, s1)));
+        if (m) {
+            return i + __builtin_ctz(m);
+        }
+    }
+    return find_sync_sse42(p, i, n);
+}
+
+__attribute__((target("avx2")))
+static void unpack_s16_avx2(const unsigned char* p, int count, int32_t* out) {
+    int i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(p + 2 * i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(p + 2 * i + 16));
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_cvtepi16_epi32(lo));
+        _mm256_storeu_si256((__m256i*)(out + i + 8), _mm256_cvtepi16_epi32(hi));
+    }
+    unpack_s16_sse42(p + 2 * i, count - i, out + i);
+}
+
+__attribute__((target("avx2")))
+static void unpack_s24_avx2(const unsigned char* p, int count, int32_t* out) {
+    // vpshufb 在每个128位通道内重排，所以两个通道分别载入 p 和 p+12
+    const __m256i shuffle = _mm256_setr_epi8(S24_SHUFFLE, S24_SHUFFLE);
+    int i = 0;
+    for (; 3 * i + 28 <= 3 * count; i += 8) {
+        __m128i lo = _mm_loadu_si128((const __m128i*)(p + 3 * i));
+        __m128i hi = _mm_loadu_si128((const __m128i*)(p + 3 * i + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        _mm256_storeu_si256((__m256i*)(out + i), _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8));
+    }
+    unpack_s24_sse42(p + 3 * i, count - i, out + i);
+}
+#endif
+
+static const decode_kernels_t decode_kernels[] = {
+    {find_sync_scalar, crc32c_scalar, unpack_s16_scalar, unpack_s24_scalar},
+#ifdef USB_DECODE_X86
+    {find_sync_sse42, crc32c_sse42, unpack_s16_sse42, unpack_s24_sse42},
+    {find_sync_avx2, crc32c_sse42, unpack_s16_avx2, unpack_s24_avx2},
+#endif
+};
+
+// 第一次使用时选择，-1表示还没有选择。多个线程同时选择时结果相同，原子读写即可
+static atomic_int decode_level = -1;
+
+usb_decode_level_t usb_decode_detect(void) {
+#ifdef USB_DECODE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("sse4.2")) {
+        return USB_DECODE_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("ssse3")) {
+        return USB_DECODE_SSE42;
+    }
+#endif
+    return USB_DECODE_SCALAR;
+}
+
+static const decode_kernels_t* kernels(void) {
+    int level = atomic_load_explicit(&decode_level, memory_order_relaxed);
+    if (level < 0) {
+        level = (int)usb_decode_detect();
+        atomic_store_explicit(&decode_level, level, memory_order_relaxed);
+    }
+    return &decode_kernels[level];
+}
+
+usb_decode_level_t usb_decode_get_level(void) {
+    kernels();
+    return (usb_decode_level_t)atomic_load_explicit(&decode_level, memory_order_relaxed);
+}
+
+int usb_decode_set_level(usb_decode_level_t level) {
+    if ((int)level < 0 || level > usb_decode_detect()) {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+    atomic_store_explicit(&decode_level, (int)level, memory_order_relaxed);
+    return 0;
+}
+
+const char* usb_decode_level_name(usb_decode_level_t level) {
+    switch (level) {
+        case USB_DECODE_SCALAR: return "scalar";
+        case USB_DECODE_SSE42: return "sse4.2";
+        case USB_DECODE_AVX2: return "avx2";
+    }
+    return "?";
+}
+
+uint32_t usb_crc32c(uint32_t crc, const unsigned char* data, size_t length) {
+    return ~kernels()->crc32c(~crc, data, length);
+}
+
+int usb_decode_find_sync(const unsigned char* data, int from, int n) {
+    return kernels()->find_sync(data, from, n);
+}
+
+int usb_sample_size(usb_sample_format_t format) {
+    switch (format) {
+        case USB_SAMPLE_S16: return 2;
+        case USB_SAMPLE_S24: return 3;
+        case USB_SAMPLE_S32: return 4;
+    }
+    return 0;
+}
+
+/* 解包样本 */
+int usb_decode_unpack(usb_sample_format_t format, const unsigned char* data, int count, int32_t* out) {
+    const decode_kernels_t* k = kernels();
+    switch (format) {
+        case USB_SAMPLE_S16:
+            k->unpack_s16(data, count, out);
+            break;
+        case USB_SAMPLE_S24:
+            k->unpack_s24(data, count, out);
+            break;
+        case USB_SAMPLE_S32:
+            unpack_s32(data, count, out);  // 编译器自动向量化
+            break;
+    }
+    return count * usb_sample_size(format);
+}
+
+// ---- 解码器 ----
+
+struct usb_decoder {
+    usb_frame_splitter_t* splitter;
+    usb_sample_format_t format;
+    int sample_size;
+    int32_t* samples;        // 一帧的样本
+    usb_decode_cb cb;
+    void* user_data;
+    uint64_t decoded;
+    uint64_t trailing_bytes;
+};
+
+static void decoder_frame_cb(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data) {
+    usb_decoder_t* dec = (usb_decoder_t*)user_data;
+    int count = length / dec->sample_size;
+    usb_decode_unpack(dec->format, payload, count, dec->samples);
+    dec->decoded += (uint64_t)count;
+    dec->trailing_bytes += (uint64_t)(length - count * dec->sample_size);
+    dec->cb(header, dec->samples, count, dec->user_data);
+}
+
+/* 创建解码器 */
+usb_decoder_t* usb_decoder_create(usb_sample_format_t format, int max_frame, usb_decode_cb cb, void* user_data) {
+    if (!cb || usb_sample_size(format) == 0 || max_frame <= 0) {
+        return NULL;
+    }
+
+    usb_decoder_t* dec = (usb_decoder_t*)calloc(1, sizeof(usb_decoder_t));
+    if (!dec) return NULL;
+    dec->format = format;
+    dec->sample_size = usb_sample_size(format);
+    dec->cb = cb;
+    dec->user_data = user_data;
+    dec->samples = (int32_t*)malloc(sizeof(int32_t) * (size_t)(max_frame / dec->sample_size + 1));
+    dec->splitter = usb_frame_splitter_create(USB_SPLIT_HEADER, max_frame, decoder_frame_cb, dec);
+    if (!dec->samples || !dec->splitter) {
+        usb_decoder_destroy(dec);
+        return NULL;
+    }
+    kernels();  // 在第一次解码之前选好实现
+    return dec;
+}
+
+void usb_decoder_destroy(usb_decoder_t* dec) {
+    if (dec) {
+        usb_frame_splitter_destroy(dec->splitter);
+        free(dec->samples);
+        free(dec);
+    }
+}
+
+usb_frame_splitter_t* usb_decoder_splitter(usb_decoder_t* dec) {
+    return dec->splitter;
+}
+
+void usb_decoder_feed(usb_decoder_t* dec, const unsigned char* data, int length) {
+    usb_frame_feed(dec->splitter, data, length, 0);
+}
+
+void usb_decoder_get_stats(usb_decoder_t* dec, usb_decode_stats_t* stats) {
+    usb_frame_get_stats(dec->splitter, &stats->frames);
+    stats->samples = dec->decoded;
+    stats->trailing_bytes = dec->trailing_bytes;
+}
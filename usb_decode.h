@@ -0,0 +1,61 @@
+#ifndef USB_DECODE_H
+#define USB_DECODE_H
+
+#include "usb_control.h"
+#include "usb_frame.h"
+
+// 帧解码: 在拆分器 (usb_frame.h, HEADER模式) 之后把每帧的负载解包为 int32 样本数组。
+// 同步字搜索、CRC-32C 和样本解包各有标量 / SSE4.2 / AVX2 实现，第一次使用时按CPU特性选择最快的，
+// 拆分器的同步搜索和 usb_crc32c 也使用这里选择的实现。不是x86或编译器不支持时只有标量实现。
+//
+// 接入方式:
+//   流式读取: stream_cfg.splitter = usb_decoder_splitter(dec)
+//   读取线程 (usb_reader.h): 把 usb_reader_read 读到的数据交给 usb_decoder_feed
+
+typedef enum {
+    USB_DECODE_SCALAR = 0,
+    USB_DECODE_SSE42 = 1,    // SSE4.2 (含SSSE3/SSE4.1): crc32指令，16字节比较/重排
+    USB_DECODE_AVX2 = 2      // AVX2: 32字节比较/重排，CRC同SSE4.2
+} usb_decode_level_t;
+
+// 样本格式 (小端，连续存放)，负载长度不是样本大小整数倍时多余的字节忽略
+typedef enum {
+    USB_SAMPLE_S16 = 0,      // 16位有符号
+    USB_SAMPLE_S24 = 1,      // 24位有符号，3字节紧密排列
+    USB_SAMPLE_S32 = 2       // 32位有符号
+} usb_sample_format_t;
+
+// 每帧调用一次 (在调用feed的线程中)，samples在回调返回前有效
+typedef void (*usb_decode_cb)(const usb_frame_header_t* header, const int32_t* samples, int count, void* user_data);
+
+typedef struct {
+    usb_frame_stats_t frames;  // 拆分器的统计 (CRC错误、重新同步...)
+    uint64_t samples;          // 解包的样本数
+    uint64_t trailing_bytes;   // 负载末尾不足一个样本、忽略的字节数
+} usb_decode_stats_t;
+
+typedef struct usb_decoder usb_decoder_t;
+
+// CPU支持的最高级别 / 当前使用的级别
+usb_decode_level_t usb_decode_detect(void);
+usb_decode_level_t usb_decode_get_level(void);
+// 强制使用某个级别 (交叉校验和基准测试用)，高于CPU支持的级别返回 LIBUSB_ERROR_NOT_SUPPORTED。
+// 全局生效，不要在有数据正在解码时切换
+int usb_decode_set_level(usb_decode_level_t level);
+const char* usb_decode_level_name(usb_decode_level_t level);
+
+// 内核 (使用当前级别)
+// 从from开始找同步字 (SYNC0 SYNC1，或位于末尾的SYNC0)，返回位置，没有返回n
+int usb_decode_find_sync(const unsigned char* data, int from, int n);
+// 解包count个样本到out，返回消耗的字节数
+int usb_decode_unpack(usb_sample_format_t format, const unsigned char* data, int count, int32_t* out);
+int usb_sample_size(usb_sample_format_t format);
+
+// max_frame: 最大负载长度
+usb_decoder_t* usb_decoder_create(usb_sample_format_t format, int max_frame, usb_decode_cb cb, void* user_data);
+void usb_decoder_destroy(usb_decoder_t* dec);
+usb_frame_splitter_t* usb_decoder_splitter(usb_decoder_t* dec);
+void usb_decoder_feed(usb_decoder_t* dec, const unsigned char* data, int length);
+void usb_decoder_get_stats(usb_decoder_t* dec, usb_decode_stats_t* stats);
+
+#endif // USB_DECODE_H
@@ -0,0 +1,73 @@
+#include <errno.h>
+#include "usb_internal.h"
+#include "usb_events.h"
+
+#define EVENTS_MAX_FDS 16
+
+int usb_control_get_pollfds(struct libusb_pollfd* fds, int max_fds) {
+    if (!usb_transport || !usb_transport->get_pollfds) {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+    const struct libusb_pollfd** list = usb_transport->get_pollfds(usb_control_context());
+    if (!list) {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+    int n = 0;
+    while (list[n]) {
+        if (n < max_fds) fds[n] = *list[n];
+        n++;
+    }
+    usb_transport->free_pollfds(list);
+    return n < max_fds ? n : max_fds;
+}
+
+int usb_control_get_next_timeout(void) {
+    struct timeval tv;
+    int timeout = -1;
+    if (usb_transport && usb_transport->get_next_timeout &&
+        usb_transport->get_next_timeout(usb_control_context(), &tv) == 1) {
+        timeout = (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+    }
+    // 有传输在等待池缓冲区时，消费者释放缓冲区不会唤醒fd
+    if (usb_stream_external_parked() && (timeout < 0 || timeout > 1)) {
+        timeout = 1;
+    }
+    return timeout;
+}
+
+int usb_control_process_events(void) {
+    struct timeval tv = {0, 0};
+    if (!usb_transport) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    int r = usb_transport->handle_events_timeout_completed(usb_control_context(), &tv, NULL);
+    usb_stream_resume_external();
+    return r;
+}
+
+int usb_control_wait_events(int timeout_ms) {
+#ifdef _WIN32
+    (void)timeout_ms;
+    return LIBUSB_ERROR_NOT_SUPPORTED;
+#else
+    struct libusb_pollfd fds[EVENTS_MAX_FDS];
+    struct pollfd pfds[EVENTS_MAX_FDS];
+    int n = usb_control_get_pollfds(fds, EVENTS_MAX_FDS);
+    if (n < 0) {
+        return n;
+    }
+    for (int i = 0; i < n; i++) {
+        pfds[i].fd = fds[i].fd;
+        pfds[i].events = fds[i].events;
+        pfds[i].revents = 0;
+    }
+    int next = usb_control_get_next_timeout();
+    if (next >= 0 && (timeout_ms < 0 || next < timeout_ms)) {
+        timeout_ms = next;
+    }
+    if (poll(pfds, (nfds_t)n, timeout_ms) < 0 && errno != EINTR) {
+        return LIBUSB_ERROR_IO;
+    }
+    return usb_control_process_events();
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef USB_EVENTS_H
+#define USB_EVENTS_H
+
+#include "usb_control.h"
+
+// 外部事件循环集成: 流式读取不再各自创建事件线程 (usb_stream_config_t.external_events)，
+// 由调用者的 epoll/poll 循环驱动。后端提供可poll的fd，fd就绪或超时后调用 usb_control_process_events，
+// 完成回调在调用者的线程中执行。多台设备、多个流和调用者自己的socket共用一个循环，没有忙等也没有额外线程。
+//
+//   n = usb_control_get_pollfds(fds, max);    // fd在 usb_control_exit 之前不变，加入epoll一次即可
+//   for (;;) {
+//       epoll_wait(ep, events, k, usb_control_get_next_timeout());
+//       ... 处理自己的fd ...
+//       usb_control_process_events();
+//   }
+//
+// sim/replay/null 后端在Linux上用timerfd，按传输的完成时间精确唤醒；libusb后端为libusb自己的fd (Windows不支持)。
+
+// 取后端的fd，返回个数；后端不支持时返回 LIBUSB_ERROR_NOT_SUPPORTED
+int usb_control_get_pollfds(struct libusb_pollfd* fds, int max_fds);
+// 即使fd没有就绪也要在多少毫秒内调用 usb_control_process_events (向上取整)，-1表示只等fd
+int usb_control_get_next_timeout(void);
+// 处理已完成的传输和热插拔事件，不阻塞
+int usb_control_process_events(void);
+// 便利函数: 等待后端的fd最多timeout_ms毫秒 (-1一直等)，然后处理事件。不支持时返回 LIBUSB_ERROR_NOT_SUPPORTED
+int usb_control_wait_events(int timeout_ms);
+
+#endif // USB_EVENTS_H
@@ -0,0 +1,258 @@
+#include "usb_frame.h"
+#include "usb_decode.h"
+
+struct usb_frame_splitter {
+    usb_split_mode_t mode;
+    int max_frame;
+    usb_frame_cb cb;
+    void* user_data;
+
+    unsigned char* buf;      // 重组缓冲区: [帧头][负载]
+    int have;                // buf中的字节数
+    int need;                // 当前帧的总长度，帧头不完整时为0
+    usb_frame_header_t header;
+    int syncing;             // 正在搜索同步字
+    usb_integrity_t* integrity;
+    uint64_t time_ns;        // 正在输入的传输的主机时间戳
+    usb_frame_stats_t stats;
+};
+
+static void put_le16(unsigned char* p, uint16_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char* p, uint32_t v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t get_le32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void usb_frame_encode_header(const usb_frame_header_t* header, unsigned char* out) {
+    put_le16(out, header->sync);
+    out[2] = header->type;
+    out[3] = header->flags;
+    put_le32(out + 4, header->seq);
+    put_le32(out + 8, header->length);
+    put_le32(out + 12, header->crc);
+}
+
+void usb_frame_decode_header(const unsigned char* in, usb_frame_header_t* header) {
+    header->sync = (uint16_t)(in[0] | (in[1] << 8));
+    header->type = in[2];
+    header->flags = in[3];
+    header->seq = get_le32(in + 4);
+    header->length = get_le32(in + 8);
+    header->crc = get_le32(in + 12);
+}
+
+usb_frame_splitter_t* usb_frame_splitter_create(usb_split_mode_t mode, int max_frame, usb_frame_cb cb, void* user_data) {
+    if (max_frame <= 0 || !cb) {
+        return NULL;
+    }
+
+    usb_frame_splitter_t* sp = (usb_frame_splitter_t*)calloc(1, sizeof(usb_frame_splitter_t));
+    if (!sp) return NULL;
+    sp->buf = (unsigned char*)malloc((size_t)max_frame + USB_FRAME_HEADER_SIZE);
+    if (!sp->buf) {
+        free(sp);
+        return NULL;
+    }
+    sp->mode = mode;
+    sp->max_frame = max_frame;
+    sp->cb = cb;
+    sp->user_data = user_data;
+    return sp;
+}
+
+void usb_frame_splitter_destroy(usb_frame_splitter_t* sp) {
+    if (sp) {
+        free(sp->buf);
+        free(sp);
+    }
+}
+
+void usb_frame_set_integrity(usb_frame_splitter_t* sp, usb_integrity_t* integrity) {
+    sp->integrity = integrity;
+}
+
+void usb_frame_set_time(usb_frame_splitter_t* sp, uint64_t time_ns) {
+    sp->time_ns = time_ns;
+}
+
+uint64_t usb_frame_time_ns(usb_frame_splitter_t* sp) {
+    return sp->time_ns;
+}
+
+int usb_frame_get_timestamp(const usb_frame_header_t* header, const unsigned char* payload, int length, uint64_t* timestamp) {
+    if (!header || !(header->flags & USB_FRAME_FLAG_TIMESTAMP) || length < USB_FRAME_TIMESTAMP_SIZE) {
+        return 0;
+    }
+    *timestamp = (uint64_t)get_le32(payload) | ((uint64_t)get_le32(payload + 4) << 32);
+    return 1;
+}
+
+void usb_frame_reset(usb_frame_splitter_t* sp) {
+    sp->have = 0;
+    sp->need = 0;
+    sp->syncing = 0;
+}
+
+void usb_frame_get_stats(usb_frame_splitter_t* sp, usb_frame_stats_t* stats) {
+    *stats = sp->stats;
+}
+
+// 同步字的小端字节
+#define SYNC0 (USB_FRAME_SYNC & 0xFF)
+#define SYNC1 (USB_FRAME_SYNC >> 8)
+
+static void skip_bytes(usb_frame_splitter_t* sp, int n) {
+    if (n > 0) {
+        if (!sp->syncing) {
+            sp->stats.resyncs++;
+            sp->syncing = 1;
+        }
+        sp->stats.skipped_bytes += (uint64_t)n;
+    }
+}
+
+static int header_ok(usb_frame_splitter_t* sp, const unsigned char* p, usb_frame_header_t* header) {
+    usb_frame_decode_header(p, header);
+    if (header->sync != USB_FRAME_SYNC) {
+        return 0;
+    }
+    if (header->length > (uint32_t)sp->max_frame) {
+        sp->stats.oversize++;
+        return 0;
+    }
+    return 1;
+}
+
+static void deliver_frame(usb_frame_splitter_t* sp, const usb_frame_header_t* header, const unsigned char* payload) {
+    sp->syncing = 0;
+    if (usb_crc32c(0, payload, header->length) != header->crc) {
+        sp->stats.crc_errors++;
+        return;
+    }
+    if (sp->integrity) {
+        usb_integrity_check(sp->integrity, header->seq);
+    }
+    sp->stats.frames++;
+    sp->stats.bytes += header->length;
+    sp->cb(header, payload, (int)header->length, sp->user_data);
+}
+
+static void feed_header(usb_frame_splitter_t* sp, const unsigned char* data, int length) {
+    usb_frame_header_t header;
+
+    while (length > 0) {
+        if (sp->have == 0) {
+            // 对齐到同步字 (下一个可能的帧起点，没有则跳过全部)
+            if (data[0] != SYNC0 || (length > 1 && data[1] != SYNC1)) {
+                int i = usb_decode_find_sync(data, 1, length);
+                skip_bytes(sp, i);
+                data += i;
+                length -= i;
+                continue;
+            }
+            // 快速路径: 整帧都在本次数据中，直接交付
+            if (length >= USB_FRAME_HEADER_SIZE) {
+                if (!header_ok(sp, data, &header)) {
+                    skip_bytes(sp, 1);
+                    data++;
+                    length--;
+                    continue;
+                }
+                int total = USB_FRAME_HEADER_SIZE + (int)header.length;
+                if (length >= total) {
+                    deliver_frame(sp, &header, data + USB_FRAME_HEADER_SIZE);
+                    data += total;
+                    length -= total;
+                    continue;
+                }
+            }
+        }
+
+        // 帧跨越传输，复制到重组缓冲区
+        if (sp->have < USB_FRAME_HEADER_SIZE) {
+            int n = USB_FRAME_HEADER_SIZE - sp->have;
+            if (n > length) n = length;
+            memcpy(sp->buf + sp->have, data, (size_t)n);
+            sp->have += n;
+            data += n;
+            length -= n;
+            if (sp->have < USB_FRAME_HEADER_SIZE) {
+                break;
+            }
+            if (!header_ok(sp, sp->buf, &sp->header)) {
+                // 帧头无效: 在已缓存的字节中重新搜索
+                int i = usb_decode_find_sync(sp->buf, 1, sp->have);
+                skip_bytes(sp, i);
+                memmove(sp->buf, sp->buf + i, (size_t)(sp->have - i));
+                sp->have -= i;
+                continue;
+            }
+            sp->need = USB_FRAME_HEADER_SIZE + (int)sp->header.length;
+        }
+
+        int n = sp->need - sp->have;
+        if (n > length) n = length;
+        memcpy(sp->buf + sp->have, data, (size_t)n);
+        sp->have += n;
+        data += n;
+        length -= n;
+        if (sp->have == sp->need) {
+            deliver_frame(sp, &sp->header, sp->buf + USB_FRAME_HEADER_SIZE);
+            sp->have = 0;
+            sp->need = 0;
+        }
+    }
+}
+
+static void deliver_packet(usb_frame_splitter_t* sp, const unsigned char* data, int length) {
+    if (length > 0) {
+        sp->stats.frames++;
+        sp->stats.bytes += (uint64_t)length;
+        sp->cb(NULL, data, length, sp->user_data);
+    }
+}
+
+static void feed_short_packet(usb_frame_splitter_t* sp, const unsigned char* data, int length, int short_packet) {
+    // 快速路径: 一个传输就是一个完整的逻辑包
+    if (sp->have == 0 && short_packet && length <= sp->max_frame) {
+        deliver_packet(sp, data, length);
+        return;
+    }
+
+    while (length > 0) {
+        int n = sp->max_frame - sp->have;
+        if (n > length) n = length;
+        memcpy(sp->buf + sp->have, data, (size_t)n);
+        sp->have += n;
+        data += n;
+        length -= n;
+        if (sp->have == sp->max_frame && (length > 0 || !short_packet)) {
+            // 逻辑包超过max_frame，截断交付
+            sp->stats.oversize++;
+            deliver_packet(sp, sp->buf, sp->have);
+            sp->have = 0;
+        }
+    }
+    if (short_packet) {
+        deliver_packet(sp, sp->buf, sp->have);
+        sp->have = 0;
+    }
+}
+
+void usb_frame_feed(usb_frame_splitter_t* sp, const unsigned char* data, int length, int short_packet) {
+    if (sp->mode == USB_SPLIT_HEADER) {
+        feed_header(sp, data, length);
+    } else {
+        feed_short_packet(sp, data, length, short_packet);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef USB_FRAME_H
+#define USB_FRAME_H
+
+#include "usb_control.h"
+#include "usb_integrity.h"
+
+// 设备帧格式和拆分器。
+// 大传输一次合并多个USB包，原始的包/帧边界需要在主机端恢复:
+//   USB_SPLIT_HEADER       - 设备在每帧前加16字节帧头，按帧头的长度拆分，CRC校验，失步时搜索同步字重新同步
+//   USB_SPLIT_SHORT_PACKET - 没有帧头，设备以短包(或零长度包)结束一个逻辑包，传输提前完成的位置就是边界
+// 一帧可以跨多个传输，拆分器内部重组；完整位于一个传输内的帧直接从传输缓冲区交付(零拷贝)。
+
+#define USB_FRAME_SYNC        0xA55A
+#define USB_FRAME_HEADER_SIZE 16
+
+// 帧头flags
+#define USB_FRAME_FLAG_TIMESTAMP  0x01  // 负载以8字节设备时间戳开头 (小端，设备时钟的纳秒)，包含在length和CRC中
+#define USB_FRAME_TIMESTAMP_SIZE  8
+
+// 帧头 (小端)
+typedef struct {
+    uint16_t sync;           // USB_FRAME_SYNC
+    uint8_t type;            // 由设备定义
+    uint8_t flags;           // USB_FRAME_FLAG_*
+    uint32_t seq;            // 帧序号，每帧加1
+    uint32_t length;         // 负载长度 (不含帧头)
+    uint32_t crc;            // 负载的CRC-32C
+} usb_frame_header_t;
+
+typedef enum {
+    USB_SPLIT_HEADER,
+    USB_SPLIT_SHORT_PACKET
+} usb_split_mode_t;
+
+// 每个逻辑包/帧调用一次；SHORT_PACKET模式下header为NULL
+typedef void (*usb_frame_cb)(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data);
+
+typedef struct {
+    uint64_t frames;         // 交付的帧数
+    uint64_t bytes;          // 交付的负载字节数
+    uint64_t crc_errors;     // CRC错误丢弃的帧数
+    uint64_t resyncs;        // 重新同步的次数
+    uint64_t skipped_bytes;  // 重新同步时跳过的字节数
+    uint64_t oversize;       // 超过max_frame的帧数: SHORT_PACKET分段交付，HEADER丢弃并重新同步
+} usb_frame_stats_t;
+
+typedef struct usb_frame_splitter usb_frame_splitter_t;
+
+// max_frame: 最大负载长度 (同时是重组缓冲区大小)
+usb_frame_splitter_t* usb_frame_splitter_create(usb_split_mode_t mode, int max_frame, usb_frame_cb cb, void* user_data);
+void usb_frame_splitter_destroy(usb_frame_splitter_t* sp);
+// 输入一个传输的数据。short_packet: 传输以短包结束 (actual_length < 请求长度)，
+// SHORT_PACKET模式下据此结束当前逻辑包
+void usb_frame_feed(usb_frame_splitter_t* sp, const unsigned char* data, int length, int short_packet);
+// 每个通过CRC校验的帧按帧头的seq检查完整性 (NULL取消)，在feed的线程中调用
+void usb_frame_set_integrity(usb_frame_splitter_t* sp, usb_integrity_t* integrity);
+// 主机时间戳: 下一次feed的数据所在传输的完成时间 (usb_time_ns)，流式读取在每个传输前设置。
+// 帧回调中 usb_frame_time_ns 返回该帧最后一个字节所在传输的时间
+void usb_frame_set_time(usb_frame_splitter_t* sp, uint64_t time_ns);
+uint64_t usb_frame_time_ns(usb_frame_splitter_t* sp);
+// 帧带设备时间戳 (USB_FRAME_FLAG_TIMESTAMP) 时取出并返回1，否则返回0
+int usb_frame_get_timestamp(const usb_frame_header_t* header, const unsigned char* payload, int length, uint64_t* timestamp);
+// 丢弃未完成的帧 (例如重新连接后)
+void usb_frame_reset(usb_frame_splitter_t* sp);
+void usb_frame_get_stats(usb_frame_splitter_t* sp, usb_frame_stats_t* stats);
+
+// 帧头编解码 (与主机字节序无关)，CRC-32C (Castagnoli，按CPU选择查表或SSE4.2指令，见 usb_decode.h)
+void usb_frame_encode_header(const usb_frame_header_t* header, unsigned char* out);
+void usb_frame_decode_header(const unsigned char* in, usb_frame_header_t* header);
+uint32_t usb_crc32c(uint32_t crc, const unsigned char* data, size_t length);
+
+#endif // USB_FRAME_H
@@ -0,0 +1,429 @@
+#include <stdatomic.h>
+#include "usb_hub.h"
+
+struct usb_hub_sub {
+    usb_hub_t* hub;
+    char name[32];
+    int depth;
+    usb_ring_policy_t policy;
+    // 过滤 (发布者线程，在集线器的锁内)
+    uint64_t type_mask[4];       // 256种type的位图
+    int match_types;
+    unsigned char pattern[USB_HUB_MAX_PATTERN];
+    int pattern_length;
+    int pattern_offset;
+    usb_hub_filter_cb filter;
+    void* filter_data;
+    uint32_t sample_every;
+    uint32_t sample_count;
+    atomic_uint_least64_t matched;
+    atomic_uint_least64_t filtered;
+
+    // 队列 (环形数组)，受lock保护
+    usb_mutex_t lock;
+    usb_cond_t not_empty;
+    usb_cond_t not_full;
+    usb_hub_msg_t* queue;
+    int head;                    // 最旧的消息
+    int count;
+    int high_water;
+    int waiting;                 // 订阅者在等待 not_empty
+    int publisher_waiting;       // 发布者在等待 not_full (BLOCK)
+    int closed;                  // 正在退订，不再入队
+    uint64_t queued;
+    uint64_t dropped;
+    uint64_t received;
+    uint64_t blocked_ns;
+    uint64_t wakeups;
+};
+
+struct usb_hub {
+    usb_mutex_t lock;            // 订阅者列表和发布
+    usb_hub_sub_t** subs;
+    int num_subs;
+    int cap_subs;
+    usb_pool_t* pool;            // usb_hub_publish_data 复制用，可以为NULL
+    atomic_int closed;
+    uint64_t seq;
+    atomic_uint_least64_t published;
+    atomic_uint_least64_t bytes;
+    atomic_uint_least64_t no_buffer;
+    atomic_uint_least64_t deliveries;
+};
+
+usb_hub_t* usb_hub_create(int pool_count, int buffer_size) {
+    usb_hub_t* hub = (usb_hub_t*)calloc(1, sizeof(usb_hub_t));
+    if (!hub) return NULL;
+    if (pool_count > 0) {
+        hub->pool = usb_pool_create(pool_count, buffer_size, 0);
+        if (!hub->pool) {
+            free(hub);
+            return NULL;
+        }
+    }
+    usb_mutex_init(&hub->lock);
+    return hub;
+}
+
+void usb_hub_destroy(usb_hub_t* hub) {
+    if (!hub) return;
+    usb_hub_close(hub);
+    usb_mutex_destroy(&hub->lock);
+    usb_pool_destroy(hub->pool);
+    free(hub->subs);
+    free(hub);
+}
+
+void usb_hub_close(usb_hub_t* hub) {
+    if (!hub) return;
+    atomic_store(&hub->closed, 1);
+    // 发布者可能正在BLOCK等待 (持有集线器的锁)，它在下一次定时醒来时看到关闭
+    usb_mutex_lock(&hub->lock);
+    for (int i = 0; i < hub->num_subs; i++) {
+        usb_hub_sub_t* sub = hub->subs[i];
+        usb_mutex_lock(&sub->lock);
+        usb_cond_broadcast(&sub->not_empty);
+        usb_mutex_unlock(&sub->lock);
+    }
+    usb_mutex_unlock(&hub->lock);
+}
+
+// 以帧头开头的消息返回type，否则返回-1
+static int hub_frame_type(const unsigned char* data, int length) {
+    if (length < USB_FRAME_HEADER_SIZE || (data[0] | (data[1] << 8)) != USB_FRAME_SYNC) {
+        return -1;
+    }
+    return data[2];
+}
+
+static int hub_pattern_match(const usb_hub_sub_t* sub, const unsigned char* data, int length) {
+    int plen = sub->pattern_length;
+    if (sub->pattern_offset >= 0) {
+        return sub->pattern_offset + plen <= length && memcmp(data + sub->pattern_offset, sub->pattern, (size_t)plen) == 0;
+    }
+    // memchr找首字节，再比较
+    if (length < plen) return 0;
+    const unsigned char* p = data;
+    const unsigned char* last = data + length - plen;
+    while (p <= last) {
+        p = (const unsigned char*)memchr(p, sub->pattern[0], (size_t)(last - p) + 1);
+        if (!p) return 0;
+        if (memcmp(p + 1, sub->pattern + 1, (size_t)plen - 1) == 0) return 1;
+        p++;
+    }
+    return 0;
+}
+
+static int hub_match(usb_hub_sub_t* sub, const usb_hub_msg_t* msg) {
+    if (sub->match_types && (msg->type < 0 || !((sub->type_mask[msg->type >> 6] >> (msg->type & 63)) & 1))) {
+        return 0;
+    }
+    if (sub->pattern_length > 0 && !hub_pattern_match(sub, msg->data, msg->length)) {
+        return 0;
+    }
+    if (sub->filter && !sub->filter(msg, sub->filter_data)) {
+        return 0;
+    }
+    if (sub->sample_every > 1) {
+        uint32_t n = sub->sample_count++;
+        if (sub->sample_count == sub->sample_every) sub->sample_count = 0;
+        if (n != 0) return 0;
+    }
+    return 1;
+}
+
+// 入队一个引用，返回1；队列满被丢弃或正在退订返回0
+static int hub_enqueue(usb_hub_t* hub, usb_hub_sub_t* sub, const usb_hub_msg_t* msg) {
+    usb_buffer_t* dropped = NULL;
+    int ok = 1;
+
+    usb_mutex_lock(&sub->lock);
+    if (sub->count == sub->depth && !sub->closed) {
+        if (sub->policy == USB_RING_BLOCK) {
+            uint64_t start = usb_time_ns();
+            while (sub->count == sub->depth && !sub->closed && !atomic_load(&hub->closed)) {
+                sub->publisher_waiting = 1;
+                usb_cond_wait_until(&sub->not_full, &sub->lock, usb_time_ns() + 10000000ull);
+            }
+            sub->publisher_waiting = 0;
+            sub->blocked_ns += usb_time_ns() - start;
+            ok = sub->count < sub->depth;
+        } else if (sub->policy == USB_RING_DROP_OLDEST) {
+            dropped = sub->queue[sub->head].buffer;
+            sub->head = sub->head + 1 == sub->depth ? 0 : sub->head + 1;
+            sub->count--;
+            sub->dropped++;
+        } else {
+            sub->dropped++;
+            ok = 0;
+        }
+    }
+    if (sub->closed) {
+        ok = 0;
+    }
+    if (ok) {
+        int tail = sub->head + sub->count;
+        if (tail >= sub->depth) tail -= sub->depth;
+        usb_buffer_ref(msg->buffer);
+        sub->queue[tail] = *msg;
+        sub->count++;
+        sub->queued++;
+        if (sub->count > sub->high_water) sub->high_water = sub->count;
+        // 每次等待只唤醒一次: 订阅者还没运行时后续的消息不再发信号
+        if (sub->waiting) {
+            sub->waiting = 0;
+            sub->wakeups++;
+            usb_cond_signal(&sub->not_empty);
+        }
+    }
+    usb_mutex_unlock(&sub->lock);
+    if (dropped) {
+        usb_buffer_release(dropped);
+    }
+    return ok;
+}
+
+/* 发布一个缓冲区片段 */
+int usb_hub_publish(usb_hub_t* hub, usb_buffer_t* buffer, int offset, int length) {
+    usb_hub_msg_t msg;
+    int delivered = 0;
+
+    if (!hub || !buffer || offset < 0 || length < 0 || offset + length > buffer->size) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (atomic_load(&hub->closed)) {
+        return LIBUSB_ERROR_INTERRUPTED;
+    }
+    msg.buffer = buffer;
+    msg.data = buffer->data + offset;
+    msg.length = length;
+    msg.type = hub_frame_type(msg.data, length);
+    msg.time_ns = buffer->time_ns;
+
+    usb_mutex_lock(&hub->lock);
+    msg.seq = hub->seq++;
+    for (int i = 0; i < hub->num_subs; i++) {
+        usb_hub_sub_t* sub = hub->subs[i];
+        if (!hub_match(sub, &msg)) {
+            atomic_fetch_add_explicit(&sub->filtered, 1, memory_order_relaxed);
+            continue;
+        }
+        atomic_fetch_add_explicit(&sub->matched, 1, memory_order_relaxed);
+        delivered += hub_enqueue(hub, sub, &msg);
+    }
+    usb_mutex_unlock(&hub->lock);
+
+    atomic_fetch_add_explicit(&hub->published, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hub->bytes, (uint64_t)length, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hub->deliveries, (uint64_t)delivered, memory_order_relaxed);
+    return delivered;
+}
+
+int usb_hub_publish_data(usb_hub_t* hub, const unsigned char* data, int length, uint64_t time_ns) {
+    if (!hub || !hub->pool || (!data && length > 0) || length < 0) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (atomic_load(&hub->closed)) {
+        return LIBUSB_ERROR_INTERRUPTED;
+    }
+    usb_buffer_t* b = usb_pool_get(hub->pool);
+    if (!b) {
+        atomic_fetch_add_explicit(&hub->no_buffer, 1, memory_order_relaxed);
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+    b->length = length < b->size ? length : b->size;
+    b->time_ns = time_ns;
+    memcpy(b->data, data, (size_t)b->length);
+    int r = usb_hub_publish(hub, b, 0, b->length);
+    usb_buffer_release(b);
+    return r;
+}
+
+void usb_hub_stream_buffer_cb(usb_buffer_t* buffer, void* user_data) {
+    usb_hub_publish((usb_hub_t*)user_data, buffer, 0, buffer->length);
+}
+
+void usb_hub_frame_cb(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data) {
+    usb_hub_t* hub = (usb_hub_t*)user_data;
+    if (!header || !hub->pool || atomic_load(&hub->closed)) {
+        return;
+    }
+    usb_buffer_t* b = usb_pool_get(hub->pool);
+    if (!b) {
+        atomic_fetch_add_explicit(&hub->no_buffer, 1, memory_order_relaxed);
+        return;
+    }
+    // 帧头重新编码，和负载一起作为一条消息
+    if (length > b->size - USB_FRAME_HEADER_SIZE) length = b->size - USB_FRAME_HEADER_SIZE;
+    usb_frame_encode_header(header, b->data);
+    memcpy(b->data + USB_FRAME_HEADER_SIZE, payload, (size_t)length);
+    b->length = USB_FRAME_HEADER_SIZE + length;
+    b->time_ns = usb_time_ns();
+    usb_hub_publish(hub, b, 0, b->length);
+    usb_buffer_release(b);
+}
+
+/* 订阅 */
+usb_hub_sub_t* usb_hub_subscribe(usb_hub_t* hub, const usb_hub_sub_config_t* cfg) {
+    usb_hub_sub_config_t c;
+
+    memset(&c, 0, sizeof(c));
+    if (cfg) c = *cfg;
+    if (!hub || c.depth < 0 || (c.types && c.num_types <= 0) || c.pattern_offset < USB_HUB_ANYWHERE ||
+        (c.pattern && (c.pattern_length <= 0 || c.pattern_length > USB_HUB_MAX_PATTERN))) {
+        return NULL;
+    }
+    if (c.depth == 0) c.depth = USB_HUB_DEFAULT_DEPTH;
+
+    usb_hub_sub_t* sub = (usb_hub_sub_t*)calloc(1, sizeof(usb_hub_sub_t));
+    if (!sub) return NULL;
+    sub->queue = (usb_hub_msg_t*)calloc((size_t)c.depth, sizeof(usb_hub_msg_t));
+    if (!sub->queue) {
+        free(sub);
+        return NULL;
+    }
+    sub->hub = hub;
+    snprintf(sub->name, sizeof(sub->name), "%s", c.name ? c.name : "");
+    sub->depth = c.depth;
+    sub->policy = c.policy;
+    if (c.types) {
+        sub->match_types = 1;
+        for (int i = 0; i < c.num_types; i++) {
+            sub->type_mask[c.types[i] >> 6] |= 1ull << (c.types[i] & 63);
+        }
+    }
+    if (c.pattern) {
+        memcpy(sub->pattern, c.pattern, (size_t)c.pattern_length);
+        sub->pattern_length = c.pattern_length;
+        sub->pattern_offset = c.pattern_offset;
+    }
+    sub->filter = c.filter;
+    sub->filter_data = c.filter_data;
+    sub->sample_every = c.sample_every > 1 ? (uint32_t)c.sample_every : 1;
+    usb_mutex_init(&sub->lock);
+    usb_cond_init(&sub->not_empty);
+    usb_cond_init(&sub->not_full);
+
+    usb_mutex_lock(&hub->lock);
+    if (hub->num_subs == hub->cap_subs) {
+        int cap = hub->cap_subs ? hub->cap_subs * 2 : 8;
+        usb_hub_sub_t** subs = (usb_hub_sub_t**)realloc(hub->subs, sizeof(usb_hub_sub_t*) * (size_t)cap);
+        if (!subs) {
+            usb_mutex_unlock(&hub->lock);
+            usb_cond_destroy(&sub->not_full);
+            usb_cond_destroy(&sub->not_empty);
+            usb_mutex_destroy(&sub->lock);
+            free(sub->queue);
+            free(sub);
+            return NULL;
+        }
+        hub->subs = subs;
+        hub->cap_subs = cap;
+    }
+    hub->subs[hub->num_subs++] = sub;
+    usb_mutex_unlock(&hub->lock);
+    return sub;
+}
+
+void usb_hub_unsubscribe(usb_hub_sub_t* sub) {
+    if (!sub) return;
+    usb_hub_t* hub = sub->hub;
+
+    // 先让BLOCK等待中的发布者放弃这个订阅者，释放集线器的锁
+    usb_mutex_lock(&sub->lock);
+    sub->closed = 1;
+    usb_cond_broadcast(&sub->not_full);
+    usb_mutex_unlock(&sub->lock);
+
+    usb_mutex_lock(&hub->lock);
+    for (int i = 0; i < hub->num_subs; i++) {
+        if (hub->subs[i] == sub) {
+            hub->subs[i] = hub->subs[--hub->num_subs];
+            break;
+        }
+    }
+    usb_mutex_unlock(&hub->lock);
+
+    for (int i = 0; i < sub->count; i++) {
+        int index = sub->head + i;
+        if (index >= sub->depth) index -= sub->depth;
+        usb_buffer_release(sub->queue[index].buffer);
+    }
+    usb_cond_destroy(&sub->not_full);
+    usb_cond_destroy(&sub->not_empty);
+    usb_mutex_destroy(&sub->lock);
+    free(sub->queue);
+    free(sub);
+}
+
+int usb_hub_next(usb_hub_sub_t* sub, usb_hub_msg_t* msg, unsigned int timeout_ms) {
+    if (!sub || !msg) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    uint64_t deadline = usb_time_ns() + (uint64_t)timeout_ms * 1000000ull;
+
+    usb_mutex_lock(&sub->lock);
+    while (sub->count == 0) {
+        if (atomic_load(&sub->hub->closed)) {
+            usb_mutex_unlock(&sub->lock);
+            return LIBUSB_ERROR_INTERRUPTED;
+        }
+        if (timeout_ms == 0 || usb_time_ns() >= deadline) {
+            usb_mutex_unlock(&sub->lock);
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        sub->waiting = 1;
+        usb_cond_wait_until(&sub->not_empty, &sub->lock, deadline);
+        sub->waiting = 0;
+    }
+    *msg = sub->queue[sub->head];
+    sub->head = sub->head + 1 == sub->depth ? 0 : sub->head + 1;
+    sub->count--;
+    sub->received++;
+    // 队列空出一半再唤醒发布者，不在每取一条时来回切换
+    if (sub->publisher_waiting && sub->count <= sub->depth / 2) {
+        sub->publisher_waiting = 0;
+        usb_cond_signal(&sub->not_full);
+    }
+    usb_mutex_unlock(&sub->lock);
+    return 0;
+}
+
+void usb_hub_release(usb_hub_msg_t* msg) {
+    if (msg && msg->buffer) {
+        usb_buffer_release(msg->buffer);
+        msg->buffer = NULL;
+    }
+}
+
+void usb_hub_get_stats(usb_hub_t* hub, usb_hub_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->published = atomic_load_explicit(&hub->published, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&hub->bytes, memory_order_relaxed);
+    stats->no_buffer = atomic_load_explicit(&hub->no_buffer, memory_order_relaxed);
+    stats->deliveries = atomic_load_explicit(&hub->deliveries, memory_order_relaxed);
+    usb_mutex_lock(&hub->lock);
+    stats->subscribers = hub->num_subs;
+    usb_mutex_unlock(&hub->lock);
+}
+
+void usb_hub_sub_get_stats(usb_hub_sub_t* sub, usb_hub_sub_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    memcpy(stats->name, sub->name, sizeof(stats->name));
+    stats->matched = atomic_load_explicit(&sub->matched, memory_order_relaxed);
+    stats->filtered = atomic_load_explicit(&sub->filtered, memory_order_relaxed);
+    stats->depth = sub->depth;
+    usb_mutex_lock(&sub->lock);
+    stats->queued = sub->queued;
+    stats->dropped = sub->dropped;
+    stats->received = sub->received;
+    stats->blocked_ns = sub->blocked_ns;
+    stats->wakeups = sub->wakeups;
+    stats->count = sub->count;
+    stats->high_water = sub->high_water;
+    usb_mutex_unlock(&sub->lock);
+}
+
+usb_pool_t* usb_hub_pool(usb_hub_t* hub) {
+    return hub->pool;
+}
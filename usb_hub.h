@@ -0,0 +1,112 @@
+#ifndef USB_HUB_H
+#define USB_HUB_H
+
+#include "usb_control.h"
+#include "usb_frame.h"
+#include "usb_pool.h"
+#include "usb_ring.h"
+
+// 进程内发布/订阅: 一路数据 (通常是一个设备的流) 分发给多个消费者 (落盘、显示、解码、报警)，
+// 每个订阅者有自己的队列、过滤条件和队列满时的策略，在自己的线程中按自己的速度取数据。
+//   - 不复制: 消息引用池中的缓冲区 (usb_pool.h)，每个接收它的订阅者持有一个引用，
+//     全部释放后缓冲区回到池中。usb_hub_publish_data / usb_hub_frame_cb 只在发布时复制一次到集线器自己的池
+//   - 互不拖累: DROP_OLDEST / DROP_NEWEST 的订阅者跟不上时只丢自己的消息，发布者和其他订阅者不受影响；
+//     BLOCK 的订阅者队列满时发布者等待 (只用于不能丢数据的订阅者，例如落盘)，会拖慢所有订阅者
+//   - 过滤在发布者一侧、入队之前: 帧类型、字节模式、按比例抽取、自定义回调，不需要的消息不占队列也不唤醒订阅者
+//
+// 池的大小: 每个订阅者最多持有 depth + 1 个缓冲区 (队列中的和正在处理的)，
+// 流的池 (usb_stream_config_t.pool) 至少要 num_transfers + 所有订阅者的 (depth + 1)，否则池被占满时流暂停。
+//
+// 发布在集线器的锁内串行执行 (通常只有流的事件线程发布)；订阅/退订可以在任意线程，每个订阅者只在一个线程中读取。
+// 订阅者只在队列为空、正在等待时才被唤醒，处理跟得上的订阅者每条消息只有一次加锁入队。
+
+typedef struct usb_hub usb_hub_t;
+typedef struct usb_hub_sub usb_hub_sub_t;
+
+#define USB_HUB_DEFAULT_DEPTH 64
+#define USB_HUB_MAX_PATTERN   64
+#define USB_HUB_ANYWHERE      (-1)  // pattern_offset: 在整个消息中查找
+
+typedef struct {
+    usb_buffer_t* buffer;    // 持有的缓冲区引用，处理完后 usb_hub_release
+    const unsigned char* data;
+    int length;
+    int type;                // 消息以帧头开头时为帧头的type，否则为-1
+    uint64_t seq;            // 发布序号 (所有消息统一编号，订阅者据此看出被过滤和丢弃的位置)，从0开始
+    uint64_t time_ns;        // 缓冲区的time_ns (流式读取为传输完成时间)
+} usb_hub_msg_t;
+
+// 自定义过滤，在发布者线程中调用，返回非0表示接收
+typedef int (*usb_hub_filter_cb)(const usb_hub_msg_t* msg, void* user_data);
+
+typedef struct {
+    const char* name;            // 统计显示用，可以为NULL
+    int depth;                   // 队列深度 (消息数)，默认 USB_HUB_DEFAULT_DEPTH
+    usb_ring_policy_t policy;    // 队列满时: BLOCK 发布者等待，DROP_OLDEST 丢弃最旧的，DROP_NEWEST 丢弃新消息
+    // 过滤 (都设置时同时满足)
+    const uint8_t* types;        // 非NULL时只接收帧头type在列表中的消息 (不以帧头开头的消息不接收)
+    int num_types;
+    const unsigned char* pattern;  // 非NULL时只接收包含pattern的消息 (最多 USB_HUB_MAX_PATTERN 字节)
+    int pattern_length;
+    int pattern_offset;          // pattern在消息中的位置，USB_HUB_ANYWHERE 为任意位置
+    usb_hub_filter_cb filter;    // 在前面的过滤之后调用
+    void* filter_data;
+    int sample_every;            // >1: 通过其他过滤的消息每N条只接收第1条 (显示之类只需要一部分数据的订阅者)
+} usb_hub_sub_config_t;
+
+typedef struct {
+    char name[32];               // 订阅时的name (截断)
+    uint64_t matched;            // 通过过滤的消息数
+    uint64_t filtered;           // 被过滤的消息数 (包括按比例抽取跳过的)
+    uint64_t queued;             // 进入队列的消息数
+    uint64_t dropped;            // 队列满时丢弃的消息数
+    uint64_t received;           // 订阅者取出的消息数
+    uint64_t blocked_ns;         // BLOCK 策略下发布者等待这个订阅者的时间
+    uint64_t wakeups;            // 唤醒等待中的订阅者的次数
+    int depth;
+    int count;                   // 当前队列中的消息数
+    int high_water;              // 队列中消息数的最大值
+} usb_hub_sub_stats_t;
+
+typedef struct {
+    uint64_t published;          // 发布的消息数
+    uint64_t bytes;
+    uint64_t no_buffer;          // usb_hub_publish_data 时池已空、没有发布的消息数
+    uint64_t deliveries;         // 进入各订阅者队列的总次数 (每次是一个引用，不是一次复制)
+    int subscribers;
+} usb_hub_stats_t;
+
+// pool_count > 0 时创建集线器自己的池 (pool_count个、每个buffer_size字节)，供 usb_hub_publish_data / usb_hub_frame_cb 复制；
+// 只发布流的池缓冲区 (usb_hub_publish / usb_hub_stream_buffer_cb) 时可以为0
+usb_hub_t* usb_hub_create(int pool_count, int buffer_size);
+// 先 usb_hub_close 并等所有订阅者退订
+void usb_hub_destroy(usb_hub_t* hub);
+// 之后发布返回 LIBUSB_ERROR_INTERRUPTED，等待中的订阅者取完队列后返回 LIBUSB_ERROR_INTERRUPTED
+void usb_hub_close(usb_hub_t* hub);
+
+// 发布缓冲区 [offset, offset+length) 的引用 (调用者的引用不变，发布后可以立即释放)，
+// 返回接收的订阅者数；已关闭返回 LIBUSB_ERROR_INTERRUPTED
+int usb_hub_publish(usb_hub_t* hub, usb_buffer_t* buffer, int offset, int length);
+// 复制到集线器的池再发布，超过缓冲区大小时截断；池已空返回 LIBUSB_ERROR_OVERFLOW
+int usb_hub_publish_data(usb_hub_t* hub, const unsigned char* data, int length, uint64_t time_ns);
+// 适配: usb_stream_config_t.buffer_cb (流使用池，user_data为集线器，流的数据回调可以为NULL)
+void usb_hub_stream_buffer_cb(usb_buffer_t* buffer, void* user_data);
+// 适配: 拆分器的帧回调 (usb_frame_splitter_create 的user_data为集线器)，帧头 + 负载复制为一条消息，
+// 时间为回调时的 usb_time_ns
+void usb_hub_frame_cb(const usb_frame_header_t* header, const unsigned char* payload, int length, void* user_data);
+
+// 参数无效 (depth < 0、pattern过长、types数量无效) 返回NULL。从下一条发布的消息开始接收
+usb_hub_sub_t* usb_hub_subscribe(usb_hub_t* hub, const usb_hub_sub_config_t* cfg);
+// 释放队列中剩余的消息；不能在读取的同时调用 (先让读取线程退出)
+void usb_hub_unsubscribe(usb_hub_sub_t* sub);
+
+// 取一条消息，timeout_ms内没有返回 LIBUSB_ERROR_TIMEOUT (为0时不等待)，
+// 集线器已关闭且队列为空返回 LIBUSB_ERROR_INTERRUPTED
+int usb_hub_next(usb_hub_sub_t* sub, usb_hub_msg_t* msg, unsigned int timeout_ms);
+void usb_hub_release(usb_hub_msg_t* msg);
+
+void usb_hub_get_stats(usb_hub_t* hub, usb_hub_stats_t* stats);
+void usb_hub_sub_get_stats(usb_hub_sub_t* sub, usb_hub_sub_stats_t* stats);
+usb_pool_t* usb_hub_pool(usb_hub_t* hub);
+
+#endif // USB_HUB_H
@@ -0,0 +1,261 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_integrity.h"
+
+#define INTEGRITY_RECENT_GAPS 8
+
+typedef struct {
+    usb_loss_cause_t cause;
+    usb_loss_source_fn fn;
+    void* ctx;
+} integrity_source_t;
+
+struct usb_integrity {
+    // 以下只由调用check的线程访问
+    uint32_t expected;
+    int started;
+    uint64_t seen[USB_INTEGRITY_WINDOW / 64];  // 窗口内的序号是否到达，按 seq % WINDOW
+    struct {
+        uint32_t start;
+        uint32_t count;
+        usb_loss_cause_t cause;
+    } recent[INTEGRITY_RECENT_GAPS];           // 最近的缺口，迟到的序号在这里找原因
+    int recent_next;
+    uint64_t attributed[USB_LOSS_CAUSES];      // 上次归因时各原因的事件数
+
+    atomic_uint_least64_t frames;              // 只由check的线程写，get_stats不加锁读取
+    atomic_uint next_seq;
+    atomic_uint_least64_t events[USB_LOSS_CAUSES];
+    atomic_int restart;
+
+    usb_mutex_t lock;                          // 保护来源表和stats (缺口等不常见的计数，frames除外)
+    usb_integrity_stats_t stats;
+    integrity_source_t sources[USB_INTEGRITY_MAX_SOURCES];
+    int num_sources;
+    uint64_t source_base[USB_LOSS_CAUSES];     // 已移除的来源的最终值 (减去添加时的初始值)，保持总数单调
+};
+
+static void seen_set(usb_integrity_t* ig, uint32_t seq) {
+    ig->seen[(seq / 64) % (USB_INTEGRITY_WINDOW / 64)] |= 1ull << (seq % 64);
+}
+
+static void seen_clear(usb_integrity_t* ig, uint32_t seq) {
+    ig->seen[(seq / 64) % (USB_INTEGRITY_WINDOW / 64)] &= ~(1ull << (seq % 64));
+}
+
+static int seen_test(usb_integrity_t* ig, uint32_t seq) {
+    return (ig->seen[(seq / 64) % (USB_INTEGRITY_WINDOW / 64)] >> (seq % 64)) & 1;
+}
+
+usb_integrity_t* usb_integrity_create(void) {
+    usb_integrity_t* ig = (usb_integrity_t*)calloc(1, sizeof(usb_integrity_t));
+    if (ig) {
+        usb_mutex_init(&ig->lock);
+    }
+    return ig;
+}
+
+void usb_integrity_destroy(usb_integrity_t* ig) {
+    if (ig) {
+        usb_mutex_destroy(&ig->lock);
+        free(ig);
+    }
+}
+
+// 到达一帧: 单写者，不需要原子的读改写
+static void integrity_frame(usb_integrity_t* ig) {
+    atomic_store_explicit(&ig->frames, atomic_load_explicit(&ig->frames, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&ig->next_seq, ig->expected, memory_order_relaxed);
+}
+
+// 各原因的当前事件数: 报告的事件 + 计数器来源
+static void integrity_events(usb_integrity_t* ig, uint64_t* now) {
+    for (int c = 0; c < USB_LOSS_CAUSES; c++) {
+        now[c] = atomic_load_explicit(&ig->events[c], memory_order_acquire);
+    }
+    usb_mutex_lock(&ig->lock);
+    for (int c = 0; c < USB_LOSS_CAUSES; c++) {
+        now[c] += ig->source_base[c];
+    }
+    for (int i = 0; i < ig->num_sources; i++) {
+        now[ig->sources[i].cause] += ig->sources[i].fn(ig->sources[i].ctx);
+    }
+    usb_mutex_unlock(&ig->lock);
+}
+
+// 自上次归因以来有事件的最高优先级原因，没有则是设备端溢出
+static usb_loss_cause_t integrity_attribute(usb_integrity_t* ig) {
+    uint64_t now[USB_LOSS_CAUSES];
+    usb_loss_cause_t cause = USB_LOSS_DEVICE;
+
+    integrity_events(ig, now);
+    for (int c = USB_LOSS_CAUSES - 1; c > USB_LOSS_DEVICE; c--) {
+        if (now[c] != ig->attributed[c]) {
+            cause = (usb_loss_cause_t)c;
+            break;
+        }
+    }
+    memcpy(ig->attributed, now, sizeof(now));
+    return cause;
+}
+
+// 以seq为新的起点
+static void integrity_baseline(usb_integrity_t* ig, uint32_t seq) {
+    if (ig->started) {
+        usb_mutex_lock(&ig->lock);
+        ig->stats.restarts++;
+        usb_mutex_unlock(&ig->lock);
+    }
+    memset(ig->seen, 0, sizeof(ig->seen));
+    memset(ig->recent, 0, sizeof(ig->recent));
+    ig->started = 1;
+    ig->expected = seq + 1;
+    seen_set(ig, seq);
+    integrity_frame(ig);
+}
+
+static int integrity_gap(usb_integrity_t* ig, uint32_t seq, uint32_t missing) {
+    usb_loss_cause_t cause = integrity_attribute(ig);
+    usb_mutex_lock(&ig->lock);
+    ig->stats.gaps++;
+    ig->stats.gaps_by[cause]++;
+    ig->stats.lost += missing;
+    ig->stats.lost_by[cause] += missing;
+    usb_mutex_unlock(&ig->lock);
+    ig->recent[ig->recent_next].start = ig->expected;
+    ig->recent[ig->recent_next].count = missing;
+    ig->recent[ig->recent_next].cause = cause;
+    ig->recent_next = (ig->recent_next + 1) % INTEGRITY_RECENT_GAPS;
+
+    uint32_t clear = missing < USB_INTEGRITY_WINDOW ? missing : USB_INTEGRITY_WINDOW;
+    for (uint32_t i = 0; i < clear; i++) {
+        seen_clear(ig, seq - 1 - i);
+    }
+    seen_set(ig, seq);
+    ig->expected = seq + 1;
+    integrity_frame(ig);
+    return (int)(missing > INT32_MAX ? INT32_MAX : missing);
+}
+
+// 窗口内向后的序号: 重复或迟到
+static int integrity_late(usb_integrity_t* ig, uint32_t seq) {
+    usb_mutex_lock(&ig->lock);
+    if (seen_test(ig, seq)) {
+        ig->stats.duplicates++;
+        usb_mutex_unlock(&ig->lock);
+        return USB_SEQ_DUPLICATE;
+    }
+    seen_set(ig, seq);
+    ig->stats.reordered++;
+    for (int i = 0; i < INTEGRITY_RECENT_GAPS; i++) {
+        if (ig->recent[i].count > 0 && seq - ig->recent[i].start < ig->recent[i].count) {
+            ig->stats.lost--;
+            ig->stats.lost_by[ig->recent[i].cause]--;
+            break;
+        }
+    }
+    usb_mutex_unlock(&ig->lock);
+    integrity_frame(ig);
+    return USB_SEQ_LATE;
+}
+
+/* 检查序号 */
+int usb_integrity_check(usb_integrity_t* ig, uint32_t seq) {
+    if (seq == ig->expected && ig->started) {
+        seen_set(ig, seq);
+        ig->expected = seq + 1;
+        integrity_frame(ig);
+        return 0;
+    }
+
+    // 序号之差按32位回绕解释: 小于2^31为向前
+    uint32_t ahead = seq - ig->expected;
+    int restart = atomic_exchange(&ig->restart, 0);
+    if (!ig->started) {
+        integrity_baseline(ig, seq);
+        return 0;
+    }
+    if (ahead != 0 && ahead < 0x80000000u) {
+        return integrity_gap(ig, seq, ahead);
+    }
+    if (!restart && ig->expected - seq <= USB_INTEGRITY_WINDOW) {
+        return integrity_late(ig, seq);
+    }
+    // 重新连接后，或远在窗口之前: 设备的计数器重新开始了
+    integrity_baseline(ig, seq);
+    return 0;
+}
+
+void usb_integrity_note(usb_integrity_t* ig, usb_loss_cause_t cause, uint64_t count) {
+    if (ig && cause >= 0 && cause < USB_LOSS_CAUSES) {
+        atomic_fetch_add_explicit(&ig->events[cause], count, memory_order_release);
+    }
+}
+
+void usb_integrity_restart(usb_integrity_t* ig) {
+    if (ig) {
+        atomic_store(&ig->restart, 1);
+    }
+}
+
+int usb_integrity_add_source(usb_integrity_t* ig, usb_loss_cause_t cause, usb_loss_source_fn fn, void* ctx) {
+    if (!ig || !fn || cause < 0 || cause >= USB_LOSS_CAUSES) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    usb_mutex_lock(&ig->lock);
+    if (ig->num_sources == USB_INTEGRITY_MAX_SOURCES) {
+        usb_mutex_unlock(&ig->lock);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    ig->sources[ig->num_sources].cause = cause;
+    ig->sources[ig->num_sources].fn = fn;
+    ig->sources[ig->num_sources].ctx = ctx;
+    ig->num_sources++;
+    ig->source_base[cause] -= fn(ctx);  // 只统计添加之后的丢失
+    usb_mutex_unlock(&ig->lock);
+    return 0;
+}
+
+void usb_integrity_remove_source(usb_integrity_t* ig, void* ctx) {
+    if (!ig) {
+        return;
+    }
+
+    usb_mutex_lock(&ig->lock);
+    for (int i = 0; i < ig->num_sources; i++) {
+        if (ig->sources[i].ctx == ctx) {
+            ig->source_base[ig->sources[i].cause] += ig->sources[i].fn(ctx);
+            ig->sources[i] = ig->sources[--ig->num_sources];
+            i--;
+        }
+    }
+    usb_mutex_unlock(&ig->lock);
+}
+
+void usb_integrity_get_stats(usb_integrity_t* ig, usb_integrity_stats_t* stats) {
+    uint64_t now[USB_LOSS_CAUSES];
+    memset(stats, 0, sizeof(*stats));
+    if (!ig) {
+        return;
+    }
+
+    usb_mutex_lock(&ig->lock);
+    *stats = ig->stats;
+    usb_mutex_unlock(&ig->lock);
+    stats->frames = atomic_load_explicit(&ig->frames, memory_order_relaxed);
+    stats->next_seq = atomic_load_explicit(&ig->next_seq, memory_order_relaxed);
+    integrity_events(ig, now);
+    memcpy(stats->events, now, sizeof(now));
+}
+
+const char* usb_loss_cause_name(usb_loss_cause_t cause) {
+    switch (cause) {
+        case USB_LOSS_DEVICE: return "device overrun";
+        case USB_LOSS_TRANSFER: return "transfer error";
+        case USB_LOSS_HOST: return "host queue overflow";
+        case USB_LOSS_DISCONNECT: return "disconnect";
+        default: return "?";
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef USB_INTEGRITY_H
+#define USB_INTEGRITY_H
+
+#include "usb_control.h"
+
+// 数据完整性: 按设备的序号 (帧头的seq或设备自己的计数器) 检查设备到消费者之间是否丢了数据，
+// 发现缺口、重复和乱序，并把每次丢失归因到一个原因。
+//
+// 按顺序到达时只有一次比较和一次置位；只有出现缺口时才归因: 查看自上次归因以来哪些来源报告了丢失事件
+// (断开 > 主机队列溢出 > 传输出错)，都没有则认为是设备端溢出 (设备FIFO满时丢弃，主机看不到)。
+// 来源有两种: 事件 (usb_integrity_note，流在传输出错时、监护在断开时调用) 和计数器
+// (usb_integrity_add_source，例如读取线程的环形缓冲区丢弃数，只在归因时读取，热路径没有开销)。
+//
+// 接入: usb_stream_config_t.integrity (流同时配置了拆分器时按帧头的seq检查)，
+// usb_reader 和 usb_supervisor 使用同一个配置自动报告各自的丢失。
+// 没有帧头的设备在消费者中对自己的计数器调用 usb_integrity_check。
+
+typedef enum {
+    USB_LOSS_DEVICE = 0,     // 设备端溢出: 没有主机端事件能解释的缺口
+    USB_LOSS_TRANSFER,       // 传输出错，数据随失败的传输丢失
+    USB_LOSS_HOST,           // 主机队列溢出 (读取线程的环形缓冲区满时丢弃)
+    USB_LOSS_DISCONNECT,     // 设备断开
+    USB_LOSS_CAUSES
+} usb_loss_cause_t;
+
+// usb_integrity_check 的返回值: 0 按顺序，>0 缺口的序号数，或下面的负值
+#define USB_SEQ_DUPLICATE (-1)  // 最近已经到达过
+#define USB_SEQ_LATE      (-2)  // 迟到 (之前记为丢失，现在扣除)
+
+#define USB_INTEGRITY_WINDOW      256  // 判断重复/迟到的窗口 (序号数)，更早的序号视为计数器重新开始
+#define USB_INTEGRITY_MAX_SOURCES 4
+
+typedef struct {
+    uint64_t frames;                      // 检查的序号数
+    uint64_t gaps;                        // 缺口次数
+    uint64_t lost;                        // 缺失的序号数 (迟到的已扣除)
+    uint64_t lost_by[USB_LOSS_CAUSES];    // 按原因
+    uint64_t gaps_by[USB_LOSS_CAUSES];
+    uint64_t duplicates;
+    uint64_t reordered;                   // 迟到的序号数
+    uint64_t restarts;                    // 序号重新开始 (重连后或设备复位)
+    uint64_t events[USB_LOSS_CAUSES];     // 来源报告的丢失事件数 (计数器来源按当前值)
+    uint32_t next_seq;                    // 期望的下一个序号
+} usb_integrity_stats_t;
+
+typedef struct usb_integrity usb_integrity_t;
+
+// 计数器来源: 返回单调增加的丢失计数 (在调用check的线程中调用)
+typedef uint64_t (*usb_loss_source_fn)(void* ctx);
+
+usb_integrity_t* usb_integrity_create(void);
+void usb_integrity_destroy(usb_integrity_t* ig);
+
+// 检查下一个序号，只能在一个线程中调用 (消费者/事件线程)
+int usb_integrity_check(usb_integrity_t* ig, uint32_t seq);
+// 报告count个丢失事件，任意线程
+void usb_integrity_note(usb_integrity_t* ig, usb_loss_cause_t cause, uint64_t count);
+// 设备的计数器可能重新开始 (重新连接后): 下一个序号向后跳时作为新的起点，向前跳时照常记为缺口。任意线程
+void usb_integrity_restart(usb_integrity_t* ig);
+int usb_integrity_add_source(usb_integrity_t* ig, usb_loss_cause_t cause, usb_loss_source_fn fn, void* ctx);
+void usb_integrity_remove_source(usb_integrity_t* ig, void* ctx);
+
+void usb_integrity_get_stats(usb_integrity_t* ig, usb_integrity_stats_t* stats);
+const char* usb_loss_cause_name(usb_loss_cause_t cause);
+
+#endif // USB_INTEGRITY_H
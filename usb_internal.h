@@ -0,0 +1,38 @@
+#ifndef USB_INTERNAL_H
+#define USB_INTERNAL_H
+
+#include "usb_control.h"
+#include "usb_transport.h"
+#include "usb_sim.h"
+#include "usb_replay.h"
+#include "usb_stats.h"
+
+// 当前后端，由 usb_control_init / usb_control_init_transport 设置，库内所有设备访问都经过它
+extern const usb_transport_t* usb_transport;
+
+// 当前的libusb上下文，设备句柄对应的libusb句柄 (device为NULL时使用默认设备)
+libusb_context* usb_control_context(void);
+libusb_device_handle* usb_device_handle(usb_device_t* device);
+usb_stats_t* usb_device_stats(usb_device_t* device);
+
+// 设备注册表，由 usb_control_init / usb_control_exit 调用
+int usb_registry_init(libusb_context* ctx);
+void usb_registry_exit(void);
+// 按序列号查找 (NULL表示第一台设备)，返回已引用的libusb设备，用完后 unref_device
+libusb_device* usb_registry_find(const char* serial, char* serial_out, int serial_length);
+
+// 由外部事件循环驱动的流 (usb_events.h): 有传输在等待池缓冲区 / 给它们分配缓冲区并重新提交
+int usb_stream_external_parked(void);
+void usb_stream_resume_external(void);
+
+// libusb后端: 加载DLL并填充函数表 / 卸载DLL
+int usb_transport_libusb_load(const usb_transport_t** transport);
+void usb_transport_libusb_unload(void);
+
+// 模拟设备: 在 init 之前设置配置
+void usb_sim_setup(const usb_sim_config_t* cfg);
+
+// 回放: 在 init 之前打开采集文件
+int usb_replay_setup(const usb_replay_config_t* cfg);
+
+#endif // USB_INTERNAL_H
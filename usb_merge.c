@@ -0,0 +1,413 @@
+#include <float.h>
+#include <stdatomic.h>
+#include "usb_merge.h"
+
+#define CLOCK_WINDOW_NS 100000000.0  // 每个窗口取一个最小延迟的样本 (设备时间)
+#define CLOCK_POINTS    64           // 拟合使用的窗口数
+
+// 槽布局: [记录头][数据]
+typedef struct {
+    uint64_t time_ns;
+    uint64_t host_ns;
+    uint64_t device_ts;
+    uint32_t seq;
+    int32_t has_device_ts;
+} merge_slot_t;
+
+// 设备时钟估计，只由该输入的生产者访问。
+// x = 设备时间 - 原点，y = (主机时间 - 设备时间) - 第一个样本的差值，拟合 y = a + b x
+typedef struct {
+    int started;
+    uint64_t dev0;
+    int64_t base;
+    double last_x;
+    double window_end;
+    double win_x, win_y;     // 当前窗口内y最小的样本
+    int win_have;
+    double xs[CLOCK_POINTS], ys[CLOCK_POINTS];
+    int points, next;
+    double a, b;
+} merge_clock_t;
+
+typedef struct {
+    usb_ring_t* ring;
+
+    // 生产者
+    merge_clock_t clock;
+    uint64_t last_time;      // 上一条记录的时间，保持每个输入内单调
+    // 生产者发布，消费者和统计读取
+    atomic_uint_least64_t watermark;   // 最近加入的记录时间: 之后的记录不会更早
+    atomic_int closed;
+    atomic_int has_clock;
+    atomic_int_least64_t offset_ns;
+    atomic_int_least64_t drift_ppb;
+
+    // 消费者: 队首记录已经peek并在堆中
+    int queued;
+    merge_slot_t head;
+    const unsigned char* head_data;
+    int head_length;
+} merge_input_t;
+
+struct usb_merge {
+    usb_merge_config_t cfg;
+    merge_input_t inputs[USB_MERGE_MAX_INPUTS];
+
+    // 消费者
+    int heap[USB_MERGE_MAX_INPUTS];    // 按队首时间排序的最小堆 (输入序号)
+    int heap_size;
+    int current;                       // 上一次pop输出的输入，下一次pop时释放它的槽
+    uint64_t last_out;                 // 已经输出的最晚时间
+    uint64_t records;
+    uint64_t late;
+    uint64_t forced;
+    uint64_t max_delay_ns;
+};
+
+// ---- 时钟估计 ----
+
+static int64_t round_i64(double v) {
+    return (int64_t)(v < 0 ? v - 0.5 : v + 0.5);
+}
+
+// 最小二乘直线拟合，只用残差 (相对直线 a0 + b0*x) 不为正或平方不超过 limit2 的点，返回使用的点数
+static int clock_lsq(const merge_clock_t* c, double a0, double b0, double limit2, double* a, double* b) {
+    double mx = 0, my = 0, sxx = 0, sxy = 0;
+    int n = 0;
+    for (int i = 0; i < c->points; i++) {
+        double r = c->ys[i] - (a0 + b0 * c->xs[i]);
+        if (r <= 0 || r * r <= limit2) {
+            mx += c->xs[i];
+            my += c->ys[i];
+            n++;
+        }
+    }
+    if (n == 0) {
+        return 0;
+    }
+    mx /= n;
+    my /= n;
+    for (int i = 0; i < c->points; i++) {
+        double r = c->ys[i] - (a0 + b0 * c->xs[i]);
+        if (r <= 0 || r * r <= limit2) {
+            sxx += (c->xs[i] - mx) * (c->xs[i] - mx);
+            sxy += (c->xs[i] - mx) * (c->ys[i] - my);
+        }
+    }
+    *b = sxx > 0 ? sxy / sxx : 0;
+    *a = my - *b * mx;
+    return n;
+}
+
+// 窗口最小值中仍有只会为正的延迟: 启动时的积压、主机负载高时整个窗口都没能及时处理完成的传输。
+// 这些窗口在时间上集中 (多在开始时)，会把斜率拉偏，所以拟合一次后去掉高于直线超过1个标准差的窗口再拟合
+static void clock_fit(merge_clock_t* c) {
+    double a, b, var = 0;
+    clock_lsq(c, 0, 0, DBL_MAX, &a, &b);
+    for (int i = 0; i < c->points; i++) {
+        double r = c->ys[i] - (a + b * c->xs[i]);
+        var += r * r;
+    }
+    var /= c->points;
+    if (clock_lsq(c, a, b, var, &c->a, &c->b) < 2) {
+        c->a = a;
+        c->b = b;
+    }
+}
+
+// 加入一个样本，返回换算到主机时钟的设备时间
+static uint64_t clock_update(merge_clock_t* c, uint64_t dev, uint64_t host) {
+    double x = c->started ? (double)(int64_t)(dev - c->dev0) : 0;
+    if (!c->started || x < c->last_x - CLOCK_WINDOW_NS) {
+        // 第一个样本，或设备时钟向后跳 (设备复位): 重新开始
+        memset(c, 0, sizeof(*c));
+        c->started = 1;
+        c->dev0 = dev;
+        c->base = (int64_t)(host - dev);
+        c->window_end = CLOCK_WINDOW_NS;
+        x = 0;
+    }
+    double y = (double)((int64_t)(host - dev) - c->base);
+    c->last_x = x;
+
+    if (x >= c->window_end) {
+        if (c->win_have) {
+            c->xs[c->next] = c->win_x;
+            c->ys[c->next] = c->win_y;
+            c->next = (c->next + 1) % CLOCK_POINTS;
+            if (c->points < CLOCK_POINTS) c->points++;
+            clock_fit(c);
+        }
+        c->window_end = (double)((int64_t)(x / CLOCK_WINDOW_NS) + 1) * CLOCK_WINDOW_NS;
+        c->win_have = 0;
+    }
+    if (!c->win_have || y < c->win_y) {
+        c->win_x = x;
+        c->win_y = y;
+        c->win_have = 1;
+    }
+    if (c->points == 0) {
+        // 第一个窗口结束前: 目前为止的最小差值，不估计漂移
+        c->a = c->win_y;
+        c->b = 0;
+    }
+    return dev + (uint64_t)(c->base + round_i64(c->a + c->b * x));
+}
+
+// ---- 堆 ----
+
+static int heap_less(usb_merge_t* m, int i, int j) {
+    const merge_input_t* a = &m->inputs[m->heap[i]];
+    const merge_input_t* b = &m->inputs[m->heap[j]];
+    if (a->head.time_ns != b->head.time_ns) {
+        return a->head.time_ns < b->head.time_ns;
+    }
+    return m->heap[i] < m->heap[j];
+}
+
+static void heap_swap(usb_merge_t* m, int i, int j) {
+    int t = m->heap[i];
+    m->heap[i] = m->heap[j];
+    m->heap[j] = t;
+}
+
+static void heap_push(usb_merge_t* m, int input) {
+    int i = m->heap_size++;
+    m->heap[i] = input;
+    while (i > 0 && heap_less(m, i, (i - 1) / 2)) {
+        heap_swap(m, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static int heap_pop(usb_merge_t* m) {
+    int top = m->heap[0];
+    int i = 0;
+    m->heap[0] = m->heap[--m->heap_size];
+    for (;;) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < m->heap_size && heap_less(m, l, min)) min = l;
+        if (r < m->heap_size && heap_less(m, r, min)) min = r;
+        if (min == i) break;
+        heap_swap(m, i, min);
+        i = min;
+    }
+    return top;
+}
+
+// ---- 创建/销毁 ----
+
+usb_merge_t* usb_merge_create(const usb_merge_config_t* cfg) {
+    if (!cfg || cfg->inputs <= 0 || cfg->inputs > USB_MERGE_MAX_INPUTS || cfg->policy == USB_RING_DROP_OLDEST) {
+        return NULL;
+    }
+
+    usb_merge_t* m = (usb_merge_t*)calloc(1, sizeof(usb_merge_t));
+    if (!m) return NULL;
+    m->cfg = *cfg;
+    if (m->cfg.depth <= 0) m->cfg.depth = USB_MERGE_DEFAULT_DEPTH;
+    if (m->cfg.max_record <= 0) m->cfg.max_record = USB_MERGE_DEFAULT_RECORD;
+    if (m->cfg.max_latency_us == 0) m->cfg.max_latency_us = USB_MERGE_DEFAULT_LATENCY;
+    m->current = -1;
+
+    for (int i = 0; i < m->cfg.inputs; i++) {
+        m->inputs[i].ring = usb_ring_create(m->cfg.depth, (int)sizeof(merge_slot_t) + m->cfg.max_record, m->cfg.policy);
+        if (!m->inputs[i].ring) {
+            usb_merge_destroy(m);
+            return NULL;
+        }
+    }
+    return m;
+}
+
+void usb_merge_destroy(usb_merge_t* merge) {
+    if (merge) {
+        for (int i = 0; i < merge->cfg.inputs; i++) {
+            usb_ring_destroy(merge->inputs[i].ring);
+        }
+        free(merge);
+    }
+}
+
+// ---- 生产者 ----
+
+/* 加入一条记录 */
+int usb_merge_push(usb_merge_t* merge, int input, uint64_t host_ns, const uint64_t* device_ts, uint32_t seq,
+                   const unsigned char* data, int length) {
+    if (input < 0 || input >= merge->cfg.inputs || length < 0) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    merge_input_t* in = &merge->inputs[input];
+    merge_slot_t slot;
+    uint64_t t = host_ns;
+    memset(&slot, 0, sizeof(slot));
+    if (device_ts) {
+        t = clock_update(&in->clock, *device_ts, host_ns);
+        merge_clock_t* c = &in->clock;
+        atomic_store_explicit(&in->offset_ns, c->base + round_i64(c->a + c->b * c->last_x), memory_order_relaxed);
+        atomic_store_explicit(&in->drift_ppb, -round_i64(c->b * 1e9), memory_order_relaxed);
+        atomic_store_explicit(&in->has_clock, 1, memory_order_relaxed);
+        slot.device_ts = *device_ts;
+        slot.has_device_ts = 1;
+    }
+    if (t < in->last_time) {
+        t = in->last_time;
+    }
+    in->last_time = t;
+    slot.time_ns = t;
+    slot.host_ns = host_ns;
+    slot.seq = seq;
+
+    int r = usb_ring_push_header(in->ring, &slot, (int)sizeof(slot), data, length);
+    // 在记录可见之后发布，消费者先读watermark再查看队列
+    atomic_store_explicit(&in->watermark, t, memory_order_release);
+    return r < 0 ? r : 0;
+}
+
+int usb_merge_push_frame(usb_merge_t* merge, int input, uint64_t host_ns, const usb_frame_header_t* header,
+                         const unsigned char* payload, int length) {
+    uint64_t ts;
+    int has_ts = usb_frame_get_timestamp(header, payload, length, &ts);
+    return usb_merge_push(merge, input, host_ns, has_ts ? &ts : NULL, header ? header->seq : 0, payload, length);
+}
+
+void usb_merge_close_input(usb_merge_t* merge, int input) {
+    if (input >= 0 && input < merge->cfg.inputs) {
+        atomic_store(&merge->inputs[input].closed, 1);
+        usb_ring_close(merge->inputs[input].ring);
+    }
+}
+
+// ---- 消费者 ----
+
+// 不在堆中的输入有记录时放入堆，返回未结束的输入数 (未关闭或还有记录)
+static int merge_refill(usb_merge_t* m) {
+    int open = 0;
+    for (int i = 0; i < m->cfg.inputs; i++) {
+        merge_input_t* in = &m->inputs[i];
+        if (in->queued) {
+            open++;
+            continue;
+        }
+        const unsigned char* p;
+        int n = usb_ring_peek(in->ring, &p, 0);
+        if (n == LIBUSB_ERROR_INTERRUPTED) {
+            continue;  // 已关闭且没有剩余记录
+        }
+        open++;
+        if (n >= (int)sizeof(merge_slot_t)) {
+            memcpy(&in->head, p, sizeof(merge_slot_t));
+            in->head_data = p + sizeof(merge_slot_t);
+            in->head_length = n - (int)sizeof(merge_slot_t);
+            in->queued = 1;
+            heap_push(m, i);
+        }
+    }
+    return open;
+}
+
+// 堆顶的记录是否可以输出: 每个空的输入之后的记录都不会更早
+static int merge_ready(usb_merge_t* m, uint64_t top_time) {
+    for (int i = 0; i < m->cfg.inputs; i++) {
+        merge_input_t* in = &m->inputs[i];
+        if (in->queued) {
+            continue;
+        }
+        uint64_t w = atomic_load_explicit(&in->watermark, memory_order_acquire);
+        if (w >= top_time) {
+            continue;
+        }
+        // 读watermark之后再确认仍然为空
+        const unsigned char* p;
+        int n = usb_ring_peek(in->ring, &p, 0);
+        if (n == LIBUSB_ERROR_INTERRUPTED) {
+            continue;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+/* 取出时间最早的记录 */
+int usb_merge_pop(usb_merge_t* merge, usb_merge_record_t* record, unsigned int timeout_ms) {
+    usb_merge_t* m = merge;
+    uint64_t deadline = 0;
+    int spins = 0;
+
+    if (m->current >= 0) {
+        usb_ring_release(m->inputs[m->current].ring);
+        m->inputs[m->current].queued = 0;
+        m->current = -1;
+    }
+
+    for (;;) {
+        int open = merge_refill(m);
+        if (m->heap_size > 0) {
+            merge_input_t* top = &m->inputs[m->heap[0]];
+            uint64_t now = usb_time_ns();
+            int ready = merge_ready(m, top->head.time_ns);
+            if (!ready && now >= top->head.time_ns + (uint64_t)m->cfg.max_latency_us * 1000ull) {
+                ready = 1;
+                m->forced++;
+            }
+            if (ready) {
+                int input = heap_pop(m);
+                record->input = input;
+                record->time_ns = top->head.time_ns;
+                record->host_ns = top->head.host_ns;
+                record->device_ts = top->head.device_ts;
+                record->has_device_ts = top->head.has_device_ts;
+                record->seq = top->head.seq;
+                record->data = top->head_data;
+                record->length = top->head_length;
+                record->late = record->time_ns < m->last_out;
+                if (record->late) {
+                    m->late++;
+                } else {
+                    m->last_out = record->time_ns;
+                }
+                if (now > record->host_ns && now - record->host_ns > m->max_delay_ns) {
+                    m->max_delay_ns = now - record->host_ns;
+                }
+                m->records++;
+                m->current = input;
+                return 0;
+            }
+        } else if (open == 0) {
+            return LIBUSB_ERROR_NOT_FOUND;
+        }
+
+        if (deadline == 0) {
+            deadline = usb_time_ns() + (uint64_t)timeout_ms * 1000000ull;
+        } else if (usb_time_ns() >= deadline) {
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        // 同 usb_ring: 先让出CPU几次，之后短暂休眠
+        if (++spins < 64) {
+            usb_thread_yield();
+        } else {
+            usb_sleep_until_ns(usb_time_ns() + 50000);
+        }
+    }
+}
+
+void usb_merge_get_stats(usb_merge_t* merge, usb_merge_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->records = merge->records;
+    stats->late = merge->late;
+    stats->forced = merge->forced;
+    stats->max_delay_ns = merge->max_delay_ns;
+    for (int i = 0; i < merge->cfg.inputs; i++) {
+        merge_input_t* in = &merge->inputs[i];
+        usb_ring_stats_t rs;
+        usb_ring_get_stats(in->ring, &rs);
+        stats->input[i].pushed = rs.pushed;
+        stats->input[i].dropped = rs.dropped;
+        stats->input[i].high_water = rs.high_water;
+        stats->input[i].closed = atomic_load(&in->closed);
+        stats->input[i].has_clock = atomic_load_explicit(&in->has_clock, memory_order_relaxed);
+        stats->input[i].offset_ns = atomic_load_explicit(&in->offset_ns, memory_order_relaxed);
+        stats->input[i].drift_ppm = (double)atomic_load_explicit(&in->drift_ppb, memory_order_relaxed) / 1000.0;
+    }
+}
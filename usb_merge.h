@@ -0,0 +1,91 @@
+#ifndef USB_MERGE_H
+#define USB_MERGE_H
+
+#include "usb_control.h"
+#include "usb_frame.h"
+#include "usb_ring.h"
+
+// 多设备按时间合并: 每台设备 (输入) 的记录带主机时间戳 (传输完成时间)，帧带设备时间戳
+// (USB_FRAME_FLAG_TIMESTAMP) 时还按估计的时钟偏移和漂移换算到主机时钟。合并器用最小堆按时间
+// 从所有输入中依次取出最早的记录，得到一个按时间排序的流。
+//
+// 每个输入是一个SPSC环形缓冲区 (生产者通常是该设备的事件线程)，缓冲的记录数和等待时间都有上限:
+//   某个输入为空时，堆顶的记录在不晚于该输入最后一条记录的时间时可以直接输出 (每个输入内时间单调)，
+//   否则最多等待 max_latency_us (按记录的时间算) 后输出；之后才到达的更早的记录标记为 late。
+//
+// 时钟估计: 设备时间戳和主机时间戳之差 = 偏移 + 漂移 + 传输延迟 (>= 0)。每个窗口 (100ms设备时间)
+// 取差值最小的样本 (延迟最小)，对最近64个窗口的最小值做最小二乘直线拟合，斜率为漂移，截距为偏移；
+// 去掉高于直线超过1个标准差的窗口 (启动积压、主机负载造成的整窗口延迟) 后再拟合一次。
+// 换算后的时间是设备时间加上最小延迟，不同设备之间的相对时间不受各自传输延迟和漂移的影响。
+//
+// 精度: 漂移误差约为 窗口最小值的波动 / 拟合的时间跨度，随运行时间下降。模拟设备 (500us完成抖动，
+// 每个窗口约12个传输，最小值波动约20us) 上2.5秒后约10-25ppm，64个窗口填满 (6.4秒) 后在10ppm以内
+// (bench_merge 用0ppm的设备检查，容差15ppm)。偏移误差与窗口最小值的波动相当 (几十us)。
+
+#define USB_MERGE_MAX_INPUTS     MAX_DEVICES
+#define USB_MERGE_DEFAULT_DEPTH  256
+#define USB_MERGE_DEFAULT_RECORD (64 * 1024)
+#define USB_MERGE_DEFAULT_LATENCY 20000
+
+typedef struct usb_merge usb_merge_t;
+
+typedef struct {
+    int inputs;                   // 输入数 (<= USB_MERGE_MAX_INPUTS)
+    int depth;                    // 每个输入缓冲的记录数
+    int max_record;               // 记录的最大字节数，更长的截断
+    unsigned int max_latency_us;  // 某个输入为空时，记录最多等待多久 (按记录时间)
+    usb_ring_policy_t policy;     // 输入缓冲满时: BLOCK 生产者等待 (默认)，DROP_NEWEST 丢弃新记录；不支持DROP_OLDEST
+} usb_merge_config_t;
+
+typedef struct {
+    int input;                    // 输入序号
+    uint64_t time_ns;             // 对齐到主机单调时钟的时间 (没有设备时间戳时为host_ns)
+    uint64_t host_ns;             // 主机时间戳 (传输完成时间)
+    uint64_t device_ts;           // 设备时间戳，has_device_ts为0时无效
+    int has_device_ts;
+    uint32_t seq;                 // 帧序号
+    int late;                     // 比已经输出的记录更早 (在等待超时后才到达)
+    const unsigned char* data;    // 在下一次 usb_merge_pop 之前有效
+    int length;
+} usb_merge_record_t;
+
+typedef struct {
+    uint64_t records;             // 输出的记录数
+    uint64_t late;                // 乱序输出的记录数
+    uint64_t forced;              // 某个输入为空、等待超时后输出的记录数
+    uint64_t max_delay_ns;        // 记录从主机时间戳到输出的最大延迟
+    struct {
+        uint64_t pushed;
+        uint64_t dropped;         // DROP_NEWEST 丢弃的记录数
+        uint32_t high_water;      // 缓冲的最大记录数
+        int closed;
+        int has_clock;            // 已经从设备时间戳估计出时钟
+        int64_t offset_ns;        // 主机时间 - 设备时间 (最近一条记录处)
+        double drift_ppm;         // 设备时钟相对主机时钟的频率偏差，正数表示设备时钟快
+    } input[USB_MERGE_MAX_INPUTS];
+} usb_merge_stats_t;
+
+// cfg中为0的字段使用默认值，inputs必须设置。参数无效或内存不足返回NULL
+usb_merge_t* usb_merge_create(const usb_merge_config_t* cfg);
+// 调用时不能有生产者或消费者正在使用
+void usb_merge_destroy(usb_merge_t* merge);
+
+// 生产者 (每个输入同一时间只能有一个线程): 加入一条记录，device_ts为NULL表示没有设备时间戳。
+// 成功返回0，DROP_NEWEST 时缓冲已满返回 LIBUSB_ERROR_OVERFLOW
+int usb_merge_push(usb_merge_t* merge, int input, uint64_t host_ns, const uint64_t* device_ts, uint32_t seq,
+                   const unsigned char* data, int length);
+// 加入一帧 (拆分器回调中调用)，帧带设备时间戳时自动取出
+int usb_merge_push_frame(usb_merge_t* merge, int input, uint64_t host_ns, const usb_frame_header_t* header,
+                         const unsigned char* payload, int length);
+// 输入结束 (设备断开)，缓冲的记录输出完后不再等待它。之后的push返回 LIBUSB_ERROR_INTERRUPTED。
+// 消费者停止取记录后，必须先关闭输入再停止生产者的流 (同 usb_reader_stop 先关闭环形缓冲区):
+// BLOCK 的输入满时生产者在push中等待，流的事件线程不返回，usb_stream_stop 会一直等下去
+void usb_merge_close_input(usb_merge_t* merge, int input);
+
+// 消费者 (单线程): 取出时间最早的记录。timeout_ms内没有可以输出的记录返回 LIBUSB_ERROR_TIMEOUT，
+// 所有输入都已关闭且输出完返回 LIBUSB_ERROR_NOT_FOUND
+int usb_merge_pop(usb_merge_t* merge, usb_merge_record_t* record, unsigned int timeout_ms);
+
+void usb_merge_get_stats(usb_merge_t* merge, usb_merge_stats_t* stats);
+
+#endif // USB_MERGE_H
@@ -0,0 +1,710 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE  // cpu_set_t / sched_setaffinity
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include "usb_platform.h"
+
+#ifdef _WIN32
+
+typedef struct {
+    usb_thread_fn fn;
+    void* arg;
+} thread_start_t;
+
+static DWORD WINAPI thread_trampoline(LPVOID param) {
+    thread_start_t start = *(thread_start_t*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+
+int usb_thread_create(usb_thread_t* thread, usb_thread_fn fn, void* arg) {
+    thread_start_t* start = (thread_start_t*)malloc(sizeof(thread_start_t));
+    if (!start) return -1;
+    start->fn = fn;
+    start->arg = arg;
+    *thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+    if (*thread == NULL) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+void usb_thread_join(usb_thread_t thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void usb_thread_yield(void) {
+    SwitchToThread();
+}
+
+int usb_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+void usb_cpu_relax(void) {
+    YieldProcessor();
+}
+
+int usb_thread_set_affinity(uint64_t cpu_mask) {
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)cpu_mask) ? 0 : -1;
+}
+
+int usb_thread_set_realtime(int priority) {
+    (void)priority;
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) ? 0 : -1;
+}
+
+// FLS 的回调在线程退出时调用，TLS 没有
+int usb_tls_create(usb_tls_t* key, void (*destructor)(void*)) {
+    *key = FlsAlloc((PFLS_CALLBACK_FUNCTION)destructor);
+    return *key == FLS_OUT_OF_INDEXES ? -1 : 0;
+}
+
+void* usb_tls_get(usb_tls_t key) { return FlsGetValue(key); }
+void usb_tls_set(usb_tls_t key, void* value) { FlsSetValue(key, value); }
+
+void usb_mutex_init(usb_mutex_t* m) { InitializeCriticalSection(m); }
+void usb_mutex_destroy(usb_mutex_t* m) { DeleteCriticalSection(m); }
+void usb_mutex_lock(usb_mutex_t* m) { EnterCriticalSection(m); }
+int usb_mutex_trylock(usb_mutex_t* m) { return TryEnterCriticalSection(m) ? 1 : 0; }
+void usb_mutex_unlock(usb_mutex_t* m) { LeaveCriticalSection(m); }
+void usb_cond_init(usb_cond_t* c) { InitializeConditionVariable(c); }
+void usb_cond_destroy(usb_cond_t* c) { (void)c; }
+void usb_cond_signal(usb_cond_t* c) { WakeConditionVariable(c); }
+void usb_cond_broadcast(usb_cond_t* c) { WakeAllConditionVariable(c); }
+
+void usb_cond_wait_until(usb_cond_t* c, usb_mutex_t* m, uint64_t deadline_ns) {
+    uint64_t now = usb_time_ns();
+    DWORD ms = 0;
+    if (deadline_ns > now) {
+        ms = (DWORD)((deadline_ns - now + 999999) / 1000000);
+    }
+    SleepConditionVariableCS(c, m, ms);
+}
+
+uint64_t usb_time_ns(void) {
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) {
+        QueryPerformanceFrequency(&freq);
+    }
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
+uint32_t usb_time_ms(void) {
+    return GetTickCount();
+}
+
+void usb_sleep_ms(unsigned int ms) {
+    Sleep(ms);
+}
+
+void usb_sleep_until_ns(uint64_t deadline_ns) {
+    uint64_t now = usb_time_ns();
+    if (deadline_ns > now) {
+        Sleep((DWORD)((deadline_ns - now) / 1000000));
+    }
+    // Sleep只有毫秒精度，剩余部分自旋
+    while (usb_time_ns() < deadline_ns) {
+        YieldProcessor();
+    }
+}
+
+uint64_t usb_cpu_time_ns(void) {
+    FILETIME create, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user)) {
+        return 0;
+    }
+    // FILETIME单位为100ns
+    uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+    uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+    return (k + u) * 100ull;
+}
+
+uint64_t usb_wall_time_ns(void) {
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    // FILETIME从1601-01-01起算
+    uint64_t t = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return (t - 116444736000000000ull) * 100ull;
+}
+
+void* usb_aligned_alloc(size_t alignment, size_t size) {
+    return _aligned_malloc(size, alignment);
+}
+
+void usb_aligned_free(void* ptr) {
+    _aligned_free(ptr);
+}
+
+int usb_file_map_create(usb_file_map_t* map, const char* path, size_t size) {
+    LARGE_INTEGER li;
+    map->addr = NULL;
+    map->size = 0;
+    map->writable = 1;
+    map->file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    li.QuadPart = (LONGLONG)size;
+    if (!SetFilePointerEx(map->file, li, NULL, FILE_BEGIN) || !SetEndOfFile(map->file)) {
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    map->addr = map->mapping ? (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_WRITE, 0, 0, size) : NULL;
+    if (!map->addr) {
+        if (map->mapping) CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->size = size;
+    return 0;
+}
+
+int usb_file_map_open(usb_file_map_t* map, const char* path) {
+    LARGE_INTEGER li;
+    map->addr = NULL;
+    map->size = 0;
+    map->writable = 0;
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+    if (map->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    if (!GetFileSizeEx(map->file, &li) || li.QuadPart == 0) {
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    map->addr = map->mapping ? (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!map->addr) {
+        if (map->mapping) CloseHandle(map->mapping);
+        CloseHandle(map->file);
+        return -1;
+    }
+    map->size = (size_t)li.QuadPart;
+    return 0;
+}
+
+int usb_file_map_flush(usb_file_map_t* map, size_t offset, size_t length, int wait) {
+    if (!FlushViewOfFile(map->addr + offset, length)) {
+        return -1;
+    }
+    if (wait && !FlushFileBuffers(map->file)) {
+        return -1;
+    }
+    return 0;
+}
+
+void usb_file_map_close(usb_file_map_t* map, size_t final_size) {
+    LARGE_INTEGER li;
+    UnmapViewOfFile(map->addr);
+    CloseHandle(map->mapping);
+    li.QuadPart = (LONGLONG)final_size;
+    if (map->writable && SetFilePointerEx(map->file, li, NULL, FILE_BEGIN)) {
+        SetEndOfFile(map->file);
+    }
+    CloseHandle(map->file);
+    map->addr = NULL;
+}
+
+// 名字 -> "Local\\名字"
+static void shm_name(char* out, size_t size, const char* name) {
+    snprintf(out, size, "Local\\%s", name[0] == '/' ? name + 1 : name);
+}
+
+int usb_shm_map_create(usb_shm_map_t* map, const char* name, size_t size) {
+    char path[256];
+    shm_name(path, sizeof(path), name);
+    map->addr = NULL;
+    map->size = 0;
+    map->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32),
+                                      (DWORD)size, path);
+    if (!map->mapping) {
+        return -1;
+    }
+    map->addr = (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!map->addr) {
+        CloseHandle(map->mapping);
+        return -1;
+    }
+    map->size = size;
+    return 0;
+}
+
+int usb_shm_map_open(usb_shm_map_t* map, const char* name) {
+    MEMORY_BASIC_INFORMATION info;
+    char path[256];
+    shm_name(path, sizeof(path), name);
+    map->addr = NULL;
+    map->size = 0;
+    map->mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path);
+    if (!map->mapping) {
+        return -1;
+    }
+    map->addr = (unsigned char*)MapViewOfFile(map->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!map->addr || VirtualQuery(map->addr, &info, sizeof(info)) == 0) {
+        if (map->addr) UnmapViewOfFile(map->addr);
+        CloseHandle(map->mapping);
+        return -1;
+    }
+    map->size = info.RegionSize;
+    return 0;
+}
+
+void usb_shm_map_close(usb_shm_map_t* map) {
+    UnmapViewOfFile(map->addr);
+    CloseHandle(map->mapping);
+    map->addr = NULL;
+}
+
+void usb_shm_map_unlink(const char* name) { (void)name; }
+
+void usb_futex_wait(void* addr, uint32_t expected, uint64_t timeout_ns) {
+    (void)timeout_ns;
+    if (*(volatile uint32_t*)addr == expected) {
+        Sleep(1);
+    }
+}
+
+void usb_futex_wake(void* addr) { (void)addr; }
+
+int usb_process_id(void) {
+    return (int)GetCurrentProcessId();
+}
+
+int usb_process_alive(int pid) {
+    DWORD code;
+    HANDLE h = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, (DWORD)pid);
+    if (!h) {
+        return GetLastError() == ERROR_ACCESS_DENIED;
+    }
+    int alive = GetExitCodeProcess(h, &code) && code == STILL_ACTIVE;
+    CloseHandle(h);
+    return alive;
+}
+
+int usb_timer_fd_create(usb_timer_fd_t* t) {
+    t->fd = -1;
+    t->write_fd = -1;
+    t->signalled = 0;
+    return -1;
+}
+
+void usb_timer_fd_arm(usb_timer_fd_t* t, uint64_t deadline_ns) { (void)t; (void)deadline_ns; }
+void usb_timer_fd_clear(usb_timer_fd_t* t) { (void)t; }
+void usb_timer_fd_close(usb_timer_fd_t* t) { (void)t; }
+
+size_t usb_page_size(void) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwAllocationGranularity;
+}
+
+usb_lib_t usb_lib_open(const char* path) { return LoadLibraryA(path); }
+void* usb_lib_sym(usb_lib_t lib, const char* name) { return (void*)GetProcAddress(lib, name); }
+void usb_lib_close(usb_lib_t lib) { FreeLibrary(lib); }
+
+#else
+
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+int usb_thread_create(usb_thread_t* thread, usb_thread_fn fn, void* arg) {
+    return pthread_create(thread, NULL, fn, arg) == 0 ? 0 : -1;
+}
+
+void usb_thread_join(usb_thread_t thread) {
+    pthread_join(thread, NULL);
+}
+
+void usb_thread_yield(void) {
+    sched_yield();
+}
+
+int usb_cpu_count(void) {
+#ifdef __linux__
+    // 受taskset/cgroup限制时按本进程可用的CPU计算
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0 && CPU_COUNT(&set) > 0) {
+        return CPU_COUNT(&set);
+    }
+#endif
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+void usb_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+int usb_thread_set_affinity(uint64_t cpu_mask) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int i = 0; i < 64 && i < CPU_SETSIZE; i++) {
+        if (cpu_mask & (1ull << i)) {
+            CPU_SET(i, &set);
+        }
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    (void)cpu_mask;
+    return -1;
+#endif
+}
+
+int usb_thread_set_realtime(int priority) {
+    struct sched_param param;
+    int min = sched_get_priority_min(SCHED_FIFO), max = sched_get_priority_max(SCHED_FIFO);
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = priority < min ? min : priority > max ? max : priority;
+    return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0 ? 0 : -1;
+}
+
+int usb_tls_create(usb_tls_t* key, void (*destructor)(void*)) {
+    return pthread_key_create(key, destructor) == 0 ? 0 : -1;
+}
+
+void* usb_tls_get(usb_tls_t key) { return pthread_getspecific(key); }
+void usb_tls_set(usb_tls_t key, void* value) { pthread_setspecific(key, value); }
+
+void usb_mutex_init(usb_mutex_t* m) { pthread_mutex_init(m, NULL); }
+void usb_mutex_destroy(usb_mutex_t* m) { pthread_mutex_destroy(m); }
+void usb_mutex_lock(usb_mutex_t* m) { pthread_mutex_lock(m); }
+int usb_mutex_trylock(usb_mutex_t* m) { return pthread_mutex_trylock(m) == 0 ? 1 : 0; }
+void usb_mutex_unlock(usb_mutex_t* m) { pthread_mutex_unlock(m); }
+
+void usb_cond_init(usb_cond_t* c) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(c, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+void usb_cond_destroy(usb_cond_t* c) { pthread_cond_destroy(c); }
+void usb_cond_signal(usb_cond_t* c) { pthread_cond_signal(c); }
+void usb_cond_broadcast(usb_cond_t* c) { pthread_cond_broadcast(c); }
+
+void usb_cond_wait_until(usb_cond_t* c, usb_mutex_t* m, uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+    ts.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    pthread_cond_timedwait(c, m, &ts);
+}
+
+uint64_t usb_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint32_t usb_time_ms(void) {
+    return (uint32_t)(usb_time_ns() / 1000000ull);
+}
+
+void usb_sleep_ms(unsigned int ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+    nanosleep(&ts, NULL);
+}
+
+void usb_sleep_until_ns(uint64_t deadline_ns) {
+    struct timespec ts;
+    if (deadline_ns <= usb_time_ns()) {
+        return;  // 已过期的绝对时间也会按定时器松弛(~50us)睡眠
+    }
+    ts.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+    ts.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        // 被信号打断，继续等待
+    }
+}
+
+uint64_t usb_cpu_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t usb_wall_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef __linux__
+int usb_timer_fd_create(usb_timer_fd_t* t) {
+    t->write_fd = -1;
+    t->signalled = 0;
+    t->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    return t->fd >= 0 ? 0 : -1;
+}
+
+void usb_timer_fd_arm(usb_timer_fd_t* t, uint64_t deadline_ns) {
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (deadline_ns > 0) {
+        its.it_value.tv_sec = (time_t)(deadline_ns / 1000000000ull);
+        its.it_value.tv_nsec = (long)(deadline_ns % 1000000000ull);
+    }
+    timerfd_settime(t->fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+void usb_timer_fd_clear(usb_timer_fd_t* t) {
+    uint64_t expirations;
+    while (read(t->fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+    }
+}
+
+void usb_timer_fd_close(usb_timer_fd_t* t) {
+    if (t->fd >= 0) close(t->fd);
+    t->fd = -1;
+}
+#else
+int usb_timer_fd_create(usb_timer_fd_t* t) {
+    int fds[2];
+    t->fd = -1;
+    t->write_fd = -1;
+    t->signalled = 0;
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    t->fd = fds[0];
+    t->write_fd = fds[1];
+    return 0;
+}
+
+void usb_timer_fd_arm(usb_timer_fd_t* t, uint64_t deadline_ns) {
+    if (deadline_ns > 0 && deadline_ns <= usb_time_ns() && !t->signalled) {
+        char c = 0;
+        t->signalled = write(t->write_fd, &c, 1) == 1;
+    }
+}
+
+void usb_timer_fd_clear(usb_timer_fd_t* t) {
+    char buf[64];
+    while (read(t->fd, buf, sizeof(buf)) > 0) {
+    }
+    t->signalled = 0;
+}
+
+void usb_timer_fd_close(usb_timer_fd_t* t) {
+    if (t->fd >= 0) close(t->fd);
+    if (t->write_fd >= 0) close(t->write_fd);
+    t->fd = -1;
+    t->write_fd = -1;
+}
+#endif
+
+void* usb_aligned_alloc(size_t alignment, size_t size) {
+    void* ptr = NULL;
+    if (alignment < sizeof(void*)) alignment = sizeof(void*);
+    return posix_memalign(&ptr, alignment, size) == 0 ? ptr : NULL;
+}
+
+void usb_aligned_free(void* ptr) {
+    free(ptr);
+}
+
+int usb_file_map_create(usb_file_map_t* map, const char* path, size_t size) {
+    map->addr = NULL;
+    map->size = 0;
+    map->writable = 1;
+    map->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (map->fd < 0) {
+        return -1;
+    }
+    // 预先分配磁盘块，写入映射时不会因为磁盘满而收到SIGBUS
+    if (posix_fallocate(map->fd, 0, (off_t)size) != 0 && ftruncate(map->fd, (off_t)size) != 0) {
+        close(map->fd);
+        return -1;
+    }
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (addr == MAP_FAILED) {
+        close(map->fd);
+        return -1;
+    }
+    map->addr = (unsigned char*)addr;
+    map->size = size;
+    return 0;
+}
+
+int usb_file_map_open(usb_file_map_t* map, const char* path) {
+    struct stat st;
+    map->addr = NULL;
+    map->size = 0;
+    map->writable = 0;
+    map->fd = open(path, O_RDONLY);
+    if (map->fd < 0) {
+        return -1;
+    }
+    if (fstat(map->fd, &st) != 0 || st.st_size == 0) {
+        close(map->fd);
+        return -1;
+    }
+    void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, map->fd, 0);
+    if (addr == MAP_FAILED) {
+        close(map->fd);
+        return -1;
+    }
+    map->addr = (unsigned char*)addr;
+    map->size = (size_t)st.st_size;
+    return 0;
+}
+
+int usb_file_map_flush(usb_file_map_t* map, size_t offset, size_t length, int wait) {
+    // msync要求起始地址按页对齐
+    size_t page = usb_page_size();
+    size_t start = offset - offset % page;
+    if (msync(map->addr + start, length + (offset - start), wait ? MS_SYNC : MS_ASYNC) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+void usb_file_map_close(usb_file_map_t* map, size_t final_size) {
+    munmap(map->addr, map->size);
+    if (map->writable && ftruncate(map->fd, (off_t)final_size) != 0) {
+        // 截断失败时文件保留预分配的大小，尾部为0
+    }
+    close(map->fd);
+    map->addr = NULL;
+}
+
+// 名字 -> "/名字"
+static void shm_name(char* out, size_t size, const char* name) {
+    snprintf(out, size, "/%s", name[0] == '/' ? name + 1 : name);
+}
+
+int usb_shm_map_create(usb_shm_map_t* map, const char* name, size_t size) {
+    char path[256];
+    shm_name(path, sizeof(path), name);
+    map->addr = NULL;
+    map->size = 0;
+    shm_unlink(path);
+    map->fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0666);
+    if (map->fd < 0) {
+        return -1;
+    }
+    if (ftruncate(map->fd, (off_t)size) != 0) {
+        close(map->fd);
+        shm_unlink(path);
+        return -1;
+    }
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (addr == MAP_FAILED) {
+        close(map->fd);
+        shm_unlink(path);
+        return -1;
+    }
+    map->addr = (unsigned char*)addr;
+    map->size = size;
+    return 0;
+}
+
+int usb_shm_map_open(usb_shm_map_t* map, const char* name) {
+    struct stat st;
+    char path[256];
+    shm_name(path, sizeof(path), name);
+    map->addr = NULL;
+    map->size = 0;
+    map->fd = shm_open(path, O_RDWR, 0);
+    if (map->fd < 0) {
+        return -1;
+    }
+    if (fstat(map->fd, &st) != 0 || st.st_size == 0) {
+        close(map->fd);
+        return -1;
+    }
+    void* addr = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, map->fd, 0);
+    if (addr == MAP_FAILED) {
+        close(map->fd);
+        return -1;
+    }
+    map->addr = (unsigned char*)addr;
+    map->size = (size_t)st.st_size;
+    return 0;
+}
+
+void usb_shm_map_close(usb_shm_map_t* map) {
+    munmap(map->addr, map->size);
+    close(map->fd);
+    map->addr = NULL;
+}
+
+void usb_shm_map_unlink(const char* name) {
+    char path[256];
+    shm_name(path, sizeof(path), name);
+    shm_unlink(path);
+}
+
+#ifdef __linux__
+// 共享映射上的futex不能用 FUTEX_PRIVATE_FLAG
+void usb_futex_wait(void* addr, uint32_t expected, uint64_t timeout_ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(timeout_ns / 1000000000ull);
+    ts.tv_nsec = (long)(timeout_ns % 1000000000ull);
+    syscall(SYS_futex, addr, FUTEX_WAIT, expected, &ts, NULL, 0);
+}
+
+void usb_futex_wake(void* addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+#else
+void usb_futex_wait(void* addr, uint32_t expected, uint64_t timeout_ns) {
+    if (*(volatile uint32_t*)addr == expected) {
+        usb_sleep_until_ns(usb_time_ns() + (timeout_ns < 1000000ull ? timeout_ns : 1000000ull));
+    }
+}
+
+void usb_futex_wake(void* addr) { (void)addr; }
+#endif
+
+int usb_process_id(void) {
+    return (int)getpid();
+}
+
+int usb_process_alive(int pid) {
+    return kill((pid_t)pid, 0) == 0 || errno == EPERM;
+}
+
+size_t usb_page_size(void) {
+    return (size_t)sysconf(_SC_PAGESIZE);
+}
+
+usb_lib_t usb_lib_open(const char* path) { return dlopen(path, RTLD_NOW | RTLD_LOCAL); }
+void* usb_lib_sym(usb_lib_t lib, const char* name) { return dlsym(lib, name); }
+void usb_lib_close(usb_lib_t lib) { dlclose(lib); }
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef USB_PLATFORM_H
+#define USB_PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 线程、锁、时钟和动态库加载的平台封装 (Windows / POSIX)
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE usb_thread_t;
+typedef CRITICAL_SECTION usb_mutex_t;
+typedef CONDITION_VARIABLE usb_cond_t;
+typedef HMODULE usb_lib_t;
+typedef DWORD usb_tls_t;
+#else
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <poll.h>
+typedef pthread_t usb_thread_t;
+typedef pthread_mutex_t usb_mutex_t;
+typedef pthread_cond_t usb_cond_t;
+typedef void* usb_lib_t;
+typedef pthread_key_t usb_tls_t;
+#endif
+
+#ifndef POLLIN
+#define POLLIN 0x0001        // Windows: 没有可poll的fd，只为编译
+#endif
+
+typedef void* (*usb_thread_fn)(void* arg);
+
+// 可以poll的定时器: 到期后fd可读，直到clear。模拟后端用它接入调用者的事件循环。
+// Linux为timerfd (纳秒精度)；其他POSIX为管道，只能立即触发，将来的到期时间靠调用者按超时等待；Windows不支持
+typedef struct {
+    int fd;
+    int write_fd;            // 管道实现的写端
+    int signalled;
+} usb_timer_fd_t;
+
+// 映射到内存的文件 (创建时预分配大小、读写共享映射；打开已有文件时只读)
+typedef struct {
+    unsigned char* addr;
+    size_t size;
+    int writable;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} usb_file_map_t;
+
+// 命名共享内存 (进程间读写共享映射)。POSIX为 shm_open("/名字")，Windows为页面文件支持的 "Local\\名字" 映射
+typedef struct {
+    unsigned char* addr;
+    size_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} usb_shm_map_t;
+
+// Threads
+int usb_thread_create(usb_thread_t* thread, usb_thread_fn fn, void* arg);
+void usb_thread_join(usb_thread_t thread);
+void usb_thread_yield(void);
+
+// CPU和调度 (低延迟模式)
+int usb_cpu_count(void);     // 可用的逻辑CPU数，至少为1
+void usb_cpu_relax(void);    // 自旋等待中的一次暂停 (x86 pause)，不让出CPU
+// 当前线程只在cpu_mask中的CPU上运行 (第i位为CPU i)，成功返回0，失败或平台不支持返回-1
+int usb_thread_set_affinity(uint64_t cpu_mask);
+// 当前线程使用实时调度: POSIX SCHED_FIFO 优先级priority (1-99)，Windows TIME_CRITICAL。
+// 成功返回0，没有权限返回-1
+int usb_thread_set_realtime(int priority);
+
+// 线程局部存储: 线程退出时对它设置过的非NULL值调用destructor (可以为NULL)。成功返回0，失败返回-1
+int usb_tls_create(usb_tls_t* key, void (*destructor)(void*));
+void* usb_tls_get(usb_tls_t key);
+void usb_tls_set(usb_tls_t key, void* value);
+
+// Mutex / condition variable
+void usb_mutex_init(usb_mutex_t* m);
+void usb_mutex_destroy(usb_mutex_t* m);
+void usb_mutex_lock(usb_mutex_t* m);
+int usb_mutex_trylock(usb_mutex_t* m);  // 成功返回1
+void usb_mutex_unlock(usb_mutex_t* m);
+void usb_cond_init(usb_cond_t* c);
+void usb_cond_destroy(usb_cond_t* c);
+void usb_cond_signal(usb_cond_t* c);
+void usb_cond_broadcast(usb_cond_t* c);
+void usb_cond_wait_until(usb_cond_t* c, usb_mutex_t* m, uint64_t deadline_ns);  // 单调时钟绝对时间
+
+// Clock
+uint64_t usb_time_ns(void);  // 单调时钟，纳秒
+uint32_t usb_time_ms(void);  // 单调时钟，毫秒 (替代 GetTickCount)
+void usb_sleep_ms(unsigned int ms);
+void usb_sleep_until_ns(uint64_t deadline_ns);
+uint64_t usb_cpu_time_ns(void);  // 本进程所有线程的用户态+内核态CPU时间，纳秒
+uint64_t usb_wall_time_ns(void);  // 墙上时间，1970-01-01 UTC 起的纳秒
+
+// Pollable timer
+// 成功返回0，失败 (或平台不支持) 返回-1
+int usb_timer_fd_create(usb_timer_fd_t* t);
+// 在单调时钟 deadline_ns 触发，已过期的立即触发，0表示取消
+void usb_timer_fd_arm(usb_timer_fd_t* t, uint64_t deadline_ns);
+// 读掉已触发的状态，fd不再可读 (不取消将来的到期时间)
+void usb_timer_fd_clear(usb_timer_fd_t* t);
+void usb_timer_fd_close(usb_timer_fd_t* t);
+
+// Aligned memory (alignment必须是2的幂)
+void* usb_aligned_alloc(size_t alignment, size_t size);
+void usb_aligned_free(void* ptr);
+
+// Memory-mapped file
+// 创建(覆盖)文件，预分配size字节并映射，成功返回0，失败返回-1
+int usb_file_map_create(usb_file_map_t* map, const char* path, size_t size);
+// 把 [offset, offset+length) 写回磁盘，wait为0时只发起写回不等待，失败返回-1
+int usb_file_map_flush(usb_file_map_t* map, size_t offset, size_t length, int wait);
+// 只读映射已有的文件 (不能为空)，成功返回0，失败返回-1
+int usb_file_map_open(usb_file_map_t* map, const char* path);
+// 解除映射并关闭，可写的映射先把文件截断到final_size
+void usb_file_map_close(usb_file_map_t* map, size_t final_size);
+size_t usb_page_size(void);
+
+// Shared memory
+// 创建size字节的共享内存并映射 (同名的旧对象先删除，已经映射它的进程不受影响)，成功返回0，失败返回-1
+int usb_shm_map_create(usb_shm_map_t* map, const char* name, size_t size);
+// 读写映射已有的共享内存，成功返回0，失败返回-1
+int usb_shm_map_open(usb_shm_map_t* map, const char* name);
+void usb_shm_map_close(usb_shm_map_t* map);
+// 删除名字 (已有的映射保持有效)；Windows在最后一个句柄关闭时自动删除
+void usb_shm_map_unlink(const char* name);
+
+// 进程间等待/唤醒共享内存中的32位字。Linux为futex，其他平台等待退化为短睡眠轮询
+// *addr 仍等于expected时等待，最多timeout_ns，被唤醒或超时返回
+void usb_futex_wait(void* addr, uint32_t expected, uint64_t timeout_ns);
+void usb_futex_wake(void* addr);
+
+// Processes
+int usb_process_id(void);
+int usb_process_alive(int pid);  // 进程仍存在返回1
+
+// Dynamic library
+usb_lib_t usb_lib_open(const char* path);
+void* usb_lib_sym(usb_lib_t lib, const char* name);
+void usb_lib_close(usb_lib_t lib);
+
+#endif // USB_PLATFORM_H
@@ -0,0 +1,137 @@
+#include <stdatomic.h>
+#include "usb_pool.h"
+
+#define CACHE_LINE 64
+
+// 每个缓冲区的管理信息，单独占一个缓存行，引用计数不会和相邻缓冲区伪共享
+typedef struct {
+    _Alignas(CACHE_LINE) usb_buffer_t buf;  // 必须是第一个成员
+    atomic_int refs;
+    atomic_uint next;                       // 空闲栈中下一个的序号+1，0表示栈底
+} pool_entry_t;
+
+struct usb_pool {
+    // 空闲栈顶: 高32位是版本号 (每次修改加1，防止ABA)，低32位是序号+1
+    _Alignas(CACHE_LINE) atomic_uint_least64_t head;
+    atomic_int available;
+    atomic_int low_water;
+    atomic_uint_least64_t gets;
+    atomic_uint_least64_t exhausted;
+
+    _Alignas(CACHE_LINE) pool_entry_t* entries;
+    unsigned char* memory;
+    int count;
+    int buffer_size;
+};
+
+static void pool_push(usb_pool_t* pool, pool_entry_t* e) {
+    uint32_t index = (uint32_t)(e - pool->entries) + 1;
+    uint64_t head = atomic_load_explicit(&pool->head, memory_order_relaxed);
+    uint64_t next;
+    do {
+        atomic_store_explicit(&e->next, (uint32_t)head, memory_order_relaxed);
+        next = (((head >> 32) + 1) << 32) | index;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->head, &head, next,
+                                                    memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&pool->available, 1, memory_order_relaxed);
+}
+
+static pool_entry_t* pool_pop(usb_pool_t* pool) {
+    uint64_t head = atomic_load_explicit(&pool->head, memory_order_acquire);
+    for (;;) {
+        uint32_t index = (uint32_t)head;
+        if (index == 0) {
+            return NULL;
+        }
+        pool_entry_t* e = &pool->entries[index - 1];
+        uint64_t next = (((head >> 32) + 1) << 32) | atomic_load_explicit(&e->next, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&pool->head, &head, next,
+                                                  memory_order_acquire, memory_order_acquire)) {
+            return e;
+        }
+    }
+}
+
+usb_pool_t* usb_pool_create(int count, int buffer_size, size_t alignment) {
+    if (count <= 0 || buffer_size <= 0) {
+        return NULL;
+    }
+    if (alignment == 0) alignment = usb_page_size();
+    if (alignment < CACHE_LINE) alignment = CACHE_LINE;
+    size_t stride = ((size_t)buffer_size + alignment - 1) & ~(alignment - 1);
+
+    usb_pool_t* pool = (usb_pool_t*)usb_aligned_alloc(CACHE_LINE, sizeof(usb_pool_t));
+    if (!pool) return NULL;
+    memset(pool, 0, sizeof(*pool));
+    pool->entries = (pool_entry_t*)usb_aligned_alloc(CACHE_LINE, sizeof(pool_entry_t) * (size_t)count);
+    pool->memory = (unsigned char*)usb_aligned_alloc(alignment, stride * (size_t)count);
+    if (!pool->entries || !pool->memory) {
+        usb_aligned_free(pool->entries);
+        usb_aligned_free(pool->memory);
+        usb_aligned_free(pool);
+        return NULL;
+    }
+    pool->count = count;
+    pool->buffer_size = (int)stride;
+
+    // 倒序压栈，第一次取到的是第0个
+    memset(pool->entries, 0, sizeof(pool_entry_t) * (size_t)count);
+    for (int i = count - 1; i >= 0; i--) {
+        pool_entry_t* e = &pool->entries[i];
+        e->buf.data = pool->memory + stride * (size_t)i;
+        e->buf.size = (int)stride;
+        e->buf.pool = pool;
+        atomic_init(&e->refs, 0);
+        pool_push(pool, e);
+    }
+    atomic_store(&pool->low_water, count);
+    return pool;
+}
+
+void usb_pool_destroy(usb_pool_t* pool) {
+    if (pool) {
+        usb_aligned_free(pool->memory);
+        usb_aligned_free(pool->entries);
+        usb_aligned_free(pool);
+    }
+}
+
+usb_buffer_t* usb_pool_get(usb_pool_t* pool) {
+    pool_entry_t* e = pool_pop(pool);
+    if (!e) {
+        atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+        return NULL;
+    }
+    atomic_fetch_add_explicit(&pool->gets, 1, memory_order_relaxed);
+    int available = atomic_fetch_sub_explicit(&pool->available, 1, memory_order_relaxed) - 1;
+    int low = atomic_load_explicit(&pool->low_water, memory_order_relaxed);
+    while (available < low && !atomic_compare_exchange_weak_explicit(&pool->low_water, &low, available,
+                                                                     memory_order_relaxed, memory_order_relaxed)) {
+    }
+
+    atomic_store_explicit(&e->refs, 1, memory_order_relaxed);
+    e->buf.length = 0;
+    e->buf.time_ns = 0;
+    return &e->buf;
+}
+
+void usb_buffer_ref(usb_buffer_t* buffer) {
+    atomic_fetch_add_explicit(&((pool_entry_t*)buffer)->refs, 1, memory_order_relaxed);
+}
+
+void usb_buffer_release(usb_buffer_t* buffer) {
+    pool_entry_t* e = (pool_entry_t*)buffer;
+    // acq_rel: 其他持有者对数据的读取发生在缓冲区被重新填充之前
+    if (atomic_fetch_sub_explicit(&e->refs, 1, memory_order_acq_rel) == 1) {
+        pool_push(buffer->pool, e);
+    }
+}
+
+void usb_pool_get_stats(usb_pool_t* pool, usb_pool_stats_t* stats) {
+    stats->count = pool->count;
+    stats->buffer_size = pool->buffer_size;
+    stats->available = atomic_load_explicit(&pool->available, memory_order_relaxed);
+    stats->low_water = atomic_load_explicit(&pool->low_water, memory_order_relaxed);
+    stats->gets = atomic_load_explicit(&pool->gets, memory_order_relaxed);
+    stats->exhausted = atomic_load_explicit(&pool->exhausted, memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#ifndef USB_POOL_H
+#define USB_POOL_H
+
+#include "usb_control.h"
+
+// 传输缓冲区池: 固定数量、固定大小、按页(或指定边界)对齐的缓冲区，创建时一次分配。
+// 缓冲区带引用计数，可以同时交给多个消费者 (落盘、统计、解码) 而不复制，
+// 最后一个持有者释放后回到池中。取/还是无锁的 (带版本号的空闲栈)，可以在任意线程调用。
+
+typedef struct usb_pool usb_pool_t;
+
+typedef struct {
+    unsigned char* data;     // 对齐的数据区
+    int size;                // 容量
+    int length;              // 有效数据长度，由填充者设置
+    uint64_t time_ns;        // 填充完成的时间，由填充者设置 (流式读取为传输完成时间)
+    usb_pool_t* pool;
+} usb_buffer_t;
+
+typedef struct {
+    int count;               // 缓冲区总数
+    int buffer_size;
+    int available;           // 当前空闲的缓冲区数
+    int low_water;           // 空闲数的最小值
+    uint64_t gets;           // 成功取得的次数
+    uint64_t exhausted;      // 池已空、取不到缓冲区的次数
+} usb_pool_stats_t;
+
+// alignment为0时按页对齐，buffer_size向上取整为alignment的整数倍
+usb_pool_t* usb_pool_create(int count, int buffer_size, size_t alignment);
+// 所有缓冲区都已释放后才能销毁
+void usb_pool_destroy(usb_pool_t* pool);
+
+// 取一个缓冲区，引用计数为1；池已空返回NULL
+usb_buffer_t* usb_pool_get(usb_pool_t* pool);
+// 增加一个持有者
+void usb_buffer_ref(usb_buffer_t* buffer);
+// 减少一个持有者，最后一个释放时回到池中
+void usb_buffer_release(usb_buffer_t* buffer);
+
+void usb_pool_get_stats(usb_pool_t* pool, usb_pool_stats_t* stats);
+
+#endif // USB_POOL_H
@@ -0,0 +1,114 @@
+#include "usb_reader.h"
+
+struct usb_reader {
+    usb_stream_t* stream;
+    usb_ring_t* ring;
+    usb_integrity_t* integrity;
+};
+
+// 完整性的计数器来源: 环形缓冲区丢弃的传输数
+static uint64_t reader_dropped(void* ctx) {
+    usb_ring_stats_t stats;
+    usb_ring_get_stats(((usb_reader_t*)ctx)->ring, &stats);
+    return stats.dropped;
+}
+
+// 在事件线程中执行: 只做一次复制进入环形缓冲区
+static void reader_stream_cb(const unsigned char* data, int length, void* user_data) {
+    usb_reader_t* reader = (usb_reader_t*)user_data;
+    usb_ring_push(reader->ring, data, length);
+}
+
+/* 启动读取线程 */
+int usb_reader_start(usb_reader_t** reader, usb_device_t* device, const usb_reader_config_t* cfg) {
+    usb_reader_config_t c;
+    if (reader == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    memset(&c, 0, sizeof(c));
+    if (cfg) c = *cfg;
+    if (c.stream.transfer_size <= 0) c.stream.transfer_size = USB_STREAM_DEFAULT_SIZE;
+    if (c.ring_slots <= 0) c.ring_slots = USB_READER_DEFAULT_SLOTS;
+    if (c.low_latency) c.stream.busy_poll = 1;
+    // 与流一样按最大包长向上对齐，保证一个传输总能放进一个槽
+    int packet_size = usb_device_get_max_packet_size(device);
+    if (packet_size > 0) {
+        c.stream.transfer_size = (c.stream.transfer_size + packet_size - 1) / packet_size * packet_size;
+    }
+
+    usb_reader_t* r = (usb_reader_t*)calloc(1, sizeof(usb_reader_t));
+    if (!r) return LIBUSB_ERROR_NO_MEM;
+
+    r->ring = usb_ring_create(c.ring_slots, c.stream.transfer_size, c.policy);
+    if (!r->ring) {
+        free(r);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    usb_ring_set_spin(r->ring, c.low_latency);
+
+    // 环形缓冲区的丢弃只在出现缺口时读取
+    r->integrity = c.stream.integrity;
+    if (r->integrity) {
+        usb_integrity_add_source(r->integrity, USB_LOSS_HOST, reader_dropped, r);
+    }
+
+    int ret = usb_stream_start(&r->stream, device, &c.stream, reader_stream_cb, r);
+    if (ret < 0) {
+        usb_integrity_remove_source(r->integrity, r);
+        usb_ring_destroy(r->ring);
+        free(r);
+        return ret;
+    }
+
+    *reader = r;
+    return 0;
+}
+
+/* 停止读取线程 */
+int usb_reader_stop(usb_reader_t* reader) {
+    if (!reader) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    // 先关闭环形缓冲区，让阻塞在push上的事件线程退出
+    usb_ring_close(reader->ring);
+    int r = usb_stream_stop(reader->stream);
+    usb_integrity_remove_source(reader->integrity, reader);
+    usb_ring_destroy(reader->ring);
+    free(reader);
+    return r;
+}
+
+int usb_reader_read(usb_reader_t* reader, unsigned char* data, int length, int* transferred, unsigned int timeout_ms) {
+    *transferred = 0;
+    int r = usb_ring_pop(reader->ring, data, length, timeout_ms);
+    if (r < 0) {
+        return r;
+    }
+    *transferred = r;
+    return 0;
+}
+
+int usb_reader_peek(usb_reader_t* reader, const unsigned char** data, int* transferred, unsigned int timeout_ms) {
+    *transferred = 0;
+    int r = usb_ring_peek(reader->ring, data, timeout_ms);
+    if (r < 0) {
+        return r;
+    }
+    *transferred = r;
+    return 0;
+}
+
+void usb_reader_release(usb_reader_t* reader) {
+    usb_ring_release(reader->ring);
+}
+
+void usb_reader_get_stats(usb_reader_t* reader, usb_stream_stats_t* stream_stats, usb_ring_stats_t* ring_stats) {
+    if (stream_stats) {
+        usb_stream_get_stats(reader->stream, stream_stats);
+    }
+    if (ring_stats) {
+        usb_ring_get_stats(reader->ring, ring_stats);
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef USB_READER_H
+#define USB_READER_H
+
+#include "usb_stream.h"
+#include "usb_ring.h"
+
+// 独立读取线程: 流式读取的事件线程把完成的传输放入SPSC环形缓冲区，
+// 消费者在自己的线程中取数据，处理慢也不会拖慢总线读取。
+//
+// 低延迟模式 (low_latency，闭环控制等更在意 到达->交给消费者 的延迟而不在意CPU的场合):
+// 事件线程忙轮询完成事件 (stream.busy_poll)，消费者在 usb_reader_read/peek 中自旋等待，
+// 路径上没有线程睡眠和唤醒。两个线程各占满一个CPU，应该分开绑定:
+// stream.cpu_mask 绑定事件线程，消费者线程自己调用 usb_thread_set_affinity；
+// stream.realtime 让事件线程不被其他线程抢占。单核时两边的自旋都改为让出CPU，延迟收益有限。
+
+typedef struct usb_reader usb_reader_t;
+
+typedef struct {
+    usb_stream_config_t stream;  // 传输数量和大小；stream.integrity 非NULL时环形缓冲区的丢弃记为 USB_LOSS_HOST
+    int ring_slots;              // 环形缓冲区槽数，每槽一个传输
+    usb_ring_policy_t policy;    // 缓冲区满时的处理策略
+    int low_latency;             // 低延迟模式: 设置 stream.busy_poll，读取时自旋等待
+} usb_reader_config_t;
+
+#define USB_READER_DEFAULT_SLOTS 256
+
+// device为NULL时使用USB_OpenDevice打开的设备
+int usb_reader_start(usb_reader_t** reader, usb_device_t* device, const usb_reader_config_t* cfg);
+int usb_reader_stop(usb_reader_t* reader);
+
+// 读取一个传输的数据，返回值同 usb_control_read
+int usb_reader_read(usb_reader_t* reader, unsigned char* data, int length, int* transferred, unsigned int timeout_ms);
+// 零拷贝读取，处理完后调用 usb_reader_release (DROP_OLDEST策略不支持)
+int usb_reader_peek(usb_reader_t* reader, const unsigned char** data, int* transferred, unsigned int timeout_ms);
+void usb_reader_release(usb_reader_t* reader);
+
+void usb_reader_get_stats(usb_reader_t* reader, usb_stream_stats_t* stream_stats, usb_ring_stats_t* ring_stats);
+
+#endif // USB_READER_H
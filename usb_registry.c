@@ -0,0 +1,426 @@
+#include "usb_internal.h"
+#include "usb_registry.h"
+#include "usb_trace.h"
+
+typedef struct {
+    libusb_device* dev;             // 已引用
+    usb_registry_entry_t info;
+    int fetched;                    // 序列号: 0 未读取, 1 已读取, 2 读取失败 (不再重试)
+    int busy;                       // 有线程正在读取
+} reg_entry_t;
+
+static libusb_context* reg_ctx = NULL;
+static usb_mutex_t reg_lock;
+static int reg_initialized = 0;
+static int reg_hotplug = 0;         // 平台支持热插拔
+static libusb_hotplug_callback_handle reg_hotplug_handle;
+
+static reg_entry_t* reg_entries = NULL;
+static int reg_count = 0;
+static int reg_capacity = 0;
+
+// 开放寻址哈希表，保存 entry下标+1 (0表示空)
+static int* reg_path_hash = NULL;
+static int* reg_serial_hash = NULL;
+static uint32_t reg_hash_mask = 0;
+
+static uint32_t hash_string(const char* s) {
+    uint32_t h = 2166136261u;  // FNV-1a
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 重建两个索引，插入/删除/读取描述符后调用，调用时持有 reg_lock
+static void reg_rebuild_index(void) {
+    uint32_t size = 16;
+    while (size < (uint32_t)reg_count * 2) size <<= 1;
+
+    if (size - 1 != reg_hash_mask || !reg_path_hash) {
+        free(reg_path_hash);
+        free(reg_serial_hash);
+        reg_path_hash = (int*)malloc(size * sizeof(int));
+        reg_serial_hash = (int*)malloc(size * sizeof(int));
+        reg_hash_mask = size - 1;
+    }
+    if (!reg_path_hash || !reg_serial_hash) {
+        reg_hash_mask = 0;
+        return;
+    }
+    memset(reg_path_hash, 0, size * sizeof(int));
+    memset(reg_serial_hash, 0, size * sizeof(int));
+
+    for (int i = 0; i < reg_count; i++) {
+        uint32_t h = hash_string(reg_entries[i].info.path) & reg_hash_mask;
+        while (reg_path_hash[h]) h = (h + 1) & reg_hash_mask;
+        reg_path_hash[h] = i + 1;
+
+        if (reg_entries[i].fetched && reg_entries[i].info.serial[0]) {
+            h = hash_string(reg_entries[i].info.serial) & reg_hash_mask;
+            while (reg_serial_hash[h]) h = (h + 1) & reg_hash_mask;
+            reg_serial_hash[h] = i + 1;
+        }
+    }
+}
+
+static int reg_lookup_path(const char* path) {
+    if (!reg_path_hash) return -1;
+    for (uint32_t h = hash_string(path) & reg_hash_mask; reg_path_hash[h]; h = (h + 1) & reg_hash_mask) {
+        int i = reg_path_hash[h] - 1;
+        if (strcmp(reg_entries[i].info.path, path) == 0) return i;
+    }
+    return -1;
+}
+
+static int reg_lookup_serial(const char* serial) {
+    if (!reg_serial_hash) return -1;
+    for (uint32_t h = hash_string(serial) & reg_hash_mask; reg_serial_hash[h]; h = (h + 1) & reg_hash_mask) {
+        int i = reg_serial_hash[h] - 1;
+        if (strcmp(reg_entries[i].info.serial, serial) == 0) return i;
+    }
+    return -1;
+}
+
+static void device_path(libusb_device* dev, char* path, int length) {
+    uint8_t ports[8];
+    int n = usb_transport->get_port_numbers(dev, ports, (int)sizeof(ports));
+    int pos = snprintf(path, (size_t)length, "%d", usb_transport->get_bus_number(dev));
+    for (int i = 0; i < n && pos < length; i++) {
+        pos += snprintf(path + pos, (size_t)(length - pos), i == 0 ? "-%d" : ".%d", ports[i]);
+    }
+}
+
+// 调用时持有 reg_lock
+static void reg_add(libusb_device* dev, const struct libusb_device_descriptor* desc) {
+    char path[USB_PATH_LENGTH];
+    device_path(dev, path, sizeof(path));
+
+    int i = reg_lookup_path(path);
+    if (i >= 0) {
+        if (reg_entries[i].dev == dev) {
+            return;
+        }
+        // 同一路径上换了一台设备
+        usb_transport->unref_device(reg_entries[i].dev);
+    } else {
+        if (reg_count == reg_capacity) {
+            int capacity = reg_capacity ? reg_capacity * 2 : MAX_DEVICES;
+            reg_entry_t* entries = (reg_entry_t*)realloc(reg_entries, (size_t)capacity * sizeof(reg_entry_t));
+            if (!entries) return;
+            reg_entries = entries;
+            reg_capacity = capacity;
+        }
+        i = reg_count++;
+    }
+
+    reg_entry_t* e = &reg_entries[i];
+    memset(e, 0, sizeof(*e));
+    e->dev = usb_transport->ref_device(dev);
+    snprintf(e->info.path, sizeof(e->info.path), "%s", path);
+    e->info.vid = desc->idVendor;
+    e->info.pid = desc->idProduct;
+    reg_rebuild_index();
+}
+
+// 调用时持有 reg_lock
+static void reg_remove(int i) {
+    usb_transport->unref_device(reg_entries[i].dev);
+    reg_entries[i] = reg_entries[--reg_count];
+    reg_rebuild_index();
+}
+
+static int reg_hotplug_cb(libusb_context* ctx, libusb_device* dev, libusb_hotplug_event event, void* user_data) {
+    (void)ctx;
+    (void)user_data;
+    usb_mutex_lock(&reg_lock);
+    if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+        struct libusb_device_descriptor desc;
+        if (usb_transport->get_device_descriptor(dev, &desc) == 0) {
+            reg_add(dev, &desc);
+        }
+    } else {
+        for (int i = 0; i < reg_count; i++) {
+            if (reg_entries[i].dev == dev) {
+                reg_remove(i);
+                break;
+            }
+        }
+    }
+    usb_mutex_unlock(&reg_lock);
+    return 0;
+}
+
+// 不支持热插拔时: 重新列出设备，增删缓存，已知路径不再打开
+static int reg_rescan(void) {
+    libusb_device** devs;
+    ssize_t cnt = usb_transport->get_device_list(reg_ctx, &devs);
+    if (cnt < 0) {
+        USB_TRACE(DEVICE_LIST_FAILED, cnt);
+        return (int)cnt;
+    }
+
+    usb_mutex_lock(&reg_lock);
+    char* seen = (char*)calloc((size_t)reg_count + (size_t)cnt + 1, 1);
+    for (ssize_t k = 0; k < cnt; k++) {
+        struct libusb_device_descriptor desc;
+        if (usb_transport->get_device_descriptor(devs[k], &desc) < 0) continue;
+        if (desc.idVendor != VENDOR_ID || desc.idProduct != PRODUCT_ID) continue;
+        reg_add(devs[k], &desc);
+        for (int i = 0; i < reg_count; i++) {
+            if (reg_entries[i].dev == devs[k] && seen) seen[i] = 1;
+        }
+    }
+    for (int i = reg_count - 1; seen && i >= 0; i--) {
+        if (!seen[i]) {
+            reg_remove(i);
+        }
+    }
+    free(seen);
+    usb_mutex_unlock(&reg_lock);
+
+    usb_transport->free_device_list(devs, 1);
+    return 0;
+}
+
+// 需要读取描述符的条目，调用时持有 reg_lock
+static int reg_needs_fetch(const reg_entry_t* e, int strings) {
+    return !e->busy && (e->fetched == 0 || (strings && e->fetched == 1 && !e->info.strings));
+}
+
+// 打开设备读取序列号和/或厂商/产品字符串，在锁外进行控制传输。调用前条目已标记为busy
+static void reg_fetch_one(libusb_device* dev, int need_serial, int need_strings) {
+    struct libusb_device_descriptor desc;
+    usb_registry_entry_t info;
+    libusb_device_handle* handle;
+
+    memset(&info, 0, sizeof(info));
+    int r = usb_transport->get_device_descriptor(dev, &desc);
+    if (r == 0) {
+        r = usb_transport->open(dev, &handle);
+    }
+    if (r == 0) {
+        if (need_strings && desc.iManufacturer)
+            usb_transport->get_string_descriptor_ascii(handle, desc.iManufacturer, (unsigned char*)info.manufacturer, sizeof(info.manufacturer));
+        if (need_strings && desc.iProduct)
+            usb_transport->get_string_descriptor_ascii(handle, desc.iProduct, (unsigned char*)info.product, sizeof(info.product));
+        if (need_serial && desc.iSerialNumber)
+            r = usb_transport->get_string_descriptor_ascii(handle, desc.iSerialNumber, (unsigned char*)info.serial, sizeof(info.serial));
+        usb_transport->close(handle);
+    }
+    if (r < 0) {
+        USB_TRACE(DESCRIPTORS_FAILED, r);
+    }
+
+    usb_mutex_lock(&reg_lock);
+    for (int i = 0; i < reg_count; i++) {
+        if (reg_entries[i].dev == dev) {
+            reg_entry_t* e = &reg_entries[i];
+            if (need_serial) {
+                memcpy(e->info.serial, info.serial, sizeof(info.serial));
+                e->fetched = r < 0 ? 2 : 1;
+            }
+            if (need_strings) {
+                memcpy(e->info.manufacturer, info.manufacturer, sizeof(info.manufacturer));
+                memcpy(e->info.product, info.product, sizeof(info.product));
+                e->info.strings = 1;  // 失败时留空，不再重试
+            }
+            e->busy = 0;
+            if (need_serial) {
+                reg_rebuild_index();
+            }
+            break;
+        }
+    }
+    usb_mutex_unlock(&reg_lock);
+}
+
+// 逐个取出需要读取的条目，直到没有为止。多个线程同时调用时各自取不同的条目
+static void reg_fetch_pending(int strings) {
+    for (;;) {
+        libusb_device* dev = NULL;
+        int need_serial = 0;
+
+        usb_mutex_lock(&reg_lock);
+        for (int i = 0; i < reg_count; i++) {
+            if (reg_needs_fetch(&reg_entries[i], strings)) {
+                dev = usb_transport->ref_device(reg_entries[i].dev);
+                need_serial = reg_entries[i].fetched == 0;
+                reg_entries[i].busy = 1;
+                break;
+            }
+        }
+        usb_mutex_unlock(&reg_lock);
+        if (!dev) {
+            return;
+        }
+        reg_fetch_one(dev, need_serial, strings);
+        usb_transport->unref_device(dev);
+    }
+}
+
+static void* reg_fetch_thread(void* arg) {
+    reg_fetch_pending(*(const int*)arg);
+    return NULL;
+}
+
+// 待读取的设备多于一台时，另外启动线程一起读取，调用线程也参与
+static void reg_fetch_parallel(int strings) {
+    usb_thread_t threads[USB_REGISTRY_FETCH_THREADS];
+    int jobs = 0;
+    int n = 0;
+
+    usb_mutex_lock(&reg_lock);
+    for (int i = 0; i < reg_count; i++) {
+        jobs += reg_needs_fetch(&reg_entries[i], strings);
+    }
+    usb_mutex_unlock(&reg_lock);
+
+    while (n < jobs - 1 && n < USB_REGISTRY_FETCH_THREADS - 1) {
+        if (usb_thread_create(&threads[n], reg_fetch_thread, &strings) != 0) {
+            break;  // 少几个线程只是慢一些
+        }
+        n++;
+    }
+    reg_fetch_pending(strings);
+    for (int i = 0; i < n; i++) {
+        usb_thread_join(threads[i]);
+    }
+}
+
+// 非阻塞地分发已经产生的热插拔事件
+static void reg_pump_events(void) {
+    if (reg_hotplug) {
+        struct timeval tv = {0, 0};
+        usb_transport->handle_events_timeout_completed(reg_ctx, &tv, NULL);
+    } else {
+        reg_rescan();
+    }
+}
+
+int usb_registry_init(libusb_context* ctx) {
+    reg_ctx = ctx;
+    usb_mutex_init(&reg_lock);
+    reg_initialized = 1;
+    reg_hotplug = 0;
+
+    if (usb_transport->hotplug_register_callback) {
+        int r = usb_transport->hotplug_register_callback(ctx,
+            LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+            LIBUSB_HOTPLUG_ENUMERATE, VENDOR_ID, PRODUCT_ID, LIBUSB_HOTPLUG_MATCH_ANY,
+            reg_hotplug_cb, NULL, &reg_hotplug_handle);
+        reg_hotplug = r == 0;
+    }
+    if (!reg_hotplug) {
+        return reg_rescan();
+    }
+    return 0;
+}
+
+void usb_registry_exit(void) {
+    if (!reg_initialized) {
+        return;
+    }
+    if (reg_hotplug) {
+        usb_transport->hotplug_deregister_callback(reg_ctx, reg_hotplug_handle);
+    }
+    for (int i = 0; i < reg_count; i++) {
+        usb_transport->unref_device(reg_entries[i].dev);
+    }
+    free(reg_entries);
+    free(reg_path_hash);
+    free(reg_serial_hash);
+    reg_entries = NULL;
+    reg_path_hash = reg_serial_hash = NULL;
+    reg_count = reg_capacity = 0;
+    reg_hash_mask = 0;
+    usb_mutex_destroy(&reg_lock);
+    reg_initialized = 0;
+}
+
+int usb_registry_refresh(void) {
+    return usb_registry_refresh_ex(1);
+}
+
+int usb_registry_refresh_ex(int strings) {
+    reg_pump_events();
+    reg_fetch_parallel(strings);
+    return usb_registry_count();
+}
+
+int usb_registry_fetch_strings(const char* serial, usb_registry_entry_t* entry) {
+    libusb_device* dev = NULL;
+    int i;
+
+    usb_mutex_lock(&reg_lock);
+    i = reg_lookup_serial(serial);
+    if (i >= 0 && !reg_entries[i].info.strings && !reg_entries[i].busy) {
+        dev = usb_transport->ref_device(reg_entries[i].dev);
+        reg_entries[i].busy = 1;
+    }
+    usb_mutex_unlock(&reg_lock);
+    if (i < 0) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    if (dev) {
+        reg_fetch_one(dev, 0, 1);
+        usb_transport->unref_device(dev);
+    }
+
+    // 条目可能在读取期间移动了位置 (其他设备拔出)，重新查找
+    usb_mutex_lock(&reg_lock);
+    i = reg_lookup_serial(serial);
+    if (i >= 0) {
+        *entry = reg_entries[i].info;
+    }
+    usb_mutex_unlock(&reg_lock);
+    return i >= 0 ? 0 : LIBUSB_ERROR_NOT_FOUND;
+}
+
+int usb_registry_count(void) {
+    usb_mutex_lock(&reg_lock);
+    int n = reg_count;
+    usb_mutex_unlock(&reg_lock);
+    return n;
+}
+
+int usb_registry_get(int index, usb_registry_entry_t* entry) {
+    int r = LIBUSB_ERROR_NOT_FOUND;
+    usb_mutex_lock(&reg_lock);
+    if (index >= 0 && index < reg_count) {
+        *entry = reg_entries[index].info;
+        r = 0;
+    }
+    usb_mutex_unlock(&reg_lock);
+    return r;
+}
+
+libusb_device* usb_registry_find(const char* serial, char* serial_out, int serial_length) {
+    libusb_device* dev = NULL;
+
+    // 先查缓存，找不到再处理热插拔事件和新设备
+    for (int pass = 0; pass < 2 && !dev; pass++) {
+        if (pass == 1) {
+            usb_registry_refresh_ex(0);  // 打开只需要序列号
+        }
+        usb_mutex_lock(&reg_lock);
+        int i = -1;
+        if (serial) {
+            i = reg_lookup_serial(serial);
+        } else {
+            for (int k = 0; k < reg_count; k++) {
+                if (reg_entries[k].fetched == 1) {
+                    i = k;
+                    break;
+                }
+            }
+        }
+        if (i >= 0) {
+            dev = usb_transport->ref_device(reg_entries[i].dev);
+            if (serial_out) snprintf(serial_out, (size_t)serial_length, "%s", reg_entries[i].info.serial);
+        }
+        usb_mutex_unlock(&reg_lock);
+    }
+    return dev;
+}
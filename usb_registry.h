@@ -0,0 +1,35 @@
+#ifndef USB_REGISTRY_H
+#define USB_REGISTRY_H
+
+#include "usb_control.h"
+
+// 设备注册表: 缓存 VID/PID/序列号/厂商/产品，按总线/端口路径索引。
+// 通过热插拔事件保持更新，只有新插入的设备才需要打开读取字符串描述符；
+// 按序列号查找是O(1)的，不会打开其他设备。
+// 平台不支持热插拔时 (例如Windows)，刷新时重新列出设备，但已缓存的路径不会再打开。
+// 新设备的描述符由多个线程同时读取 (每台设备的控制传输是串行的，设备之间并行)，
+// 厂商/产品字符串可以推迟到需要时再读 (usb_registry_refresh_ex(0) + usb_registry_fetch_strings)。
+
+#define USB_PATH_LENGTH 32
+#define USB_REGISTRY_FETCH_THREADS 16  // 同时读取描述符的最大线程数 (包括调用线程)
+
+typedef struct {
+    char path[USB_PATH_LENGTH];        // "总线-端口.端口..."
+    uint16_t vid;
+    uint16_t pid;
+    char serial[MAX_STR_LENGTH];
+    char manufacturer[MAX_STR_LENGTH];
+    char product[MAX_STR_LENGTH];
+    int strings;                       // 厂商/产品字符串已读取
+} usb_registry_entry_t;
+
+// 分发挂起的热插拔事件，并读取新设备的描述符；返回缓存的设备数量
+int usb_registry_refresh(void);
+// 同上，strings为0时新设备只读取序列号，厂商/产品留空
+int usb_registry_refresh_ex(int strings);
+// 读取设备的厂商/产品字符串 (已经读取过时直接返回缓存)，找不到序列号返回 LIBUSB_ERROR_NOT_FOUND
+int usb_registry_fetch_strings(const char* serial, usb_registry_entry_t* entry);
+int usb_registry_count(void);
+int usb_registry_get(int index, usb_registry_entry_t* entry);
+
+#endif // USB_REGISTRY_H
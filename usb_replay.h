@@ -0,0 +1,24 @@
+#ifndef USB_REPLAY_H
+#define USB_REPLAY_H
+
+#include "usb_control.h"
+
+// 回放后端: 把采集文件 (usb_capture.h) 作为设备提供给库，打开、读取、流式读取和真实设备完全相同。
+// 采集中的每个序列号是一台设备，VID/PID与真实设备相同；每条记录回放为一次传输
+// (读取长度不够时分成多次，剩下的留给下一次读取)。
+// 收到打开命令(0x01)时从头开始回放。
+typedef struct {
+    const char* path;        // 段文件路径前缀，同 usb_capture_config_t.path
+    double speed;            // 1.0 按原始时间，2.0 两倍速；0 尽可能快 (只受消费者限制)
+    int loop;                // 读完后从头再来，否则之后的读取超时
+} usb_replay_config_t;
+
+#define USB_REPLAY_PACKET 512
+
+// 使用采集文件代替libusb DLL初始化
+int usb_control_init_replay(const usb_replay_config_t* cfg);
+
+// 所有开始回放的设备都已读完 (loop时永远为0)
+int usb_replay_finished(void);
+
+#endif // USB_REPLAY_H
@@ -0,0 +1,249 @@
+#include <stdatomic.h>
+#include "usb_ring.h"
+
+#define CACHE_LINE 64
+
+struct usb_ring {
+    // 生产者独占的缓存行
+    _Alignas(CACHE_LINE) atomic_uint_least64_t head;
+    uint64_t cached_tail;
+
+    // 消费者独占的缓存行 (DROP_OLDEST时生产者也会CAS推进tail)
+    _Alignas(CACHE_LINE) atomic_uint_least64_t tail;
+    uint64_t cached_head;
+
+    // 只读配置
+    _Alignas(CACHE_LINE) uint32_t capacity;
+    uint32_t mask;
+    int slot_size;
+    size_t stride;
+    usb_ring_policy_t policy;
+    int spin;                // 0 让出+休眠, 1 自旋让出CPU (单核), 2 cpu pause
+    unsigned char* slots;
+    atomic_int closed;
+
+    // 生产者更新的统计
+    _Alignas(CACHE_LINE) atomic_uint_least64_t dropped;
+    atomic_uint_least64_t dropped_bytes;
+    atomic_uint high_water;
+};
+
+// 槽布局: [int32 长度][数据]，按缓存行对齐
+static inline unsigned char* ring_slot(usb_ring_t* ring, uint64_t index) {
+    return ring->slots + (size_t)(index & ring->mask) * ring->stride;
+}
+
+// 先让出CPU几次，之后短暂休眠；自旋模式不休眠
+static void ring_backoff(usb_ring_t* ring, int* spins) {
+    if (ring->spin == 2) {
+        usb_cpu_relax();
+    } else if (ring->spin == 1 || ++(*spins) < 64) {
+        usb_thread_yield();
+    } else {
+        usb_sleep_until_ns(usb_time_ns() + 50000);
+    }
+}
+
+usb_ring_t* usb_ring_create(int slots, int slot_size, usb_ring_policy_t policy) {
+    if (slots <= 0 || slot_size <= 0) {
+        return NULL;
+    }
+
+    uint32_t capacity = 1;
+    while (capacity < (uint32_t)slots) capacity <<= 1;
+
+    usb_ring_t* ring = (usb_ring_t*)usb_aligned_alloc(CACHE_LINE, sizeof(usb_ring_t));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(*ring));
+
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->slot_size = slot_size;
+    ring->stride = (sizeof(int32_t) + (size_t)slot_size + CACHE_LINE - 1) & ~(size_t)(CACHE_LINE - 1);
+    ring->policy = policy;
+    ring->slots = (unsigned char*)usb_aligned_alloc(CACHE_LINE, ring->stride * capacity);
+    if (!ring->slots) {
+        usb_aligned_free(ring);
+        return NULL;
+    }
+    return ring;
+}
+
+void usb_ring_destroy(usb_ring_t* ring) {
+    if (ring) {
+        usb_aligned_free(ring->slots);
+        usb_aligned_free(ring);
+    }
+}
+
+void usb_ring_close(usb_ring_t* ring) {
+    atomic_store(&ring->closed, 1);
+}
+
+void usb_ring_set_spin(usb_ring_t* ring, int spin) {
+    ring->spin = !spin ? 0 : usb_cpu_count() < 2 ? 1 : 2;
+}
+
+// 槽数据为 header + data，总长超过槽大小时截断data
+static int ring_push(usb_ring_t* ring, const void* header, int header_length, const unsigned char* data, int length) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    int spins = 0;
+
+    if (header_length > ring->slot_size) {
+        header_length = ring->slot_size;
+    }
+    if (length > ring->slot_size - header_length) {
+        length = ring->slot_size - header_length;
+    }
+    length += header_length;
+
+    while (head - ring->cached_tail >= ring->capacity) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail < ring->capacity) {
+            break;
+        }
+
+        if (ring->policy == USB_RING_DROP_NEWEST) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            atomic_fetch_add_explicit(&ring->dropped_bytes, (uint64_t)length, memory_order_relaxed);
+            return LIBUSB_ERROR_OVERFLOW;
+        }
+        if (ring->policy == USB_RING_DROP_OLDEST) {
+            // 和消费者竞争最旧的槽，CAS成功表示该槽被丢弃
+            uint64_t tail = ring->cached_tail;
+            int32_t old_length;
+            memcpy(&old_length, ring_slot(ring, tail), sizeof(old_length));
+            if (atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + 1,
+                                                        memory_order_acq_rel, memory_order_acquire)) {
+                atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+                atomic_fetch_add_explicit(&ring->dropped_bytes, (uint64_t)old_length, memory_order_relaxed);
+                ring->cached_tail = tail + 1;
+            } else {
+                ring->cached_tail = tail;
+            }
+            continue;
+        }
+        if (atomic_load_explicit(&ring->closed, memory_order_relaxed)) {
+            return LIBUSB_ERROR_INTERRUPTED;
+        }
+        ring_backoff(ring, &spins);
+    }
+
+    unsigned char* slot = ring_slot(ring, head);
+    int32_t len32 = length;
+    memcpy(slot, &len32, sizeof(len32));
+    if (header_length > 0) {
+        memcpy(slot + sizeof(int32_t), header, (size_t)header_length);
+    }
+    memcpy(slot + sizeof(int32_t) + header_length, data, (size_t)(length - header_length));
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    // 每个传输只读一次消费者索引，开销可以忽略
+    uint32_t count = (uint32_t)(head + 1 - atomic_load_explicit(&ring->tail, memory_order_relaxed));
+    if (count > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, count, memory_order_relaxed);
+    }
+    return 0;
+}
+
+int usb_ring_push(usb_ring_t* ring, const unsigned char* data, int length) {
+    return ring_push(ring, NULL, 0, data, length);
+}
+
+int usb_ring_push_header(usb_ring_t* ring, const void* header, int header_length, const unsigned char* data, int length) {
+    return ring_push(ring, header, header_length, data, length);
+}
+
+// 等待至少一个槽可读，返回当前tail
+static int ring_wait(usb_ring_t* ring, uint64_t* tail_out, unsigned int timeout_ms) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint64_t deadline = 0;
+    int spins = 0;
+
+    // DROP_OLDEST时生产者可能把tail推过cached_head，所以用>=判断
+    while (tail >= ring->cached_head) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail < ring->cached_head) {
+            break;
+        }
+        if (atomic_load_explicit(&ring->closed, memory_order_relaxed)) {
+            return LIBUSB_ERROR_INTERRUPTED;
+        }
+        if (timeout_ms == 0) {
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        if (deadline == 0) {
+            deadline = usb_time_ns() + (uint64_t)timeout_ms * 1000000ull;
+        } else if (usb_time_ns() >= deadline) {
+            return LIBUSB_ERROR_TIMEOUT;
+        }
+        ring_backoff(ring, &spins);
+        tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    }
+    *tail_out = tail;
+    return 0;
+}
+
+int usb_ring_pop(usb_ring_t* ring, unsigned char* data, int max_length, unsigned int timeout_ms) {
+    for (;;) {
+        uint64_t tail;
+        int r = ring_wait(ring, &tail, timeout_ms);
+        if (r < 0) {
+            return r;
+        }
+
+        const unsigned char* slot = ring_slot(ring, tail);
+        int32_t length;
+        memcpy(&length, slot, sizeof(length));
+        if (length > max_length) length = max_length;
+        memcpy(data, slot + sizeof(int32_t), (size_t)length);
+
+        if (ring->policy != USB_RING_DROP_OLDEST) {
+            atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+            return length;
+        }
+        // 复制期间槽可能被生产者覆盖，CAS失败说明数据已丢弃，重新读取
+        if (atomic_compare_exchange_strong_explicit(&ring->tail, &tail, tail + 1,
+                                                    memory_order_acq_rel, memory_order_acquire)) {
+            return length;
+        }
+    }
+}
+
+int usb_ring_peek(usb_ring_t* ring, const unsigned char** data, unsigned int timeout_ms) {
+    if (ring->policy == USB_RING_DROP_OLDEST) {
+        return LIBUSB_ERROR_NOT_SUPPORTED;
+    }
+
+    uint64_t tail;
+    int r = ring_wait(ring, &tail, timeout_ms);
+    if (r < 0) {
+        return r;
+    }
+
+    const unsigned char* slot = ring_slot(ring, tail);
+    int32_t length;
+    memcpy(&length, slot, sizeof(length));
+    *data = slot + sizeof(int32_t);
+    return length;
+}
+
+void usb_ring_release(usb_ring_t* ring) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+void usb_ring_get_stats(usb_ring_t* ring, usb_ring_stats_t* stats) {
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t dropped = atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+
+    stats->capacity = ring->capacity;
+    stats->count = (uint32_t)(head - tail);
+    stats->high_water = atomic_load_explicit(&ring->high_water, memory_order_relaxed);
+    stats->pushed = head;
+    stats->dropped = dropped;
+    stats->dropped_bytes = atomic_load_explicit(&ring->dropped_bytes, memory_order_relaxed);
+    // DROP_OLDEST丢弃的槽也推进了tail
+    stats->popped = ring->policy == USB_RING_DROP_OLDEST ? tail - dropped : tail;
+}
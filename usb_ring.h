@@ -0,0 +1,50 @@
+#ifndef USB_RING_H
+#define USB_RING_H
+
+#include "usb_control.h"
+
+// 无锁单生产者/单消费者环形缓冲区。
+// 每个槽保存一次传输的数据 (最多 slot_size 字节)，生产者和消费者的索引
+// 分别放在独立的缓存行上，避免伪共享。
+
+typedef enum {
+    USB_RING_BLOCK,          // 缓冲区满时生产者等待
+    USB_RING_DROP_OLDEST,    // 覆盖最旧的数据
+    USB_RING_DROP_NEWEST     // 丢弃新数据
+} usb_ring_policy_t;
+
+typedef struct usb_ring usb_ring_t;
+
+typedef struct {
+    uint32_t capacity;       // 槽数
+    uint32_t count;          // 当前占用的槽数
+    uint32_t high_water;     // 最大占用槽数
+    uint64_t pushed;         // 写入的槽数
+    uint64_t popped;         // 读出的槽数
+    uint64_t dropped;        // 丢弃的槽数
+    uint64_t dropped_bytes;  // 丢弃的字节数
+} usb_ring_stats_t;
+
+// slots会向上取整为2的幂
+usb_ring_t* usb_ring_create(int slots, int slot_size, usb_ring_policy_t policy);
+void usb_ring_destroy(usb_ring_t* ring);
+// 关闭后阻塞的生产者/消费者立即返回
+void usb_ring_close(usb_ring_t* ring);
+// 等待方式 (开始使用之前设置): 默认先让出CPU几次、之后每次休眠50us；
+// spin非0时一直自旋 (cpu pause) 不休眠，数据写入后几十ns内被读到，等待的线程占满一个CPU。单核时自旋改为让出CPU
+void usb_ring_set_spin(usb_ring_t* ring, int spin);
+
+// 生产者: 成功返回0，丢弃新数据返回LIBUSB_ERROR_OVERFLOW，已关闭返回LIBUSB_ERROR_INTERRUPTED
+int usb_ring_push(usb_ring_t* ring, const unsigned char* data, int length);
+// 同上，槽数据为 header + data (记录头和负载一次写入，不需要先拼接)，超过槽大小时截断data
+int usb_ring_push_header(usb_ring_t* ring, const void* header, int header_length, const unsigned char* data, int length);
+
+// 消费者: 复制一个槽的数据，返回长度；timeout_ms内没有数据返回LIBUSB_ERROR_TIMEOUT (为0时不等待)
+int usb_ring_pop(usb_ring_t* ring, unsigned char* data, int max_length, unsigned int timeout_ms);
+// 消费者零拷贝读取 (DROP_OLDEST策略不支持): peek得到数据指针，处理完后release
+int usb_ring_peek(usb_ring_t* ring, const unsigned char** data, unsigned int timeout_ms);
+void usb_ring_release(usb_ring_t* ring);
+
+void usb_ring_get_stats(usb_ring_t* ring, usb_ring_stats_t* stats);
+
+#endif // USB_RING_H
@@ -0,0 +1,385 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_shm.h"
+#include "usb_trace.h"
+
+#define SHM_RECORD_SIZE(length) (((size_t)(length) + sizeof(usb_shm_record_t) + 7) & ~(size_t)7)
+
+// 每个读者一个缓存行
+typedef struct {
+    _Alignas(64) atomic_int pid;               // 读者进程，0表示空闲
+    atomic_uint_least64_t read_pos;            // 下一条要读的记录的位置
+    atomic_uint_least64_t overruns;
+    atomic_uint_least64_t lost_bytes;
+} shm_reader_slot_t;
+
+typedef struct {
+    char magic[8];                             // USB_SHM_MAGIC
+    uint32_t version;
+    uint32_t header_size;                      // 数据区偏移
+    uint64_t data_size;                        // 2的幂
+    uint32_t max_readers;
+    int32_t producer_pid;
+    uint64_t start_wall_ns;
+    char serial[MAX_STR_LENGTH];
+
+    // 生产者写，读者读
+    _Alignas(64) atomic_uint_least64_t write_pos;   // 已完成的记录的结尾
+    atomic_uint_least64_t reserve_pos;              // 正在写入的记录的结尾，之前 data_size 字节以外的数据已失效
+    atomic_uint_least64_t seq;
+    atomic_int closed;
+
+    // 读者写，生产者读: 有读者等待时，生产者增加notify并唤醒
+    _Alignas(64) atomic_uint waiters;
+    atomic_uint notify;                             // futex字
+
+    shm_reader_slot_t readers[USB_SHM_MAX_READERS];
+} shm_header_t;
+
+_Static_assert(sizeof(shm_header_t) <= USB_SHM_HEADER_SIZE, "shm header too large");
+
+struct usb_shm_publisher {
+    usb_shm_map_t map;
+    shm_header_t* header;
+    unsigned char* data;
+    uint64_t mask;
+    uint64_t pos;                              // 生产者自己的写位置
+    uint64_t seq;
+    char name[MAX_STR_LENGTH];
+    atomic_uint_least64_t bytes;
+    atomic_uint_least64_t dropped;
+    atomic_uint_least64_t wakeups;
+};
+
+struct usb_shm_reader {
+    usb_shm_map_t map;
+    shm_header_t* header;
+    unsigned char* data;
+    uint64_t mask;
+    shm_reader_slot_t* slot;
+    uint64_t pos;
+    size_t pending;                            // 当前记录占用的字节数 (含跳过的填充)，0表示没有
+    uint64_t pending_start;                    // 当前记录的起始位置
+    uint32_t pending_length;                   // 当前记录的负载长度
+    uint64_t records;
+    uint64_t bytes;
+};
+
+/* 创建共享内存发布者 */
+int usb_shm_publisher_create(usb_shm_publisher_t** pub, const usb_shm_config_t* cfg) {
+    usb_shm_config_t c;
+    if (pub == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    memset(&c, 0, sizeof(c));
+    if (cfg) c = *cfg;
+    if (!c.name) c.name = USB_SHM_DEFAULT_NAME;
+    if (c.size == 0) c.size = USB_SHM_DEFAULT_SIZE;
+    if (c.max_readers <= 0) c.max_readers = USB_SHM_DEFAULT_READERS;
+    if (c.max_readers > USB_SHM_MAX_READERS) c.max_readers = USB_SHM_MAX_READERS;
+    size_t data_size = 4096;
+    while (data_size < c.size) data_size <<= 1;
+
+    usb_shm_publisher_t* p = (usb_shm_publisher_t*)calloc(1, sizeof(usb_shm_publisher_t));
+    if (!p) return LIBUSB_ERROR_NO_MEM;
+    snprintf(p->name, sizeof(p->name), "%s", c.name);
+    if (usb_shm_map_create(&p->map, p->name, USB_SHM_HEADER_SIZE + data_size) != 0) {
+        USB_TRACE_STR(SHM_CREATE_FAILED, p->name);
+        free(p);
+        return LIBUSB_ERROR_ACCESS;
+    }
+
+    // 新建的共享内存全部为0
+    shm_header_t* h = (shm_header_t*)p->map.addr;
+    h->version = USB_SHM_VERSION;
+    h->header_size = USB_SHM_HEADER_SIZE;
+    h->data_size = data_size;
+    h->max_readers = (uint32_t)c.max_readers;
+    h->producer_pid = usb_process_id();
+    h->start_wall_ns = usb_wall_time_ns();
+    if (c.serial) snprintf(h->serial, sizeof(h->serial), "%s", c.serial);
+    p->header = h;
+    p->data = p->map.addr + USB_SHM_HEADER_SIZE;
+    p->mask = data_size - 1;
+    // 魔数最后写，读者看到魔数时头部已经完整
+    atomic_thread_fence(memory_order_release);
+    memcpy(h->magic, USB_SHM_MAGIC, sizeof(h->magic));
+
+    *pub = p;
+    return 0;
+}
+
+void usb_shm_publisher_destroy(usb_shm_publisher_t* pub) {
+    if (!pub) {
+        return;
+    }
+    shm_header_t* h = pub->header;
+    atomic_store(&h->closed, 1);
+    atomic_fetch_add(&h->notify, 1);
+    usb_futex_wake(&h->notify);
+    usb_shm_map_unlink(pub->name);
+    usb_shm_map_close(&pub->map);
+    free(pub);
+}
+
+/* 发布一条记录 */
+int usb_shm_publish(usb_shm_publisher_t* pub, const unsigned char* data, int length) {
+    shm_header_t* h = pub->header;
+    size_t need = SHM_RECORD_SIZE(length);
+    if (length < 0 || need > h->data_size / 2) {
+        atomic_fetch_add_explicit(&pub->dropped, 1, memory_order_relaxed);
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+
+    uint64_t start = pub->pos;
+    size_t offset = (size_t)(start & pub->mask);
+    size_t tail = (size_t)h->data_size - offset;
+    size_t pad = tail < need ? tail : 0;
+
+    // 先声明要覆盖的范围，再写数据: 读者读完后检查 reserve_pos，就知道读到的数据是否被覆盖
+    atomic_store_explicit(&h->reserve_pos, start + pad + need, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    usb_shm_record_t rec;
+    if (pad >= sizeof(rec)) {
+        rec.length = (uint32_t)(pad - sizeof(rec));
+        rec.type = USB_SHM_PAD;
+        rec.flags = 0;
+        rec.seq = pub->seq;
+        rec.time_ns = 0;
+        memcpy(pub->data + offset, &rec, sizeof(rec));
+    }
+    if (pad) {
+        offset = 0;
+    }
+    rec.length = (uint32_t)length;
+    rec.type = USB_SHM_DATA;
+    rec.flags = 0;
+    rec.seq = pub->seq++;
+    rec.time_ns = usb_time_ns();
+    memcpy(pub->data + offset, &rec, sizeof(rec));
+    memcpy(pub->data + offset + sizeof(rec), data, (size_t)length);
+    pub->pos = start + pad + need;
+    atomic_fetch_add_explicit(&pub->bytes, (uint64_t)length, memory_order_relaxed);
+
+    // 与读者的 waiters++ / 检查写位置 配对 (都是seq_cst)，不会漏掉唤醒
+    atomic_store(&h->write_pos, pub->pos);
+    atomic_store_explicit(&h->seq, pub->seq, memory_order_relaxed);
+    if (atomic_load(&h->waiters) > 0) {
+        atomic_fetch_add(&h->notify, 1);
+        usb_futex_wake(&h->notify);
+        atomic_fetch_add_explicit(&pub->wakeups, 1, memory_order_relaxed);
+    }
+    return LIBUSB_SUCCESS;
+}
+
+void usb_shm_stream_cb(const unsigned char* data, int length, void* user_data) {
+    usb_shm_publish((usb_shm_publisher_t*)user_data, data, length);
+}
+
+void usb_shm_publisher_get_stats(usb_shm_publisher_t* pub, usb_shm_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!pub) {
+        return;
+    }
+    shm_header_t* h = pub->header;
+    uint64_t write = atomic_load(&h->write_pos);
+    stats->records = atomic_load_explicit(&h->seq, memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&pub->bytes, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&pub->dropped, memory_order_relaxed);
+    stats->wakeups = atomic_load_explicit(&pub->wakeups, memory_order_relaxed);
+    for (uint32_t i = 0; i < h->max_readers; i++) {
+        shm_reader_slot_t* slot = &h->readers[i];
+        if (atomic_load(&slot->pid) == 0) {
+            continue;
+        }
+        stats->readers++;
+        if (write - atomic_load_explicit(&slot->read_pos, memory_order_relaxed) > h->data_size) {
+            stats->lagging++;
+        }
+        stats->overruns += atomic_load_explicit(&slot->overruns, memory_order_relaxed);
+    }
+}
+
+// 占用一个读者槽: 先找空闲的，再接管进程已经退出的
+static shm_reader_slot_t* reader_claim(shm_header_t* h, int pid) {
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 0; i < h->max_readers; i++) {
+            shm_reader_slot_t* slot = &h->readers[i];
+            int expected = atomic_load(&slot->pid);
+            if (pass == 0 ? expected != 0 : (expected == 0 || usb_process_alive(expected))) {
+                continue;
+            }
+            if (atomic_compare_exchange_strong(&slot->pid, &expected, pid)) {
+                return slot;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* 附加到共享内存 */
+int usb_shm_reader_open(usb_shm_reader_t** reader, const char* name) {
+    if (reader == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    usb_shm_reader_t* r = (usb_shm_reader_t*)calloc(1, sizeof(usb_shm_reader_t));
+    if (!r) return LIBUSB_ERROR_NO_MEM;
+    if (usb_shm_map_open(&r->map, name ? name : USB_SHM_DEFAULT_NAME) != 0) {
+        free(r);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    shm_header_t* h = (shm_header_t*)r->map.addr;
+    if (r->map.size < USB_SHM_HEADER_SIZE || memcmp(h->magic, USB_SHM_MAGIC, sizeof(h->magic)) != 0 ||
+        h->version != USB_SHM_VERSION || h->header_size != USB_SHM_HEADER_SIZE ||
+        r->map.size < (size_t)h->header_size + h->data_size || h->max_readers > USB_SHM_MAX_READERS) {
+        USB_TRACE_STR(SHM_BAD_FORMAT, name ? name : USB_SHM_DEFAULT_NAME);
+        usb_shm_map_close(&r->map);
+        free(r);
+        return LIBUSB_ERROR_IO;
+    }
+    atomic_thread_fence(memory_order_acquire);
+
+    r->slot = reader_claim(h, usb_process_id());
+    if (!r->slot) {
+        USB_TRACE(SHM_TOO_MANY_READERS);
+        usb_shm_map_close(&r->map);
+        free(r);
+        return LIBUSB_ERROR_BUSY;
+    }
+    r->header = h;
+    r->data = r->map.addr + h->header_size;
+    r->mask = h->data_size - 1;
+    r->pos = atomic_load(&h->write_pos);
+    atomic_store(&r->slot->read_pos, r->pos);
+    atomic_store(&r->slot->overruns, 0);
+    atomic_store(&r->slot->lost_bytes, 0);
+
+    *reader = r;
+    return 0;
+}
+
+void usb_shm_reader_close(usb_shm_reader_t* reader) {
+    if (!reader) {
+        return;
+    }
+    atomic_store(&reader->slot->pid, 0);
+    usb_shm_map_close(&reader->map);
+    free(reader);
+}
+
+// 位置start开始的数据是否仍然有效 (没有被正在写入或已写入的记录覆盖)
+static int reader_valid(usb_shm_reader_t* r, uint64_t start) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&r->header->reserve_pos, memory_order_relaxed) - start <= r->header->data_size;
+}
+
+// 落后被覆盖: 跳到最新的写位置
+static int reader_overrun(usb_shm_reader_t* r) {
+    uint64_t write = atomic_load(&r->header->write_pos);
+    atomic_fetch_add_explicit(&r->slot->overruns, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->slot->lost_bytes, write - r->pos, memory_order_relaxed);
+    r->pos = write;
+    r->pending = 0;
+    atomic_store_explicit(&r->slot->read_pos, r->pos, memory_order_relaxed);
+    return LIBUSB_ERROR_OVERFLOW;
+}
+
+/* 读取下一条记录 */
+int usb_shm_reader_next(usb_shm_reader_t* reader, usb_shm_record_t* record, const unsigned char** payload,
+                        unsigned int timeout_ms) {
+    usb_shm_reader_t* r = reader;
+    shm_header_t* h = r->header;
+    uint64_t deadline = 0;
+
+    if (r->pending) {
+        usb_shm_reader_release(r);
+    }
+    for (;;) {
+        uint64_t write = atomic_load_explicit(&h->write_pos, memory_order_acquire);
+        if (write == r->pos) {
+            if (atomic_load(&h->closed)) {
+                return LIBUSB_ERROR_NO_DEVICE;
+            }
+            uint64_t now = usb_time_ns();
+            if (deadline == 0) {
+                deadline = now + (uint64_t)timeout_ms * 1000000ull;
+            }
+            if (now >= deadline) {
+                // 生产者异常退出时不会设置closed
+                return usb_process_alive(h->producer_pid) ? 0 : LIBUSB_ERROR_NO_DEVICE;
+            }
+            unsigned int notify = atomic_load(&h->notify);
+            atomic_fetch_add(&h->waiters, 1);
+            if (atomic_load(&h->write_pos) == r->pos && !atomic_load(&h->closed)) {
+                usb_futex_wait(&h->notify, notify, deadline - now);
+            }
+            atomic_fetch_sub(&h->waiters, 1);
+            continue;
+        }
+        if (write - r->pos > h->data_size) {
+            return reader_overrun(r);
+        }
+
+        size_t offset = (size_t)(r->pos & r->mask);
+        size_t tail = (size_t)h->data_size - offset;
+        usb_shm_record_t rec;
+        if (tail < sizeof(rec)) {
+            r->pos += tail;  // 剩余不到一个记录头，没有写PAD
+            continue;
+        }
+        memcpy(&rec, r->data + offset, sizeof(rec));
+        if (!reader_valid(r, r->pos)) {
+            return reader_overrun(r);
+        }
+        if (rec.type == USB_SHM_PAD) {
+            r->pos += tail;
+            continue;
+        }
+        size_t need = SHM_RECORD_SIZE(rec.length);
+        if (need > tail || r->pos + need > write) {
+            return reader_overrun(r);  // 记录头已被覆盖成别的内容
+        }
+        r->pending_start = r->pos;
+        r->pending = need;
+        r->pending_length = rec.length;
+        *record = rec;
+        *payload = r->data + offset + sizeof(rec);
+        return 1;
+    }
+}
+
+int usb_shm_reader_release(usb_shm_reader_t* reader) {
+    usb_shm_reader_t* r = reader;
+    if (!r->pending) {
+        return LIBUSB_SUCCESS;
+    }
+    if (!reader_valid(r, r->pending_start)) {
+        return reader_overrun(r);
+    }
+    r->records++;
+    r->bytes += r->pending_length;
+    r->pos = r->pending_start + r->pending;
+    r->pending = 0;
+    atomic_store_explicit(&r->slot->read_pos, r->pos, memory_order_relaxed);
+    return LIBUSB_SUCCESS;
+}
+
+const char* usb_shm_reader_serial(usb_shm_reader_t* reader) {
+    return reader ? reader->header->serial : NULL;
+}
+
+void usb_shm_reader_get_stats(usb_shm_reader_t* reader, usb_shm_reader_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!reader) {
+        return;
+    }
+    shm_header_t* h = reader->header;
+    stats->records = reader->records;
+    stats->bytes = reader->bytes;
+    stats->overruns = atomic_load_explicit(&reader->slot->overruns, memory_order_relaxed);
+    stats->lost_bytes = atomic_load_explicit(&reader->slot->lost_bytes, memory_order_relaxed);
+    stats->behind = atomic_load(&h->write_pos) - reader->pos;
+    stats->producer_closed = atomic_load(&h->closed) || !usb_process_alive(h->producer_pid);
+}
@@ -0,0 +1,93 @@
+#ifndef USB_SHM_H
+#define USB_SHM_H
+
+#include "usb_control.h"
+
+// 共享内存发布: 打开设备的进程把收到的传输写入一个命名的共享内存环，其他本地进程附加后直接读取。
+// 一个生产者，多个读者，每个读者在共享内存中有自己的游标 (生产者可以看到每个读者落后多少)。
+//   - 零拷贝: 读者拿到的是共享内存中负载的指针；
+//   - 每个包没有系统调用: 发布只写共享内存，只有读者在等待 (环为空) 时才唤醒它们 (Linux futex)；
+//   - 生产者从不等待读者: 落后超过环大小的读者在读取时发现数据已被覆盖，返回 LIBUSB_ERROR_OVERFLOW
+//     并跳到最新的位置，丢失的字节数记在它的游标里。
+//
+// 布局 (主机字节序):
+//   [头部 USB_SHM_HEADER_SIZE 字节: 魔数、版本、数据区大小、设备序列号、写位置、读者表][数据区 (2的幂字节)]
+//   数据区中的记录 = usb_shm_record_t + 负载，按8字节对齐，连续存放；
+//   到数据区末尾放不下时写一个PAD记录 (剩余不到一个记录头时不写) 然后从头开始，所以负载总是连续的。
+//   位置是单调递增的字节数，对数据区大小取模得到偏移。
+
+#define USB_SHM_MAGIC         "USBSHM01"
+#define USB_SHM_VERSION       1
+#define USB_SHM_HEADER_SIZE   4096
+#define USB_SHM_MAX_READERS   32
+#define USB_SHM_DEFAULT_NAME  "usb_stream"
+#define USB_SHM_DEFAULT_SIZE  (16u * 1024 * 1024)
+#define USB_SHM_DEFAULT_READERS 8
+
+typedef enum {
+    USB_SHM_DATA = 1,        // 一个传输的数据
+    USB_SHM_PAD = 2          // 填充到数据区末尾
+} usb_shm_type_t;
+
+typedef struct {
+    uint32_t length;         // 负载长度
+    uint16_t type;           // usb_shm_type_t
+    uint16_t flags;          // 保留
+    uint64_t seq;            // 记录序号，从0开始
+    uint64_t time_ns;        // 发布时的单调时钟 (usb_time_ns，同一台机器上的进程间可比较)
+} usb_shm_record_t;
+
+typedef struct {
+    const char* name;        // 共享内存名字，默认 USB_SHM_DEFAULT_NAME
+    size_t size;             // 数据区大小，向上取整为2的幂，默认16MB
+    int max_readers;         // 读者数上限，默认8，最多 USB_SHM_MAX_READERS
+    const char* serial;      // 设备序列号，写入头部供读者确认
+} usb_shm_config_t;
+
+typedef struct {
+    uint64_t records;        // 发布的记录数
+    uint64_t bytes;          // 发布的负载字节数
+    uint64_t dropped;        // 超过数据区一半大小、没有发布的记录数
+    uint64_t wakeups;        // 唤醒等待中的读者的次数
+    int readers;             // 当前附加的读者数
+    int lagging;             // 当前落后超过数据区大小的读者数
+    uint64_t overruns;       // 所有读者被覆盖的次数之和
+} usb_shm_stats_t;
+
+typedef struct {
+    uint64_t records;        // 读到的记录数
+    uint64_t bytes;          // 读到的负载字节数
+    uint64_t overruns;       // 落后被覆盖的次数
+    uint64_t lost_bytes;     // 因此丢失的字节数
+    uint64_t behind;         // 当前落后生产者的字节数
+    int producer_closed;     // 生产者已经关闭或退出
+} usb_shm_reader_stats_t;
+
+typedef struct usb_shm_publisher usb_shm_publisher_t;
+typedef struct usb_shm_reader usb_shm_reader_t;
+
+// ---- 生产者 ----
+// 创建共享内存 (替换同名的旧对象)，cfg为NULL时使用默认配置
+int usb_shm_publisher_create(usb_shm_publisher_t** pub, const usb_shm_config_t* cfg);
+// 标记关闭 (唤醒所有读者) 并删除名字；已附加的读者读完剩下的数据后得到 LIBUSB_ERROR_NO_DEVICE
+void usb_shm_publisher_destroy(usb_shm_publisher_t* pub);
+// 发布一条记录，只能在一个线程中调用 (例如流的事件线程)
+int usb_shm_publish(usb_shm_publisher_t* pub, const unsigned char* data, int length);
+// usb_stream_cb 适配，user_data为发布者
+void usb_shm_stream_cb(const unsigned char* data, int length, void* user_data);
+void usb_shm_publisher_get_stats(usb_shm_publisher_t* pub, usb_shm_stats_t* stats);
+
+// ---- 读者 (可以在其他进程中) ----
+// 附加到名字为name的共享内存 (NULL为默认名字)，从当前的写位置开始读
+int usb_shm_reader_open(usb_shm_reader_t** reader, const char* name);
+void usb_shm_reader_close(usb_shm_reader_t* reader);
+// 等待下一条记录: 成功返回1，payload指向共享内存中的负载，release之前有效；timeout_ms内没有数据返回0；
+// 落后被覆盖返回 LIBUSB_ERROR_OVERFLOW (已跳到最新位置，继续读即可)；生产者已关闭且数据读完返回 LIBUSB_ERROR_NO_DEVICE
+int usb_shm_reader_next(usb_shm_reader_t* reader, usb_shm_record_t* record, const unsigned char** payload,
+                        unsigned int timeout_ms);
+// 处理完当前记录，游标前进。处理期间数据被覆盖时返回 LIBUSB_ERROR_OVERFLOW (已读到的数据不可信)
+int usb_shm_reader_release(usb_shm_reader_t* reader);
+const char* usb_shm_reader_serial(usb_shm_reader_t* reader);
+void usb_shm_reader_get_stats(usb_shm_reader_t* reader, usb_shm_reader_stats_t* stats);
+
+#endif // USB_SHM_H
@@ -0,0 +1,46 @@
+#ifndef USB_SIM_H
+#define USB_SIM_H
+
+#include "usb_control.h"
+
+// 进程内模拟设备配置 (VID/PID 与真实设备相同)
+typedef struct {
+    int num_devices;         // 模拟设备数量 (<= USB_SIM_MAX_DEVICES)
+    double bytes_per_sec;    // 每台设备的数据速率，0表示不限速
+    int fifo_bytes;          // 设备端FIFO大小，主机读得不够快时溢出丢弃
+    int control_latency_us;  // 打开设备和每次控制传输(字符串描述符、设置配置)的延迟
+    int latency_us;          // 每次批量传输在数据就绪后的固定完成延迟
+    int jitter_us;           // 额外的随机完成延迟 [0, jitter_us]，同一设备仍按提交顺序完成
+    int packet_size;         // 批量端点最大包长，读取长度按整包截断，小于一包时返回OVERFLOW
+    double error_rate;       // 每次批量传输以 TRANSFER_ERROR / ERROR_IO 失败的概率，失败传输的数据丢失
+    uint32_t seed;           // 抖动和错误注入的随机种子，相同种子结果可复现
+    int frame_payload;       // >0: 数据按帧发送 (usb_frame.h 帧头 + 负载)，每帧以短包结束
+                             //     (帧长正好是包长整数倍时没有短包，多帧合并在一个传输里)；
+                             // 0: 连续的字节计数，不分帧
+    int dropout_interval_ms; // >0: 故障注入，每隔这么久轮流拔出一台设备 (模拟掉电)，dropout_ms 后重新插入
+    int dropout_ms;          // 每次掉电的时长，默认100ms
+    int timestamps;          // >0: 分帧时每帧负载以8字节设备时间戳开头 (帧头flags为 USB_FRAME_FLAG_TIMESTAMP)。
+                             //     第i台设备的时钟 = (i+1)秒 + 帧开始产生的时间 x (1 + ppm_i/1e6)，时间从初始化算起，
+                             //     不限速时按每字节1ns推算产生时间
+    double clock_ppm;        // 设备时钟的频率偏差: 第i台 ppm_i = (i+1) x clock_ppm，奇数号设备为负
+} usb_sim_config_t;
+
+#define USB_SIM_DEFAULT_RATE    (8.0 * 1024 * 1024)
+#define USB_SIM_DEFAULT_FIFO    (64 * 1024)
+#define USB_SIM_DEFAULT_PACKET  64
+#define USB_SIM_MAX_FRAME       (1024 * 1024)
+#define USB_SIM_DEFAULT_DROPOUT 100
+#define USB_SIM_MAX_DEVICES     255  // 都在总线1上，端口号1-255
+
+// 使用模拟设备代替libusb DLL初始化，cfg为NULL时使用默认配置
+// 未设置(为0)的字段使用默认值: 1台设备, 默认FIFO/包长, 无延迟/抖动/错误
+int usb_control_init_sim(const usb_sim_config_t* cfg);
+
+// 模拟拔出/插入第index台设备 (从0开始)，产生热插拔事件
+int usb_sim_unplug(int index);
+int usb_sim_plug(int index);
+
+// 第index台设备的时间戳对应的真实主机时间 (usb_time_ns)，用于检验时钟对齐的误差
+int usb_sim_device_to_host(int index, uint64_t device_ts, uint64_t* host_ns);
+
+#endif // USB_SIM_H
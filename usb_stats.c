@@ -0,0 +1,183 @@
+#include <stdatomic.h>
+#include "usb_stats.h"
+
+#define CACHE_LINE 64
+
+struct usb_stats {
+    // 每次传输都更新的计数器放在同一缓存行
+    _Alignas(CACHE_LINE) atomic_uint_least64_t bytes;
+    atomic_uint_least64_t transfers;
+    atomic_uint_least64_t sum_ns;
+    atomic_uint_least64_t max_ns;
+
+    // 异常路径
+    _Alignas(CACHE_LINE) atomic_uint_least64_t short_reads;
+    atomic_uint_least64_t timeouts;
+    atomic_uint_least64_t errors;
+    atomic_int last_error;
+
+    _Alignas(CACHE_LINE) atomic_uint_least64_t buckets[USB_STATS_BUCKETS];
+};
+
+static atomic_int stats_enabled = 1;
+
+static inline int stats_msb(uint64_t v) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int n = 0;
+    while (v >>= 1) n++;
+    return n;
+#endif
+}
+
+// 值 -> 桶: 小于4的值各占一个桶，之后每个2的幂区间按次高2位分4个子桶
+static inline int stats_bucket(uint64_t v) {
+    const int sub = 1 << USB_STATS_SUB_BITS;
+    if (v < (uint64_t)sub) {
+        return (int)v;
+    }
+    int msb = stats_msb(v);
+    return (msb - USB_STATS_SUB_BITS + 1) * sub + (int)((v >> (msb - USB_STATS_SUB_BITS)) & (uint64_t)(sub - 1));
+}
+
+// 桶的上界 (不含)
+static uint64_t stats_bucket_limit(int index) {
+    const int sub = 1 << USB_STATS_SUB_BITS;
+    if (index < sub) {
+        return (uint64_t)index + 1;
+    }
+    int msb = index / sub + USB_STATS_SUB_BITS - 1;
+    uint64_t lower = (uint64_t)(sub + index % sub) << (msb - USB_STATS_SUB_BITS);
+    uint64_t width = (uint64_t)1 << (msb - USB_STATS_SUB_BITS);
+    return lower + width < lower ? UINT64_MAX : lower + width;
+}
+
+usb_stats_t* usb_stats_create(void) {
+    usb_stats_t* stats = (usb_stats_t*)usb_aligned_alloc(CACHE_LINE, sizeof(usb_stats_t));
+    if (stats) {
+        usb_stats_reset(stats);
+    }
+    return stats;
+}
+
+void usb_stats_destroy(usb_stats_t* stats) {
+    usb_aligned_free(stats);
+}
+
+void usb_stats_reset(usb_stats_t* stats) {
+    atomic_store(&stats->bytes, 0);
+    atomic_store(&stats->transfers, 0);
+    atomic_store(&stats->sum_ns, 0);
+    atomic_store(&stats->max_ns, 0);
+    atomic_store(&stats->short_reads, 0);
+    atomic_store(&stats->timeouts, 0);
+    atomic_store(&stats->errors, 0);
+    atomic_store(&stats->last_error, 0);
+    for (int i = 0; i < USB_STATS_BUCKETS; i++) {
+        atomic_store(&stats->buckets[i], 0);
+    }
+}
+
+void usb_stats_set_enabled(int enabled) {
+    atomic_store(&stats_enabled, enabled ? 1 : 0);
+}
+
+uint64_t usb_stats_clock(void) {
+    return atomic_load_explicit(&stats_enabled, memory_order_relaxed) ? usb_time_ns() : 0;
+}
+
+void usb_stats_record(usb_stats_t* stats, uint64_t submit_ns, int requested, int actual, int status) {
+    if (!stats || submit_ns == 0) {
+        return;
+    }
+
+    if (actual > 0) {
+        atomic_fetch_add_explicit(&stats->bytes, (uint64_t)actual, memory_order_relaxed);
+    }
+    if (status == LIBUSB_ERROR_TIMEOUT) {
+        atomic_fetch_add_explicit(&stats->timeouts, 1, memory_order_relaxed);
+        return;
+    }
+    if (status < 0) {
+        atomic_fetch_add_explicit(&stats->errors, 1, memory_order_relaxed);
+        atomic_store_explicit(&stats->last_error, status, memory_order_relaxed);
+        return;
+    }
+
+    atomic_fetch_add_explicit(&stats->transfers, 1, memory_order_relaxed);
+    if (actual < requested) {
+        atomic_fetch_add_explicit(&stats->short_reads, 1, memory_order_relaxed);
+    }
+
+    uint64_t now = usb_time_ns();
+    uint64_t ns = now > submit_ns ? now - submit_ns : 0;
+    atomic_fetch_add_explicit(&stats->buckets[stats_bucket(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats->sum_ns, ns, memory_order_relaxed);
+
+    // 最大值很少变化，先读再CAS
+    uint64_t cur = atomic_load_explicit(&stats->max_ns, memory_order_relaxed);
+    while (ns > cur && !atomic_compare_exchange_weak_explicit(&stats->max_ns, &cur, ns, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+// 各字段分别读取，快照不是原子的，但每个计数器本身单调
+void usb_stats_snapshot(usb_stats_t* stats, usb_stats_snapshot_t* snap) {
+    memset(snap, 0, sizeof(*snap));
+    snap->time_ns = usb_time_ns();
+    if (!stats) {
+        return;
+    }
+
+    snap->bytes = atomic_load_explicit(&stats->bytes, memory_order_relaxed);
+    snap->transfers = atomic_load_explicit(&stats->transfers, memory_order_relaxed);
+    snap->short_reads = atomic_load_explicit(&stats->short_reads, memory_order_relaxed);
+    snap->timeouts = atomic_load_explicit(&stats->timeouts, memory_order_relaxed);
+    snap->errors = atomic_load_explicit(&stats->errors, memory_order_relaxed);
+    snap->last_error = atomic_load_explicit(&stats->last_error, memory_order_relaxed);
+    snap->sum_ns = atomic_load_explicit(&stats->sum_ns, memory_order_relaxed);
+    snap->max_ns = atomic_load_explicit(&stats->max_ns, memory_order_relaxed);
+    for (int i = 0; i < USB_STATS_BUCKETS; i++) {
+        snap->buckets[i] = atomic_load_explicit(&stats->buckets[i], memory_order_relaxed);
+        snap->count += snap->buckets[i];
+    }
+}
+
+uint64_t usb_stats_percentile(const usb_stats_snapshot_t* snap, double p) {
+    if (snap->count == 0) {
+        return 0;
+    }
+    if (p < 0) p = 0;
+    if (p > 1) p = 1;
+
+    uint64_t rank = (uint64_t)(p * (double)(snap->count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < USB_STATS_BUCKETS; i++) {
+        seen += snap->buckets[i];
+        if (seen >= rank) {
+            uint64_t limit = stats_bucket_limit(i) - 1;
+            return limit > snap->max_ns ? snap->max_ns : limit;
+        }
+    }
+    return snap->max_ns;
+}
+
+double usb_stats_mean_ns(const usb_stats_snapshot_t* snap) {
+    return snap->count ? (double)snap->sum_ns / (double)snap->count : 0;
+}
+
+// 计数器和直方图相减；max无法相减，保留now的值
+void usb_stats_delta(const usb_stats_snapshot_t* now, const usb_stats_snapshot_t* prev, usb_stats_snapshot_t* delta) {
+    *delta = *now;
+    delta->time_ns = now->time_ns - prev->time_ns;
+    delta->bytes -= prev->bytes;
+    delta->transfers -= prev->transfers;
+    delta->short_reads -= prev->short_reads;
+    delta->timeouts -= prev->timeouts;
+    delta->errors -= prev->errors;
+    delta->count -= prev->count;
+    delta->sum_ns -= prev->sum_ns;
+    for (int i = 0; i < USB_STATS_BUCKETS; i++) {
+        delta->buckets[i] -= prev->buckets[i];
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef USB_STATS_H
+#define USB_STATS_H
+
+#include "usb_control.h"
+
+// 每台设备的传输统计: 计数器 + 提交->完成延迟的对数直方图。
+// 同步读取 (usb_device_read) 和设备上的所有流都记录到同一份统计。
+// 记录是无锁的 (每次传输几次relaxed原子加)，快照只读，可以在其他线程每100ms轮询一次。
+
+// 直方图: 每个2的幂区间分4个子桶，相对误差 < 25%，覆盖 0 ~ 2^64 ns
+#define USB_STATS_SUB_BITS 2
+#define USB_STATS_BUCKETS  (64 << USB_STATS_SUB_BITS)
+
+typedef struct usb_stats usb_stats_t;
+
+typedef struct {
+    uint64_t time_ns;        // 快照时间 (usb_time_ns)
+    uint64_t bytes;          // 收到的总字节数
+    uint64_t transfers;      // 成功完成的传输数
+    uint64_t short_reads;    // 完成但不足请求长度的传输数
+    uint64_t timeouts;       // 超时的传输数
+    uint64_t errors;         // 出错的传输数
+    int last_error;          // 最近一次错误 (LIBUSB_ERROR_*)
+    uint64_t count;          // 直方图中的延迟样本数
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t buckets[USB_STATS_BUCKETS];
+} usb_stats_snapshot_t;
+
+usb_stats_t* usb_stats_create(void);
+void usb_stats_destroy(usb_stats_t* stats);
+void usb_stats_reset(usb_stats_t* stats);
+
+// 记录一次传输: status为0或LIBUSB_ERROR_*，submit_ns为提交时 usb_stats_clock() 的返回值
+void usb_stats_record(usb_stats_t* stats, uint64_t submit_ns, int requested, int actual, int status);
+void usb_stats_snapshot(usb_stats_t* stats, usb_stats_snapshot_t* snap);
+
+// 全局开关 (默认开启)，关闭后 usb_stats_clock 返回0且不再记录，用于测量开销
+void usb_stats_set_enabled(int enabled);
+uint64_t usb_stats_clock(void);
+
+// 设备统计快照，device为NULL时使用 USB_OpenDevice 打开的默认设备
+int usb_device_get_stats(usb_device_t* device, usb_stats_snapshot_t* snap);
+
+// 快照工具: 延迟百分位 (p为0~1，返回ns，取所在桶的上界)、平均延迟、两个快照之差 (用于计算区间速率)
+uint64_t usb_stats_percentile(const usb_stats_snapshot_t* snap, double p);
+double usb_stats_mean_ns(const usb_stats_snapshot_t* snap);
+void usb_stats_delta(const usb_stats_snapshot_t* now, const usb_stats_snapshot_t* prev, usb_stats_snapshot_t* delta);
+
+#endif // USB_STATS_H
@@ -0,0 +1,482 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_stream.h"
+#include "usb_trace.h"
+
+// 每个传输的私有数据 (transfer->user_data)
+typedef struct {
+    usb_stream_t* stream;
+    uint64_t submit_ns;
+    usb_buffer_t* buffer;           // 使用缓冲区池时当前挂在传输上的缓冲区
+    atomic_int parked;              // 池已空，等待缓冲区后再提交
+} stream_slot_t;
+
+struct usb_stream {
+    libusb_device_handle* handle;
+    usb_stats_t* stats;             // 设备统计，记录每个传输的延迟
+    usb_stream_config_t cfg;
+    usb_stream_cb cb;
+    void* user_data;
+
+    struct libusb_transfer** transfers;
+    unsigned char** buffers;
+    stream_slot_t* slots;
+    atomic_int running;
+    atomic_int in_flight;           // 挂起和等待缓冲区的传输数
+    atomic_int parked;              // 等待缓冲区的传输数
+    usb_thread_t thread;
+
+    uint64_t start_ns;
+    atomic_uint_least64_t stop_ns;
+    atomic_uint_least64_t bytes;
+    atomic_uint_least64_t completed;
+    atomic_uint_least64_t timeouts;
+    atomic_uint_least64_t errors;
+    atomic_uint_least64_t pool_waits;
+    atomic_int last_error;
+
+    // 自适应传输大小，只在事件线程中更新
+    int packet_size;
+    atomic_int cur_size;
+    uint64_t window_start_ns;
+    uint64_t window_bytes;
+};
+
+#define STREAM_ADAPT_WINDOW_NS 50000000ull  // 每50ms重新估计一次速率
+#define STREAM_MAX_EXTERNAL    64
+
+// 由外部事件循环驱动的流，usb_control_process_events 给其中等待缓冲区的传输重新提交
+static _Atomic(usb_stream_t*) external_streams[STREAM_MAX_EXTERNAL];
+
+// 根据最近一个窗口的到达速率选择传输大小，在回调中调用
+static void stream_adapt(usb_stream_t* s, int actual_length) {
+    uint64_t now = usb_time_ns();
+    s->window_bytes += (uint64_t)actual_length;
+    if (s->window_start_ns == 0) {
+        s->window_start_ns = now;
+        s->window_bytes = 0;
+        return;
+    }
+    if (now - s->window_start_ns < STREAM_ADAPT_WINDOW_NS) {
+        return;
+    }
+
+    double rate = (double)s->window_bytes * 1e9 / (double)(now - s->window_start_ns);
+    double want = rate * s->cfg.target_latency_us / 1e6;
+    int size = want > s->cfg.transfer_size ? s->cfg.transfer_size : (int)want;
+    size -= size % s->packet_size;
+    if (size < s->cfg.min_transfer_size) size = s->cfg.min_transfer_size;
+    atomic_store_explicit(&s->cur_size, size, memory_order_relaxed);
+    s->window_start_ns = now;
+    s->window_bytes = 0;
+}
+
+// 一个传输不再挂起: in_flight减1。减到0之后 usb_stream_stop 可能已经在另一个线程中释放了s
+// (所有流共用一个上下文，回调可能在别的流的事件线程中执行)，所以最后一个传输先记下停止时间再减，之后不再访问s
+static void stream_transfer_done(usb_stream_t* s) {
+    int n = atomic_load(&s->in_flight);
+    for (;;) {
+        if (n == 1) {
+            atomic_store(&s->stop_ns, usb_time_ns());
+        }
+        if (atomic_compare_exchange_weak(&s->in_flight, &n, n - 1)) {
+            return;
+        }
+    }
+}
+
+static int transfer_error(enum libusb_transfer_status status) {
+    switch (status) {
+        case LIBUSB_TRANSFER_TIMED_OUT: return LIBUSB_ERROR_TIMEOUT;
+        case LIBUSB_TRANSFER_STALL: return LIBUSB_ERROR_PIPE;
+        case LIBUSB_TRANSFER_NO_DEVICE: return LIBUSB_ERROR_NO_DEVICE;
+        case LIBUSB_TRANSFER_OVERFLOW: return LIBUSB_ERROR_OVERFLOW;
+        default: return LIBUSB_ERROR_IO;
+    }
+}
+
+// 传输完成回调: 交付数据并立即重新提交
+static void stream_transfer_cb(struct libusb_transfer* transfer) {
+    stream_slot_t* slot = (stream_slot_t*)transfer->user_data;
+    usb_stream_t* s = slot->stream;
+    int resubmit = 1;
+
+    if (transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+        usb_stats_record(s->stats, slot->submit_ns, transfer->length, transfer->actual_length,
+                         transfer->status == LIBUSB_TRANSFER_COMPLETED ? 0 : transfer_error(transfer->status));
+        USB_TRACE(STREAM_TRANSFER, transfer->actual_length, transfer->status);
+    }
+
+    switch (transfer->status) {
+        case LIBUSB_TRANSFER_COMPLETED:
+        case LIBUSB_TRANSFER_TIMED_OUT: {
+            uint64_t done_ns = usb_time_ns();  // 主机时间戳: 缓冲区的time_ns和拆分器交付的帧
+            if (transfer->status == LIBUSB_TRANSFER_TIMED_OUT) {
+                atomic_fetch_add_explicit(&s->timeouts, 1, memory_order_relaxed);
+            }
+            if (transfer->actual_length > 0) {
+                atomic_fetch_add_explicit(&s->bytes, (uint64_t)transfer->actual_length, memory_order_relaxed);
+                atomic_fetch_add_explicit(&s->completed, 1, memory_order_relaxed);
+                if (s->cb) {
+                    s->cb(transfer->buffer, transfer->actual_length, s->user_data);
+                }
+                if (slot->buffer) {
+                    slot->buffer->length = transfer->actual_length;
+                    slot->buffer->time_ns = done_ns;
+                    if (s->cfg.buffer_cb) {
+                        s->cfg.buffer_cb(slot->buffer, s->user_data);
+                    }
+                }
+            }
+            // 零长度包也结束一个逻辑包
+            if (s->cfg.splitter && (transfer->actual_length > 0 || transfer->status == LIBUSB_TRANSFER_COMPLETED)) {
+                usb_frame_set_time(s->cfg.splitter, done_ns);
+                usb_frame_feed(s->cfg.splitter, transfer->buffer, transfer->actual_length,
+                               transfer->status == LIBUSB_TRANSFER_COMPLETED && transfer->actual_length < transfer->length);
+            }
+            if (s->cfg.adaptive) {
+                stream_adapt(s, transfer->actual_length);
+                transfer->length = atomic_load_explicit(&s->cur_size, memory_order_relaxed);
+            }
+            break;
+        }
+        case LIBUSB_TRANSFER_CANCELLED:
+            resubmit = 0;
+            break;
+        default:
+            atomic_fetch_add_explicit(&s->errors, 1, memory_order_relaxed);
+            atomic_store(&s->last_error, transfer_error(transfer->status));
+            resubmit = 0;
+            if (transfer->status != LIBUSB_TRANSFER_NO_DEVICE) {
+                usb_integrity_note(s->cfg.integrity, USB_LOSS_TRANSFER, 1);  // 断开由监护报告
+            }
+            if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+                atomic_store(&s->running, 0);
+            }
+            break;
+    }
+
+    if (resubmit && atomic_load(&s->running)) {
+        // 交付过的缓冲区可能还被消费者持有，换一个新的
+        if (slot->buffer && transfer->actual_length > 0) {
+            usb_buffer_release(slot->buffer);
+            slot->buffer = usb_pool_get(s->cfg.pool);
+            if (!slot->buffer) {
+                // 池已空: 传输暂停，事件线程拿到缓冲区后再提交
+                atomic_fetch_add_explicit(&s->pool_waits, 1, memory_order_relaxed);
+                atomic_store(&slot->parked, 1);
+                atomic_fetch_add(&s->parked, 1);
+                return;
+            }
+            transfer->buffer = slot->buffer->data;
+        }
+        slot->submit_ns = usb_stats_clock();
+        int r = usb_transport->submit_transfer(transfer);
+        if (r == 0) {
+            return;
+        }
+        atomic_fetch_add_explicit(&s->errors, 1, memory_order_relaxed);
+        atomic_store(&s->last_error, r);
+    }
+
+    stream_transfer_done(s);
+}
+
+// 给等待缓冲区的传输分配缓冲区并重新提交，停止后直接结束它们
+static void stream_resume_parked(usb_stream_t* s) {
+    for (int i = 0; i < s->cfg.num_transfers && atomic_load(&s->parked) > 0; i++) {
+        stream_slot_t* slot = &s->slots[i];
+        if (!atomic_load(&slot->parked)) {
+            continue;
+        }
+        int r = LIBUSB_ERROR_INTERRUPTED;
+        if (atomic_load(&s->running)) {
+            slot->buffer = usb_pool_get(s->cfg.pool);
+            if (!slot->buffer) {
+                return;  // 池仍然是空的
+            }
+            s->transfers[i]->buffer = slot->buffer->data;
+            slot->submit_ns = usb_stats_clock();
+            atomic_store(&slot->parked, 0);
+            atomic_fetch_sub(&s->parked, 1);
+            r = usb_transport->submit_transfer(s->transfers[i]);
+            if (r == 0) {
+                continue;
+            }
+            atomic_fetch_add_explicit(&s->errors, 1, memory_order_relaxed);
+            atomic_store(&s->last_error, r);
+        } else {
+            atomic_store(&slot->parked, 0);
+            atomic_fetch_sub(&s->parked, 1);
+        }
+        stream_transfer_done(s);
+    }
+}
+
+// 事件线程的CPU绑定和实时调度，失败时只警告
+static void stream_thread_setup(usb_stream_t* s) {
+    if (s->cfg.cpu_mask && usb_thread_set_affinity(s->cfg.cpu_mask) != 0) {
+        USB_TRACE_STR(AFFINITY_FAILED, "event", s->cfg.cpu_mask);
+    }
+    if (s->cfg.realtime > 0) {
+        // 单核上实时优先级的忙轮询线程不会让出CPU，消费者和系统线程都无法运行
+        if (s->cfg.busy_poll && usb_cpu_count() < 2) {
+            USB_TRACE_STR(REALTIME_SKIPPED, "event");
+        } else if (usb_thread_set_realtime(s->cfg.realtime) != 0) {
+            USB_TRACE_STR(REALTIME_FAILED, "event", s->cfg.realtime);
+        }
+    }
+}
+
+// 事件线程: 处理完成事件直到所有传输都已返回
+static void* stream_event_thread(void* arg) {
+    usb_stream_t* s = (usb_stream_t*)arg;
+    libusb_context* ctx = usb_control_context();
+    // 单核时忙轮询之间让出CPU，否则消费者要等到时间片用完
+    int share_cpu = s->cfg.busy_poll && usb_cpu_count() < 2;
+
+    stream_thread_setup(s);
+    while (atomic_load(&s->in_flight) > 0) {
+        if (s->cfg.busy_poll) {
+            struct timeval tv = {0, 0};
+            usb_transport->handle_events_timeout_completed(ctx, &tv, NULL);
+            if (share_cpu) {
+                usb_thread_yield();
+            } else {
+                usb_cpu_relax();
+            }
+        } else {
+            // 有传输等待缓冲区时缩短等待，及时拿到消费者释放的缓冲区
+            struct timeval tv = {0, atomic_load(&s->parked) > 0 ? 1000 : 100000};
+            usb_transport->handle_events_timeout_completed(ctx, &tv, NULL);
+        }
+        if (atomic_load(&s->parked) > 0) {
+            stream_resume_parked(s);
+        }
+    }
+    return NULL;
+}
+
+static int external_add(usb_stream_t* s) {
+    for (int i = 0; i < STREAM_MAX_EXTERNAL; i++) {
+        usb_stream_t* expected = NULL;
+        if (atomic_compare_exchange_strong(&external_streams[i], &expected, s)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static void external_remove(usb_stream_t* s) {
+    for (int i = 0; i < STREAM_MAX_EXTERNAL; i++) {
+        usb_stream_t* expected = s;
+        if (atomic_compare_exchange_strong(&external_streams[i], &expected, NULL)) {
+            return;
+        }
+    }
+}
+
+int usb_stream_external_parked(void) {
+    for (int i = 0; i < STREAM_MAX_EXTERNAL; i++) {
+        usb_stream_t* s = atomic_load(&external_streams[i]);
+        if (s && atomic_load(&s->parked) > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void usb_stream_resume_external(void) {
+    for (int i = 0; i < STREAM_MAX_EXTERNAL; i++) {
+        usb_stream_t* s = atomic_load(&external_streams[i]);
+        if (s && atomic_load(&s->parked) > 0) {
+            stream_resume_parked(s);
+        }
+    }
+}
+
+// 启动失败时取消前n个已提交的传输并等待它们返回
+static void stream_abort(usb_stream_t* s, int n) {
+    atomic_store(&s->running, 0);
+    for (int i = 0; i < n; i++) {
+        usb_transport->cancel_transfer(s->transfers[i]);
+    }
+    while (atomic_load(&s->in_flight) > 0) {
+        struct timeval tv = {0, 100000};
+        usb_transport->handle_events_timeout_completed(usb_control_context(), &tv, NULL);
+    }
+}
+
+static void stream_free(usb_stream_t* s) {
+    for (int i = 0; i < s->cfg.num_transfers; i++) {
+        if (s->transfers && s->transfers[i]) usb_transport->free_transfer(s->transfers[i]);
+        if (s->slots && s->slots[i].buffer) {
+            usb_buffer_release(s->slots[i].buffer);
+        } else if (s->buffers && !s->cfg.pool) {
+            free(s->buffers[i]);
+        }
+    }
+    free(s->transfers);
+    free(s->buffers);
+    free(s->slots);
+    free(s);
+}
+
+/* 开始流式读取 */
+int usb_stream_start(usb_stream_t** stream, usb_device_t* device, const usb_stream_config_t* cfg,
+                     usb_stream_cb cb, void* user_data) {
+    libusb_device_handle* handle = usb_device_handle(device);
+    if (stream == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (!handle) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+
+    usb_stream_t* s = (usb_stream_t*)calloc(1, sizeof(usb_stream_t));
+    if (!s) return LIBUSB_ERROR_NO_MEM;
+
+    s->handle = handle;
+    s->stats = usb_device_stats(device);
+    s->cb = cb;
+    s->user_data = user_data;
+    if (cfg) s->cfg = *cfg;
+    if (s->cfg.num_transfers <= 0) s->cfg.num_transfers = USB_STREAM_DEFAULT_TRANSFERS;
+    if (s->cfg.transfer_size <= 0) s->cfg.transfer_size = USB_STREAM_DEFAULT_SIZE;
+    if (s->cfg.target_latency_us == 0) s->cfg.target_latency_us = USB_STREAM_DEFAULT_LATENCY;
+
+    // 传输大小按最大包长对齐，避免设备发送整包时缓冲区溢出
+    s->packet_size = usb_transport->get_max_packet_size(usb_transport->get_device(handle), 0x81);
+    if (s->packet_size <= 0) s->packet_size = 512;
+    s->cfg.transfer_size = (s->cfg.transfer_size + s->packet_size - 1) / s->packet_size * s->packet_size;
+    if (s->cfg.min_transfer_size < s->packet_size) s->cfg.min_transfer_size = s->packet_size;
+    s->cfg.min_transfer_size -= s->cfg.min_transfer_size % s->packet_size;
+    if (s->cfg.min_transfer_size > s->cfg.transfer_size) s->cfg.min_transfer_size = s->cfg.transfer_size;
+    // 自适应模式从下限开始，第一个窗口之后按速率增长
+    atomic_store(&s->cur_size, s->cfg.adaptive ? s->cfg.min_transfer_size : s->cfg.transfer_size);
+
+    if (s->cfg.pool) {
+        usb_pool_stats_t pool_stats;
+        usb_pool_get_stats(s->cfg.pool, &pool_stats);
+        if (pool_stats.buffer_size < s->cfg.transfer_size) {
+            USB_TRACE(POOL_TOO_SMALL, pool_stats.buffer_size, s->cfg.transfer_size);
+            free(s);
+            return LIBUSB_ERROR_INVALID_PARAM;
+        }
+    }
+
+    if (s->cfg.splitter && s->cfg.integrity) {
+        usb_frame_set_integrity(s->cfg.splitter, s->cfg.integrity);
+    }
+
+    s->transfers = (struct libusb_transfer**)calloc((size_t)s->cfg.num_transfers, sizeof(struct libusb_transfer*));
+    s->buffers = (unsigned char**)calloc((size_t)s->cfg.num_transfers, sizeof(unsigned char*));
+    s->slots = (stream_slot_t*)calloc((size_t)s->cfg.num_transfers, sizeof(stream_slot_t));
+    if (!s->transfers || !s->buffers || !s->slots) {
+        stream_free(s);
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    for (int i = 0; i < s->cfg.num_transfers; i++) {
+        s->transfers[i] = usb_transport->alloc_transfer(0);
+        if (s->cfg.pool) {
+            s->slots[i].buffer = usb_pool_get(s->cfg.pool);
+            s->buffers[i] = s->slots[i].buffer ? s->slots[i].buffer->data : NULL;
+        } else {
+            s->buffers[i] = (unsigned char*)malloc((size_t)s->cfg.transfer_size);
+        }
+        if (!s->transfers[i] || !s->buffers[i]) {
+            stream_free(s);
+            return LIBUSB_ERROR_NO_MEM;
+        }
+        s->slots[i].stream = s;
+        libusb_fill_bulk_transfer(s->transfers[i], handle, 0x81, s->buffers[i], atomic_load(&s->cur_size),
+                                  stream_transfer_cb, &s->slots[i], s->cfg.timeout);
+    }
+
+    atomic_store(&s->running, 1);
+    s->start_ns = usb_time_ns();
+    for (int i = 0; i < s->cfg.num_transfers; i++) {
+        atomic_fetch_add(&s->in_flight, 1);
+        s->slots[i].submit_ns = usb_stats_clock();
+        int r = usb_transport->submit_transfer(s->transfers[i]);
+        if (r < 0) {
+            USB_TRACE(SUBMIT_FAILED, r);
+            atomic_fetch_sub(&s->in_flight, 1);
+            stream_abort(s, i);
+            stream_free(s);
+            return r;
+        }
+    }
+
+    if (s->cfg.external_events) {
+        if (external_add(s) != 0) {
+            USB_TRACE(TOO_MANY_STREAMS);
+            stream_abort(s, s->cfg.num_transfers);
+            stream_free(s);
+            return LIBUSB_ERROR_NO_MEM;
+        }
+    } else if (usb_thread_create(&s->thread, stream_event_thread, s) != 0) {
+        USB_TRACE_STR(THREAD_FAILED, "event");
+        stream_abort(s, s->cfg.num_transfers);
+        stream_free(s);
+        return LIBUSB_ERROR_OTHER;
+    }
+
+    *stream = s;
+    return 0;
+}
+
+/* 停止流式读取 */
+int usb_stream_stop(usb_stream_t* stream) {
+    if (!stream) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    // 回调可能正在重新提交，循环取消直到所有传输都已返回
+    atomic_store(&stream->running, 0);
+    while (atomic_load(&stream->in_flight) > 0) {
+        for (int i = 0; i < stream->cfg.num_transfers; i++) {
+            usb_transport->cancel_transfer(stream->transfers[i]);  // 不在挂起状态的传输返回NOT_FOUND，忽略
+        }
+        if (stream->cfg.external_events) {
+            // 没有事件线程，取消的传输要在这里处理才会返回
+            struct timeval tv = {0, 10000};
+            usb_transport->handle_events_timeout_completed(usb_control_context(), &tv, NULL);
+            stream_resume_parked(stream);
+        } else {
+            usb_sleep_ms(10);
+        }
+    }
+    if (stream->cfg.external_events) {
+        external_remove(stream);
+    } else {
+        usb_thread_join(stream->thread);
+    }
+
+    int r = atomic_load(&stream->last_error);
+    stream_free(stream);
+    return r;
+}
+
+void usb_stream_get_stats(usb_stream_t* stream, usb_stream_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!stream) {
+        return;
+    }
+
+    uint64_t end = atomic_load(&stream->stop_ns);
+    if (end == 0) end = usb_time_ns();
+
+    stats->bytes = atomic_load_explicit(&stream->bytes, memory_order_relaxed);
+    stats->transfers = atomic_load_explicit(&stream->completed, memory_order_relaxed);
+    stats->timeouts = atomic_load_explicit(&stream->timeouts, memory_order_relaxed);
+    stats->errors = atomic_load_explicit(&stream->errors, memory_order_relaxed);
+    stats->last_error = atomic_load(&stream->last_error);
+    stats->pool_waits = atomic_load_explicit(&stream->pool_waits, memory_order_relaxed);
+    stats->transfer_size = atomic_load_explicit(&stream->cur_size, memory_order_relaxed);
+    stats->in_flight = atomic_load(&stream->in_flight);
+    stats->elapsed_sec = (double)(end - stream->start_ns) / 1e9;
+    if (stats->elapsed_sec > 0) {
+        stats->mb_per_sec = (double)stats->bytes / (1024.0 * 1024.0) / stats->elapsed_sec;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef USB_STREAM_H
+#define USB_STREAM_H
+
+#include "usb_control.h"
+#include "usb_frame.h"
+#include "usb_pool.h"
+#include "usb_integrity.h"
+
+// 异步流式读取: 在 EP 0x81 上保持多个传输同时挂起，完成后立即重新提交，
+// 数据通过回调交给调用者 (回调在事件线程中执行)。
+
+typedef struct usb_stream usb_stream_t;
+
+// 使用缓冲区池时每个完成的传输调用一次 (在事件线程中)。回调返回后流释放自己的引用，
+// 需要在回调之后继续使用数据的消费者先调用 usb_buffer_ref，用完再 usb_buffer_release
+typedef void (*usb_stream_buffer_cb)(usb_buffer_t* buffer, void* user_data);
+
+typedef struct {
+    int num_transfers;       // 同时挂起的传输数量
+    int transfer_size;       // 每个传输的字节数，向上取整为最大包长的整数倍；自适应模式下为上限
+    unsigned int timeout;    // 单个传输的超时(ms)，0表示不超时
+    usb_frame_splitter_t* splitter;  // 非NULL时每个传输的数据交给拆分器，按帧/逻辑包回调 (在事件线程中)
+    int adaptive;            // 按观测到的到达速率调整传输大小: 速率 x target_latency_us
+    int min_transfer_size;   // 自适应下限，默认一个最大包
+    unsigned int target_latency_us;  // 自适应目标: 填满一个传输的时间，默认2ms
+    usb_pool_t* pool;        // 非NULL时传输缓冲区从池中取 (缓冲区大小不能小于transfer_size)，每个传输完成后换一个
+    usb_stream_buffer_cb buffer_cb;  // 使用池时的缓冲区回调，user_data与数据回调相同
+    int external_events;     // 不创建事件线程，由调用者的事件循环调用 usb_control_process_events (usb_events.h)
+    usb_integrity_t* integrity;  // 非NULL时传输出错报告为 USB_LOSS_TRANSFER；配置了拆分器时按帧头的seq检查 (usb_integrity.h)
+    // 低延迟 (见 usb_reader.h 的 low_latency)，external_events 时无效
+    int busy_poll;           // 事件线程不阻塞等待，以0超时连续处理事件，完成的传输不经过线程唤醒 (占满一个CPU)
+    uint64_t cpu_mask;       // 非0时事件线程只在这些CPU上运行 (第i位为CPU i)
+    int realtime;            // >0: 事件线程使用实时调度，优先级1-99；没有权限时警告后按普通优先级运行
+} usb_stream_config_t;
+
+#define USB_STREAM_DEFAULT_TRANSFERS 8
+#define USB_STREAM_DEFAULT_SIZE      (16 * 1024)
+#define USB_STREAM_DEFAULT_LATENCY   2000
+
+typedef void (*usb_stream_cb)(const unsigned char* data, int length, void* user_data);
+
+typedef struct {
+    uint64_t bytes;          // 收到的总字节数
+    uint64_t transfers;      // 完成的传输数
+    uint64_t timeouts;       // 超时的传输数
+    uint64_t errors;         // 出错的传输数
+    int last_error;          // 最近一次错误 (LIBUSB_ERROR_*)
+    int transfer_size;       // 当前的传输大小 (自适应模式下会变化)
+    uint64_t pool_waits;     // 缓冲区池已空、传输暂停等待的次数
+    int in_flight;           // 挂起 (和等待缓冲区) 的传输数，为0表示流已经结束 (设备断开或传输全部出错)
+    double elapsed_sec;      // 启动以来的时间
+    double mb_per_sec;       // 启动以来的平均速率 (MB/s)
+} usb_stream_stats_t;
+
+// 在已打开的设备上开始流式读取。device为NULL时使用USB_OpenDevice打开的设备，
+// cfg为NULL时使用默认配置。每个流有自己的事件线程 (external_events时没有)，所有设备共享一个libusb上下文。
+int usb_stream_start(usb_stream_t** stream, usb_device_t* device, const usb_stream_config_t* cfg,
+                     usb_stream_cb cb, void* user_data);
+// 取消所有挂起的传输，等待事件线程退出并释放资源。
+// external_events 的流在停止时自己处理事件，调用时不能有其他线程正在 usb_control_process_events
+int usb_stream_stop(usb_stream_t* stream);
+void usb_stream_get_stats(usb_stream_t* stream, usb_stream_stats_t* stats);
+
+#endif // USB_STREAM_H
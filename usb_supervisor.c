@@ -0,0 +1,262 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_registry.h"
+#include "usb_supervisor.h"
+#include "usb_trace.h"
+
+struct usb_supervisor {
+    char serial[MAX_STR_LENGTH];
+    usb_supervisor_config_t cfg;
+    usb_stream_config_t stream_cfg; // 回调换成下面的包装
+    usb_stream_cb cb;
+    usb_stream_buffer_cb buffer_cb;
+    usb_gap_cb gap_cb;
+    void* user_data;
+
+    // 还没交付的中断: 由监护线程在启动新的流之前设置，新流第一次交付数据时回调。
+    // 两次断开之间没有数据时合并成一个中断
+    usb_gap_t gap;
+    atomic_int gap_pending;
+
+    // 以下由 lock 保护
+    usb_mutex_t lock;
+    usb_cond_t cond;
+    int running;
+    usb_device_t* device;           // 当前连接，断开时为NULL
+    usb_stream_t* stream;
+    uint64_t lost_ns;               // 当前中断的开始，0表示已连接
+    uint64_t bytes;                 // 已结束的连接的累计
+    uint64_t transfers;
+    int reconnects;
+    int attempts;
+    int last_error;
+    uint64_t downtime_ns;
+    uint64_t last_downtime_ns;
+    uint64_t max_downtime_ns;
+
+    usb_thread_t thread;
+};
+
+static void supervisor_deliver_gap(usb_supervisor_t* s) {
+    if (atomic_exchange(&s->gap_pending, 0) && s->gap_cb) {
+        s->gap_cb(&s->gap, s->user_data);
+    }
+}
+
+// 流的数据回调: 先交付挂起的中断，再交给调用者
+static void supervisor_data_cb(const unsigned char* data, int length, void* user_data) {
+    usb_supervisor_t* s = (usb_supervisor_t*)user_data;
+    if (atomic_load_explicit(&s->gap_pending, memory_order_relaxed)) {
+        supervisor_deliver_gap(s);
+    }
+    if (s->cb) {
+        s->cb(data, length, s->user_data);
+    }
+}
+
+static void supervisor_buffer_cb(usb_buffer_t* buffer, void* user_data) {
+    usb_supervisor_t* s = (usb_supervisor_t*)user_data;
+    if (atomic_load_explicit(&s->gap_pending, memory_order_relaxed)) {
+        supervisor_deliver_gap(s);
+    }
+    s->buffer_cb(buffer, s->user_data);
+}
+
+// 打开设备 (按序列号定位、认领接口0、发送打开命令) 并启动流，不持有锁时调用
+static int supervisor_open(usb_supervisor_t* s, usb_device_t** device, usb_stream_t** stream) {
+    int r = USB_OpenDeviceEx(s->serial[0] ? s->serial : NULL, device);
+    if (r < 0) {
+        return r;
+    }
+    if (s->lost_ns) {
+        s->gap.resumed_ns = usb_time_ns();
+        s->gap.reconnects = s->reconnects + 1;
+        atomic_store(&s->gap_pending, 1);
+    }
+    r = usb_stream_start(stream, *device, &s->stream_cfg, supervisor_data_cb, s);
+    if (r < 0) {
+        USB_TRACE(STREAM_START_FAILED, r);
+        atomic_store(&s->gap_pending, 0);
+        USB_CloseDeviceEx(*device);
+        *device = NULL;
+    }
+    return r;
+}
+
+// 流已经结束: 停止流、关闭设备，进入断开状态。调用时持有锁，返回时仍持有
+static void supervisor_disconnect(usb_supervisor_t* s, const usb_stream_stats_t* st) {
+    usb_stream_t* stream = s->stream;
+    usb_device_t* device = s->device;
+    uint64_t now = usb_time_ns();
+
+    s->stream = NULL;
+    s->device = NULL;
+    s->lost_ns = now;
+    s->last_error = st->last_error ? st->last_error : LIBUSB_ERROR_IO;
+    usb_mutex_unlock(&s->lock);
+
+    USB_TRACE_STR(DEVICE_LOST, s->serial, s->last_error);
+    usb_stream_stop(stream);
+    USB_CloseDeviceEx(device);
+    // 上一个中断还没交付 (恢复后没有收到数据)，合并到这一次，保留最早的断开时间
+    if (!atomic_load(&s->gap_pending)) {
+        s->gap.lost_ns = now;
+    }
+    s->gap.error = s->last_error;
+    atomic_store(&s->gap_pending, 0);
+    if (s->stream_cfg.splitter) {
+        usb_frame_reset(s->stream_cfg.splitter);
+    }
+    // 重新连接后设备的计数器可能从头开始
+    usb_integrity_note(s->stream_cfg.integrity, USB_LOSS_DISCONNECT, 1);
+    usb_integrity_restart(s->stream_cfg.integrity);
+
+    usb_mutex_lock(&s->lock);
+    s->bytes += st->bytes;
+    s->transfers += st->transfers;
+}
+
+// 监护线程: 连接时周期检查流的状态，断开时按退避间隔重试
+static void* supervisor_thread(void* arg) {
+    usb_supervisor_t* s = (usb_supervisor_t*)arg;
+    unsigned int retry = s->cfg.retry_ms;
+
+    usb_mutex_lock(&s->lock);
+    while (s->running) {
+        if (s->stream) {
+            usb_stream_stats_t st;
+            usb_stream_get_stats(s->stream, &st);
+            if (st.in_flight > 0 && st.last_error != LIBUSB_ERROR_NO_DEVICE) {
+                usb_cond_wait_until(&s->cond, &s->lock, usb_time_ns() + (uint64_t)s->cfg.poll_ms * 1000000ull);
+                continue;
+            }
+            supervisor_disconnect(s, &st);
+            retry = s->cfg.retry_ms;
+            continue;
+        }
+
+        usb_device_t* device;
+        usb_stream_t* stream;
+        s->attempts++;
+        usb_mutex_unlock(&s->lock);
+        usb_registry_refresh_ex(0);  // 处理挂起的热插拔事件，去掉已经拔出的设备
+        int r = supervisor_open(s, &device, &stream);
+        usb_mutex_lock(&s->lock);
+        if (r == 0) {
+            uint64_t downtime = s->gap.resumed_ns - s->lost_ns;
+            s->downtime_ns += downtime;
+            s->last_downtime_ns = downtime;
+            if (downtime > s->max_downtime_ns) s->max_downtime_ns = downtime;
+            s->reconnects++;
+            s->lost_ns = 0;
+            s->device = device;
+            s->stream = stream;
+            USB_TRACE_STR(DEVICE_RECONNECTED, s->serial, usb_trace_double(downtime / 1e6));
+            continue;
+        }
+        usb_cond_wait_until(&s->cond, &s->lock, usb_time_ns() + (uint64_t)retry * 1000000ull);
+        retry = retry * 2 > s->cfg.max_retry_ms ? s->cfg.max_retry_ms : retry * 2;
+    }
+    usb_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/* 开始受监护的流式读取 */
+int usb_supervisor_start(usb_supervisor_t** sup, const char* serial, const usb_supervisor_config_t* cfg,
+                         usb_stream_cb cb, usb_gap_cb gap_cb, void* user_data) {
+    if (sup == NULL || (cfg && cfg->stream.external_events)) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    usb_supervisor_t* s = (usb_supervisor_t*)calloc(1, sizeof(usb_supervisor_t));
+    if (!s) return LIBUSB_ERROR_NO_MEM;
+    if (cfg) s->cfg = *cfg;
+    if (s->cfg.poll_ms == 0) s->cfg.poll_ms = USB_SUPERVISOR_DEFAULT_POLL;
+    if (s->cfg.retry_ms == 0) s->cfg.retry_ms = USB_SUPERVISOR_DEFAULT_RETRY;
+    if (s->cfg.max_retry_ms < s->cfg.retry_ms) s->cfg.max_retry_ms = USB_SUPERVISOR_DEFAULT_MAX;
+    if (s->cfg.max_retry_ms < s->cfg.retry_ms) s->cfg.max_retry_ms = s->cfg.retry_ms;
+    s->stream_cfg = s->cfg.stream;
+    s->cb = cb;
+    s->buffer_cb = s->cfg.stream.buffer_cb;
+    if (s->buffer_cb) s->stream_cfg.buffer_cb = supervisor_buffer_cb;
+    s->gap_cb = gap_cb;
+    s->user_data = user_data;
+    if (serial) snprintf(s->serial, sizeof(s->serial), "%s", serial);
+
+    int r = supervisor_open(s, &s->device, &s->stream);
+    if (r < 0) {
+        free(s);
+        return r;
+    }
+    // 没有指定序列号时，重连也使用第一次打开的这台设备
+    snprintf(s->serial, sizeof(s->serial), "%s", usb_device_get_serial(s->device));
+
+    usb_mutex_init(&s->lock);
+    usb_cond_init(&s->cond);
+    s->running = 1;
+    if (usb_thread_create(&s->thread, supervisor_thread, s) != 0) {
+        USB_TRACE_STR(THREAD_FAILED, "supervisor");
+        usb_stream_stop(s->stream);
+        USB_CloseDeviceEx(s->device);
+        usb_cond_destroy(&s->cond);
+        usb_mutex_destroy(&s->lock);
+        free(s);
+        return LIBUSB_ERROR_OTHER;
+    }
+
+    *sup = s;
+    return 0;
+}
+
+/* 停止受监护的流式读取 */
+int usb_supervisor_stop(usb_supervisor_t* sup) {
+    if (!sup) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    usb_mutex_lock(&sup->lock);
+    sup->running = 0;
+    usb_cond_broadcast(&sup->cond);
+    usb_mutex_unlock(&sup->lock);
+    usb_thread_join(sup->thread);
+
+    int r = LIBUSB_ERROR_NO_DEVICE;
+    if (sup->stream) {
+        r = usb_stream_stop(sup->stream);
+        USB_CloseDeviceEx(sup->device);
+        supervisor_deliver_gap(sup);  // 恢复后还没收到数据
+    } else if (sup->gap_cb) {
+        // 断开时已经填好 lost_ns 和原因
+        sup->gap.resumed_ns = 0;
+        sup->gap.error = sup->last_error;
+        sup->gap.reconnects = sup->reconnects;
+        sup->gap_cb(&sup->gap, sup->user_data);
+    }
+
+    usb_cond_destroy(&sup->cond);
+    usb_mutex_destroy(&sup->lock);
+    free(sup);
+    return r;
+}
+
+void usb_supervisor_get_stats(usb_supervisor_t* sup, usb_supervisor_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!sup) {
+        return;
+    }
+
+    usb_mutex_lock(&sup->lock);
+    if (sup->stream) {
+        usb_stream_get_stats(sup->stream, &stats->stream);
+    }
+    stats->bytes = sup->bytes + stats->stream.bytes;
+    stats->transfers = sup->transfers + stats->stream.transfers;
+    stats->connected = sup->stream != NULL;
+    stats->reconnects = sup->reconnects;
+    stats->attempts = sup->attempts;
+    stats->last_error = sup->last_error;
+    stats->downtime_ns = sup->downtime_ns + (sup->lost_ns ? usb_time_ns() - sup->lost_ns : 0);
+    stats->last_downtime_ns = sup->last_downtime_ns;
+    stats->max_downtime_ns = sup->max_downtime_ns;
+    usb_mutex_unlock(&sup->lock);
+}
@@ -0,0 +1,61 @@
+#ifndef USB_SUPERVISOR_H
+#define USB_SUPERVISOR_H
+
+#include "usb_control.h"
+#include "usb_stream.h"
+
+// 受监护的流式读取: 设备掉电/拔出后自动重新连接并继续读取。
+// 监护线程发现流结束 (传输返回 NO_DEVICE，或全部传输出错) 后停止流、关闭设备，
+// 然后按序列号重新定位同一台设备，打开、认领接口0、发送打开命令，成功后启动新的流。
+// 断开前已经交付的数据不受影响 (消费者的缓冲区、采集文件保持不变)。
+//
+// 中断在数据中显式标记: 重新连接后、新连接的第一个数据回调之前调用 gap_cb (在同一个事件线程中)，
+// 所以消费者看到的顺序是 旧连接的数据 -> 中断 -> 新连接的数据。
+// 配置了拆分器时，未完成的帧在中断处丢弃 (usb_frame_reset)。
+// 配置了 stream.integrity 时，断开记为 USB_LOSS_DISCONNECT，重连后的序号可以从头开始。
+
+typedef struct usb_supervisor usb_supervisor_t;
+
+typedef struct {
+    uint64_t lost_ns;        // 发现断开的时间 (usb_time_ns)
+    uint64_t resumed_ns;     // 重新连接的时间，0表示停止时仍未恢复
+    int error;               // 断开的原因 (LIBUSB_ERROR_*)
+    int reconnects;          // 包括这一次的重连次数
+} usb_gap_t;
+
+// 数据中断回调 (在流的事件线程中执行，停止时在调用 usb_supervisor_stop 的线程中)
+typedef void (*usb_gap_cb)(const usb_gap_t* gap, void* user_data);
+
+typedef struct {
+    usb_stream_config_t stream;  // 每次连接使用的流配置 (不支持 external_events)
+    unsigned int poll_ms;        // 检查流状态的周期，默认10ms
+    unsigned int retry_ms;       // 第一次重试的间隔，之后每次加倍，默认50ms
+    unsigned int max_retry_ms;   // 重试间隔的上限，默认1000ms
+} usb_supervisor_config_t;
+
+#define USB_SUPERVISOR_DEFAULT_POLL  10
+#define USB_SUPERVISOR_DEFAULT_RETRY 50
+#define USB_SUPERVISOR_DEFAULT_MAX   1000
+
+typedef struct {
+    usb_stream_stats_t stream;   // 当前连接的流 (断开时为0)
+    uint64_t bytes;              // 所有连接累计收到的字节数
+    uint64_t transfers;          // 所有连接累计完成的传输数
+    int connected;
+    int reconnects;              // 成功重连的次数
+    int attempts;                // 重连尝试次数 (包括失败的)
+    int last_error;              // 最近一次断开的原因
+    uint64_t downtime_ns;        // 累计断开时间 (包括当前仍未恢复的)
+    uint64_t last_downtime_ns;   // 最近一次完成的中断时长
+    uint64_t max_downtime_ns;
+} usb_supervisor_stats_t;
+
+// 打开序列号为serial的设备 (NULL表示第一台设备) 并开始受监护的流式读取，
+// 第一次打开失败时直接返回错误。cb/gap_cb 的 user_data 相同，gap_cb可以为NULL
+int usb_supervisor_start(usb_supervisor_t** sup, const char* serial, const usb_supervisor_config_t* cfg,
+                         usb_stream_cb cb, usb_gap_cb gap_cb, void* user_data);
+// 停止读取并关闭设备。停止时仍在断开状态的，以 resumed_ns 为0调用一次 gap_cb
+int usb_supervisor_stop(usb_supervisor_t* sup);
+void usb_supervisor_get_stats(usb_supervisor_t* sup, usb_supervisor_stats_t* stats);
+
+#endif // USB_SUPERVISOR_H
@@ -0,0 +1,516 @@
+#include <stdatomic.h>
+#include "usb_trace.h"
+
+#define TRACE_MAX_RINGS 256
+#define TRACE_LINE      512
+
+typedef struct {
+    usb_trace_level_t level;
+    const char* name;
+    const char* format;
+} trace_event_t;
+
+#define TRACE_EVENT_ENTRY(name, level, fmt) {USB_TRACE_##level, #name, fmt},
+static const trace_event_t trace_events[USB_TRACE_NUM_EVENTS] = {USB_TRACE_EVENTS(TRACE_EVENT_ENTRY)};
+
+// 每个线程一个环: 生产者是拥有它的线程，消费者是后台线程。线程退出后环留给下一个新线程
+typedef struct {
+    atomic_uint_least64_t head;     // 生产者写，下一条记录的位置
+    uint64_t cached_tail;           // 生产者缓存的tail，满时才重新读取
+    char pad1[48];
+    atomic_uint_least64_t tail;     // 消费者写
+    uint64_t reported;              // 消费者: 已经报告过的丢弃数
+    char pad2[48];
+    atomic_uint_least64_t dropped;
+    atomic_int owned;               // 有线程在使用
+    uint32_t index;
+    uint64_t mask;
+    usb_trace_record_t* records;
+} trace_ring_t;
+
+volatile int usb_trace_threshold = USB_TRACE_INFO;
+
+static struct {
+    int initialized;
+    usb_tls_t key;
+    usb_mutex_t lock;               // 环表的增加、start/stop、flush的同步
+    usb_cond_t cond;
+    trace_ring_t* rings[TRACE_MAX_RINGS];
+    atomic_int num_rings;
+    atomic_int running;
+    atomic_int wake;                // 有环写入了半个环的记录，后台线程应立即输出
+    int stopping;
+    usb_thread_t thread;
+    usb_trace_config_t cfg;
+    FILE* file;                     // 二进制输出
+    uint64_t start_ns;
+    uint64_t flush_requested;       // flush 请求的序号
+    uint64_t flush_done;            // 后台线程完成的最后一个请求
+    atomic_uint_least64_t written;
+    atomic_uint_least64_t lost;     // 环表满、没有环可用时丢弃的记录
+} trace;
+
+// ---- 格式化 ----
+
+// 按事件的格式输出一条记录 (没有换行)
+static void trace_format(const char* fmt, const usb_trace_record_t* rec, char* out, size_t size) {
+    uint64_t args[USB_TRACE_MAX_ARGS];
+    int nargs = rec->nargs <= USB_TRACE_MAX_ARGS ? rec->nargs : USB_TRACE_MAX_ARGS;
+    const unsigned char* str = rec->payload + nargs * 8;
+    int str_length = rec->str_length <= USB_TRACE_PAYLOAD - nargs * 8 ? rec->str_length : USB_TRACE_PAYLOAD - nargs * 8;
+    size_t pos = 0;
+    int arg = 0;
+
+    memcpy(args, rec->payload, (size_t)nargs * 8);
+    while (*fmt && pos + 1 < size) {
+        if (*fmt != '%') {
+            out[pos++] = *fmt++;
+            continue;
+        }
+        fmt++;
+        if (*fmt == '%') {
+            out[pos++] = *fmt++;
+            continue;
+        }
+        // 标志、宽度、精度原样保留，长度修饰忽略，整数统一按64位
+        char spec[32];
+        size_t n = 0;
+        spec[n++] = '%';
+        while (*fmt && strchr("-+ #0123456789.", *fmt) && n < 16) spec[n++] = *fmt++;
+        while (*fmt && strchr("hlLqjzt", *fmt)) fmt++;
+        char conv = *fmt ? *fmt++ : 0;
+        uint64_t v = arg < nargs ? args[arg] : 0;
+        size_t room = size - pos;
+        int w = 0;
+        switch (conv) {
+            case 'd': case 'i':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = 0;
+                w = snprintf(out + pos, room, spec, (long long)v);
+                arg++;
+                break;
+            case 'u': case 'x': case 'X': case 'o':
+                spec[n++] = 'l'; spec[n++] = 'l'; spec[n++] = conv; spec[n] = 0;
+                w = snprintf(out + pos, room, spec, (unsigned long long)v);
+                arg++;
+                break;
+            case 'c':
+                spec[n++] = 'c'; spec[n] = 0;
+                w = snprintf(out + pos, room, spec, (int)v);
+                arg++;
+                break;
+            case 'f': case 'e': case 'g': {
+                double d;
+                memcpy(&d, &v, sizeof(d));
+                spec[n++] = conv; spec[n] = 0;
+                w = snprintf(out + pos, room, spec, d);
+                arg++;
+                break;
+            }
+            case 'E':
+                spec[n++] = 's'; spec[n] = 0;
+                w = snprintf(out + pos, room, spec, libusb_error_name((int)(int64_t)v));
+                arg++;
+                break;
+            case 's': {
+                char tmp[USB_TRACE_PAYLOAD + 1];
+                memcpy(tmp, str, (size_t)str_length);
+                tmp[str_length] = 0;
+                spec[n++] = 's'; spec[n] = 0;
+                w = snprintf(out + pos, room, spec, tmp);
+                break;
+            }
+            case 'B':
+                for (int i = 0; i < str_length && pos + 4 < size; i++) {
+                    pos += (size_t)snprintf(out + pos, size - pos, i ? " %02X" : "%02X", str[i]);
+                }
+                break;
+            default:
+                break;
+        }
+        if (w > 0) {
+            pos += (size_t)w < room ? (size_t)w : room - 1;
+        }
+    }
+    out[pos] = 0;
+}
+
+static void trace_format_line(const char* fmt, const char* level, const usb_trace_record_t* rec, uint64_t start_ns,
+                              int prefix, char* out, size_t size) {
+    size_t pos = 0;
+    if (prefix) {
+        int w = snprintf(out, size, "[%12.6f T%-2u %-5s] ",
+                         rec->time_ns >= start_ns ? (double)(rec->time_ns - start_ns) / 1e9 : 0.0,
+                         rec->thread, level);
+        pos = w > 0 && (size_t)w < size ? (size_t)w : 0;
+    }
+    trace_format(fmt, rec, out + pos, size - pos);
+}
+
+// ---- 写入 ----
+
+static void fill_record(usb_trace_record_t* rec, int event, const void* str, int str_length, const uint64_t* args,
+                        int nargs) {
+    if (nargs > USB_TRACE_MAX_ARGS) nargs = USB_TRACE_MAX_ARGS;
+    rec->time_ns = usb_time_ns();
+    rec->event = (uint16_t)event;
+    rec->nargs = (uint8_t)nargs;
+    memcpy(rec->payload, args, (size_t)nargs * 8);
+    int room = USB_TRACE_PAYLOAD - nargs * 8;
+    if (str) {
+        if (str_length < 0) {
+            const char* end = (const char*)memchr(str, 0, (size_t)room);
+            str_length = end ? (int)(end - (const char*)str) : room;
+        }
+        if (str_length > room) str_length = room;
+        memcpy(rec->payload + nargs * 8, str, (size_t)str_length);
+    } else {
+        str_length = 0;
+    }
+    rec->str_length = (uint8_t)str_length;
+}
+
+static void trace_ring_release(void* ptr) {
+    atomic_store_explicit(&((trace_ring_t*)ptr)->owned, 0, memory_order_release);
+}
+
+// 给本线程找一个环: 先用退出的线程留下的，没有再新建
+static trace_ring_t* trace_claim_ring(void) {
+    trace_ring_t* ring = NULL;
+    usb_mutex_lock(&trace.lock);
+    int n = atomic_load(&trace.num_rings);
+    for (int i = 0; i < n && !ring; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&trace.rings[i]->owned, &expected, 1)) {
+            ring = trace.rings[i];
+        }
+    }
+    if (!ring && n < TRACE_MAX_RINGS) {
+        ring = (trace_ring_t*)usb_aligned_alloc(64, sizeof(trace_ring_t));
+        usb_trace_record_t* records =
+            (usb_trace_record_t*)usb_aligned_alloc(64, sizeof(usb_trace_record_t) * (size_t)trace.cfg.ring_size);
+        if (ring && records) {
+            memset(ring, 0, sizeof(*ring));
+            atomic_init(&ring->head, 0);
+            atomic_init(&ring->tail, 0);
+            atomic_init(&ring->dropped, 0);
+            atomic_init(&ring->owned, 1);
+            ring->index = (uint32_t)n;
+            ring->mask = (uint64_t)trace.cfg.ring_size - 1;
+            ring->records = records;
+            trace.rings[n] = ring;
+            atomic_store(&trace.num_rings, n + 1);
+        } else {
+            usb_aligned_free(ring);
+            usb_aligned_free(records);
+            ring = NULL;
+        }
+    }
+    usb_mutex_unlock(&trace.lock);
+    if (ring) {
+        usb_tls_set(trace.key, ring);
+    }
+    return ring;
+}
+
+/* 写入一条记录 */
+void usb_trace_write(int event, const void* str, int str_length, const uint64_t* args, int nargs) {
+    if (event < 0 || event >= USB_TRACE_NUM_EVENTS) {
+        return;
+    }
+    if (!atomic_load_explicit(&trace.running, memory_order_acquire)) {
+        // 没有后台线程: 直接打印
+        usb_trace_record_t rec;
+        char line[TRACE_LINE];
+        fill_record(&rec, event, str, str_length, args, nargs);
+        trace_format(trace_events[event].format, &rec, line, sizeof(line));
+        printf("%s\n", line);
+        return;
+    }
+
+    trace_ring_t* ring = (trace_ring_t*)usb_tls_get(trace.key);
+    if (!ring && !(ring = trace_claim_ring())) {
+        atomic_fetch_add_explicit(&trace.lost, 1, memory_order_relaxed);
+        return;
+    }
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head - ring->cached_tail > ring->mask) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head - ring->cached_tail > ring->mask) {
+            atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+            return;
+        }
+    }
+    usb_trace_record_t* rec = &ring->records[head & ring->mask];
+    fill_record(rec, event, str, str_length, args, nargs);
+    rec->thread = ring->index;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    if (((head + 1) & (ring->mask >> 1)) == 0) {
+        // 每写入半个环的记录唤醒一次后台线程，不等周期。已经有唤醒请求时不加锁
+        if (!atomic_exchange_explicit(&trace.wake, 1, memory_order_acq_rel)) {
+            usb_mutex_lock(&trace.lock);
+            usb_cond_signal(&trace.cond);
+            usb_mutex_unlock(&trace.lock);
+        }
+    }
+}
+
+// ---- 后台线程 ----
+
+static void trace_output(const usb_trace_record_t* rec) {
+    if (trace.file) {
+        fwrite(rec, sizeof(*rec), 1, trace.file);
+    } else {
+        char line[TRACE_LINE];
+        const trace_event_t* ev = &trace_events[rec->event];
+        trace_format_line(ev->format, usb_trace_level_name(ev->level), rec, trace.start_ns, trace.cfg.prefix, line,
+                          sizeof(line));
+        fputs(line, trace.cfg.text);
+        fputc('\n', trace.cfg.text);
+    }
+    atomic_fetch_add_explicit(&trace.written, 1, memory_order_relaxed);
+}
+
+// 取出所有环中已有的记录，按时间合并输出 (每个环内有序，环之间按当前各环的第一条记录比较)
+static void trace_drain(void) {
+    uint64_t heads[TRACE_MAX_RINGS];
+    uint64_t tails[TRACE_MAX_RINGS];
+    int n = atomic_load(&trace.num_rings);
+
+    for (int i = 0; i < n; i++) {
+        heads[i] = atomic_load_explicit(&trace.rings[i]->head, memory_order_acquire);
+        tails[i] = atomic_load_explicit(&trace.rings[i]->tail, memory_order_relaxed);
+    }
+    for (;;) {
+        int best = -1;
+        uint64_t best_time = 0;
+        for (int i = 0; i < n; i++) {
+            if (tails[i] != heads[i]) {
+                uint64_t t = trace.rings[i]->records[tails[i] & trace.rings[i]->mask].time_ns;
+                if (best < 0 || t < best_time) {
+                    best = i;
+                    best_time = t;
+                }
+            }
+        }
+        if (best < 0) break;
+        trace_ring_t* ring = trace.rings[best];
+        trace_output(&ring->records[tails[best] & ring->mask]);
+        tails[best]++;
+        atomic_store_explicit(&ring->tail, tails[best], memory_order_release);
+    }
+
+    // 丢弃的记录作为一条事件输出
+    for (int i = 0; i < n; i++) {
+        uint64_t dropped = atomic_load_explicit(&trace.rings[i]->dropped, memory_order_relaxed);
+        if (dropped != trace.rings[i]->reported) {
+            usb_trace_record_t rec;
+            uint64_t args[2] = {dropped - trace.rings[i]->reported, trace.rings[i]->index};
+            fill_record(&rec, USB_EV_TRACE_DROPPED, NULL, 0, args, 2);
+            rec.thread = trace.rings[i]->index;
+            trace_output(&rec);
+            trace.rings[i]->reported = dropped;
+        }
+    }
+    if (trace.file) {
+        fflush(trace.file);
+    } else {
+        fflush(trace.cfg.text);
+    }
+}
+
+static void* trace_thread(void* arg) {
+    (void)arg;
+    usb_mutex_lock(&trace.lock);
+    while (!trace.stopping) {
+        uint64_t requested = trace.flush_requested;
+        if (requested == trace.flush_done && !atomic_load(&trace.wake)) {
+            usb_cond_wait_until(&trace.cond, &trace.lock, usb_time_ns() + (uint64_t)trace.cfg.flush_ms * 1000000ull);
+            requested = trace.flush_requested;
+        }
+        // 输出期间的唤醒请求留到下一轮
+        atomic_store(&trace.wake, 0);
+        usb_mutex_unlock(&trace.lock);
+        trace_drain();
+        usb_mutex_lock(&trace.lock);
+        trace.flush_done = requested;
+        usb_cond_broadcast(&trace.cond);
+    }
+    usb_mutex_unlock(&trace.lock);
+    trace_drain();
+    return NULL;
+}
+
+static int trace_write_header(FILE* f) {
+    usb_trace_file_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, USB_TRACE_MAGIC, sizeof(h.magic));
+    h.version = USB_TRACE_VERSION;
+    h.record_size = (uint32_t)sizeof(usb_trace_record_t);
+    h.num_events = USB_TRACE_NUM_EVENTS;
+    h.start_ns = trace.start_ns;
+    h.start_wall_ns = usb_wall_time_ns() - (usb_time_ns() - trace.start_ns);
+    if (fwrite(&h, sizeof(h), 1, f) != 1) return -1;
+    for (int i = 0; i < USB_TRACE_NUM_EVENTS; i++) {
+        usb_trace_file_event_t e;
+        memset(&e, 0, sizeof(e));
+        e.level = (uint32_t)trace_events[i].level;
+        snprintf(e.name, sizeof(e.name), "%s", trace_events[i].name);
+        snprintf(e.format, sizeof(e.format), "%s", trace_events[i].format);
+        if (fwrite(&e, sizeof(e), 1, f) != 1) return -1;
+    }
+    return 0;
+}
+
+/* 启动后台线程 */
+int usb_trace_start(const usb_trace_config_t* cfg) {
+    if (!trace.initialized) {
+        if (usb_tls_create(&trace.key, trace_ring_release) != 0) {
+            return LIBUSB_ERROR_NO_MEM;
+        }
+        usb_mutex_init(&trace.lock);
+        usb_cond_init(&trace.cond);
+        trace.initialized = 1;
+    }
+    if (atomic_load(&trace.running)) {
+        return LIBUSB_ERROR_BUSY;
+    }
+
+    memset(&trace.cfg, 0, sizeof(trace.cfg));
+    if (cfg) trace.cfg = *cfg;
+    if (!trace.cfg.text) trace.cfg.text = stdout;
+    if (trace.cfg.ring_size <= 0) trace.cfg.ring_size = USB_TRACE_DEFAULT_RING;
+    if (trace.cfg.ring_size & (trace.cfg.ring_size - 1)) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    if (trace.cfg.flush_ms == 0) trace.cfg.flush_ms = USB_TRACE_DEFAULT_FLUSH;
+    trace.start_ns = usb_time_ns();
+    trace.file = NULL;
+    if (trace.cfg.path) {
+        trace.file = fopen(trace.cfg.path, "wb");
+        if (!trace.file || trace_write_header(trace.file) < 0) {
+            USB_TRACE_STR(TRACE_FILE_FAILED, trace.cfg.path);
+            if (trace.file) fclose(trace.file);
+            trace.file = NULL;
+            return LIBUSB_ERROR_IO;
+        }
+    }
+    trace.stopping = 0;
+    atomic_store(&trace.wake, 0);
+    trace.flush_requested = trace.flush_done = 0;
+    if (usb_thread_create(&trace.thread, trace_thread, NULL) != 0) {
+        if (trace.file) fclose(trace.file);
+        trace.file = NULL;
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    atomic_store(&trace.running, 1);
+    return 0;
+}
+
+void usb_trace_stop(void) {
+    if (!trace.initialized || !atomic_load(&trace.running)) {
+        return;
+    }
+    usb_mutex_lock(&trace.lock);
+    trace.stopping = 1;
+    usb_cond_broadcast(&trace.cond);
+    usb_mutex_unlock(&trace.lock);
+    usb_thread_join(trace.thread);
+    atomic_store(&trace.running, 0);
+    trace_drain();
+    if (trace.file) {
+        fclose(trace.file);
+        trace.file = NULL;
+    }
+}
+
+void usb_trace_flush(void) {
+    if (!trace.initialized || !atomic_load(&trace.running)) {
+        return;
+    }
+    usb_mutex_lock(&trace.lock);
+    uint64_t want = ++trace.flush_requested;
+    usb_cond_broadcast(&trace.cond);
+    while (trace.flush_done < want && !trace.stopping) {
+        usb_cond_wait_until(&trace.cond, &trace.lock, usb_time_ns() + 100000000ull);
+    }
+    usb_mutex_unlock(&trace.lock);
+}
+
+void usb_trace_get_stats(usb_trace_stats_t* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->written = atomic_load(&trace.written);
+    stats->dropped = atomic_load(&trace.lost);
+    stats->threads = atomic_load(&trace.num_rings);
+    for (int i = 0; i < stats->threads; i++) {
+        stats->dropped += atomic_load(&trace.rings[i]->dropped);
+    }
+}
+
+// ---- 级别 ----
+
+void usb_trace_set_level(usb_trace_level_t level) {
+    usb_trace_threshold = (int)level;
+}
+
+usb_trace_level_t usb_trace_get_level(void) {
+    return (usb_trace_level_t)usb_trace_threshold;
+}
+
+static const char* const trace_level_names[] = {"off", "error", "warn", "info", "debug"};
+
+int usb_trace_parse_level(const char* name) {
+    for (int i = 0; i <= USB_TRACE_DEBUG; i++) {
+        if (strcmp(name, trace_level_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char* usb_trace_level_name(usb_trace_level_t level) {
+    return level >= USB_TRACE_OFF && level <= USB_TRACE_DEBUG ? trace_level_names[level] : "?";
+}
+
+// ---- 离线解码 ----
+
+/* 解码二进制文件 */
+int usb_trace_decode(const char* path, FILE* out) {
+    usb_trace_file_header_t h;
+    usb_trace_file_event_t* events;
+    usb_trace_record_t rec;
+    char line[TRACE_LINE];
+    int count = 0;
+
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        USB_TRACE_STR(TRACE_OPEN_FAILED, path);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, USB_TRACE_MAGIC, sizeof(h.magic)) != 0 ||
+        h.record_size != sizeof(usb_trace_record_t) || h.num_events == 0 || h.num_events > 65536) {
+        USB_TRACE_STR(NOT_A_TRACE, path);
+        fclose(f);
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    events = (usb_trace_file_event_t*)calloc(h.num_events, sizeof(usb_trace_file_event_t));
+    if (!events || fread(events, sizeof(usb_trace_file_event_t), h.num_events, f) != h.num_events) {
+        free(events);
+        fclose(f);
+        return events ? LIBUSB_ERROR_IO : LIBUSB_ERROR_NO_MEM;
+    }
+    // 格式来自文件本身，写入它的程序版本不同也能解码
+    while (fread(&rec, sizeof(rec), 1, f) == 1) {
+        if (rec.event < h.num_events) {
+            usb_trace_file_event_t* e = &events[rec.event];
+            e->format[sizeof(e->format) - 1] = 0;
+            trace_format_line(e->format, usb_trace_level_name((usb_trace_level_t)e->level), &rec, h.start_ns, 1, line,
+                              sizeof(line));
+        } else {
+            snprintf(line, sizeof(line), "[%12.6f T%-2u ?    ] unknown event %u", (double)(rec.time_ns - h.start_ns) / 1e9,
+                     rec.thread, rec.event);
+        }
+        fprintf(out, "%s\n", line);
+        count++;
+    }
+    free(events);
+    fclose(f);
+    return count;
+}
@@ -0,0 +1,197 @@
+#ifndef USB_TRACE_H
+#define USB_TRACE_H
+
+#include "usb_control.h"
+
+// 跟踪日志: 代替控制路径和热路径上的printf。
+// 每个事件是一条64字节的二进制记录 (时间、事件号、参数)，写入本线程自己的无锁环形缓冲区 (SPSC)，
+// 格式化推迟到后台线程 (输出文本)，或者原样写入二进制文件、之后离线解码 (usb_trace_decode)。
+// 写入一条记录约为几十ns，不做格式化和I/O；环满时丢弃新记录并计数，不会阻塞读取。
+// 级别可以在运行时修改，低于当前级别的事件只有一次比较。
+//
+// 没有调用 usb_trace_start 时，事件在调用的线程中直接格式化打印到stdout (与原来的printf相同)。
+//
+// 事件在下面的表中定义: 名字、级别、格式。格式是printf格式，参数在写入时保存、输出时才格式化:
+//   %d %i %u %x %X %o %c  整数参数 (不用写长度修饰，按64位处理)
+//   %f %e %g              浮点参数，用 usb_trace_double(x) 传入
+//   %E                    整数参数，按 libusb_error_name 输出
+//   %s                    事件的字符串 (USB_TRACE_STR，每个事件最多一个)
+//   %B                    事件的字节 (USB_TRACE_BYTES)，按十六进制输出
+// 参数和字符串共用40字节: 参数每个8字节，剩下的给字符串 (超出的截断)。
+
+#define USB_TRACE_MAX_ARGS   5
+#define USB_TRACE_PAYLOAD    (USB_TRACE_MAX_ARGS * 8)
+#define USB_TRACE_MAGIC      "USBTRC01"
+#define USB_TRACE_VERSION    1
+#define USB_TRACE_FORMAT_LENGTH 96
+#define USB_TRACE_DEFAULT_RING  16384
+#define USB_TRACE_DEFAULT_FLUSH 20
+
+typedef enum {
+    USB_TRACE_OFF = 0,
+    USB_TRACE_ERROR = 1,
+    USB_TRACE_WARN = 2,
+    USB_TRACE_INFO = 3,
+    USB_TRACE_DEBUG = 4
+} usb_trace_level_t;
+
+// 事件表: X(名字, 级别, 格式)
+#define USB_TRACE_EVENTS(X) \
+    X(TRACE_DROPPED,      WARN,  "%u trace event(s) dropped on thread %u") \
+    X(INIT_FAILED,        ERROR, "Init Error: %E") \
+    X(INIT_OK,            INFO,  "%s initialized successfully") \
+    X(LIB_LOAD_FAILED,    ERROR, "Failed to load %s") \
+    X(LIB_LOADED,         INFO,  "Loaded %s") \
+    X(LIB_SYMBOLS_FAILED, ERROR, "Failed to get function pointers") \
+    X(LIB_SYMBOLS_OK,     INFO,  "Got function pointers") \
+    X(DEVICE_LIST_FAILED, ERROR, "Get Device Error: %E") \
+    X(DEVICE_LIST,        INFO,  "Found %d devices") \
+    X(DESCRIPTOR_FAILED,  WARN,  "Failed to get device descriptor: %E") \
+    X(DESCRIPTORS_FAILED, WARN,  "Cannot read descriptors: %E") \
+    X(STRING_FAILED,      WARN,  "Failed to read string descriptor %d: %E") \
+    X(NO_DEVICES,         WARN,  "No matching devices found") \
+    X(DEVICES_FOUND,      INFO,  "Found %d matching device(s)") \
+    X(TARGET_NOT_FOUND,   ERROR, "Target device not found") \
+    X(CANDIDATE,          INFO,  "Candidate device S/N: %s") \
+    X(TARGET_FOUND,       INFO,  "Found target device!") \
+    X(OPEN_FAILED,        ERROR, "Cannot open device: %E") \
+    X(OPENING,            INFO,  "Opening device with S/N: %s") \
+    X(SET_CONFIG_FAILED,  ERROR, "Failed to set configuration: %E") \
+    X(CLAIM_FAILED,       ERROR, "Failed to claim interface: %E") \
+    X(OPEN_COMMAND,       INFO,  "Sending open command...") \
+    X(OPEN_COMMAND_FAILED, ERROR, "Failed to send open command: %E") \
+    X(OPENED,             INFO,  "Device opened successfully (transferred %d bytes)") \
+    X(CLOSE_COMMAND,      INFO,  "Sending close command...") \
+    X(CLOSED,             INFO,  "Device closed successfully (transferred %d bytes)") \
+    X(CLOSE_FAILED,       ERROR, "Error in bulk transfer: %E") \
+    X(DEVICE_READ,        DEBUG, "read %d of %d bytes: %E") \
+    X(POOL_TOO_SMALL,     ERROR, "Pool buffer size %d is smaller than transfer size %d") \
+    X(SUBMIT_FAILED,      ERROR, "Failed to submit transfer: %E") \
+    X(TOO_MANY_STREAMS,   ERROR, "Too many streams on the external event loop") \
+    X(THREAD_FAILED,      ERROR, "Failed to create %s thread") \
+    X(AFFINITY_FAILED,    WARN,  "Cannot pin %s thread to CPU mask 0x%x") \
+    X(REALTIME_FAILED,    WARN,  "Cannot set real-time priority %d for %s thread (needs privileges)") \
+    X(REALTIME_SKIPPED,   WARN,  "Busy polling with real-time priority needs 2+ CPUs, %s thread keeps normal priority") \
+    X(STREAM_TRANSFER,    DEBUG, "stream transfer %d bytes, status %d") \
+    X(STREAM_START_FAILED, ERROR, "Failed to start stream: %E") \
+    X(DEVICE_LOST,        WARN,  "Device %s lost (%E), reconnecting...") \
+    X(DEVICE_RECONNECTED, INFO,  "Device %s reconnected after %.1f ms") \
+    X(DATA_RECEIVED,      INFO,  "Received %d bytes: %B") \
+    X(EXTERNAL_TRIGGER,   INFO,  "External trigger") \
+    X(SEGMENT_FAILED,     ERROR, "Failed to create capture segment %s") \
+    X(NOT_A_SEGMENT,      ERROR, "%s is not a capture segment") \
+    X(NO_SEGMENTS,        ERROR, "No capture segments found at %s") \
+    X(REPLAY_NO_DEVICES,  ERROR, "Capture %s has no devices") \
+    X(SHM_CREATE_FAILED,  ERROR, "Failed to create shared memory %s") \
+    X(SHM_BAD_FORMAT,     ERROR, "Shared memory %s has an unknown format") \
+    X(SHM_TOO_MANY_READERS, ERROR, "Too many shared memory readers") \
+    X(TRACE_FILE_FAILED,  ERROR, "Failed to create trace file %s") \
+    X(TRACE_OPEN_FAILED,  ERROR, "Cannot open trace file %s") \
+    X(NOT_A_TRACE,        ERROR, "%s is not a trace file")
+
+#define USB_TRACE_EVENT_ID(name, level, fmt) USB_EV_##name,
+#define USB_TRACE_EVENT_LEVEL(name, level, fmt) USB_EV_LEVEL_##name = USB_TRACE_##level,
+typedef enum { USB_TRACE_EVENTS(USB_TRACE_EVENT_ID) USB_TRACE_NUM_EVENTS } usb_trace_event_t;
+enum { USB_TRACE_EVENTS(USB_TRACE_EVENT_LEVEL) };
+
+// 二进制记录 (环中和文件中相同)
+typedef struct {
+    uint64_t time_ns;        // usb_time_ns
+    uint16_t event;          // usb_trace_event_t
+    uint8_t nargs;
+    uint8_t str_length;      // 字符串/字节的长度，位于参数之后
+    uint32_t thread;         // 线程序号 (第一次写入时分配)
+    unsigned char payload[USB_TRACE_PAYLOAD];  // 参数 (uint64_t) + 字符串
+} usb_trace_record_t;
+
+// 二进制文件: [文件头][事件表 x num_events][记录]...
+typedef struct {
+    char magic[8];           // USB_TRACE_MAGIC
+    uint32_t version;
+    uint32_t record_size;    // sizeof(usb_trace_record_t)
+    uint32_t num_events;
+    uint32_t reserved;
+    uint64_t start_ns;       // 开始时的单调时钟
+    uint64_t start_wall_ns;  // 同一时刻的墙上时间
+} usb_trace_file_header_t;
+
+typedef struct {
+    uint32_t level;
+    char name[28];
+    char format[USB_TRACE_FORMAT_LENGTH];
+} usb_trace_file_event_t;
+
+typedef struct {
+    const char* path;        // 二进制文件，NULL时在后台线程格式化为文本写到text
+    FILE* text;              // 文本输出，默认stdout
+    int prefix;              // 文本每行加上 [时间 线程 级别] 前缀
+    int ring_size;           // 每个线程的环能容纳的记录数 (2的幂)，默认16384 (每个写过事件的线程1MB)
+    unsigned int flush_ms;   // 后台线程的周期，默认20ms；每个环每写入半个环的记录也唤醒一次
+} usb_trace_config_t;
+
+typedef struct {
+    uint64_t written;        // 输出的记录数
+    uint64_t dropped;        // 环满丢弃的记录数
+    int threads;             // 写过记录的线程数 (环的个数)
+} usb_trace_stats_t;
+
+// 当前级别，只由 usb_trace_set_level 修改
+extern volatile int usb_trace_threshold;
+
+void usb_trace_set_level(usb_trace_level_t level);
+usb_trace_level_t usb_trace_get_level(void);
+// "off" "error" "warn" "info" "debug"，无法识别返回-1
+int usb_trace_parse_level(const char* name);
+const char* usb_trace_level_name(usb_trace_level_t level);
+
+// 启动后台线程，cfg为NULL时文本输出到stdout。已经启动返回 LIBUSB_ERROR_BUSY
+int usb_trace_start(const usb_trace_config_t* cfg);
+// 输出所有已写入的记录后停止，之后的事件恢复直接打印
+void usb_trace_stop(void);
+// 等待后台线程输出调用前写入的记录 (没有启动时立即返回)
+void usb_trace_flush(void);
+void usb_trace_get_stats(usb_trace_stats_t* stats);
+
+// 离线解码二进制文件为文本 (带前缀)，返回记录数或负的 LIBUSB_ERROR_*
+int usb_trace_decode(const char* path, FILE* out);
+
+// 写入一条记录 (通过下面的宏调用)。str_length < 0 时str按C字符串处理
+void usb_trace_write(int event, const void* str, int str_length, const uint64_t* args, int nargs);
+
+static inline uint64_t usb_trace_double(double x) {
+    uint64_t bits;
+    memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+#define USB_TRACE_ON(ev) (usb_trace_threshold >= USB_EV_LEVEL_##ev)
+
+// 参数为整数 (浮点用 usb_trace_double)，最多 USB_TRACE_MAX_ARGS 个
+#define USB_TRACE(ev, ...) \
+    do { \
+        if (USB_TRACE_ON(ev)) { \
+            const uint64_t usb_trace_args_[] = {0, __VA_ARGS__}; \
+            usb_trace_write(USB_EV_##ev, NULL, 0, usb_trace_args_ + 1, \
+                            (int)(sizeof(usb_trace_args_) / sizeof(uint64_t)) - 1); \
+        } \
+    } while (0)
+
+#define USB_TRACE_STR(ev, str, ...) \
+    do { \
+        if (USB_TRACE_ON(ev)) { \
+            const uint64_t usb_trace_args_[] = {0, __VA_ARGS__}; \
+            usb_trace_write(USB_EV_##ev, (str), -1, usb_trace_args_ + 1, \
+                            (int)(sizeof(usb_trace_args_) / sizeof(uint64_t)) - 1); \
+        } \
+    } while (0)
+
+#define USB_TRACE_BYTES(ev, data, length, ...) \
+    do { \
+        if (USB_TRACE_ON(ev)) { \
+            const uint64_t usb_trace_args_[] = {0, __VA_ARGS__}; \
+            usb_trace_write(USB_EV_##ev, (data), (length), usb_trace_args_ + 1, \
+                            (int)(sizeof(usb_trace_args_) / sizeof(uint64_t)) - 1); \
+        } \
+    } while (0)
+
+#endif // USB_TRACE_H
@@ -0,0 +1,55 @@
+#ifndef USB_TRANSPORT_H
+#define USB_TRANSPORT_H
+
+#include "usb_control.h"
+
+// 传输后端虚函数表。函数签名与libusb-1.0一致，库内所有对设备的访问都经过当前后端:
+//   libusb - 真实设备 (LoadLibrary / dlopen 加载libusb-1.0)
+//   sim    - 进程内确定性模拟设备 (usb_sim.h)
+//   replay - 回放采集文件 (usb_replay.h)
+//   null   - 空设备，传输立即完成且不写数据，用于测量纯主机端开销
+// 也可以自己实现一个表，通过 usb_control_init_transport 使用。
+typedef struct usb_transport {
+    const char* name;
+    libusb_init_t init;
+    libusb_exit_t exit;
+    libusb_get_device_list_t get_device_list;
+    libusb_free_device_list_t free_device_list;
+    libusb_get_device_descriptor_t get_device_descriptor;
+    libusb_get_bus_number_t get_bus_number;
+    libusb_get_port_numbers_t get_port_numbers;
+    libusb_ref_device_t ref_device;
+    libusb_unref_device_t unref_device;
+    libusb_get_device_t get_device;
+    libusb_get_max_packet_size_t get_max_packet_size;
+    libusb_open_t open;
+    libusb_close_t close;
+    libusb_set_configuration_t set_configuration;
+    libusb_claim_interface_t claim_interface;
+    libusb_release_interface_t release_interface;
+    libusb_get_string_descriptor_ascii_t get_string_descriptor_ascii;
+    libusb_bulk_transfer_t bulk_transfer;
+    libusb_alloc_transfer_t alloc_transfer;
+    libusb_free_transfer_t free_transfer;
+    libusb_submit_transfer_t submit_transfer;
+    libusb_cancel_transfer_t cancel_transfer;
+    libusb_handle_events_timeout_completed_t handle_events_timeout_completed;
+    libusb_hotplug_register_callback_t hotplug_register_callback;      // 可以为NULL (不支持热插拔)
+    libusb_hotplug_deregister_callback_t hotplug_deregister_callback;
+    libusb_get_pollfds_t get_pollfds;                                  // 可以为NULL (不能接入外部事件循环)
+    libusb_free_pollfds_t free_pollfds;
+    libusb_get_next_timeout_t get_next_timeout;
+} usb_transport_t;
+
+extern const usb_transport_t usb_transport_sim;
+extern const usb_transport_t usb_transport_null;
+extern const usb_transport_t usb_transport_replay;
+
+// 使用指定的后端初始化 (表在 usb_control_exit 之前必须保持有效)
+int usb_control_init_transport(const usb_transport_t* transport);
+// 使用空设备初始化
+int usb_control_init_null(void);
+// 当前后端，未初始化时为NULL
+const usb_transport_t* usb_control_transport(void);
+
+#endif // USB_TRANSPORT_H
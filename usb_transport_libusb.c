@@ -0,0 +1,86 @@
+#include "usb_internal.h"
+#include "usb_trace.h"
+
+// 真实libusb后端: 运行时加载 libusb-1.0 (Windows: LoadLibrary, 其他: dlopen)
+
+static usb_lib_t dll = NULL;
+static usb_transport_t libusb_table;
+
+#define LOAD(field, name) \
+    libusb_table.field = (void*)usb_lib_sym(dll, name)
+
+int usb_transport_libusb_load(const usb_transport_t** transport) {
+    // Load DLL
+    dll = usb_lib_open(LIBUSB_DLL_PATH);
+    if (!dll) {
+        USB_TRACE_STR(LIB_LOAD_FAILED, LIBUSB_DLL_PATH);
+        return -1;
+    }
+    USB_TRACE_STR(LIB_LOADED, LIBUSB_DLL_PATH);
+
+    // Get function pointers
+    memset(&libusb_table, 0, sizeof(libusb_table));
+    libusb_table.name = "libusb";
+    LOAD(init, "libusb_init");
+    LOAD(exit, "libusb_exit");
+    LOAD(get_device_list, "libusb_get_device_list");
+    LOAD(free_device_list, "libusb_free_device_list");
+    LOAD(get_device_descriptor, "libusb_get_device_descriptor");
+    LOAD(get_bus_number, "libusb_get_bus_number");
+    LOAD(get_port_numbers, "libusb_get_port_numbers");
+    LOAD(ref_device, "libusb_ref_device");
+    LOAD(unref_device, "libusb_unref_device");
+    LOAD(get_device, "libusb_get_device");
+    LOAD(get_max_packet_size, "libusb_get_max_packet_size");
+    LOAD(open, "libusb_open");
+    LOAD(close, "libusb_close");
+    LOAD(set_configuration, "libusb_set_configuration");
+    LOAD(claim_interface, "libusb_claim_interface");
+    LOAD(release_interface, "libusb_release_interface");
+    LOAD(get_string_descriptor_ascii, "libusb_get_string_descriptor_ascii");
+    LOAD(bulk_transfer, "libusb_bulk_transfer");
+    LOAD(alloc_transfer, "libusb_alloc_transfer");
+    LOAD(free_transfer, "libusb_free_transfer");
+    LOAD(submit_transfer, "libusb_submit_transfer");
+    LOAD(cancel_transfer, "libusb_cancel_transfer");
+    LOAD(handle_events_timeout_completed, "libusb_handle_events_timeout_completed");
+    LOAD(hotplug_register_callback, "libusb_hotplug_register_callback");
+    LOAD(hotplug_deregister_callback, "libusb_hotplug_deregister_callback");
+    LOAD(get_pollfds, "libusb_get_pollfds");
+    LOAD(free_pollfds, "libusb_free_pollfds");
+    LOAD(get_next_timeout, "libusb_get_next_timeout");
+
+    const usb_transport_t* t = &libusb_table;
+    if (!t->init || !t->exit || !t->get_device_list || !t->free_device_list ||
+        !t->get_device_descriptor || !t->get_bus_number || !t->get_port_numbers ||
+        !t->ref_device || !t->unref_device || !t->get_device || !t->get_max_packet_size || !t->open || !t->close || !t->set_configuration ||
+        !t->claim_interface || !t->release_interface || !t->get_string_descriptor_ascii ||
+        !t->bulk_transfer || !t->alloc_transfer || !t->free_transfer || !t->submit_transfer ||
+        !t->cancel_transfer || !t->handle_events_timeout_completed) {
+        USB_TRACE(LIB_SYMBOLS_FAILED);
+        usb_lib_close(dll);
+        dll = NULL;
+        return -1;
+    }
+    if (!t->hotplug_register_callback || !t->hotplug_deregister_callback) {
+        libusb_table.hotplug_register_callback = NULL;
+        libusb_table.hotplug_deregister_callback = NULL;
+    }
+    // Windows上libusb没有可poll的fd (get_pollfds返回NULL)，free_pollfds从1.0.20开始才有
+    if (!t->get_pollfds || !t->free_pollfds || !t->get_next_timeout) {
+        libusb_table.get_pollfds = NULL;
+        libusb_table.free_pollfds = NULL;
+        libusb_table.get_next_timeout = NULL;
+    }
+    USB_TRACE(LIB_SYMBOLS_OK);
+
+    *transport = t;
+    return 0;
+}
+
+void usb_transport_libusb_unload(void) {
+    if (dll) {
+        usb_lib_close(dll);
+        dll = NULL;
+    }
+}
@@ -0,0 +1,335 @@
+#include "usb_internal.h"
+
+// 空设备后端: 一台设备，读取立即以请求长度完成，不写缓冲区，也没有速率限制。
+// 用来测量库本身 (提交/回调/环形缓冲/消费者) 的主机端开销。
+
+struct libusb_device {
+    struct libusb_device_descriptor desc;
+    int present;
+};
+
+struct libusb_device_handle {
+    struct libusb_device* dev;
+};
+
+typedef struct null_transfer {
+    struct null_transfer* next;
+} null_transfer_t;
+
+#define NULL_TRANSFER(t) ((null_transfer_t*)((char*)(t) - sizeof(null_transfer_t)))
+#define NULL_LIBUSB(p)   ((struct libusb_transfer*)((char*)(p) + sizeof(null_transfer_t)))
+
+static const char* null_serial = "NULL0001";
+static struct libusb_device null_device;
+static usb_mutex_t null_lock;
+static usb_mutex_t null_event_lock;
+static usb_cond_t null_cond;
+static null_transfer_t* null_head = NULL;   // 已完成待回调，FIFO
+static null_transfer_t** null_tail = &null_head;
+static int null_context;
+static libusb_hotplug_callback_fn null_hotplug_cb = NULL;
+static usb_timer_fd_t null_timer;           // 外部事件循环: 有已完成的传输时可读
+static struct libusb_pollfd null_pollfd;
+static int null_pollable = 0;
+static int null_armed = 0;
+
+// 调用时持有 null_lock
+static void null_rearm(void) {
+    int want = null_head != NULL;
+    if (null_pollable && want != null_armed) {
+        usb_timer_fd_arm(&null_timer, want ? 1 : 0);
+        null_armed = want;
+    }
+}
+
+static int null_init(libusb_context** ctx) {
+    usb_mutex_init(&null_lock);
+    usb_mutex_init(&null_event_lock);
+    usb_cond_init(&null_cond);
+    memset(&null_device, 0, sizeof(null_device));
+    null_device.desc.bLength = 18;
+    null_device.desc.bDescriptorType = 1;
+    null_device.desc.bcdUSB = 0x0200;
+    null_device.desc.bMaxPacketSize0 = 64;
+    null_device.desc.idVendor = VENDOR_ID;
+    null_device.desc.idProduct = PRODUCT_ID;
+    null_device.desc.iSerialNumber = 3;
+    null_device.desc.bNumConfigurations = 1;
+    null_device.present = 1;
+    null_head = NULL;
+    null_tail = &null_head;
+    null_hotplug_cb = NULL;
+    null_pollable = 0;
+    *ctx = (libusb_context*)&null_context;
+    return LIBUSB_SUCCESS;
+}
+
+static void null_exit(libusb_context* ctx) {
+    (void)ctx;
+    if (null_pollable) {
+        usb_timer_fd_close(&null_timer);
+        null_pollable = 0;
+    }
+    usb_cond_destroy(&null_cond);
+    usb_mutex_destroy(&null_event_lock);
+    usb_mutex_destroy(&null_lock);
+}
+
+static ssize_t null_get_device_list(libusb_context* ctx, libusb_device*** list) {
+    (void)ctx;
+    libusb_device** devs = (libusb_device**)calloc(2, sizeof(libusb_device*));
+    if (!devs) return LIBUSB_ERROR_NO_MEM;
+    devs[0] = &null_device;
+    *list = devs;
+    return 1;
+}
+
+static void null_free_device_list(libusb_device** list, int unref_devices) {
+    (void)unref_devices;
+    free(list);
+}
+
+static int null_get_device_descriptor(libusb_device* dev, struct libusb_device_descriptor* desc) {
+    *desc = dev->desc;
+    return LIBUSB_SUCCESS;
+}
+
+static uint8_t null_get_bus_number(libusb_device* dev) {
+    (void)dev;
+    return 0;
+}
+
+static int null_get_port_numbers(libusb_device* dev, uint8_t* port_numbers, int length) {
+    (void)dev;
+    if (length < 1) return LIBUSB_ERROR_OVERFLOW;
+    port_numbers[0] = 1;
+    return 1;
+}
+
+static libusb_device* null_ref_device(libusb_device* dev) {
+    return dev;
+}
+
+static void null_unref_device(libusb_device* dev) {
+    (void)dev;
+}
+
+static libusb_device* null_get_device(libusb_device_handle* handle) {
+    return handle->dev;
+}
+
+static int null_get_max_packet_size(libusb_device* dev, unsigned char endpoint) {
+    (void)dev;
+    (void)endpoint;
+    return 512;
+}
+
+static int null_open(libusb_device* dev, libusb_device_handle** handle) {
+    libusb_device_handle* h = (libusb_device_handle*)calloc(1, sizeof(libusb_device_handle));
+    if (!h) return LIBUSB_ERROR_NO_MEM;
+    h->dev = dev;
+    *handle = h;
+    return LIBUSB_SUCCESS;
+}
+
+static void null_close(libusb_device_handle* handle) {
+    free(handle);
+}
+
+static int null_set_configuration(libusb_device_handle* handle, int configuration) {
+    (void)handle;
+    return configuration == 1 ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int null_claim_interface(libusb_device_handle* handle, int interface_number) {
+    (void)handle;
+    return interface_number == 0 ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int null_release_interface(libusb_device_handle* handle, int interface_number) {
+    (void)handle;
+    (void)interface_number;
+    return LIBUSB_SUCCESS;
+}
+
+static int null_get_string_descriptor_ascii(libusb_device_handle* handle, uint8_t desc_index, unsigned char* data, int length) {
+    (void)handle;
+    if (desc_index != 3) return LIBUSB_ERROR_INVALID_PARAM;
+    int n = (int)strlen(null_serial);
+    if (n >= length) n = length - 1;
+    memcpy(data, null_serial, (size_t)n);
+    data[n] = 0;
+    return n;
+}
+
+static int null_bulk_transfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data, int length, int* transferred, unsigned int timeout) {
+    (void)handle;
+    (void)endpoint;
+    (void)data;
+    (void)timeout;
+    *transferred = length;
+    return LIBUSB_SUCCESS;
+}
+
+static struct libusb_transfer* null_alloc_transfer(int iso_packets) {
+    size_t size = sizeof(null_transfer_t) + sizeof(struct libusb_transfer) +
+                  (size_t)iso_packets * sizeof(struct libusb_iso_packet_descriptor);
+    null_transfer_t* nt = (null_transfer_t*)calloc(1, size);
+    if (!nt) return NULL;
+    NULL_LIBUSB(nt)->num_iso_packets = iso_packets;
+    return NULL_LIBUSB(nt);
+}
+
+static void null_free_transfer(struct libusb_transfer* transfer) {
+    if (transfer) {
+        free(NULL_TRANSFER(transfer));
+    }
+}
+
+static int null_submit_transfer(struct libusb_transfer* transfer) {
+    null_transfer_t* nt = NULL_TRANSFER(transfer);
+    usb_mutex_lock(&null_lock);
+    nt->next = NULL;
+    *null_tail = nt;
+    null_tail = &nt->next;
+    null_rearm();
+    usb_cond_signal(&null_cond);
+    usb_mutex_unlock(&null_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int null_cancel_transfer(struct libusb_transfer* transfer) {
+    // 传输提交后立即完成，没有可以取消的
+    (void)transfer;
+    return LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int null_handle_events_timeout_completed(libusb_context* ctx, struct timeval* tv, int* completed) {
+    (void)ctx;
+    uint64_t now = usb_time_ns();
+    uint64_t deadline = now + (uint64_t)tv->tv_sec * 1000000000ull + (uint64_t)tv->tv_usec * 1000ull;
+
+    if (deadline == now) {
+        if (!usb_mutex_trylock(&null_event_lock)) return LIBUSB_SUCCESS;
+    } else {
+        usb_mutex_lock(&null_event_lock);
+    }
+
+    // 只处理进入时已完成的一批，回调中重新提交的留给下一次调用
+    usb_mutex_lock(&null_lock);
+    if (null_pollable) {
+        usb_timer_fd_clear(&null_timer);
+        null_armed = 0;
+    }
+    while (!null_head && !(completed && *completed) && usb_time_ns() < deadline) {
+        usb_cond_wait_until(&null_cond, &null_lock, deadline);
+    }
+    null_transfer_t* done = null_head;
+    null_head = NULL;
+    null_tail = &null_head;
+    usb_mutex_unlock(&null_lock);
+
+    while (done) {
+        null_transfer_t* nt = done;
+        struct libusb_transfer* transfer = NULL_LIBUSB(nt);
+        done = nt->next;
+        transfer->status = LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = transfer->length;
+        transfer->callback(transfer);
+    }
+    usb_mutex_unlock(&null_event_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int null_hotplug_register_callback(libusb_context* ctx, int events, int flags, int vendor_id, int product_id,
+                                          int dev_class, libusb_hotplug_callback_fn cb_fn, void* user_data,
+                                          libusb_hotplug_callback_handle* callback_handle) {
+    (void)vendor_id;
+    (void)product_id;
+    (void)dev_class;
+    if (null_hotplug_cb) return LIBUSB_ERROR_NO_MEM;
+    null_hotplug_cb = cb_fn;
+    if (callback_handle) *callback_handle = 1;
+    if ((flags & LIBUSB_HOTPLUG_ENUMERATE) && (events & LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)) {
+        cb_fn(ctx, &null_device, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, user_data);
+    }
+    return LIBUSB_SUCCESS;
+}
+
+static void null_hotplug_deregister_callback(libusb_context* ctx, libusb_hotplug_callback_handle callback_handle) {
+    (void)ctx;
+    (void)callback_handle;
+    null_hotplug_cb = NULL;
+}
+
+static const struct libusb_pollfd** null_get_pollfds(libusb_context* ctx) {
+    (void)ctx;
+    const struct libusb_pollfd** list = (const struct libusb_pollfd**)calloc(2, sizeof(struct libusb_pollfd*));
+    if (!list) return NULL;
+    usb_mutex_lock(&null_lock);
+    if (!null_pollable) {
+        if (usb_timer_fd_create(&null_timer) != 0) {
+            usb_mutex_unlock(&null_lock);
+            free(list);
+            return NULL;
+        }
+        null_pollfd.fd = null_timer.fd;
+        null_pollfd.events = POLLIN;
+        null_pollable = 1;
+        null_armed = 0;
+        null_rearm();
+    }
+    list[0] = &null_pollfd;
+    usb_mutex_unlock(&null_lock);
+    return list;
+}
+
+static void null_free_pollfds(const struct libusb_pollfd** list) {
+    free((void*)list);
+}
+
+// 传输提交后立即完成，有挂起的传输时不需要等待
+static int null_get_next_timeout(libusb_context* ctx, struct timeval* tv) {
+    (void)ctx;
+    usb_mutex_lock(&null_lock);
+    int pending = null_head != NULL;
+    usb_mutex_unlock(&null_lock);
+    if (!pending) {
+        return 0;
+    }
+    tv->tv_sec = 0;
+    tv->tv_usec = 0;
+    return 1;
+}
+
+const usb_transport_t usb_transport_null = {
+    "null",
+    null_init,
+    null_exit,
+    null_get_device_list,
+    null_free_device_list,
+    null_get_device_descriptor,
+    null_get_bus_number,
+    null_get_port_numbers,
+    null_ref_device,
+    null_unref_device,
+    null_get_device,
+    null_get_max_packet_size,
+    null_open,
+    null_close,
+    null_set_configuration,
+    null_claim_interface,
+    null_release_interface,
+    null_get_string_descriptor_ascii,
+    null_bulk_transfer,
+    null_alloc_transfer,
+    null_free_transfer,
+    null_submit_transfer,
+    null_cancel_transfer,
+    null_handle_events_timeout_completed,
+    null_hotplug_register_callback,
+    null_hotplug_deregister_callback,
+    null_get_pollfds,
+    null_free_pollfds,
+    null_get_next_timeout,
+};
@@ -0,0 +1,601 @@
+#include "usb_internal.h"
+#include "usb_capture.h"
+#include "usb_trace.h"
+
+// 回放后端: 每台设备有自己的读取游标，只取本设备的记录。
+// 记录的完成时间 = 打开命令的时间 + (记录时间 - 采集开始时间) / speed，同一设备按顺序完成。
+// 数据在提交时从映射的段文件复制到传输缓冲区 (游标换段后原来的映射就无效了)，
+// 消费者在回调之前不会读取缓冲区，效果和完成时写入相同。
+
+struct libusb_device {
+    struct libusb_device_descriptor desc;
+    char serial[USB_CAPTURE_SERIAL_LENGTH];
+    int index;
+    int claimed;
+    int streaming;
+    int finished;                    // 记录已读完 (不循环时)
+    usb_capture_reader_t* reader;
+    usb_capture_record_t record;     // 当前记录
+    const unsigned char* payload;
+    uint32_t consumed;               // 当前记录已经读出的字节数
+    int has_record;
+    uint64_t base_ns;                // 本轮回放开始的时钟
+    uint64_t last_ready_ns;          // 上一次读取的完成时间，保证按提交顺序完成
+};
+
+struct libusb_device_handle {
+    struct libusb_device* dev;
+};
+
+// 异步传输的私有头，放在 libusb_transfer 之前
+typedef struct replay_transfer {
+    struct replay_transfer* next;
+    uint64_t ready_ns;
+    int actual_length;
+    enum libusb_transfer_status status;
+} replay_transfer_t;
+
+#define REPLAY_TRANSFER(t) ((replay_transfer_t*)((char*)(t) - sizeof(replay_transfer_t)))
+#define REPLAY_LIBUSB(p)   ((struct libusb_transfer*)((char*)(p) + sizeof(replay_transfer_t)))
+
+static usb_replay_config_t replay_cfg;
+static usb_capture_info_t replay_info;
+static struct libusb_device replay_devices[MAX_DEVICES];
+static int replay_num_devices = 0;
+static usb_mutex_t replay_lock;
+static usb_mutex_t replay_event_lock;
+static usb_cond_t replay_cond;
+static replay_transfer_t* replay_pending = NULL;  // 按 ready_ns 排序
+static int replay_context;
+static libusb_hotplug_callback_fn replay_hotplug_cb = NULL;
+
+// 外部事件循环: 第一次 get_pollfds 之后定时器总是设在最早的挂起传输
+static usb_timer_fd_t replay_timer;
+static struct libusb_pollfd replay_pollfd;
+static int replay_pollable = 0;
+static uint64_t replay_armed_ns = 0;
+
+static const char* replay_manufacturer = "Replay";
+static const char* replay_product = "USB Replay Device";
+
+static void replay_cleanup(void) {
+    for (int i = 0; i < replay_num_devices; i++) {
+        usb_capture_reader_close(replay_devices[i].reader);
+    }
+    memset(replay_devices, 0, sizeof(replay_devices));
+    replay_num_devices = 0;
+}
+
+/* 打开采集文件，每个序列号一台设备 */
+int usb_replay_setup(const usb_replay_config_t* cfg) {
+    usb_capture_reader_t* reader;
+
+    if (cfg == NULL || cfg->path == NULL) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    replay_cleanup();
+    replay_cfg = *cfg;
+    if (replay_cfg.speed < 0) replay_cfg.speed = 0;
+
+    int r = usb_capture_reader_open(&reader, cfg->path);
+    if (r < 0) {
+        return r;
+    }
+    usb_capture_reader_get_info(reader, &replay_info);
+    usb_capture_reader_close(reader);
+    if (replay_info.num_devices <= 0) {
+        USB_TRACE_STR(REPLAY_NO_DEVICES, cfg->path);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+
+    for (int i = 0; i < replay_info.num_devices && i < MAX_DEVICES; i++) {
+        struct libusb_device* dev = &replay_devices[i];
+        r = usb_capture_reader_open(&dev->reader, cfg->path);
+        if (r < 0) {
+            replay_cleanup();
+            return r;
+        }
+        replay_num_devices++;
+        dev->desc.bLength = 18;
+        dev->desc.bDescriptorType = 1;
+        dev->desc.bcdUSB = 0x0200;
+        dev->desc.bMaxPacketSize0 = 64;
+        dev->desc.idVendor = VENDOR_ID;
+        dev->desc.idProduct = PRODUCT_ID;
+        dev->desc.iManufacturer = 1;
+        dev->desc.iProduct = 2;
+        dev->desc.iSerialNumber = 3;
+        dev->desc.bNumConfigurations = 1;
+        dev->index = i;
+        memcpy(dev->serial, replay_info.serials[i], sizeof(dev->serial));
+        dev->serial[sizeof(dev->serial) - 1] = 0;
+    }
+    return LIBUSB_SUCCESS;
+}
+
+// 保证有当前记录，读完时按配置从头开始。没有记录返回0，调用时持有 replay_lock
+static int replay_peek(struct libusb_device* dev) {
+    int wrapped = 0;
+    while (!dev->has_record) {
+        int r = usb_capture_reader_next(dev->reader, &dev->record, &dev->payload);
+        if (r == 1) {
+            if (dev->record.type == USB_CAPTURE_DATA && dev->record.device == (uint8_t)dev->index &&
+                dev->record.length > 0) {
+                dev->has_record = 1;
+                dev->consumed = 0;
+            }
+            continue;
+        }
+        if (r < 0 || !replay_cfg.loop || wrapped) {
+            dev->finished = 1;
+            return 0;
+        }
+        // 下一轮紧接着上一轮最后一次读取
+        usb_capture_reader_seek(dev->reader, 0);
+        dev->base_ns = dev->last_ready_ns;
+        wrapped = 1;
+    }
+    return 1;
+}
+
+// 当前记录的完成时间，调用时持有 replay_lock
+static uint64_t replay_ready_ns(struct libusb_device* dev, uint64_t now) {
+    uint64_t ready = now;
+    if (replay_cfg.speed > 0) {
+        uint64_t offset = dev->record.time_ns > replay_info.start_ns ? dev->record.time_ns - replay_info.start_ns : 0;
+        ready = dev->base_ns + (uint64_t)((double)offset / replay_cfg.speed);
+    }
+    return ready < dev->last_ready_ns ? dev->last_ready_ns : ready;
+}
+
+// 从当前记录复制最多length字节 (记录放不下时按整包截断)，调用时持有 replay_lock
+static int replay_take(struct libusb_device* dev, unsigned char* data, int length, uint64_t ready) {
+    uint32_t n = dev->record.length - dev->consumed;
+    if ((uint32_t)length < n) {
+        n = (uint32_t)(length - length % USB_REPLAY_PACKET);
+    }
+    memcpy(data, dev->payload + dev->consumed, n);
+    dev->consumed += n;
+    if (dev->consumed == dev->record.length) {
+        dev->has_record = 0;
+    }
+    dev->last_ready_ns = ready;
+    return (int)n;
+}
+
+// 命令端点: 0x01 从头开始回放, 0x00 停止。调用时持有 replay_lock
+static void replay_command(struct libusb_device* dev, const unsigned char* data, int length, uint64_t now) {
+    if (length <= 0) return;
+    dev->streaming = data[0] == 0x01;
+    if (dev->streaming) {
+        usb_capture_reader_seek(dev->reader, 0);
+        dev->has_record = 0;
+        dev->finished = 0;
+        dev->base_ns = now;
+        dev->last_ready_ns = now;
+    }
+}
+
+static void replay_insert(replay_transfer_t* rt) {
+    replay_transfer_t** pp = &replay_pending;
+    while (*pp && (*pp)->ready_ns <= rt->ready_ns) {
+        pp = &(*pp)->next;
+    }
+    rt->next = *pp;
+    *pp = rt;
+}
+
+// 调用时持有 replay_lock
+static void replay_rearm(void) {
+    if (!replay_pollable) return;
+    uint64_t next = 0;
+    if (replay_pending && replay_pending->ready_ns != UINT64_MAX) {
+        next = replay_pending->ready_ns ? replay_pending->ready_ns : 1;
+    }
+    if (next != replay_armed_ns) {
+        usb_timer_fd_arm(&replay_timer, next);
+        replay_armed_ns = next;
+    }
+}
+
+static int replay_init(libusb_context** ctx) {
+    if (replay_num_devices == 0) {
+        return LIBUSB_ERROR_NOT_FOUND;  // 没有调用 usb_replay_setup
+    }
+    usb_mutex_init(&replay_lock);
+    usb_mutex_init(&replay_event_lock);
+    usb_cond_init(&replay_cond);
+    replay_pending = NULL;
+    replay_hotplug_cb = NULL;
+    replay_pollable = 0;
+    *ctx = (libusb_context*)&replay_context;
+    return LIBUSB_SUCCESS;
+}
+
+static void replay_exit(libusb_context* ctx) {
+    (void)ctx;
+    if (replay_pollable) {
+        usb_timer_fd_close(&replay_timer);
+        replay_pollable = 0;
+    }
+    replay_cleanup();
+    usb_cond_destroy(&replay_cond);
+    usb_mutex_destroy(&replay_event_lock);
+    usb_mutex_destroy(&replay_lock);
+}
+
+static ssize_t replay_get_device_list(libusb_context* ctx, libusb_device*** list) {
+    (void)ctx;
+    libusb_device** devs = (libusb_device**)calloc((size_t)replay_num_devices + 1, sizeof(libusb_device*));
+    if (!devs) return LIBUSB_ERROR_NO_MEM;
+    for (int i = 0; i < replay_num_devices; i++) {
+        devs[i] = &replay_devices[i];
+    }
+    *list = devs;
+    return replay_num_devices;
+}
+
+static void replay_free_device_list(libusb_device** list, int unref_devices) {
+    (void)unref_devices;
+    free(list);
+}
+
+static int replay_get_device_descriptor(libusb_device* dev, struct libusb_device_descriptor* desc) {
+    *desc = dev->desc;
+    return LIBUSB_SUCCESS;
+}
+
+static uint8_t replay_get_bus_number(libusb_device* dev) {
+    (void)dev;
+    return 1;
+}
+
+static int replay_get_port_numbers(libusb_device* dev, uint8_t* port_numbers, int length) {
+    if (length < 1) return LIBUSB_ERROR_OVERFLOW;
+    port_numbers[0] = (uint8_t)(dev->index + 1);
+    return 1;
+}
+
+static libusb_device* replay_ref_device(libusb_device* dev) {
+    return dev;
+}
+
+static void replay_unref_device(libusb_device* dev) {
+    (void)dev;
+}
+
+static libusb_device* replay_get_device(libusb_device_handle* handle) {
+    return handle->dev;
+}
+
+static int replay_get_max_packet_size(libusb_device* dev, unsigned char endpoint) {
+    (void)dev;
+    return (endpoint & 0x7F) == 1 ? USB_REPLAY_PACKET : LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int replay_open(libusb_device* dev, libusb_device_handle** handle) {
+    libusb_device_handle* h = (libusb_device_handle*)calloc(1, sizeof(libusb_device_handle));
+    if (!h) return LIBUSB_ERROR_NO_MEM;
+    h->dev = dev;
+    *handle = h;
+    return LIBUSB_SUCCESS;
+}
+
+static void replay_close(libusb_device_handle* handle) {
+    free(handle);
+}
+
+static int replay_set_configuration(libusb_device_handle* handle, int configuration) {
+    (void)handle;
+    return configuration == 1 ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int replay_claim_interface(libusb_device_handle* handle, int interface_number) {
+    if (interface_number != 0) return LIBUSB_ERROR_NOT_FOUND;
+    usb_mutex_lock(&replay_lock);
+    int r = handle->dev->claimed ? LIBUSB_ERROR_BUSY : LIBUSB_SUCCESS;
+    handle->dev->claimed = 1;
+    usb_mutex_unlock(&replay_lock);
+    return r;
+}
+
+static int replay_release_interface(libusb_device_handle* handle, int interface_number) {
+    (void)interface_number;
+    usb_mutex_lock(&replay_lock);
+    handle->dev->claimed = 0;
+    usb_mutex_unlock(&replay_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int replay_get_string_descriptor_ascii(libusb_device_handle* handle, uint8_t desc_index, unsigned char* data, int length) {
+    const char* s;
+    switch (desc_index) {
+        case 1: s = replay_manufacturer; break;
+        case 2: s = replay_product; break;
+        case 3: s = handle->dev->serial; break;
+        default: return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    int n = (int)strlen(s);
+    if (n >= length) n = length - 1;
+    memcpy(data, s, (size_t)n);
+    data[n] = 0;
+    return n;
+}
+
+static int replay_bulk_transfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data, int length, int* transferred, unsigned int timeout) {
+    struct libusb_device* dev = handle->dev;
+    uint64_t now = usb_time_ns();
+    *transferred = 0;
+
+    if (endpoint == 0x01) {
+        usb_mutex_lock(&replay_lock);
+        replay_command(dev, data, length, now);
+        usb_mutex_unlock(&replay_lock);
+        *transferred = length;
+        return LIBUSB_SUCCESS;
+    }
+    if (endpoint != 0x81) {
+        return LIBUSB_ERROR_PIPE;
+    }
+    if (length < USB_REPLAY_PACKET) {
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+
+    uint64_t ready = UINT64_MAX;
+    uint64_t timeout_ns = timeout ? (uint64_t)timeout * 1000000ull : UINT64_MAX;
+    int n = 0;
+    usb_mutex_lock(&replay_lock);
+    if (dev->streaming && replay_peek(dev)) {
+        ready = replay_ready_ns(dev, now);
+        if (ready <= now || ready - now <= timeout_ns) {
+            n = replay_take(dev, data, length, ready);
+        }
+    }
+    usb_mutex_unlock(&replay_lock);
+
+    if (ready > now && ready - now > timeout_ns) {
+        usb_sleep_until_ns(now + timeout_ns);
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+    usb_sleep_until_ns(ready);
+    *transferred = n;
+    return LIBUSB_SUCCESS;
+}
+
+static struct libusb_transfer* replay_alloc_transfer(int iso_packets) {
+    size_t size = sizeof(replay_transfer_t) + sizeof(struct libusb_transfer) +
+                  (size_t)iso_packets * sizeof(struct libusb_iso_packet_descriptor);
+    replay_transfer_t* rt = (replay_transfer_t*)calloc(1, size);
+    if (!rt) return NULL;
+    REPLAY_LIBUSB(rt)->num_iso_packets = iso_packets;
+    return REPLAY_LIBUSB(rt);
+}
+
+static void replay_free_transfer(struct libusb_transfer* transfer) {
+    if (transfer) {
+        free(REPLAY_TRANSFER(transfer));
+    }
+}
+
+static int replay_submit_transfer(struct libusb_transfer* transfer) {
+    replay_transfer_t* rt = REPLAY_TRANSFER(transfer);
+    struct libusb_device* dev = transfer->dev_handle->dev;
+    uint64_t now = usb_time_ns();
+    uint64_t timeout_ns = transfer->timeout ? (uint64_t)transfer->timeout * 1000000ull : UINT64_MAX;
+
+    usb_mutex_lock(&replay_lock);
+    rt->status = LIBUSB_TRANSFER_COMPLETED;
+    rt->actual_length = transfer->length;
+    rt->ready_ns = now;
+    if (transfer->endpoint == 0x01) {
+        replay_command(dev, transfer->buffer, transfer->length, now);
+    } else if (transfer->length < USB_REPLAY_PACKET) {
+        rt->status = LIBUSB_TRANSFER_OVERFLOW;
+        rt->actual_length = 0;
+    } else if (dev->streaming && replay_peek(dev)) {
+        uint64_t ready = replay_ready_ns(dev, now);
+        if (ready > now && ready - now > timeout_ns) {
+            // 超时前记录还没到，不消耗
+            rt->ready_ns = now + timeout_ns;
+            rt->status = LIBUSB_TRANSFER_TIMED_OUT;
+            rt->actual_length = 0;
+        } else {
+            rt->ready_ns = ready;
+            rt->actual_length = replay_take(dev, transfer->buffer, transfer->length, ready);
+        }
+    } else {
+        rt->ready_ns = timeout_ns == UINT64_MAX ? UINT64_MAX : now + timeout_ns;
+        rt->status = LIBUSB_TRANSFER_TIMED_OUT;
+        rt->actual_length = 0;
+    }
+    replay_insert(rt);
+    replay_rearm();
+    usb_cond_broadcast(&replay_cond);
+    usb_mutex_unlock(&replay_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int replay_cancel_transfer(struct libusb_transfer* transfer) {
+    replay_transfer_t* rt = REPLAY_TRANSFER(transfer);
+    int r = LIBUSB_ERROR_NOT_FOUND;
+
+    usb_mutex_lock(&replay_lock);
+    for (replay_transfer_t** pp = &replay_pending; *pp; pp = &(*pp)->next) {
+        if (*pp == rt) {
+            *pp = rt->next;
+            rt->status = LIBUSB_TRANSFER_CANCELLED;
+            rt->actual_length = 0;
+            rt->ready_ns = 0;
+            replay_insert(rt);
+            replay_rearm();
+            usb_cond_broadcast(&replay_cond);
+            r = LIBUSB_SUCCESS;
+            break;
+        }
+    }
+    usb_mutex_unlock(&replay_lock);
+    return r;
+}
+
+static int replay_handle_events_timeout_completed(libusb_context* ctx, struct timeval* tv, int* completed) {
+    (void)ctx;
+    uint64_t now = usb_time_ns();
+    uint64_t deadline = now + (uint64_t)tv->tv_sec * 1000000000ull + (uint64_t)tv->tv_usec * 1000ull;
+    replay_transfer_t* done = NULL;
+    replay_transfer_t** tail = &done;
+
+    if (deadline == now) {
+        if (!usb_mutex_trylock(&replay_event_lock)) return LIBUSB_SUCCESS;
+    } else {
+        usb_mutex_lock(&replay_event_lock);
+    }
+    usb_mutex_lock(&replay_lock);
+    if (replay_pollable) {
+        usb_timer_fd_clear(&replay_timer);
+        replay_armed_ns = 0;
+    }
+    for (;;) {
+        if (completed && *completed) break;
+        now = usb_time_ns();
+        while (replay_pending && replay_pending->ready_ns <= now) {
+            replay_transfer_t* rt = replay_pending;
+            replay_pending = rt->next;
+            rt->next = NULL;
+            *tail = rt;
+            tail = &rt->next;
+        }
+        if (done || now >= deadline) break;
+        uint64_t wake = deadline;
+        if (replay_pending && replay_pending->ready_ns < wake) {
+            wake = replay_pending->ready_ns;
+        }
+        usb_cond_wait_until(&replay_cond, &replay_lock, wake);
+    }
+    replay_rearm();
+    usb_mutex_unlock(&replay_lock);
+
+    while (done) {
+        replay_transfer_t* rt = done;
+        struct libusb_transfer* transfer = REPLAY_LIBUSB(rt);
+        done = rt->next;
+        transfer->status = rt->status;
+        transfer->actual_length = rt->actual_length;
+        transfer->callback(transfer);
+    }
+    usb_mutex_unlock(&replay_event_lock);
+    return LIBUSB_SUCCESS;
+}
+
+// 回放设备不会拔出，只支持注册时枚举
+static int replay_hotplug_register_callback(libusb_context* ctx, int events, int flags, int vendor_id, int product_id,
+                                            int dev_class, libusb_hotplug_callback_fn cb_fn, void* user_data,
+                                            libusb_hotplug_callback_handle* callback_handle) {
+    (void)vendor_id;
+    (void)product_id;
+    (void)dev_class;
+    if (replay_hotplug_cb) return LIBUSB_ERROR_NO_MEM;
+    replay_hotplug_cb = cb_fn;
+    if (callback_handle) *callback_handle = 1;
+    if ((flags & LIBUSB_HOTPLUG_ENUMERATE) && (events & LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)) {
+        for (int i = 0; i < replay_num_devices; i++) {
+            cb_fn(ctx, &replay_devices[i], LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, user_data);
+        }
+    }
+    return LIBUSB_SUCCESS;
+}
+
+static void replay_hotplug_deregister_callback(libusb_context* ctx, libusb_hotplug_callback_handle callback_handle) {
+    (void)ctx;
+    (void)callback_handle;
+    replay_hotplug_cb = NULL;
+}
+
+static const struct libusb_pollfd** replay_get_pollfds(libusb_context* ctx) {
+    (void)ctx;
+    const struct libusb_pollfd** list = (const struct libusb_pollfd**)calloc(2, sizeof(struct libusb_pollfd*));
+    if (!list) return NULL;
+    usb_mutex_lock(&replay_lock);
+    if (!replay_pollable) {
+        if (usb_timer_fd_create(&replay_timer) != 0) {
+            usb_mutex_unlock(&replay_lock);
+            free(list);
+            return NULL;
+        }
+        replay_pollfd.fd = replay_timer.fd;
+        replay_pollfd.events = POLLIN;
+        replay_pollable = 1;
+        replay_armed_ns = 0;
+        replay_rearm();
+    }
+    list[0] = &replay_pollfd;
+    usb_mutex_unlock(&replay_lock);
+    return list;
+}
+
+static void replay_free_pollfds(const struct libusb_pollfd** list) {
+    free((void*)list);
+}
+
+static int replay_get_next_timeout(libusb_context* ctx, struct timeval* tv) {
+    (void)ctx;
+    uint64_t next = UINT64_MAX;
+    usb_mutex_lock(&replay_lock);
+    if (replay_pending) {
+        next = replay_pending->ready_ns;
+    }
+    usb_mutex_unlock(&replay_lock);
+    if (next == UINT64_MAX) {
+        return 0;
+    }
+    uint64_t now = usb_time_ns();
+    uint64_t wait = next > now ? next - now : 0;
+    tv->tv_sec = (long)(wait / 1000000000ull);
+    tv->tv_usec = (long)(wait % 1000000000ull / 1000ull);
+    return 1;
+}
+
+/* 所有开始回放的设备是否都已读完 */
+int usb_replay_finished(void) {
+    int started = 0, finished = 1;
+    usb_mutex_lock(&replay_lock);
+    for (int i = 0; i < replay_num_devices; i++) {
+        if (replay_devices[i].streaming) {
+            started = 1;
+            finished = finished && replay_devices[i].finished && !replay_devices[i].has_record;
+        }
+    }
+    usb_mutex_unlock(&replay_lock);
+    return started && finished;
+}
+
+const usb_transport_t usb_transport_replay = {
+    "replay",
+    replay_init,
+    replay_exit,
+    replay_get_device_list,
+    replay_free_device_list,
+    replay_get_device_descriptor,
+    replay_get_bus_number,
+    replay_get_port_numbers,
+    replay_ref_device,
+    replay_unref_device,
+    replay_get_device,
+    replay_get_max_packet_size,
+    replay_open,
+    replay_close,
+    replay_set_configuration,
+    replay_claim_interface,
+    replay_release_interface,
+    replay_get_string_descriptor_ascii,
+    replay_bulk_transfer,
+    replay_alloc_transfer,
+    replay_free_transfer,
+    replay_submit_transfer,
+    replay_cancel_transfer,
+    replay_handle_events_timeout_completed,
+    replay_hotplug_register_callback,
+    replay_hotplug_deregister_callback,
+    replay_get_pollfds,
+    replay_free_pollfds,
+    replay_get_next_timeout,
+};
@@ -0,0 +1,916 @@
+#include <stdatomic.h>
+#include "usb_internal.h"
+#include "usb_sim.h"
+#include "usb_frame.h"
+#include "usb_trace.h"
+
+// 模拟设备：按配置的速率产生数据，数据内容为设备字节计数(低8位)，
+// 便于消费者检查数据连续性。分帧模式下第k帧的负载为 (k + i) 的低8位。
+
+struct libusb_device {
+    struct libusb_device_descriptor desc;
+    char serial[MAX_STR_LENGTH];
+    int index;
+    int present;
+    int claimed;
+    int streaming;           // 收到打开命令(0x01)后开始产生数据
+    uint64_t consumed_ns;    // 下一个未读字节的产生时间
+    uint64_t byte_offset;    // 下一个未读字节的序号
+    uint64_t overrun_bytes;  // FIFO溢出丢弃的字节数
+    uint64_t last_ready_ns;  // 上一次读取的完成时间，保证按提交顺序完成
+    uint64_t last_write_ns;  // 上一次写入(EP 0x01)的完成时间，写入之间也按提交顺序完成
+    uint64_t clock_base_ns;  // 开始产生数据的时间和当时的字节序号，设备时间戳由此推算
+    uint64_t clock_base_offset;
+};
+
+struct libusb_device_handle {
+    struct libusb_device* dev;
+};
+
+// 异步传输的私有头，放在 libusb_transfer 之前
+typedef struct sim_transfer {
+    struct sim_transfer* next;
+    uint64_t ready_ns;       // 完成时间
+    uint64_t byte_offset;    // 数据起始序号
+    int actual_length;
+    enum libusb_transfer_status status;
+} sim_transfer_t;
+
+#define SIM_TRANSFER(t) ((sim_transfer_t*)((char*)(t) - sizeof(sim_transfer_t)))
+#define SIM_LIBUSB(p)   ((struct libusb_transfer*)((char*)(p) + sizeof(sim_transfer_t)))
+
+static usb_sim_config_t sim_cfg;
+static struct libusb_device sim_devices[USB_SIM_MAX_DEVICES];
+static usb_mutex_t sim_lock;
+static usb_mutex_t sim_event_lock;          // 同libusb: 同一时间只有一个线程处理事件
+static usb_cond_t sim_cond;
+static sim_transfer_t* sim_pending = NULL;  // 按 ready_ns 排序
+static int sim_context;                     // libusb_init返回的占位上下文
+static uint64_t sim_rng;                    // xorshift64 状态，持有 sim_lock 时访问
+static uint32_t sim_frame_crc[256];         // 负载只取决于 帧号%256，预先算好CRC
+static uint64_t sim_epoch_ns;               // 初始化的时间，设备时钟从这里算起
+
+// 外部事件循环: 第一次 get_pollfds 之后定时器总是设在下一个要处理的时刻
+static usb_timer_fd_t sim_timer;
+static struct libusb_pollfd sim_pollfd;
+static int sim_pollable = 0;
+static uint64_t sim_armed_ns = 0;           // 定时器当前的到期时间，没变时不重复设置
+
+// 故障注入线程 (dropout_interval_ms)
+static usb_thread_t sim_fault_thread;
+static atomic_int sim_fault_running;
+
+// 热插拔回调和待分发的事件
+#define SIM_MAX_HOTPLUG 8
+#define SIM_MAX_EVENTS  64
+typedef struct {
+    libusb_hotplug_callback_fn cb;
+    void* user_data;
+    int events;
+} sim_hotplug_t;
+typedef struct {
+    struct libusb_device* dev;
+    libusb_hotplug_event event;
+} sim_event_t;
+static sim_hotplug_t sim_hotplug[SIM_MAX_HOTPLUG];
+static sim_event_t sim_events[SIM_MAX_EVENTS];
+static int sim_num_events = 0;
+
+static const char* sim_manufacturer = "Simulated";
+static const char* sim_product = "USB Sim Device";
+
+void usb_sim_setup(const usb_sim_config_t* cfg) {
+    if (cfg) {
+        sim_cfg = *cfg;
+    } else {
+        memset(&sim_cfg, 0, sizeof(sim_cfg));
+        sim_cfg.num_devices = 1;
+        sim_cfg.bytes_per_sec = USB_SIM_DEFAULT_RATE;
+    }
+    if (sim_cfg.num_devices <= 0) sim_cfg.num_devices = 1;
+    if (sim_cfg.num_devices > USB_SIM_MAX_DEVICES) sim_cfg.num_devices = USB_SIM_MAX_DEVICES;
+    if (sim_cfg.fifo_bytes <= 0) sim_cfg.fifo_bytes = USB_SIM_DEFAULT_FIFO;
+    if (sim_cfg.packet_size <= 0) sim_cfg.packet_size = USB_SIM_DEFAULT_PACKET;
+    if (sim_cfg.dropout_ms <= 0) sim_cfg.dropout_ms = USB_SIM_DEFAULT_DROPOUT;
+    sim_rng = sim_cfg.seed ? sim_cfg.seed : 0x9E3779B97F4A7C15ull;
+    if (sim_cfg.frame_payload > USB_SIM_MAX_FRAME) sim_cfg.frame_payload = USB_SIM_MAX_FRAME;
+    if (sim_cfg.frame_payload < USB_FRAME_TIMESTAMP_SIZE) sim_cfg.timestamps = 0;
+    sim_epoch_ns = usb_time_ns();
+    for (int k = 0; sim_cfg.frame_payload > 0 && k < 256; k++) {
+        unsigned char chunk[256];
+        uint32_t crc = 0;
+        for (int i = 0; i < 256; i++) chunk[i] = (uint8_t)(k + i);
+        for (int done = 0; done < sim_cfg.frame_payload; done += 256) {
+            int n = sim_cfg.frame_payload - done < 256 ? sim_cfg.frame_payload - done : 256;
+            crc = usb_crc32c(crc, chunk, (size_t)n);  // 负载以256为周期
+        }
+        sim_frame_crc[k] = crc;
+    }
+
+    memset(sim_devices, 0, sizeof(sim_devices));
+    for (int i = 0; i < sim_cfg.num_devices; i++) {
+        struct libusb_device* dev = &sim_devices[i];
+        dev->desc.bLength = 18;
+        dev->desc.bDescriptorType = 1;
+        dev->desc.bcdUSB = 0x0200;
+        dev->desc.bMaxPacketSize0 = 64;
+        dev->desc.idVendor = VENDOR_ID;
+        dev->desc.idProduct = PRODUCT_ID;
+        dev->desc.iManufacturer = 1;
+        dev->desc.iProduct = 2;
+        dev->desc.iSerialNumber = 3;
+        dev->desc.bNumConfigurations = 1;
+        dev->index = i;
+        dev->present = 1;
+        snprintf(dev->serial, sizeof(dev->serial), "SIM%04d", i + 1);
+    }
+}
+
+// 一次读取实际能得到的长度: 按整包截断；分帧且帧尾是短包时，传输在帧尾结束。由 sim_produce 调用
+static int sim_read_length(struct libusb_device* dev, int length) {
+    length -= length % sim_cfg.packet_size;
+    if (sim_cfg.frame_payload > 0) {
+        uint64_t frame_size = USB_FRAME_HEADER_SIZE + (uint64_t)sim_cfg.frame_payload;
+        if (frame_size % (uint64_t)sim_cfg.packet_size != 0) {
+            uint64_t remaining = frame_size - dev->byte_offset % frame_size;
+            if (remaining < (uint64_t)length) {
+                length = (int)remaining;
+            }
+        }
+    }
+    return length;
+}
+
+// 计算一次读取的完成时间并推进设备的数据时间线，*length返回实际读取的长度，调用时持有 sim_lock
+static uint64_t sim_produce(struct libusb_device* dev, int* length, uint64_t now, uint64_t* offset) {
+    if (sim_cfg.bytes_per_sec <= 0) {
+        *length = sim_read_length(dev, *length);
+        *offset = dev->byte_offset;
+        dev->byte_offset += (uint64_t)*length;
+        return now;
+    }
+
+    double ns_per_byte = 1e9 / sim_cfg.bytes_per_sec;
+    uint64_t fifo_ns = (uint64_t)(sim_cfg.fifo_bytes * ns_per_byte);
+    if (now > dev->consumed_ns + fifo_ns) {
+        // 主机读取太慢，设备FIFO溢出
+        uint64_t lost = (uint64_t)((double)(now - fifo_ns - dev->consumed_ns) / ns_per_byte);
+        if (sim_cfg.frame_payload > 0) {
+            // 分帧输出时设备丢弃整帧，下一次读取从帧头开始
+            uint64_t frame_size = USB_FRAME_HEADER_SIZE + (uint64_t)sim_cfg.frame_payload;
+            lost += (frame_size - (dev->byte_offset + lost) % frame_size) % frame_size;
+        }
+        dev->byte_offset += lost;
+        dev->overrun_bytes += lost;
+        dev->consumed_ns = now - fifo_ns;
+    }
+
+    // 溢出之后再决定帧边界
+    *length = sim_read_length(dev, *length);
+    *offset = dev->byte_offset;
+    dev->byte_offset += (uint64_t)*length;
+    dev->consumed_ns += (uint64_t)(*length * ns_per_byte);
+    return dev->consumed_ns;
+}
+
+static uint64_t sim_random(void) {
+    sim_rng ^= sim_rng << 13;
+    sim_rng ^= sim_rng >> 7;
+    sim_rng ^= sim_rng << 17;
+    return sim_rng;
+}
+
+// 在数据就绪时间上加上完成延迟和抖动，调用时持有 sim_lock
+static uint64_t sim_complete_ns(struct libusb_device* dev, uint64_t ready) {
+    ready += (uint64_t)sim_cfg.latency_us * 1000ull;
+    if (sim_cfg.jitter_us > 0) {
+        ready += sim_random() % ((uint64_t)sim_cfg.jitter_us * 1000ull + 1);
+    }
+    if (ready < dev->last_ready_ns) {
+        ready = dev->last_ready_ns;
+    }
+    dev->last_ready_ns = ready;
+    return ready;
+}
+
+// 按 error_rate 注入传输错误，调用时持有 sim_lock
+static int sim_inject_error(void) {
+    if (sim_cfg.error_rate <= 0) return 0;
+    return (double)(sim_random() >> 11) * (1.0 / 9007199254740992.0) < sim_cfg.error_rate;
+}
+
+// 模拟控制传输的往返延迟
+static void sim_control_delay(void) {
+    if (sim_cfg.control_latency_us > 0) {
+        usb_sleep_until_ns(usb_time_ns() + (uint64_t)sim_cfg.control_latency_us * 1000ull);
+    }
+}
+
+static double sim_clock_rate(int index) {
+    double ppm = sim_cfg.clock_ppm * (index + 1) * (index % 2 ? -1 : 1);
+    return 1.0 + ppm * 1e-6;
+}
+
+// 第k帧开始产生时的设备时钟
+static uint64_t sim_frame_timestamp(struct libusb_device* dev, uint64_t k) {
+    double ns_per_byte = sim_cfg.bytes_per_sec > 0 ? 1e9 / sim_cfg.bytes_per_sec : 1.0;
+    double start = (double)(k * (USB_FRAME_HEADER_SIZE + (uint64_t)sim_cfg.frame_payload)) - (double)dev->clock_base_offset;
+    double t = (double)(dev->clock_base_ns - sim_epoch_ns) + start * ns_per_byte;
+    return (uint64_t)(dev->index + 1) * 1000000000ull + (uint64_t)(t * sim_clock_rate(dev->index));
+}
+
+// 带时间戳的负载: 前8字节是时间戳，之后与不带时间戳时相同 ((k + i) 的低8位)
+static uint32_t sim_timestamp_crc(uint64_t k, const unsigned char* ts) {
+    static unsigned char pattern[512];
+    if (pattern[1] == 0) {
+        for (int i = 0; i < 512; i++) pattern[i] = (uint8_t)i;
+    }
+    uint32_t crc = usb_crc32c(0, ts, USB_FRAME_TIMESTAMP_SIZE);
+    for (int done = USB_FRAME_TIMESTAMP_SIZE; done < sim_cfg.frame_payload; done += 256) {
+        int n = sim_cfg.frame_payload - done < 256 ? sim_cfg.frame_payload - done : 256;
+        crc = usb_crc32c(crc, pattern + ((k + (uint64_t)done) & 0xFF), (size_t)n);
+    }
+    return crc;
+}
+
+static void sim_encode_timestamp(uint64_t ts, unsigned char* out) {
+    for (int i = 0; i < USB_FRAME_TIMESTAMP_SIZE; i++) {
+        out[i] = (unsigned char)(ts >> (8 * i));
+    }
+}
+
+static void sim_fill(struct libusb_device* dev, unsigned char* data, int length, uint64_t offset) {
+    if (sim_cfg.frame_payload <= 0) {
+        uint8_t base = (uint8_t)offset;
+        for (int i = 0; i < length; i++) {
+            data[i] = (uint8_t)(base + i);
+        }
+        return;
+    }
+
+    uint64_t frame_size = USB_FRAME_HEADER_SIZE + (uint64_t)sim_cfg.frame_payload;
+    while (length > 0) {
+        uint64_t k = offset / frame_size;
+        int pos = (int)(offset % frame_size);
+        int n;
+        unsigned char ts[USB_FRAME_TIMESTAMP_SIZE];
+        if (sim_cfg.timestamps && pos < USB_FRAME_HEADER_SIZE + USB_FRAME_TIMESTAMP_SIZE) {
+            sim_encode_timestamp(sim_frame_timestamp(dev, k), ts);
+        }
+        if (pos < USB_FRAME_HEADER_SIZE) {
+            unsigned char raw[USB_FRAME_HEADER_SIZE];
+            usb_frame_header_t header = {USB_FRAME_SYNC, 1, 0, (uint32_t)k, (uint32_t)sim_cfg.frame_payload, sim_frame_crc[k & 0xFF]};
+            if (sim_cfg.timestamps) {
+                header.flags = USB_FRAME_FLAG_TIMESTAMP;
+                header.crc = sim_timestamp_crc(k, ts);
+            }
+            usb_frame_encode_header(&header, raw);
+            n = USB_FRAME_HEADER_SIZE - pos;
+            if (n > length) n = length;
+            memcpy(data, raw + pos, (size_t)n);
+        } else {
+            uint8_t base = (uint8_t)(k + (uint64_t)(pos - USB_FRAME_HEADER_SIZE));
+            n = (int)(frame_size - (uint64_t)pos);
+            if (n > length) n = length;
+            for (int i = 0; i < n; i++) {
+                data[i] = (uint8_t)(base + i);
+            }
+            for (int i = pos - USB_FRAME_HEADER_SIZE; sim_cfg.timestamps && i < USB_FRAME_TIMESTAMP_SIZE && i < pos - USB_FRAME_HEADER_SIZE + n; i++) {
+                data[i - (pos - USB_FRAME_HEADER_SIZE)] = ts[i];
+            }
+        }
+        data += n;
+        length -= n;
+        offset += (uint64_t)n;
+    }
+}
+
+
+static void sim_insert(sim_transfer_t* st) {
+    sim_transfer_t** pp = &sim_pending;
+    while (*pp && (*pp)->ready_ns <= st->ready_ns) {
+        pp = &(*pp)->next;
+    }
+    st->next = *pp;
+    *pp = st;
+}
+
+// 把定时器设到最早的挂起传输或待分发事件，调用时持有 sim_lock
+static void sim_rearm(void) {
+    if (!sim_pollable) return;
+    uint64_t next = 0;
+    if (sim_num_events > 0) {
+        next = 1;
+    } else if (sim_pending && sim_pending->ready_ns != UINT64_MAX) {
+        next = sim_pending->ready_ns ? sim_pending->ready_ns : 1;
+    }
+    if (next != sim_armed_ns) {
+        usb_timer_fd_arm(&sim_timer, next);
+        sim_armed_ns = next;
+    }
+}
+
+// 睡眠ms毫秒，停止时提前返回0
+static int sim_fault_sleep(int ms) {
+    uint64_t end = usb_time_ns() + (uint64_t)ms * 1000000ull;
+    while (atomic_load(&sim_fault_running)) {
+        uint64_t now = usb_time_ns();
+        if (now >= end) return 1;
+        usb_sleep_until_ns(end - now > 10000000ull ? now + 10000000ull : end);
+    }
+    return 0;
+}
+
+// 故障注入: 轮流让设备掉电 dropout_ms
+static void* sim_fault_loop(void* arg) {
+    (void)arg;
+    for (int next = 0; sim_fault_sleep(sim_cfg.dropout_interval_ms); next = (next + 1) % sim_cfg.num_devices) {
+        if (usb_sim_unplug(next) == LIBUSB_SUCCESS) {
+            sim_fault_sleep(sim_cfg.dropout_ms);
+            usb_sim_plug(next);
+        }
+    }
+    return NULL;
+}
+
+static int sim_init(libusb_context** ctx) {
+    usb_mutex_init(&sim_lock);
+    usb_mutex_init(&sim_event_lock);
+    usb_cond_init(&sim_cond);
+    sim_pending = NULL;
+    sim_num_events = 0;
+    sim_pollable = 0;
+    memset(sim_hotplug, 0, sizeof(sim_hotplug));
+    *ctx = (libusb_context*)&sim_context;
+
+    atomic_store(&sim_fault_running, sim_cfg.dropout_interval_ms > 0);
+    if (sim_cfg.dropout_interval_ms > 0 && usb_thread_create(&sim_fault_thread, sim_fault_loop, NULL) != 0) {
+        USB_TRACE_STR(THREAD_FAILED, "fault injection");
+        atomic_store(&sim_fault_running, 0);
+    }
+    return LIBUSB_SUCCESS;
+}
+
+static void sim_exit(libusb_context* ctx) {
+    (void)ctx;
+    if (atomic_exchange(&sim_fault_running, 0)) {
+        usb_thread_join(sim_fault_thread);
+    }
+    if (sim_pollable) {
+        usb_timer_fd_close(&sim_timer);
+        sim_pollable = 0;
+    }
+    usb_cond_destroy(&sim_cond);
+    usb_mutex_destroy(&sim_event_lock);
+    usb_mutex_destroy(&sim_lock);
+}
+
+static ssize_t sim_get_device_list(libusb_context* ctx, libusb_device*** list) {
+    (void)ctx;
+    int n = 0;
+    libusb_device** devs = (libusb_device**)calloc((size_t)sim_cfg.num_devices + 1, sizeof(libusb_device*));
+    if (!devs) return LIBUSB_ERROR_NO_MEM;
+    usb_mutex_lock(&sim_lock);
+    for (int i = 0; i < sim_cfg.num_devices; i++) {
+        if (sim_devices[i].present) {
+            devs[n++] = &sim_devices[i];
+        }
+    }
+    usb_mutex_unlock(&sim_lock);
+    *list = devs;
+    return n;
+}
+
+static void sim_free_device_list(libusb_device** list, int unref_devices) {
+    (void)unref_devices;
+    free(list);
+}
+
+static int sim_get_device_descriptor(libusb_device* dev, struct libusb_device_descriptor* desc) {
+    *desc = dev->desc;
+    return LIBUSB_SUCCESS;
+}
+
+static uint8_t sim_get_bus_number(libusb_device* dev) {
+    (void)dev;
+    return 1;
+}
+
+static int sim_get_port_numbers(libusb_device* dev, uint8_t* port_numbers, int length) {
+    if (length < 1) return LIBUSB_ERROR_OVERFLOW;
+    port_numbers[0] = (uint8_t)(dev->index + 1);
+    return 1;
+}
+
+static libusb_device* sim_ref_device(libusb_device* dev) {
+    return dev;  // 模拟设备是静态的，不需要引用计数
+}
+
+static void sim_unref_device(libusb_device* dev) {
+    (void)dev;
+}
+
+static libusb_device* sim_get_device(libusb_device_handle* handle) {
+    return handle->dev;
+}
+
+static int sim_get_max_packet_size(libusb_device* dev, unsigned char endpoint) {
+    (void)dev;
+    return (endpoint & 0x7F) == 1 ? sim_cfg.packet_size : LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int sim_open(libusb_device* dev, libusb_device_handle** handle) {
+    sim_control_delay();
+    if (!dev->present) return LIBUSB_ERROR_NO_DEVICE;
+    libusb_device_handle* h = (libusb_device_handle*)calloc(1, sizeof(libusb_device_handle));
+    if (!h) return LIBUSB_ERROR_NO_MEM;
+    h->dev = dev;
+    *handle = h;
+    return LIBUSB_SUCCESS;
+}
+
+static void sim_close(libusb_device_handle* handle) {
+    free(handle);
+}
+
+static int sim_set_configuration(libusb_device_handle* handle, int configuration) {
+    sim_control_delay();
+    if (!handle->dev->present) return LIBUSB_ERROR_NO_DEVICE;
+    return configuration == 1 ? LIBUSB_SUCCESS : LIBUSB_ERROR_NOT_FOUND;
+}
+
+static int sim_claim_interface(libusb_device_handle* handle, int interface_number) {
+    if (interface_number != 0) return LIBUSB_ERROR_NOT_FOUND;
+    usb_mutex_lock(&sim_lock);
+    int r = handle->dev->claimed ? LIBUSB_ERROR_BUSY : LIBUSB_SUCCESS;
+    handle->dev->claimed = 1;
+    usb_mutex_unlock(&sim_lock);
+    return r;
+}
+
+static int sim_release_interface(libusb_device_handle* handle, int interface_number) {
+    (void)interface_number;
+    usb_mutex_lock(&sim_lock);
+    handle->dev->claimed = 0;
+    usb_mutex_unlock(&sim_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int sim_get_string_descriptor_ascii(libusb_device_handle* handle, uint8_t desc_index, unsigned char* data, int length) {
+    const char* s;
+    sim_control_delay();
+    if (!handle->dev->present) return LIBUSB_ERROR_NO_DEVICE;
+    switch (desc_index) {
+        case 1: s = sim_manufacturer; break;
+        case 2: s = sim_product; break;
+        case 3: s = handle->dev->serial; break;
+        default: return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    int n = (int)strlen(s);
+    if (n >= length) n = length - 1;
+    memcpy(data, s, (size_t)n);
+    data[n] = 0;
+    return n;
+}
+
+static int sim_bulk_transfer(libusb_device_handle* handle, unsigned char endpoint, unsigned char* data, int length, int* transferred, unsigned int timeout) {
+    struct libusb_device* dev = handle->dev;
+    uint64_t now = usb_time_ns();
+    *transferred = 0;
+
+    if (!dev->present) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    if (endpoint == 0x01) {
+        // 命令端点: 单字节 0x01 开始产生数据, 0x00 停止，更长的命令接收后忽略
+        usb_mutex_lock(&sim_lock);
+        if (length == 1) {
+            dev->streaming = data[0] == 0x01;
+            dev->consumed_ns = now;
+            dev->clock_base_ns = now;
+            dev->clock_base_offset = dev->byte_offset;
+        }
+        usb_mutex_unlock(&sim_lock);
+        if (sim_cfg.latency_us > 0) {
+            usb_sleep_until_ns(now + (uint64_t)sim_cfg.latency_us * 1000ull);
+        }
+        *transferred = length;
+        return LIBUSB_SUCCESS;
+    }
+    if (endpoint != 0x81) {
+        return LIBUSB_ERROR_PIPE;
+    }
+
+    // 设备按整包发送，缓冲区放不下一包时溢出
+    if (length < sim_cfg.packet_size) {
+        return LIBUSB_ERROR_OVERFLOW;
+    }
+
+    uint64_t offset = 0, ready = UINT64_MAX;
+    uint64_t timeout_ns = timeout ? (uint64_t)timeout * 1000000ull : UINT64_MAX;
+    int error = 0;
+    usb_mutex_lock(&sim_lock);
+    if (dev->streaming) {
+        uint64_t saved_ns = dev->consumed_ns, saved_offset = dev->byte_offset;
+        ready = sim_produce(dev, &length, now, &offset);
+        if (ready > now && ready - now > timeout_ns) {
+            dev->consumed_ns = saved_ns;
+            dev->byte_offset = saved_offset;
+        } else {
+            ready = sim_complete_ns(dev, ready);
+            error = sim_inject_error();
+        }
+    }
+    usb_mutex_unlock(&sim_lock);
+
+    if (ready > now && ready - now > timeout_ns) {
+        usb_sleep_until_ns(now + timeout_ns);
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+    usb_sleep_until_ns(ready);
+    if (error) {
+        return LIBUSB_ERROR_IO;
+    }
+    sim_fill(dev, data, length, offset);
+    *transferred = length;
+    return LIBUSB_SUCCESS;
+}
+
+static struct libusb_transfer* sim_alloc_transfer(int iso_packets) {
+    size_t size = sizeof(sim_transfer_t) + sizeof(struct libusb_transfer) +
+                  (size_t)iso_packets * sizeof(struct libusb_iso_packet_descriptor);
+    sim_transfer_t* st = (sim_transfer_t*)calloc(1, size);
+    if (!st) return NULL;
+    SIM_LIBUSB(st)->num_iso_packets = iso_packets;
+    return SIM_LIBUSB(st);
+}
+
+static void sim_free_transfer(struct libusb_transfer* transfer) {
+    if (transfer) {
+        free(SIM_TRANSFER(transfer));
+    }
+}
+
+static int sim_submit_transfer(struct libusb_transfer* transfer) {
+    sim_transfer_t* st = SIM_TRANSFER(transfer);
+    struct libusb_device* dev = transfer->dev_handle->dev;
+    uint64_t now = usb_time_ns();
+    uint64_t timeout_ns = transfer->timeout ? (uint64_t)transfer->timeout * 1000000ull : UINT64_MAX;
+
+    usb_mutex_lock(&sim_lock);
+    if (!dev->present) {
+        usb_mutex_unlock(&sim_lock);
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    st->status = LIBUSB_TRANSFER_COMPLETED;
+    st->actual_length = transfer->length;
+    if (transfer->endpoint == 0x01) {
+        if (transfer->length == 1) {
+            dev->streaming = transfer->buffer[0] == 0x01;
+            dev->consumed_ns = now;
+            dev->clock_base_ns = now;
+            dev->clock_base_offset = dev->byte_offset;
+        }
+        // 写入和读取互不等待，只和之前的写入保持顺序
+        st->ready_ns = now + (uint64_t)sim_cfg.latency_us * 1000ull;
+        if (sim_cfg.jitter_us > 0) {
+            st->ready_ns += sim_random() % ((uint64_t)sim_cfg.jitter_us * 1000ull + 1);
+        }
+        if (st->ready_ns < dev->last_write_ns) {
+            st->ready_ns = dev->last_write_ns;
+        }
+        if (st->ready_ns - now > timeout_ns) {
+            st->ready_ns = now + timeout_ns;
+            st->status = LIBUSB_TRANSFER_TIMED_OUT;
+            st->actual_length = 0;
+        } else {
+            dev->last_write_ns = st->ready_ns;
+        }
+    } else if (transfer->length < sim_cfg.packet_size) {
+        // 设备按整包发送，缓冲区放不下一包时溢出
+        st->ready_ns = now;
+        st->status = LIBUSB_TRANSFER_OVERFLOW;
+        st->actual_length = 0;
+    } else if (dev->streaming) {
+        uint64_t offset;
+        uint64_t saved_ns = dev->consumed_ns, saved_offset = dev->byte_offset;
+        st->actual_length = transfer->length;
+        st->ready_ns = sim_produce(dev, &st->actual_length, now, &offset);
+        st->byte_offset = offset;
+        if (st->ready_ns > now && st->ready_ns - now > timeout_ns) {
+            // 超时前数据不够，不消耗设备数据
+            dev->consumed_ns = saved_ns;
+            dev->byte_offset = saved_offset;
+            st->ready_ns = now + timeout_ns;
+            st->status = LIBUSB_TRANSFER_TIMED_OUT;
+            st->actual_length = 0;
+        } else {
+            st->ready_ns = sim_complete_ns(dev, st->ready_ns);
+            if (sim_inject_error()) {
+                st->status = LIBUSB_TRANSFER_ERROR;
+                st->actual_length = 0;
+            }
+        }
+    } else {
+        st->ready_ns = timeout_ns == UINT64_MAX ? UINT64_MAX : now + timeout_ns;
+        st->status = LIBUSB_TRANSFER_TIMED_OUT;
+        st->actual_length = 0;
+    }
+    sim_insert(st);
+    sim_rearm();
+    usb_cond_broadcast(&sim_cond);
+    usb_mutex_unlock(&sim_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int sim_cancel_transfer(struct libusb_transfer* transfer) {
+    sim_transfer_t* st = SIM_TRANSFER(transfer);
+    int r = LIBUSB_ERROR_NOT_FOUND;
+
+    usb_mutex_lock(&sim_lock);
+    for (sim_transfer_t** pp = &sim_pending; *pp; pp = &(*pp)->next) {
+        if (*pp == st) {
+            *pp = st->next;
+            st->status = LIBUSB_TRANSFER_CANCELLED;
+            st->actual_length = 0;
+            st->ready_ns = 0;
+            sim_insert(st);
+            sim_rearm();
+            usb_cond_broadcast(&sim_cond);
+            r = LIBUSB_SUCCESS;
+            break;
+        }
+    }
+    usb_mutex_unlock(&sim_lock);
+    return r;
+}
+
+static int sim_handle_events_timeout_completed(libusb_context* ctx, struct timeval* tv, int* completed) {
+    (void)ctx;
+    uint64_t now = usb_time_ns();
+    uint64_t deadline = now + (uint64_t)tv->tv_sec * 1000000000ull + (uint64_t)tv->tv_usec * 1000ull;
+    sim_transfer_t* done = NULL;
+    sim_transfer_t** tail = &done;
+    sim_event_t events[SIM_MAX_EVENTS];
+    int num_events;
+
+    // 回调在持有事件锁时执行，同一个流的回调不会并发。
+    // 其他线程正在处理事件且不等待时直接返回。
+    if (deadline == now) {
+        if (!usb_mutex_trylock(&sim_event_lock)) return LIBUSB_SUCCESS;
+    } else {
+        usb_mutex_lock(&sim_event_lock);
+    }
+    usb_mutex_lock(&sim_lock);
+    if (sim_pollable) {
+        usb_timer_fd_clear(&sim_timer);
+        sim_armed_ns = 0;
+    }
+    for (;;) {
+        if (completed && *completed) break;
+        now = usb_time_ns();
+        while (sim_pending && sim_pending->ready_ns <= now) {
+            sim_transfer_t* st = sim_pending;
+            sim_pending = st->next;
+            st->next = NULL;
+            *tail = st;
+            tail = &st->next;
+        }
+        if (done || sim_num_events > 0 || now >= deadline) break;
+        uint64_t wake = deadline;
+        if (sim_pending && sim_pending->ready_ns < wake) {
+            wake = sim_pending->ready_ns;
+        }
+        usb_cond_wait_until(&sim_cond, &sim_lock, wake);
+    }
+    num_events = sim_num_events;
+    memcpy(events, sim_events, sizeof(sim_event_t) * (size_t)num_events);
+    sim_num_events = 0;
+    sim_rearm();
+    usb_mutex_unlock(&sim_lock);
+
+    for (int i = 0; i < num_events; i++) {
+        for (int j = 0; j < SIM_MAX_HOTPLUG; j++) {
+            if (sim_hotplug[j].cb && (sim_hotplug[j].events & events[i].event)) {
+                sim_hotplug[j].cb(ctx, events[i].dev, events[i].event, sim_hotplug[j].user_data);
+            }
+        }
+    }
+
+    while (done) {
+        sim_transfer_t* st = done;
+        struct libusb_transfer* transfer = SIM_LIBUSB(st);
+        done = st->next;
+        transfer->status = st->status;
+        transfer->actual_length = st->actual_length;
+        if (st->status == LIBUSB_TRANSFER_COMPLETED && transfer->endpoint == 0x81) {
+            sim_fill(transfer->dev_handle->dev, transfer->buffer, st->actual_length, st->byte_offset);
+        }
+        transfer->callback(transfer);
+    }
+    usb_mutex_unlock(&sim_event_lock);
+    return LIBUSB_SUCCESS;
+}
+
+static int sim_hotplug_register_callback(libusb_context* ctx, int events, int flags, int vendor_id, int product_id,
+                                         int dev_class, libusb_hotplug_callback_fn cb_fn, void* user_data,
+                                         libusb_hotplug_callback_handle* callback_handle) {
+    (void)dev_class;
+    int slot = -1;
+    for (int i = 0; i < SIM_MAX_HOTPLUG; i++) {
+        if (!sim_hotplug[i].cb) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) return LIBUSB_ERROR_NO_MEM;
+    if ((vendor_id != LIBUSB_HOTPLUG_MATCH_ANY && vendor_id != VENDOR_ID) ||
+        (product_id != LIBUSB_HOTPLUG_MATCH_ANY && product_id != PRODUCT_ID)) {
+        events = 0;  // 模拟设备只有一种VID/PID
+    }
+
+    sim_hotplug[slot].events = events;
+    sim_hotplug[slot].user_data = user_data;
+    sim_hotplug[slot].cb = cb_fn;
+    if (callback_handle) *callback_handle = slot + 1;
+
+    if ((flags & LIBUSB_HOTPLUG_ENUMERATE) && (events & LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)) {
+        for (int i = 0; i < sim_cfg.num_devices; i++) {
+            if (sim_devices[i].present) {
+                cb_fn(ctx, &sim_devices[i], LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED, user_data);
+            }
+        }
+    }
+    return LIBUSB_SUCCESS;
+}
+
+static void sim_hotplug_deregister_callback(libusb_context* ctx, libusb_hotplug_callback_handle callback_handle) {
+    (void)ctx;
+    if (callback_handle >= 1 && callback_handle <= SIM_MAX_HOTPLUG) {
+        memset(&sim_hotplug[callback_handle - 1], 0, sizeof(sim_hotplug_t));
+    }
+}
+
+static const struct libusb_pollfd** sim_get_pollfds(libusb_context* ctx) {
+    (void)ctx;
+    const struct libusb_pollfd** list = (const struct libusb_pollfd**)calloc(2, sizeof(struct libusb_pollfd*));
+    if (!list) return NULL;
+    usb_mutex_lock(&sim_lock);
+    if (!sim_pollable) {
+        if (usb_timer_fd_create(&sim_timer) != 0) {
+            usb_mutex_unlock(&sim_lock);
+            free(list);
+            return NULL;
+        }
+        sim_pollfd.fd = sim_timer.fd;
+        sim_pollfd.events = POLLIN;
+        sim_pollable = 1;
+        sim_armed_ns = 0;
+        sim_rearm();
+    }
+    list[0] = &sim_pollfd;
+    usb_mutex_unlock(&sim_lock);
+    return list;
+}
+
+static void sim_free_pollfds(const struct libusb_pollfd** list) {
+    free((void*)list);
+}
+
+// 距离最早的挂起传输完成还有多久，没有有限的完成时间时返回0
+static int sim_get_next_timeout(libusb_context* ctx, struct timeval* tv) {
+    (void)ctx;
+    uint64_t next = UINT64_MAX;
+    usb_mutex_lock(&sim_lock);
+    if (sim_num_events > 0) {
+        next = 0;
+    } else if (sim_pending) {
+        next = sim_pending->ready_ns;
+    }
+    usb_mutex_unlock(&sim_lock);
+    if (next == UINT64_MAX) {
+        return 0;
+    }
+    uint64_t now = usb_time_ns();
+    uint64_t wait = next > now ? next - now : 0;
+    tv->tv_sec = (long)(wait / 1000000000ull);
+    tv->tv_usec = (long)(wait % 1000000000ull / 1000ull);
+    return 1;
+}
+
+// 调用时持有 sim_lock
+static void sim_queue_event(struct libusb_device* dev, libusb_hotplug_event event) {
+    if (sim_num_events < SIM_MAX_EVENTS) {
+        sim_events[sim_num_events].dev = dev;
+        sim_events[sim_num_events].event = event;
+        sim_num_events++;
+    }
+    sim_rearm();
+    usb_cond_broadcast(&sim_cond);
+}
+
+/* 模拟拔出设备: 挂起的传输以NO_DEVICE完成 */
+int usb_sim_unplug(int index) {
+    if (index < 0 || index >= sim_cfg.num_devices) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    struct libusb_device* dev = &sim_devices[index];
+    usb_mutex_lock(&sim_lock);
+    if (!dev->present) {
+        usb_mutex_unlock(&sim_lock);
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    dev->present = 0;
+    dev->streaming = 0;
+    dev->claimed = 0;
+
+    // 把该设备的传输从挂起队列中取出，其余保持原有顺序
+    sim_transfer_t* gone = NULL;
+    sim_transfer_t** pp = &sim_pending;
+    while (*pp) {
+        sim_transfer_t* st = *pp;
+        if (SIM_LIBUSB(st)->dev_handle->dev == dev) {
+            *pp = st->next;
+            st->next = gone;
+            gone = st;
+        } else {
+            pp = &st->next;
+        }
+    }
+    uint64_t now = usb_time_ns();
+    while (gone) {
+        sim_transfer_t* st = gone;
+        gone = st->next;
+        st->status = LIBUSB_TRANSFER_NO_DEVICE;
+        st->actual_length = 0;
+        st->ready_ns = now;
+        sim_insert(st);
+    }
+    sim_queue_event(dev, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT);
+    usb_mutex_unlock(&sim_lock);
+    return LIBUSB_SUCCESS;
+}
+
+/* 模拟插入设备 */
+int usb_sim_plug(int index) {
+    if (index < 0 || index >= sim_cfg.num_devices) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+
+    struct libusb_device* dev = &sim_devices[index];
+    usb_mutex_lock(&sim_lock);
+    if (dev->present) {
+        usb_mutex_unlock(&sim_lock);
+        return LIBUSB_ERROR_BUSY;
+    }
+    dev->present = 1;
+    dev->byte_offset = 0;
+    dev->last_ready_ns = 0;
+    dev->last_write_ns = 0;
+    sim_queue_event(dev, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+    usb_mutex_unlock(&sim_lock);
+    return LIBUSB_SUCCESS;
+}
+
+/* 模拟设备时钟到主机时间 */
+int usb_sim_device_to_host(int index, uint64_t device_ts, uint64_t* host_ns) {
+    if (index < 0 || index >= sim_cfg.num_devices) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    double t = (double)(int64_t)(device_ts - (uint64_t)(index + 1) * 1000000000ull) / sim_clock_rate(index);
+    *host_ns = sim_epoch_ns + (uint64_t)(int64_t)t;
+    return 0;
+}
+
+const usb_transport_t usb_transport_sim = {
+    "sim",
+    sim_init,
+    sim_exit,
+    sim_get_device_list,
+    sim_free_device_list,
+    sim_get_device_descriptor,
+    sim_get_bus_number,
+    sim_get_port_numbers,
+    sim_ref_device,
+    sim_unref_device,
+    sim_get_device,
+    sim_get_max_packet_size,
+    sim_open,
+    sim_close,
+    sim_set_configuration,
+    sim_claim_interface,
+    sim_release_interface,
+    sim_get_string_descriptor_ascii,
+    sim_bulk_transfer,
+    sim_alloc_transfer,
+    sim_free_transfer,
+    sim_submit_transfer,
+    sim_cancel_transfer,
+    sim_handle_events_timeout_completed,
+    sim_hotplug_register_callback,
+    sim_hotplug_deregister_callback,
+    sim_get_pollfds,
+    sim_free_pollfds,
+    sim_get_next_timeout,
+};
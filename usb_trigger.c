@@ -0,0 +1,322 @@
+#include <stdatomic.h>
+#include "usb_trigger.h"
+
+// 预触发环中的记录: [记录头][数据]，按8字节对齐，记录不跨越环的末尾
+typedef struct {
+    uint64_t time_ns;
+    uint32_t length;
+    uint32_t reserved;
+} trigger_slot_t;
+
+struct usb_trigger {
+    usb_trigger_config_t cfg;
+    unsigned char pattern[USB_TRIGGER_MAX_PATTERN];
+    usb_capture_sink_t* sink;
+    uint64_t pre_ns;
+    uint64_t post_ns;
+
+    // 预触发环: [head, tail) 为有效记录；wrapped时为 [head, limit) + [0, tail)
+    unsigned char* ring;
+    size_t size;
+    size_t head;
+    size_t tail;
+    size_t limit;
+    int wrapped;
+    uint64_t count;
+    uint64_t overwritten_ns;       // 因为环满被覆盖的最新记录的时间
+
+    // 窗口内的数据直接写入采集文件
+    int active;
+    uint64_t window_end;
+
+    // 上一条记录末尾的 pattern_length-1 个字节，跨记录的匹配
+    unsigned char carry[USB_TRIGGER_MAX_PATTERN];
+    int carry_length;
+
+    atomic_uint_least64_t fired;   // usb_trigger_fire 的时间，0表示没有
+
+    usb_trigger_stats_t stats;
+};
+
+static size_t slot_size(int length) {
+    return (sizeof(trigger_slot_t) + (size_t)length + 7) & ~(size_t)7;
+}
+
+usb_trigger_t* usb_trigger_create(const usb_trigger_config_t* cfg, usb_capture_sink_t* sink) {
+    if (!cfg || !sink || cfg->mode < USB_TRIGGER_THRESHOLD || cfg->mode > USB_TRIGGER_EXTERNAL ||
+        (cfg->mode == USB_TRIGGER_THRESHOLD && cfg->threshold <= 0) ||
+        (cfg->mode == USB_TRIGGER_PATTERN &&
+         (!cfg->pattern || cfg->pattern_length <= 0 || cfg->pattern_length > USB_TRIGGER_MAX_PATTERN))) {
+        return NULL;
+    }
+
+    usb_trigger_t* trig = (usb_trigger_t*)calloc(1, sizeof(usb_trigger_t));
+    if (!trig) return NULL;
+    trig->cfg = *cfg;
+    if (cfg->mode == USB_TRIGGER_PATTERN) {
+        memcpy(trig->pattern, cfg->pattern, (size_t)cfg->pattern_length);
+    }
+    trig->cfg.pattern = trig->pattern;
+    if (trig->cfg.pre_ms == 0) trig->cfg.pre_ms = USB_TRIGGER_DEFAULT_PRE;
+    if (trig->cfg.post_ms == 0) trig->cfg.post_ms = USB_TRIGGER_DEFAULT_POST;
+    if (trig->cfg.ring_size == 0) trig->cfg.ring_size = USB_TRIGGER_DEFAULT_RING;
+    trig->pre_ns = (uint64_t)trig->cfg.pre_ms * 1000000ull;
+    trig->post_ns = (uint64_t)trig->cfg.post_ms * 1000000ull;
+    trig->sink = sink;
+
+    trig->size = trig->cfg.ring_size & ~(size_t)7;
+    trig->ring = (unsigned char*)usb_aligned_alloc(64, trig->size);
+    if (!trig->ring) {
+        free(trig);
+        return NULL;
+    }
+    atomic_init(&trig->fired, 0);
+    return trig;
+}
+
+void usb_trigger_destroy(usb_trigger_t* trig) {
+    if (trig) {
+        usb_aligned_free(trig->ring);
+        free(trig);
+    }
+}
+
+// ---- 预触发环 ----
+
+static trigger_slot_t* ring_oldest(usb_trigger_t* trig) {
+    return (trigger_slot_t*)(trig->ring + trig->head);
+}
+
+static void ring_evict(usb_trigger_t* trig) {
+    trig->head += slot_size((int)ring_oldest(trig)->length);
+    trig->count--;
+    if (trig->wrapped && trig->head == trig->limit) {
+        trig->head = 0;
+        trig->wrapped = 0;
+    }
+    if (trig->count == 0) {
+        trig->head = trig->tail = 0;
+        trig->wrapped = 0;
+    }
+}
+
+static void ring_push(usb_trigger_t* trig, uint64_t time_ns, const unsigned char* data, int length) {
+    size_t need = slot_size(length);
+    if (need > trig->size) {
+        trig->overwritten_ns = time_ns;
+        return;
+    }
+
+    // 超出预触发窗口的记录不再需要
+    while (trig->count > 0 && ring_oldest(trig)->time_ns + trig->pre_ns < time_ns) {
+        ring_evict(trig);
+    }
+    for (;;) {
+        if (!trig->wrapped) {
+            if (trig->size - trig->tail >= need) break;
+            if (trig->head >= need) {
+                // 末尾放不下，从头开始
+                trig->limit = trig->tail;
+                trig->tail = 0;
+                trig->wrapped = 1;
+                break;
+            }
+        } else if (trig->head - trig->tail >= need) {
+            break;
+        }
+        // 环满: 覆盖窗口内最早的记录
+        trig->overwritten_ns = ring_oldest(trig)->time_ns;
+        ring_evict(trig);
+    }
+
+    trigger_slot_t* slot = (trigger_slot_t*)(trig->ring + trig->tail);
+    slot->time_ns = time_ns;
+    slot->length = (uint32_t)length;
+    slot->reserved = 0;
+    memcpy(slot + 1, data, (size_t)length);
+    trig->tail += need;
+    trig->count++;
+}
+
+// ---- 触发 ----
+
+static void trigger_save(usb_trigger_t* trig, uint64_t time_ns, const unsigned char* data, int length) {
+    if (usb_capture_write_at(trig->sink, time_ns, data, length) < 0) {
+        trig->stats.write_errors++;
+        return;
+    }
+    trig->stats.saved_records++;
+    trig->stats.saved_bytes += (uint64_t)length;
+}
+
+// trigger_ns时的数据满足了条件，detect_ns为检出的时间
+static void trigger_start(usb_trigger_t* trig, uint64_t trigger_ns, uint64_t detect_ns) {
+    uint64_t delay = detect_ns > trigger_ns ? detect_ns - trigger_ns : 0;
+    trig->stats.detect_sum_ns += delay;
+    if (delay > trig->stats.detect_max_ns) trig->stats.detect_max_ns = delay;
+
+    if (trig->active) {
+        if (trigger_ns + trig->post_ns > trig->window_end) {
+            trig->window_end = trigger_ns + trig->post_ns;
+        }
+        trig->stats.retriggers++;
+        return;
+    }
+
+    // 写出预触发窗口: TRIGGER记录，然后是环中 [trigger_ns - pre_ns, ...] 的记录
+    uint64_t start = trigger_ns > trig->pre_ns ? trigger_ns - trig->pre_ns : 0;
+    while (trig->count > 0 && ring_oldest(trig)->time_ns < start) {
+        ring_evict(trig);
+    }
+    if (trig->overwritten_ns && trig->overwritten_ns >= start) {
+        trig->stats.truncated++;
+    }
+    usb_capture_trigger_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.trigger_ns = trigger_ns;
+    rec.pre_ns = trig->pre_ns;
+    rec.post_ns = trig->post_ns;
+    rec.condition = (int32_t)trig->cfg.mode;
+    uint64_t first = trig->count > 0 && ring_oldest(trig)->time_ns < trigger_ns ? ring_oldest(trig)->time_ns
+                                                                                 : trigger_ns;
+    if (usb_capture_write_trigger(trig->sink, first, &rec) < 0) {
+        trig->stats.write_errors++;
+    }
+    while (trig->count > 0) {
+        trigger_slot_t* slot = ring_oldest(trig);
+        trigger_save(trig, slot->time_ns, (const unsigned char*)(slot + 1), (int)slot->length);
+        ring_evict(trig);
+    }
+
+    trig->active = 1;
+    trig->window_end = trigger_ns + trig->post_ns;
+    trig->stats.triggers++;
+    uint64_t flush = usb_time_ns() - detect_ns;
+    trig->stats.flush_sum_ns += flush;
+    if (flush > trig->stats.flush_max_ns) trig->stats.flush_max_ns = flush;
+}
+
+static void trigger_poll_fired(usb_trigger_t* trig) {
+    if (atomic_load_explicit(&trig->fired, memory_order_relaxed) != 0) {
+        uint64_t fired = atomic_exchange_explicit(&trig->fired, 0, memory_order_acquire);
+        if (fired) {
+            trigger_start(trig, fired, usb_time_ns());
+        }
+    }
+}
+
+// ---- 条件 ----
+
+// data中是否有pattern (memchr找首字节，再比较)
+static int pattern_find(const unsigned char* pattern, int plen, const unsigned char* data, int length) {
+    if (length < plen) return 0;
+    const unsigned char* p = data;
+    const unsigned char* last = data + length - plen;
+    while (p <= last) {
+        p = (const unsigned char*)memchr(p, pattern[0], (size_t)(last - p) + 1);
+        if (!p) return 0;
+        if (memcmp(p + 1, pattern + 1, (size_t)plen - 1) == 0) return 1;
+        p++;
+    }
+    return 0;
+}
+
+static int pattern_scan(usb_trigger_t* trig, const unsigned char* data, int length) {
+    int plen = trig->cfg.pattern_length;
+    int hit = 0;
+
+    // 跨记录: 上一条记录的末尾 + 这条记录的开头
+    if (trig->carry_length > 0 && length > 0) {
+        unsigned char joint[2 * USB_TRIGGER_MAX_PATTERN];
+        int n = length < plen - 1 ? length : plen - 1;
+        memcpy(joint, trig->carry, (size_t)trig->carry_length);
+        memcpy(joint + trig->carry_length, data, (size_t)n);
+        hit = pattern_find(trig->pattern, plen, joint, trig->carry_length + n);
+        if (length < plen - 1) {
+            // 记录比pattern短: 保留拼接后的末尾
+            int keep = trig->carry_length + n < plen - 1 ? trig->carry_length + n : plen - 1;
+            memmove(trig->carry, joint + trig->carry_length + n - keep, (size_t)keep);
+            trig->carry_length = keep;
+            return hit;
+        }
+    }
+    if (!hit) {
+        hit = pattern_find(trig->pattern, plen, data, length);
+    }
+    if (length >= plen - 1) {
+        memcpy(trig->carry, data + length - (plen - 1), (size_t)plen - 1);
+        trig->carry_length = plen - 1;
+    } else if (trig->carry_length == 0) {
+        memcpy(trig->carry, data, (size_t)length);
+        trig->carry_length = length;
+    }
+    return hit;
+}
+
+// |样本| >= threshold: 先求最小值和最大值 (循环没有分支，编译器可以向量化)
+static int threshold_hit(const int32_t* samples, int count, int32_t threshold) {
+    int32_t lo = INT32_MAX;
+    int32_t hi = INT32_MIN;
+    for (int i = 0; i < count; i++) {
+        lo = samples[i] < lo ? samples[i] : lo;
+        hi = samples[i] > hi ? samples[i] : hi;
+    }
+    return count > 0 && (hi >= threshold || lo <= -threshold);
+}
+
+/* 写入一条记录 */
+int usb_trigger_write(usb_trigger_t* trig, uint64_t time_ns, const unsigned char* data, int length) {
+    if (length < 0) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    trigger_poll_fired(trig);
+    if (trig->active && time_ns > trig->window_end) {
+        trig->active = 0;
+    }
+
+    int hit = trig->cfg.mode == USB_TRIGGER_PATTERN && pattern_scan(trig, data, length);
+    trig->stats.records++;
+    trig->stats.bytes += (uint64_t)length;
+    if (trig->active) {
+        trigger_save(trig, time_ns, data, length);
+    } else {
+        ring_push(trig, time_ns, data, length);
+    }
+    if (hit) {
+        trigger_start(trig, time_ns, usb_time_ns());
+    }
+    return hit;
+}
+
+/* 检查样本 */
+int usb_trigger_check_samples(usb_trigger_t* trig, uint64_t time_ns, const int32_t* samples, int count) {
+    trigger_poll_fired(trig);
+    if (trig->cfg.mode != USB_TRIGGER_THRESHOLD || !threshold_hit(samples, count, trig->cfg.threshold)) {
+        return 0;
+    }
+    trigger_start(trig, time_ns, usb_time_ns());
+    return 1;
+}
+
+void usb_trigger_fire(usb_trigger_t* trig) {
+    uint64_t expected = 0;
+    // 还没生效的外部触发只保留第一次
+    atomic_compare_exchange_strong(&trig->fired, &expected, usb_time_ns());
+}
+
+void usb_trigger_stream_cb(const unsigned char* data, int length, void* user_data) {
+    usb_trigger_write((usb_trigger_t*)user_data, usb_time_ns(), data, length);
+}
+
+void usb_trigger_get_stats(usb_trigger_t* trig, usb_trigger_stats_t* stats) {
+    *stats = trig->stats;
+}
+
+const char* usb_trigger_mode_name(usb_trigger_mode_t mode) {
+    switch (mode) {
+        case USB_TRIGGER_THRESHOLD: return "threshold";
+        case USB_TRIGGER_PATTERN: return "pattern";
+        case USB_TRIGGER_EXTERNAL: return "external";
+        default: return "?";
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef USB_TRIGGER_H
+#define USB_TRIGGER_H
+
+#include "usb_control.h"
+#include "usb_capture.h"
+
+// 触发采集: 数据先进入内存中的预触发环，只保留最近 pre_ms 的数据；触发条件满足时，
+// 把预触发窗口和之后 post_ms 内的数据写入采集文件 (usb_capture.h)，其余的数据不落盘。
+// 每个窗口在文件中以一条TRIGGER记录开始，数据记录保留原来的时间。窗口内再次触发时窗口延长，不重复写入。
+//
+// 触发条件:
+//   THRESHOLD: 解码后的样本 (usb_decode.h) 的绝对值 >= threshold，样本由 usb_trigger_check_samples 送入
+//   PATTERN:   写入的数据中出现某个字节序列 (可以跨记录)
+//   EXTERNAL:  数据不触发，只由 usb_trigger_fire 触发 (外部命令，可以在任何线程调用)
+// 任何模式下 usb_trigger_fire 都有效。
+//
+// 写入和检查在同一个线程中进行 (通常是流的事件线程)，预触发环只有一个线程访问，不加锁。
+
+#define USB_TRIGGER_MAX_PATTERN   64
+#define USB_TRIGGER_DEFAULT_PRE   100
+#define USB_TRIGGER_DEFAULT_POST  100
+#define USB_TRIGGER_DEFAULT_RING  (4 * 1024 * 1024)
+
+typedef enum {
+    USB_TRIGGER_THRESHOLD = 0,
+    USB_TRIGGER_PATTERN = 1,
+    USB_TRIGGER_EXTERNAL = 2
+} usb_trigger_mode_t;
+
+typedef struct {
+    usb_trigger_mode_t mode;
+    int32_t threshold;            // THRESHOLD: |样本| >= threshold 时触发
+    const unsigned char* pattern; // PATTERN: 字节序列 (创建时复制)
+    int pattern_length;           // <= USB_TRIGGER_MAX_PATTERN
+    unsigned int pre_ms;          // 触发前保留的时长，默认100ms
+    unsigned int post_ms;         // 触发后写入的时长，默认100ms
+    size_t ring_size;             // 预触发环的字节数，默认4MB，不够放下pre_ms的数据时最早的记录被覆盖
+} usb_trigger_config_t;
+
+typedef struct {
+    uint64_t records;             // 写入的记录数
+    uint64_t bytes;               // 写入的字节数
+    uint64_t saved_records;       // 写入采集文件的记录数
+    uint64_t saved_bytes;         // 写入采集文件的字节数
+    uint64_t triggers;            // 开始的窗口数
+    uint64_t retriggers;          // 窗口内再次触发 (延长窗口) 的次数
+    uint64_t truncated;           // 预触发窗口不完整的窗口数 (环满，窗口内的记录被覆盖了，ring_size太小)
+    uint64_t write_errors;        // 写入采集文件失败的记录数
+    uint64_t detect_sum_ns;       // 触发延迟: 触发数据的时间 -> 检出
+    uint64_t detect_max_ns;
+    uint64_t flush_sum_ns;        // 检出 -> 预触发窗口写入采集文件完成
+    uint64_t flush_max_ns;
+} usb_trigger_stats_t;
+
+typedef struct usb_trigger usb_trigger_t;
+
+// sink为写入的采集设备 (usb_capture_add_device)。cfg中为0的字段使用默认值，参数无效或内存不足返回NULL
+usb_trigger_t* usb_trigger_create(const usb_trigger_config_t* cfg, usb_capture_sink_t* sink);
+// 调用时不能有线程正在写入；未结束的窗口到此为止
+void usb_trigger_destroy(usb_trigger_t* trig);
+
+// 写入一条记录 (time_ns为数据到达的时间)，PATTERN模式下同时检查。返回1表示这条记录触发了 (或延长了) 窗口
+int usb_trigger_write(usb_trigger_t* trig, uint64_t time_ns, const unsigned char* data, int length);
+// THRESHOLD模式: 检查time_ns时到达的样本，数据本身由 usb_trigger_write 写入 (先于检查)。返回1表示触发
+int usb_trigger_check_samples(usb_trigger_t* trig, uint64_t time_ns, const int32_t* samples, int count);
+// 外部触发，下一次写入或检查时生效 (触发时间为调用时)
+void usb_trigger_fire(usb_trigger_t* trig);
+// usb_stream_cb 适配，user_data为trigger，时间取回调时的 usb_time_ns
+void usb_trigger_stream_cb(const unsigned char* data, int length, void* user_data);
+
+// 在写入线程中或停止写入后调用
+void usb_trigger_get_stats(usb_trigger_t* trig, usb_trigger_stats_t* stats);
+const char* usb_trigger_mode_name(usb_trigger_mode_t mode);
+
+#endif // USB_TRIGGER_H